@@ -110,7 +110,8 @@ struct cell_black_holes {
   /*! Max smoothing length in this cell. */
   float h_max;
 
-  /*! Is the #bpart data of this cell being used in a sub-cell? */
+  /*! Is the #bpart data of this cell locked or used in a sub-cell? (lock
+   * bit and number of locked progeny, see cell_lock.c) */
   int hold;
 
   /*! Number of #bpart updated in this cell. */
@@ -255,6 +255,28 @@ void cell_drift_part(struct cell *c, const struct engine *e, int force,
       dt_therm = (ti_current - ti_old_part) * e->time_base;
     }
 
+#ifdef WITH_LIGHTCONE
+    /* Find the replications in which the particles of this cell may cross
+     * the lightcones during this drift */
+    struct lightcone_cell_crossings lightcone_crossings_data;
+    lightcone_cell_crossings_init(&lightcone_crossings_data, e,
+                                  replication_list, ti_old_part, ti_current,
+                                  c->loc);
+    if (lightcone_cell_crossings_active(&lightcone_crossings_data)) {
+      for (int k = 0; k < c->hydro.count; k++) {
+        const struct part *p = &parts[k];
+        if (part_is_inhibited(p, e)) continue;
+        lightcone_cell_crossings_add_to_bounds(&lightcone_crossings_data,
+                                               p->x, p->gpart);
+      }
+    }
+    lightcone_cell_crossings_prepare(&lightcone_crossings_data);
+    const struct lightcone_cell_crossings *lightcone_crossings =
+        &lightcone_crossings_data;
+#else
+    const struct lightcone_cell_crossings *lightcone_crossings = NULL;
+#endif
+
     /* Loop over all the gas particles in the cell */
     const size_t nr_parts = c->hydro.count;
     for (size_t k = 0; k < nr_parts; k++) {
@@ -272,7 +294,7 @@ void cell_drift_part(struct cell *c, const struct engine *e, int force,
 
       /* Drift... */
       drift_part(p, xp, dt_drift, dt_kick_hydro, dt_kick_grav, dt_therm,
-                 ti_old_part, ti_current, e, replication_list, c->loc);
+                 ti_old_part, ti_current, e, lightcone_crossings);
 
       /* Update the tracers properties */
       tracers_after_drift(p, xp, e->internal_units, e->physical_constants,
@@ -388,6 +410,10 @@ void cell_drift_part(struct cell *c, const struct engine *e, int force,
     c->hydro.dx_max_part = dx_max;
     c->hydro.dx_max_sort = dx_max_sort;
 
+#ifdef WITH_LIGHTCONE
+    lightcone_cell_crossings_clean(&lightcone_crossings_data);
+#endif
+
     /* Update the time of the last drift */
     c->hydro.ti_old_part = ti_current;
   }
@@ -483,6 +509,34 @@ void cell_drift_gpart(struct cell *c, const struct engine *e, int force,
       dt_drift = (ti_current - ti_old_gpart) * e->time_base;
     }
 
+#ifdef WITH_LIGHTCONE
+    /* Find the replications in which the particles of this cell may cross
+     * the lightcones during this drift */
+    struct lightcone_cell_crossings lightcone_crossings_data;
+    lightcone_cell_crossings_init(&lightcone_crossings_data, e,
+                                  replication_list, ti_old_gpart, ti_current,
+                                  c->loc);
+    if (lightcone_cell_crossings_active(&lightcone_crossings_data)) {
+      for (int k = 0; k < c->grav.count; k++) {
+        const struct gpart *gp = &gparts[k];
+        if (gpart_is_inhibited(gp, e)) continue;
+        /* Only the particles without a *part counterpart are checked here */
+        if (gp->type != swift_type_dark_matter &&
+            gp->type != swift_type_dark_matter_background &&
+            gp->type != swift_type_neutrino)
+          continue;
+
+        lightcone_cell_crossings_add_to_bounds(&lightcone_crossings_data,
+                                               gp->x, gp);
+      }
+    }
+    lightcone_cell_crossings_prepare(&lightcone_crossings_data);
+    const struct lightcone_cell_crossings *lightcone_crossings =
+        &lightcone_crossings_data;
+#else
+    const struct lightcone_cell_crossings *lightcone_crossings = NULL;
+#endif
+
     /* Loop over all the g-particles in the cell */
     const size_t nr_gparts = c->grav.count;
     for (size_t k = 0; k < nr_gparts; k++) {
@@ -500,7 +554,7 @@ void cell_drift_gpart(struct cell *c, const struct engine *e, int force,
 
       /* Drift... */
       drift_gpart(gp, dt_drift_k, ti_old_gpart, ti_current, grav_props, e,
-                  replication_list, c->loc);
+                  lightcone_crossings);
 
 #ifdef SWIFT_DEBUG_CHECKS
       /* Make sure the particle does not drift by more than a box length. */
@@ -557,6 +611,10 @@ void cell_drift_gpart(struct cell *c, const struct engine *e, int force,
       }
     }
 
+#ifdef WITH_LIGHTCONE
+    lightcone_cell_crossings_clean(&lightcone_crossings_data);
+#endif
+
     /* Update the time of the last drift */
     c->grav.ti_old_part = ti_current;
   }
@@ -666,6 +724,28 @@ void cell_drift_spart(struct cell *c, const struct engine *e, int force,
       dt_drift = (ti_current - ti_old_spart) * e->time_base;
     }
 
+#ifdef WITH_LIGHTCONE
+    /* Find the replications in which the particles of this cell may cross
+     * the lightcones during this drift */
+    struct lightcone_cell_crossings lightcone_crossings_data;
+    lightcone_cell_crossings_init(&lightcone_crossings_data, e,
+                                  replication_list, ti_old_spart, ti_current,
+                                  c->loc);
+    if (lightcone_cell_crossings_active(&lightcone_crossings_data)) {
+      for (int k = 0; k < c->stars.count; k++) {
+        const struct spart *sp = &sparts[k];
+        if (spart_is_inhibited(sp, e)) continue;
+        lightcone_cell_crossings_add_to_bounds(&lightcone_crossings_data,
+                                               sp->x, sp->gpart);
+      }
+    }
+    lightcone_cell_crossings_prepare(&lightcone_crossings_data);
+    const struct lightcone_cell_crossings *lightcone_crossings =
+        &lightcone_crossings_data;
+#else
+    const struct lightcone_cell_crossings *lightcone_crossings = NULL;
+#endif
+
     /* Loop over all the star particles in the cell */
     const size_t nr_sparts = c->stars.count;
     for (size_t k = 0; k < nr_sparts; k++) {
@@ -676,8 +756,8 @@ void cell_drift_spart(struct cell *c, const struct engine *e, int force,
       if (spart_is_inhibited(sp, e)) continue;
 
       /* Drift... */
-      drift_spart(sp, dt_drift, ti_old_spart, ti_current, e, replication_list,
-                  c->loc);
+      drift_spart(sp, dt_drift, ti_old_spart, ti_current, e,
+                  lightcone_crossings);
 
 #ifdef SWIFT_DEBUG_CHECKS
       /* Make sure the particle does not drift by more than a box length. */
@@ -761,6 +841,10 @@ void cell_drift_spart(struct cell *c, const struct engine *e, int force,
     c->stars.dx_max_part = dx_max;
     c->stars.dx_max_sort = dx_max_sort;
 
+#ifdef WITH_LIGHTCONE
+    lightcone_cell_crossings_clean(&lightcone_crossings_data);
+#endif
+
     /* Update the time of the last drift */
     c->stars.ti_old_part = ti_current;
   }
@@ -871,6 +955,28 @@ void cell_drift_bpart(struct cell *c, const struct engine *e, int force,
       dt_drift = (ti_current - ti_old_bpart) * e->time_base;
     }
 
+#ifdef WITH_LIGHTCONE
+    /* Find the replications in which the particles of this cell may cross
+     * the lightcones during this drift */
+    struct lightcone_cell_crossings lightcone_crossings_data;
+    lightcone_cell_crossings_init(&lightcone_crossings_data, e,
+                                  replication_list, ti_old_bpart, ti_current,
+                                  c->loc);
+    if (lightcone_cell_crossings_active(&lightcone_crossings_data)) {
+      for (int k = 0; k < c->black_holes.count; k++) {
+        const struct bpart *bp = &bparts[k];
+        if (bpart_is_inhibited(bp, e)) continue;
+        lightcone_cell_crossings_add_to_bounds(&lightcone_crossings_data,
+                                               bp->x, bp->gpart);
+      }
+    }
+    lightcone_cell_crossings_prepare(&lightcone_crossings_data);
+    const struct lightcone_cell_crossings *lightcone_crossings =
+        &lightcone_crossings_data;
+#else
+    const struct lightcone_cell_crossings *lightcone_crossings = NULL;
+#endif
+
     /* Loop over all the black hole particles in the cell */
     const size_t nr_bparts = c->black_holes.count;
     for (size_t k = 0; k < nr_bparts; k++) {
@@ -882,8 +988,8 @@ void cell_drift_bpart(struct cell *c, const struct engine *e, int force,
       if (bpart_is_inhibited(bp, e)) continue;
 
       /* Drift... */
-      drift_bpart(bp, dt_drift, ti_old_bpart, ti_current, e, replication_list,
-                  c->loc);
+      drift_bpart(bp, dt_drift, ti_old_bpart, ti_current, e,
+                  lightcone_crossings);
 
 #ifdef SWIFT_DEBUG_CHECKS
       /* Make sure the particle does not drift by more than a box length. */
@@ -958,6 +1064,10 @@ void cell_drift_bpart(struct cell *c, const struct engine *e, int force,
     c->black_holes.h_max_active = cell_h_max_active;
     c->black_holes.dx_max_part = dx_max;
 
+#ifdef WITH_LIGHTCONE
+    lightcone_cell_crossings_clean(&lightcone_crossings_data);
+#endif
+
     /* Update the time of the last drift */
     c->black_holes.ti_old_part = ti_current;
   }
@@ -111,10 +111,12 @@ struct cell_grav {
   /*! Number of #gpart updated in this cell. */
   int updated;
 
-  /*! Is the #gpart data of this cell being used in a sub-cell? */
+  /*! Is the #gpart data of this cell locked or used in a sub-cell? (lock
+   * bit and number of locked progeny, see cell_lock.c) */
   int phold;
 
-  /*! Is the #multipole data of this cell being used in a sub-cell? */
+  /*! Is the #multipole data of this cell locked or used in a sub-cell? (lock
+   * bit and number of locked progeny, see cell_lock.c) */
   int mhold;
 
   /*! Number of M-M tasks that are associated with this cell. */
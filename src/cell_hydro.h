@@ -166,7 +166,8 @@ struct cell_hydro {
   /*! Number of #part updated in this cell. */
   int updated;
 
-  /*! Is the #part data of this cell being used in a sub-cell? */
+  /*! Is the #part data of this cell locked or used in a sub-cell? (lock
+   * bit and number of locked progeny, see cell_lock.c) */
   int hold;
 
   /*! Nr of #part in this cell. */
@@ -22,48 +22,66 @@
 /* Config parameters. */
 #include <config.h>
 
+/* Standard headers. */
+#include <stddef.h>
+
 /* This object's header. */
 #include "cell.h"
 
 /* Local headers. */
 #include "timers.h"
 
+/* The hold word of a cell combines a bit flagging that the cell itself is
+ * locked with the number of its progeny that are locked. A cell can only be
+ * locked if its hold word is zero and a progeny can only be locked if the
+ * lock bit of all its parents is clear, both of which are checked and
+ * updated with a single atomic operation per cell. */
+#define cell_lock_bit (1 << 30)
+
+/* Access the hold word at a given offset in a #cell. */
+#define cell_lock_hold(c, offset) ((volatile int *)((char *)(c) + (offset)))
+
 /**
- * @brief Lock a cell for access to its array of #part and hold its parents.
+ * @brief Lock a cell and hold its parents.
+ *
+ * The cell's spin lock is taken as well so that code locking it directly is
+ * still excluded. The parents are only held, which only requires an atomic
+ * update of their hold word and never conflicts with other holders.
  *
  * @param c The #cell.
+ * @param lock The spin lock of the cell.
+ * @param hold_offset The offset of the hold word in the #cell.
  * @return 0 on success, 1 on failure
  */
-int cell_locktree(struct cell *c) {
+static int cell_lock_tree(struct cell *c, swift_lock_type *lock,
+                          const size_t hold_offset) {
   TIMER_TIC;
 
-  /* First of all, try to lock this cell. */
-  if (c->hydro.hold || lock_trylock(&c->hydro.lock) != 0) {
+  /* Fast path: is this cell, or any of its progeny, already locked? */
+  volatile int *hold = cell_lock_hold(c, hold_offset);
+  if (*hold || lock_trylock(lock) != 0) {
     TIMER_TOC(timer_locktree);
     return 1;
   }
 
-  /* Did somebody hold this cell in the meantime? */
-  if (c->hydro.hold) {
-    /* Unlock this cell. */
-    if (lock_unlock(&c->hydro.lock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
+  /* Flag the cell as locked, unless somebody held it in the meantime. */
+  if (atomic_cas(hold, 0, cell_lock_bit) != 0) {
+    if (lock_unlock(lock) != 0) error("Failed to unlock cell.");
     TIMER_TOC(timer_locktree);
     return 1;
   }
 
-  /* Climb up the tree and lock/hold/unlock. */
+  /* Climb up the tree and hold the parents that are not locked. */
   struct cell *finger;
   for (finger = c->parent; finger != NULL; finger = finger->parent) {
-    /* Lock this cell. */
-    if (lock_trylock(&finger->hydro.lock) != 0) break;
-
-    /* Increment the hold. */
-    atomic_inc(&finger->hydro.hold);
-
-    /* Unlock the cell. */
-    if (lock_unlock(&finger->hydro.lock) != 0) error("Failed to unlock cell.");
+    volatile int *finger_hold = cell_lock_hold(finger, hold_offset);
+    int old = *finger_hold;
+    while (!(old & cell_lock_bit)) {
+      const int prev = atomic_cas(finger_hold, old, old + 1);
+      if (prev == old) break;
+      old = prev;
+    }
+    if (old & cell_lock_bit) break;
   }
 
   /* If we reached the top of the tree, we're done. */
@@ -72,80 +90,65 @@ int cell_locktree(struct cell *c) {
     return 0;
   }
 
-  /* Otherwise, we hit a snag. */
-  else {
-    /* Undo the holds up to finger. */
-    for (struct cell *finger2 = c->parent; finger2 != finger;
-         finger2 = finger2->parent)
-      atomic_dec(&finger2->hydro.hold);
+  /* Otherwise, we hit a snag. Undo the holds up to finger. */
+  for (struct cell *finger2 = c->parent; finger2 != finger;
+       finger2 = finger2->parent)
+    atomic_dec(cell_lock_hold(finger2, hold_offset));
 
-    /* Unlock this cell. */
-    if (lock_unlock(&c->hydro.lock) != 0) error("Failed to unlock cell.");
+  /* Unlock this cell. */
+  atomic_and(hold, ~cell_lock_bit);
+  if (lock_unlock(lock) != 0) error("Failed to unlock cell.");
 
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
+  /* Admit defeat. */
+  TIMER_TOC(timer_locktree);
+  return 1;
 }
 
 /**
- * @brief Lock a cell for access to its array of #gpart and hold its parents.
+ * @brief Unlock a cell and release the hold on its parents.
  *
  * @param c The #cell.
- * @return 0 on success, 1 on failure
+ * @param lock The spin lock of the cell.
+ * @param hold_offset The offset of the hold word in the #cell.
  */
-int cell_glocktree(struct cell *c) {
+static void cell_unlock_tree(struct cell *c, swift_lock_type *lock,
+                             const size_t hold_offset) {
   TIMER_TIC;
 
-  /* First of all, try to lock this cell. */
-  if (c->grav.phold || lock_trylock(&c->grav.plock) != 0) {
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Did somebody hold this cell in the meantime? */
-  if (c->grav.phold) {
-    /* Unlock this cell. */
-    if (lock_unlock(&c->grav.plock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Climb up the tree and lock/hold/unlock. */
-  struct cell *finger;
-  for (finger = c->parent; finger != NULL; finger = finger->parent) {
-    /* Lock this cell. */
-    if (lock_trylock(&finger->grav.plock) != 0) break;
+#ifdef SWIFT_DEBUG_CHECKS
+  if (!(*cell_lock_hold(c, hold_offset) & cell_lock_bit))
+    error("Unlocking a cell that is not locked.");
+#endif
 
-    /* Increment the hold. */
-    atomic_inc(&finger->grav.phold);
+  /* First of all, unlock this cell. */
+  atomic_and(cell_lock_hold(c, hold_offset), ~cell_lock_bit);
+  if (lock_unlock(lock) != 0) error("Failed to unlock cell.");
 
-    /* Unlock the cell. */
-    if (lock_unlock(&finger->grav.plock) != 0) error("Failed to unlock cell.");
-  }
-
-  /* If we reached the top of the tree, we're done. */
-  if (finger == NULL) {
-    TIMER_TOC(timer_locktree);
-    return 0;
-  }
+  /* Climb up the tree and unhold the parents. */
+  for (struct cell *finger = c->parent; finger != NULL; finger = finger->parent)
+    atomic_dec(cell_lock_hold(finger, hold_offset));
 
-  /* Otherwise, we hit a snag. */
-  else {
-    /* Undo the holds up to finger. */
-    for (struct cell *finger2 = c->parent; finger2 != finger;
-         finger2 = finger2->parent)
-      atomic_dec(&finger2->grav.phold);
+  TIMER_TOC(timer_locktree);
+}
 
-    /* Unlock this cell. */
-    if (lock_unlock(&c->grav.plock) != 0) error("Failed to unlock cell.");
+/**
+ * @brief Lock a cell for access to its array of #part and hold its parents.
+ *
+ * @param c The #cell.
+ * @return 0 on success, 1 on failure
+ */
+int cell_locktree(struct cell *c) {
+  return cell_lock_tree(c, &c->hydro.lock, offsetof(struct cell, hydro.hold));
+}
 
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
+/**
+ * @brief Lock a cell for access to its array of #gpart and hold its parents.
+ *
+ * @param c The #cell.
+ * @return 0 on success, 1 on failure
+ */
+int cell_glocktree(struct cell *c) {
+  return cell_lock_tree(c, &c->grav.plock, offsetof(struct cell, grav.phold));
 }
 
 /**
@@ -155,57 +158,7 @@ int cell_glocktree(struct cell *c) {
  * @return 0 on success, 1 on failure
  */
 int cell_mlocktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to lock this cell. */
-  if (c->grav.mhold || lock_trylock(&c->grav.mlock) != 0) {
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Did somebody hold this cell in the meantime? */
-  if (c->grav.mhold) {
-    /* Unlock this cell. */
-    if (lock_unlock(&c->grav.mlock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Climb up the tree and lock/hold/unlock. */
-  struct cell *finger;
-  for (finger = c->parent; finger != NULL; finger = finger->parent) {
-    /* Lock this cell. */
-    if (lock_trylock(&finger->grav.mlock) != 0) break;
-
-    /* Increment the hold. */
-    atomic_inc(&finger->grav.mhold);
-
-    /* Unlock the cell. */
-    if (lock_unlock(&finger->grav.mlock) != 0) error("Failed to unlock cell.");
-  }
-
-  /* If we reached the top of the tree, we're done. */
-  if (finger == NULL) {
-    TIMER_TOC(timer_locktree);
-    return 0;
-  }
-
-  /* Otherwise, we hit a snag. */
-  else {
-    /* Undo the holds up to finger. */
-    for (struct cell *finger2 = c->parent; finger2 != finger;
-         finger2 = finger2->parent)
-      atomic_dec(&finger2->grav.mhold);
-
-    /* Unlock this cell. */
-    if (lock_unlock(&c->grav.mlock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
+  return cell_lock_tree(c, &c->grav.mlock, offsetof(struct cell, grav.mhold));
 }
 
 /**
@@ -215,57 +168,7 @@ int cell_mlocktree(struct cell *c) {
  * @return 0 on success, 1 on failure
  */
 int cell_slocktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to lock this cell. */
-  if (c->stars.hold || lock_trylock(&c->stars.lock) != 0) {
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Did somebody hold this cell in the meantime? */
-  if (c->stars.hold) {
-    /* Unlock this cell. */
-    if (lock_unlock(&c->stars.lock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Climb up the tree and lock/hold/unlock. */
-  struct cell *finger;
-  for (finger = c->parent; finger != NULL; finger = finger->parent) {
-    /* Lock this cell. */
-    if (lock_trylock(&finger->stars.lock) != 0) break;
-
-    /* Increment the hold. */
-    atomic_inc(&finger->stars.hold);
-
-    /* Unlock the cell. */
-    if (lock_unlock(&finger->stars.lock) != 0) error("Failed to unlock cell.");
-  }
-
-  /* If we reached the top of the tree, we're done. */
-  if (finger == NULL) {
-    TIMER_TOC(timer_locktree);
-    return 0;
-  }
-
-  /* Otherwise, we hit a snag. */
-  else {
-    /* Undo the holds up to finger. */
-    for (struct cell *finger2 = c->parent; finger2 != finger;
-         finger2 = finger2->parent)
-      atomic_dec(&finger2->stars.hold);
-
-    /* Unlock this cell. */
-    if (lock_unlock(&c->stars.lock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
+  return cell_lock_tree(c, &c->stars.lock, offsetof(struct cell, stars.hold));
 }
 
 /**
@@ -275,57 +178,7 @@ int cell_slocktree(struct cell *c) {
  * @return 0 on success, 1 on failure
  */
 int cell_sink_locktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to lock this cell. */
-  if (c->sinks.hold || lock_trylock(&c->sinks.lock) != 0) {
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Did somebody hold this cell in the meantime? */
-  if (c->sinks.hold) {
-    /* Unlock this cell. */
-    if (lock_unlock(&c->sinks.lock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Climb up the tree and lock/hold/unlock. */
-  struct cell *finger;
-  for (finger = c->parent; finger != NULL; finger = finger->parent) {
-    /* Lock this cell. */
-    if (lock_trylock(&finger->sinks.lock) != 0) break;
-
-    /* Increment the hold. */
-    atomic_inc(&finger->sinks.hold);
-
-    /* Unlock the cell. */
-    if (lock_unlock(&finger->sinks.lock) != 0) error("Failed to unlock cell.");
-  }
-
-  /* If we reached the top of the tree, we're done. */
-  if (finger == NULL) {
-    TIMER_TOC(timer_locktree);
-    return 0;
-  }
-
-  /* Otherwise, we hit a snag. */
-  else {
-    /* Undo the holds up to finger. */
-    for (struct cell *finger2 = c->parent; finger2 != finger;
-         finger2 = finger2->parent)
-      atomic_dec(&finger2->sinks.hold);
-
-    /* Unlock this cell. */
-    if (lock_unlock(&c->sinks.lock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
+  return cell_lock_tree(c, &c->sinks.lock, offsetof(struct cell, sinks.hold));
 }
 
 /**
@@ -335,58 +188,8 @@ int cell_sink_locktree(struct cell *c) {
  * @return 0 on success, 1 on failure
  */
 int cell_blocktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to lock this cell. */
-  if (c->black_holes.hold || lock_trylock(&c->black_holes.lock) != 0) {
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Did somebody hold this cell in the meantime? */
-  if (c->black_holes.hold) {
-    /* Unlock this cell. */
-    if (lock_unlock(&c->black_holes.lock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
-
-  /* Climb up the tree and lock/hold/unlock. */
-  struct cell *finger;
-  for (finger = c->parent; finger != NULL; finger = finger->parent) {
-    /* Lock this cell. */
-    if (lock_trylock(&finger->black_holes.lock) != 0) break;
-
-    /* Increment the hold. */
-    atomic_inc(&finger->black_holes.hold);
-
-    /* Unlock the cell. */
-    if (lock_unlock(&finger->black_holes.lock) != 0)
-      error("Failed to unlock cell.");
-  }
-
-  /* If we reached the top of the tree, we're done. */
-  if (finger == NULL) {
-    TIMER_TOC(timer_locktree);
-    return 0;
-  }
-
-  /* Otherwise, we hit a snag. */
-  else {
-    /* Undo the holds up to finger. */
-    for (struct cell *finger2 = c->parent; finger2 != finger;
-         finger2 = finger2->parent)
-      atomic_dec(&finger2->black_holes.hold);
-
-    /* Unlock this cell. */
-    if (lock_unlock(&c->black_holes.lock) != 0) error("Failed to unlock cell.");
-
-    /* Admit defeat. */
-    TIMER_TOC(timer_locktree);
-    return 1;
-  }
+  return cell_lock_tree(c, &c->black_holes.lock,
+                        offsetof(struct cell, black_holes.hold));
 }
 
 /**
@@ -395,16 +198,7 @@ int cell_blocktree(struct cell *c) {
  * @param c The #cell.
  */
 void cell_unlocktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to unlock this cell. */
-  if (lock_unlock(&c->hydro.lock) != 0) error("Failed to unlock cell.");
-
-  /* Climb up the tree and unhold the parents. */
-  for (struct cell *finger = c->parent; finger != NULL; finger = finger->parent)
-    atomic_dec(&finger->hydro.hold);
-
-  TIMER_TOC(timer_locktree);
+  cell_unlock_tree(c, &c->hydro.lock, offsetof(struct cell, hydro.hold));
 }
 
 /**
@@ -413,16 +207,7 @@ void cell_unlocktree(struct cell *c) {
  * @param c The #cell.
  */
 void cell_gunlocktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to unlock this cell. */
-  if (lock_unlock(&c->grav.plock) != 0) error("Failed to unlock cell.");
-
-  /* Climb up the tree and unhold the parents. */
-  for (struct cell *finger = c->parent; finger != NULL; finger = finger->parent)
-    atomic_dec(&finger->grav.phold);
-
-  TIMER_TOC(timer_locktree);
+  cell_unlock_tree(c, &c->grav.plock, offsetof(struct cell, grav.phold));
 }
 
 /**
@@ -431,16 +216,7 @@ void cell_gunlocktree(struct cell *c) {
  * @param c The #cell.
  */
 void cell_munlocktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to unlock this cell. */
-  if (lock_unlock(&c->grav.mlock) != 0) error("Failed to unlock cell.");
-
-  /* Climb up the tree and unhold the parents. */
-  for (struct cell *finger = c->parent; finger != NULL; finger = finger->parent)
-    atomic_dec(&finger->grav.mhold);
-
-  TIMER_TOC(timer_locktree);
+  cell_unlock_tree(c, &c->grav.mlock, offsetof(struct cell, grav.mhold));
 }
 
 /**
@@ -449,16 +225,7 @@ void cell_munlocktree(struct cell *c) {
  * @param c The #cell.
  */
 void cell_sunlocktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to unlock this cell. */
-  if (lock_unlock(&c->stars.lock) != 0) error("Failed to unlock cell.");
-
-  /* Climb up the tree and unhold the parents. */
-  for (struct cell *finger = c->parent; finger != NULL; finger = finger->parent)
-    atomic_dec(&finger->stars.hold);
-
-  TIMER_TOC(timer_locktree);
+  cell_unlock_tree(c, &c->stars.lock, offsetof(struct cell, stars.hold));
 }
 
 /**
@@ -467,16 +234,7 @@ void cell_sunlocktree(struct cell *c) {
  * @param c The #cell.
  */
 void cell_sink_unlocktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to unlock this cell. */
-  if (lock_unlock(&c->sinks.lock) != 0) error("Failed to unlock cell.");
-
-  /* Climb up the tree and unhold the parents. */
-  for (struct cell *finger = c->parent; finger != NULL; finger = finger->parent)
-    atomic_dec(&finger->sinks.hold);
-
-  TIMER_TOC(timer_locktree);
+  cell_unlock_tree(c, &c->sinks.lock, offsetof(struct cell, sinks.hold));
 }
 
 /**
@@ -485,14 +243,6 @@ void cell_sink_unlocktree(struct cell *c) {
  * @param c The #cell.
  */
 void cell_bunlocktree(struct cell *c) {
-  TIMER_TIC;
-
-  /* First of all, try to unlock this cell. */
-  if (lock_unlock(&c->black_holes.lock) != 0) error("Failed to unlock cell.");
-
-  /* Climb up the tree and unhold the parents. */
-  for (struct cell *finger = c->parent; finger != NULL; finger = finger->parent)
-    atomic_dec(&finger->black_holes.hold);
-
-  TIMER_TOC(timer_locktree);
+  cell_unlock_tree(c, &c->black_holes.lock,
+                   offsetof(struct cell, black_holes.hold));
 }
@@ -114,7 +114,8 @@ struct cell_sinks {
   /*! Number of #sink updated in this cell. */
   int updated;
 
-  /*! Is the #sink data of this cell being used in a sub-cell? */
+  /*! Is the #sink data of this cell locked or used in a sub-cell? (lock
+   * bit and number of locked progeny, see cell_lock.c) */
   int hold;
 
   /*! Nr of #sink in this cell. */
@@ -155,7 +155,8 @@ struct cell_stars {
   /*! Nr of #spart in this cell. */
   int count;
 
-  /*! Is the #spart data of this cell being used in a sub-cell? */
+  /*! Is the #spart data of this cell locked or used in a sub-cell? (lock
+   * bit and number of locked progeny, see cell_lock.c) */
   int hold;
 };
 
@@ -59,6 +59,7 @@ struct mpicollectgroup1 {
   float runtime;
   int flush_lightcone_maps;
   double deadtime;
+  double tailtime;
 #ifdef WITH_CSDS
   float csds_file_size_gb;
 #endif
@@ -139,6 +140,7 @@ void collectgroup1_apply(const struct collectgroup1 *grp1, struct engine *e) {
   e->runtime = grp1->runtime;
   e->flush_lightcone_maps = grp1->flush_lightcone_maps;
   e->global_deadtime = grp1->deadtime;
+  e->global_tailtime = grp1->tailtime;
 }
 
 /**
@@ -201,6 +203,7 @@ void collectgroup1_apply(const struct collectgroup1 *grp1, struct engine *e) {
  * @param runtime The runtime of rank in hours.
  * @param flush_lightcone_maps Flag whether lightcone maps should be updated
  * @param deadtime The deadtime of rank.
+ * @param tailtime The idle time at the end of the step of rank.
  * @param csds_file_size_gb The current size of the CSDS.
  */
 void collectgroup1_init(
@@ -216,7 +219,8 @@ void collectgroup1_init(
     integertime_t ti_black_holes_beg_max, int forcerebuild,
     long long total_nr_cells, long long total_nr_tasks, float tasks_per_cell,
     const struct star_formation_history sfh, float runtime,
-    int flush_lightcone_maps, double deadtime, float csds_file_size_gb) {
+    int flush_lightcone_maps, double deadtime, double tailtime,
+    float csds_file_size_gb) {
 
   grp1->updated = updated;
   grp1->g_updated = g_updated;
@@ -248,6 +252,7 @@ void collectgroup1_init(
   grp1->runtime = runtime;
   grp1->flush_lightcone_maps = flush_lightcone_maps;
   grp1->deadtime = deadtime;
+  grp1->tailtime = tailtime;
 #ifdef WITH_CSDS
   grp1->csds_file_size_gb = csds_file_size_gb;
 #endif
@@ -297,6 +302,7 @@ void collectgroup1_reduce(struct collectgroup1 *grp1) {
   mpigrp11.runtime = grp1->runtime;
   mpigrp11.flush_lightcone_maps = grp1->flush_lightcone_maps;
   mpigrp11.deadtime = grp1->deadtime;
+  mpigrp11.tailtime = grp1->tailtime;
 #ifdef WITH_CSDS
   mpigrp11.csds_file_size_gb = grp1->csds_file_size_gb;
 #endif
@@ -338,6 +344,7 @@ void collectgroup1_reduce(struct collectgroup1 *grp1) {
   grp1->flush_lightcone_maps = mpigrp12.flush_lightcone_maps;
 
   grp1->deadtime = mpigrp12.deadtime;
+  grp1->tailtime = mpigrp12.tailtime;
 #ifdef WITH_CSDS
   grp1->csds_file_size_gb = mpigrp12.csds_file_size_gb;
 #endif
@@ -423,6 +430,9 @@ static void doreduce1(struct mpicollectgroup1 *mpigrp11,
   /* Sum the deadtime. */
   mpigrp11->deadtime += mpigrp12->deadtime;
 
+  /* Sum the idle time at the end of the step. */
+  mpigrp11->tailtime += mpigrp12->tailtime;
+
 #ifdef WITH_CSDS
   mpigrp11->csds_file_size_gb += mpigrp12->csds_file_size_gb;
 #endif
@@ -71,6 +71,9 @@ struct collectgroup1 {
   /* Accumulated dead time during the step. */
   double deadtime;
 
+  /* Accumulated idle time at the end of the step. */
+  double tailtime;
+
 #ifdef WITH_CSDS
   /* Filesize used by the CSDS (does not correspond to the allocated one) */
   float csds_file_size_gb;
@@ -92,7 +95,8 @@ void collectgroup1_init(
     integertime_t ti_black_holes_beg_max, int forcerebuild,
     long long total_nr_cells, long long total_nr_tasks, float tasks_per_cell,
     const struct star_formation_history sfh, float runtime,
-    int flush_lightcone_maps, double deadtime, float csds_file_size_gb);
+    int flush_lightcone_maps, double deadtime, double tailtime,
+    float csds_file_size_gb);
 void collectgroup1_reduce(struct collectgroup1 *grp1);
 #ifdef WITH_MPI
 void mpicollect_free_MPI_type(void);
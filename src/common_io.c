@@ -671,6 +671,37 @@ void io_write_meta_data(hid_t h_file, const struct engine* e,
   }
 }
 
+/**
+ * @brief Creates the group holding the stratified subsample of a particle
+ * type in a snapshot (/Subsample/PartTypeN).
+ *
+ * @param h_file The (opened) HDF5 file.
+ * @param ptype The particle type.
+ * @param fraction The fraction of particles in the subsample.
+ * @param N The total number of particles in the subsample.
+ */
+void io_create_stratified_subsample_group(hid_t h_file, const int ptype,
+                                          const float fraction,
+                                          const long long N) {
+
+  if (H5Lexists(h_file, "/Subsample", H5P_DEFAULT) <= 0) {
+    const hid_t h_grp =
+        H5Gcreate(h_file, "/Subsample", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (h_grp < 0) error("Error while creating subsample group.");
+    H5Gclose(h_grp);
+  }
+
+  char groupName[PARTICLE_GROUP_BUFFER_SIZE];
+  snprintf(groupName, PARTICLE_GROUP_BUFFER_SIZE, "/Subsample/PartType%d",
+           ptype);
+  const hid_t h_grp =
+      H5Gcreate(h_file, groupName, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  if (h_grp < 0) error("Error while creating subsample group.");
+  io_write_attribute_ll(h_grp, "NumberOfParticles", N);
+  io_write_attribute_f(h_grp, "SubsampleFraction", fraction);
+  H5Gclose(h_grp);
+}
+
 /**
  * @brief Reads the Unit System from an IC file.
  *
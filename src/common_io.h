@@ -103,6 +103,9 @@ void io_write_meta_data(hid_t h_file, const struct engine* e,
                         const struct unit_system* internal_units,
                         const struct unit_system* snapshot_units,
                         const int fof);
+void io_create_stratified_subsample_group(hid_t h_file, const int ptype,
+                                          const float fraction,
+                                          const long long N);
 
 void io_write_code_description(hid_t h_file);
 void io_write_engine_policy(hid_t h_file, const struct engine* e);
@@ -119,6 +122,7 @@ void io_write_cell_offsets(hid_t h_grp, const int cdim[3], const double dim[3],
                            const long long global_offsets[swift_type_count],
                            const int to_write[swift_type_count],
                            const int num_fields[swift_type_count],
+                           const int sub_cell_depth,
                            const struct unit_system* internal_units,
                            const struct unit_system* snapshot_units);
 
@@ -132,6 +136,49 @@ void io_copy_temp_buffer(void* temp, const struct engine* e,
                          const struct io_props props, size_t N,
                          const struct unit_system* internal_units,
                          const struct unit_system* snapshot_units);
+size_t io_stratified_subsample_count(const size_t N, const float fraction,
+                                     const int ptype, const int snap_num);
+void* io_stratified_subsample(const struct engine* e, const void* temp,
+                              const struct io_props props, const size_t N,
+                              const int ptype, size_t* N_sub);
+
+/*! A chunk of a dataset that already went through the filters */
+struct io_chunk {
+  void* data;
+  size_t size;
+};
+
+/* Can we run the compression filters ourselves and write raw chunks? */
+#if defined(HAVE_ZLIB) && H5_VERSION_GE(1, 10, 3)
+#define IO_THREADED_COMPRESSION
+
+size_t io_compressed_chunk_length(const size_t N, const int nr_threads);
+struct io_chunk* io_compress_chunks(const void* temp, const size_t N,
+                                    const int dimension,
+                                    const enum IO_DATA_TYPE type,
+                                    const size_t chunk_length,
+                                    const int gzip_level,
+                                    struct threadpool* tp);
+size_t io_slice_chunk_length(const size_t N, const size_t max_chunk_length);
+struct io_chunk* io_compress_slices(const void* temp, const size_t num_slices,
+                                    const size_t* slice_offsets,
+                                    const int dimension,
+                                    const enum IO_DATA_TYPE type,
+                                    const size_t max_chunk_length,
+                                    const int gzip_level,
+                                    struct threadpool* tp,
+                                    size_t* first_chunk);
+void io_write_compressed_chunks(hid_t h_data, const struct io_chunk* chunks,
+                                const size_t N, const size_t chunk_length);
+size_t io_compressed_chunks_size(const struct io_chunk* chunks, const size_t N,
+                                 const size_t chunk_length);
+void io_free_compressed_chunks(struct io_chunk* chunks, const size_t N,
+                               const size_t chunk_length);
+#endif
+
+struct io_chunk* io_compress_field(const struct engine* e, const void* temp,
+                                   const struct io_props props, const size_t N,
+                                   const int lossless, size_t* chunk_length);
 
 #endif /* HAVE_HDF5 */
 
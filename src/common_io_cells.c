@@ -251,6 +251,255 @@ void io_write_array(hid_t h_grp, const int n, const int dim, const void* array,
   H5Sclose(h_space);
 }
 
+/**
+ * @brief A cell of the multi-resolution index of a snapshot, i.e. a leaf of
+ * the cell tree truncated at the requested depth.
+ */
+struct io_sub_cell {
+
+  /* Lower corner of the cell */
+  double loc[3];
+
+  /* Index of the top-level cell this cell belongs to */
+  int top_cell;
+
+  /* Depth below the top-level cell */
+  int depth;
+
+  /* Number and offsets of the particles of each type to write */
+  long long count[swift_type_count];
+  long long offset[swift_type_count];
+};
+
+/*! A growing list of #io_sub_cell */
+struct io_sub_cell_list {
+  struct io_sub_cell* cells;
+  size_t count;
+  size_t size;
+};
+
+/**
+ * @brief Recursively collect the leaves of the cell tree of a top-level cell
+ * down to a given depth.
+ *
+ * Particles are stored in depth-first order of the tree in the particle
+ * arrays (and hence in the snapshots), such that the particles of each leaf
+ * form a contiguous range.
+ *
+ * @param c The #cell.
+ * @param top_cell The index of the top-level cell.
+ * @param depth The depth of c below the top-level cell.
+ * @param max_depth The maximal depth of the index.
+ * @param subsample Are we subsampling the different particle types?
+ * @param subsample_fraction The fraction of particles to keep when subsampling.
+ * @param snap_num The snapshot number used as subsampling random seed.
+ * @param offsets (in/out) The running offset of each particle type.
+ * @param list The list to append to.
+ */
+static void io_collect_sub_cells(
+    const struct cell* c, const int top_cell, const int depth,
+    const int max_depth, const int subsample[swift_type_count],
+    const float subsample_fraction[swift_type_count], const int snap_num,
+    long long offsets[swift_type_count], struct io_sub_cell_list* list) {
+
+  /* Recurse? */
+  if (c->split && depth < max_depth) {
+    for (int k = 0; k < 8; ++k)
+      if (c->progeny[k] != NULL)
+        io_collect_sub_cells(c->progeny[k], top_cell, depth + 1, max_depth,
+                             subsample, subsample_fraction, snap_num, offsets,
+                             list);
+    return;
+  }
+
+  if (list->count == list->size) {
+    list->size = list->size == 0 ? 1024 : 2 * list->size;
+    list->cells = (struct io_sub_cell*)realloc(
+        list->cells, list->size * sizeof(struct io_sub_cell));
+    if (list->cells == NULL) error("Unable to allocate sub-cell list.");
+  }
+
+  struct io_sub_cell* sub = &list->cells[list->count++];
+  sub->loc[0] = c->loc[0];
+  sub->loc[1] = c->loc[1];
+  sub->loc[2] = c->loc[2];
+  sub->top_cell = top_cell;
+  sub->depth = depth;
+
+  double dummy1[3], dummy2[3];
+  sub->count[swift_type_gas] = cell_count_non_inhibited_part(
+      c, subsample[swift_type_gas], subsample_fraction[swift_type_gas],
+      snap_num, dummy1, dummy2);
+  sub->count[swift_type_dark_matter] = cell_count_non_inhibited_dark_matter(
+      c, subsample[swift_type_dark_matter],
+      subsample_fraction[swift_type_dark_matter], snap_num, dummy1, dummy2);
+  sub->count[swift_type_dark_matter_background] =
+      cell_count_non_inhibited_background_dark_matter(
+          c, subsample[swift_type_dark_matter_background],
+          subsample_fraction[swift_type_dark_matter_background], snap_num,
+          dummy1, dummy2);
+  sub->count[swift_type_sink] = cell_count_non_inhibited_sink(
+      c, subsample[swift_type_sink], subsample_fraction[swift_type_sink],
+      snap_num, dummy1, dummy2);
+  sub->count[swift_type_stars] = cell_count_non_inhibited_spart(
+      c, subsample[swift_type_stars], subsample_fraction[swift_type_stars],
+      snap_num, dummy1, dummy2);
+  sub->count[swift_type_black_hole] = cell_count_non_inhibited_bpart(
+      c, subsample[swift_type_black_hole],
+      subsample_fraction[swift_type_black_hole], snap_num, dummy1, dummy2);
+  sub->count[swift_type_neutrino] = cell_count_non_inhibited_neutrinos(
+      c, subsample[swift_type_neutrino],
+      subsample_fraction[swift_type_neutrino], snap_num, dummy1, dummy2);
+
+  for (int ptype = 0; ptype < swift_type_count; ++ptype) {
+    sub->offset[ptype] = offsets[ptype];
+    offsets[ptype] += sub->count[ptype];
+  }
+}
+
+/**
+ * @brief Compute and write the multi-resolution index of the particles below
+ * the top-level cells.
+ *
+ * The index lists the cells of the tree truncated at max_depth (or the
+ * leaves of the tree if they are shallower) with the range of particles of
+ * each type they contain.
+ *
+ * @param h_grp the hdf5 group to write to.
+ * @param cells_top The top-level cells.
+ * @param nr_cells The number of top-level cells.
+ * @param nodeID The rank of this node.
+ * @param distributed Is this a distributed snapshot?
+ * @param max_depth The maximal depth of the index.
+ * @param subsample Are we subsampling the different particle types?
+ * @param subsample_fraction The fraction of particles to keep when subsampling.
+ * @param snap_num The snapshot number used as subsampling random seed.
+ * @param global_offsets The offsets of this node into the global list of
+ * particles.
+ * @param to_write Whether a given particle type should be written to the cell
+ * info.
+ * @param num_fields The number of fields to write for each particle type.
+ * @param factor The conversion factor of lengths to snapshot units.
+ */
+static void io_write_sub_cell_offsets(
+    hid_t h_grp, const struct cell* cells_top, const int nr_cells,
+    const int nodeID, const int distributed, const int max_depth,
+    const int subsample[swift_type_count],
+    const float subsample_fraction[swift_type_count], const int snap_num,
+    const long long global_offsets[swift_type_count],
+    const int to_write[swift_type_count],
+    const int num_fields[swift_type_count], const double factor) {
+
+  /* Collect our local part of the index */
+  struct io_sub_cell_list list = {NULL, 0, 0};
+  long long offsets[swift_type_count];
+  for (int ptype = 0; ptype < swift_type_count; ++ptype)
+    offsets[ptype] = global_offsets[ptype];
+
+  for (int i = 0; i < nr_cells; ++i)
+    if (cells_top[i].nodeID == nodeID)
+      io_collect_sub_cells(&cells_top[i], i, /*depth=*/0, max_depth, subsample,
+                           subsample_fraction, snap_num, offsets, &list);
+
+#ifdef WITH_MPI
+  /* Gather everything on rank 0 when writing a single file */
+  if (!distributed) {
+    int nr_ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &nr_ranks);
+    const int local_size = list.count * sizeof(struct io_sub_cell);
+    int* sizes = NULL;
+    int* displs = NULL;
+    struct io_sub_cell* all_cells = NULL;
+    size_t total = 0;
+    if (nodeID == 0) {
+      sizes = (int*)malloc(nr_ranks * sizeof(int));
+      displs = (int*)malloc(nr_ranks * sizeof(int));
+      if (sizes == NULL || displs == NULL)
+        error("Unable to allocate sub-cell counts.");
+    }
+    MPI_Gather(&local_size, 1, MPI_INT, sizes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (nodeID == 0) {
+      for (int i = 0; i < nr_ranks; ++i) {
+        displs[i] = total;
+        total += sizes[i];
+      }
+      all_cells = (struct io_sub_cell*)malloc(total);
+      if (all_cells == NULL) error("Unable to allocate sub-cell list.");
+    }
+    MPI_Gatherv(list.cells, local_size, MPI_BYTE, all_cells, sizes, displs,
+                MPI_BYTE, 0, MPI_COMM_WORLD);
+    free(list.cells);
+    free(sizes);
+    free(displs);
+    list.cells = all_cells;
+    list.count = total / sizeof(struct io_sub_cell);
+  }
+#endif
+
+  /* When writing a single file, only rank 0 writes the meta-data */
+  if (distributed || nodeID == 0) {
+
+    const int n = list.count;
+    int* top_cells = (int*)malloc(n * sizeof(int));
+    int* depths = (int*)malloc(n * sizeof(int));
+    double* locs = (double*)malloc(3 * n * sizeof(double));
+    long long* values = (long long*)malloc(n * sizeof(long long));
+    if (top_cells == NULL || depths == NULL || locs == NULL || values == NULL)
+      error("Unable to allocate sub-cell arrays.");
+
+    for (int i = 0; i < n; ++i) {
+      top_cells[i] = list.cells[i].top_cell;
+      depths[i] = list.cells[i].depth;
+      for (int k = 0; k < 3; ++k)
+        locs[3 * i + k] = list.cells[i].loc[k] * factor;
+    }
+
+    hid_t h_subgrp =
+        H5Gcreate(h_grp, "SubCells", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (h_subgrp < 0) error("Error while creating sub-cells group");
+    io_write_attribute_i(h_subgrp, "max_depth", max_depth);
+    io_write_attribute_i(h_subgrp, "nr_cells", n);
+
+    io_write_array(h_subgrp, n, /*dim=*/1, top_cells, INT, "TopLevelCell",
+                   "sub-cells");
+    io_write_array(h_subgrp, n, /*dim=*/1, depths, INT, "Depth", "sub-cells");
+    io_write_array(h_subgrp, n, /*dim=*/3, locs, DOUBLE, "Locations",
+                   "sub-cells");
+
+    hid_t h_grp_offsets = H5Gcreate(h_subgrp, "OffsetsInFile", H5P_DEFAULT,
+                                    H5P_DEFAULT, H5P_DEFAULT);
+    hid_t h_grp_counts =
+        H5Gcreate(h_subgrp, "Counts", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (h_grp_offsets < 0 || h_grp_counts < 0)
+      error("Error while creating sub-cells sub-groups");
+
+    for (int ptype = 0; ptype < swift_type_count; ++ptype) {
+      if (to_write[ptype] <= 0 || num_fields[ptype] <= 0) continue;
+
+      char name[32];
+      sprintf(name, "PartType%d", ptype);
+
+      for (int i = 0; i < n; ++i) values[i] = list.cells[i].offset[ptype];
+      io_write_array(h_grp_offsets, n, /*dim=*/1, values, LONGLONG, name,
+                     "sub-cell offsets");
+      for (int i = 0; i < n; ++i) values[i] = list.cells[i].count[ptype];
+      io_write_array(h_grp_counts, n, /*dim=*/1, values, LONGLONG, name,
+                     "sub-cell counts");
+    }
+
+    H5Gclose(h_grp_offsets);
+    H5Gclose(h_grp_counts);
+    H5Gclose(h_subgrp);
+
+    free(top_cells);
+    free(depths);
+    free(locs);
+    free(values);
+  }
+
+  free(list.cells);
+}
+
 /**
  * @brief Compute and write the top-level cell counts and offsets meta-data.
  *
@@ -269,6 +518,8 @@ void io_write_array(hid_t h_grp, const int n, const int dim, const void* array,
  * @param to_write Whether a given particle type should be written to the cell
  * info.
  * @param numFields The number of fields to write for each particle type.
+ * @param sub_cell_depth The depth of the index below the top-level cells (0
+ * for none).
  * @param internal_units The internal unit system.
  * @param snapshot_units The snapshot unit system.
  */
@@ -283,6 +534,7 @@ void io_write_cell_offsets(hid_t h_grp, const int cdim[3], const double dim[3],
                            const long long global_offsets[swift_type_count],
                            const int to_write[swift_type_count],
                            const int num_fields[swift_type_count],
+                           const int sub_cell_depth,
                            const struct unit_system* internal_units,
                            const struct unit_system* snapshot_units) {
 
@@ -726,6 +978,15 @@ void io_write_cell_offsets(hid_t h_grp, const int cdim[3], const double dim[3],
     H5Gclose(h_grp_max_pos);
   }
 
+  /* Index of the particles below the top-level cells */
+  if (sub_cell_depth > 0)
+    io_write_sub_cell_offsets(
+        h_grp, cells_top, nr_cells, nodeID, distributed, sub_cell_depth,
+        subsample, subsample_fraction, snap_num, global_offsets, to_write,
+        num_fields,
+        units_conversion_factor(internal_units, snapshot_units,
+                                UNIT_CONV_LENGTH));
+
   /* Free everything we allocated */
   free(centres);
   free(files);
@@ -0,0 +1,443 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "common_io.h"
+
+#if defined(HAVE_HDF5)
+
+/* Standard headers */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* Local includes. */
+#include "engine.h"
+#include "error.h"
+#include "io_properties.h"
+#include "threadpool.h"
+
+#if defined(IO_THREADED_COMPRESSION)
+
+/*! Size of the Fletcher-32 checksum appended to each chunk */
+#define io_fletcher32_size 4
+
+/**
+ * @brief Fletcher-32 checksum of a buffer, as computed by the HDF5 filter.
+ *
+ * @param data The buffer.
+ * @param nbytes The size of the buffer in bytes.
+ */
+static uint32_t io_checksum_fletcher32(const uint8_t* data, size_t nbytes) {
+
+  size_t len = nbytes / 2;
+  uint32_t sum1 = 0, sum2 = 0;
+
+  while (len) {
+    size_t tlen = len > 360 ? 360 : len;
+    len -= tlen;
+    do {
+      sum1 += (uint32_t)((((uint16_t)data[0]) << 8) | ((uint16_t)data[1]));
+      data += 2;
+      sum2 += sum1;
+    } while (--tlen);
+    sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+    sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+  }
+
+  /* Odd number of bytes */
+  if (nbytes % 2) {
+    sum1 += (uint32_t)(((uint16_t)*data) << 8);
+    sum2 += sum1;
+    sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+    sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+  }
+
+  sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+  sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+
+  return (sum2 << 16) | sum1;
+}
+
+/*! Data shared by the compression mappers */
+struct io_compress_data {
+
+  /* The converted field and its number of rows */
+  const char* temp;
+  size_t N;
+
+  /* Number of rows per chunk (the largest one when using slices) */
+  size_t chunk_length;
+
+  /* Optional first row of each slice the field is split into (num_slices +
+   * 1 entries, NULL if the field is one single slice) */
+  const size_t* slice_offsets;
+
+  /* Slice and first chunk in it of each chunk (when using slices) */
+  const size_t* chunk_slice;
+  const size_t* slice_first_chunk;
+
+  /* Size of an element and of a row in bytes */
+  size_t element_size;
+  size_t row_size;
+
+  /* GZIP level */
+  int gzip_level;
+
+  /* Start of the output array */
+  struct io_chunk* chunks;
+};
+
+/**
+ * @brief Mapper function running the shuffle, deflate and Fletcher-32
+ * filters on a set of chunks.
+ */
+static void io_compress_mapper(void* map_data, int num, void* extra_data) {
+
+  const struct io_compress_data* data =
+      (const struct io_compress_data*)extra_data;
+  struct io_chunk* chunks = (struct io_chunk*)map_data;
+
+  const size_t element_size = data->element_size;
+
+  /* Buffer for the shuffled data, zero-padded past the end of the field */
+  uint8_t* shuffled = (uint8_t*)malloc(data->chunk_length * data->row_size);
+  if (shuffled == NULL) error("Unable to allocate shuffle buffer.");
+
+  /* One deflate stream for all the chunks (this is what compress2() does,
+   * without setting up the stream for every chunk) */
+  z_stream stream;
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+  if (deflateInit(&stream, data->gzip_level) != Z_OK)
+    error("Unable to initialise the deflate stream.");
+
+  for (int k = 0; k < num; ++k) {
+
+    const size_t chunk_id = &chunks[k] - data->chunks;
+
+    /* Rows covered by this chunk */
+    size_t slice_start = 0, slice_end = data->N;
+    size_t chunk_length = data->chunk_length, chunk_in_slice = chunk_id;
+    if (data->slice_offsets != NULL) {
+      const size_t slice = data->chunk_slice[chunk_id];
+      slice_start = data->slice_offsets[slice];
+      slice_end = data->slice_offsets[slice + 1];
+      if (slice_end - slice_start < chunk_length)
+        chunk_length = slice_end - slice_start;
+      chunk_in_slice = chunk_id - data->slice_first_chunk[slice];
+    }
+    const size_t first = slice_start + chunk_in_slice * chunk_length;
+    const size_t count =
+        first + chunk_length > slice_end ? slice_end - first : chunk_length;
+    const size_t chunk_bytes = chunk_length * data->row_size;
+    const size_t num_elements = chunk_bytes / element_size;
+    const uint8_t* raw = (const uint8_t*)data->temp + first * data->row_size;
+    const size_t valid = count * data->row_size / element_size;
+
+    /* Shuffle: gather the j-th byte of every element together */
+    for (size_t j = 0; j < element_size; ++j) {
+      uint8_t* out = shuffled + j * num_elements;
+      for (size_t i = 0; i < valid; ++i) out[i] = raw[i * element_size + j];
+      memset(out + valid, 0, num_elements - valid);
+    }
+
+    /* Deflate */
+    const uLong max_size = compressBound(chunk_bytes);
+    uint8_t* out = (uint8_t*)malloc(max_size + io_fletcher32_size);
+    if (out == NULL) error("Unable to allocate compressed chunk.");
+    if (deflateReset(&stream) != Z_OK)
+      error("Error while compressing chunk %zd.", chunk_id);
+    stream.next_in = shuffled;
+    stream.avail_in = chunk_bytes;
+    stream.next_out = out;
+    stream.avail_out = max_size;
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+      error("Error while compressing chunk %zd.", chunk_id);
+    const size_t compressed_size = stream.total_out;
+
+    /* Append the checksum of the compressed data (little-endian) */
+    const uint32_t sum = io_checksum_fletcher32(out, compressed_size);
+    out[compressed_size + 0] = sum & 0xff;
+    out[compressed_size + 1] = (sum >> 8) & 0xff;
+    out[compressed_size + 2] = (sum >> 16) & 0xff;
+    out[compressed_size + 3] = (sum >> 24) & 0xff;
+
+    /* Only keep the memory we actually need */
+    uint8_t* shrunk =
+        (uint8_t*)realloc(out, compressed_size + io_fletcher32_size);
+    if (shrunk != NULL) out = shrunk;
+
+    chunks[k].data = out;
+    chunks[k].size = compressed_size + io_fletcher32_size;
+  }
+
+  deflateEnd(&stream);
+  free(shuffled);
+}
+
+/**
+ * @brief Chooses the number of rows per chunk for a field compressed on the
+ * threadpool.
+ *
+ * We aim at a few chunks per thread to balance the work but keep chunks of
+ * at least 2^16 rows (and at most the usual 2^20) to retain a good
+ * compression ratio.
+ *
+ * @param N The number of rows in the field.
+ * @param nr_threads The number of threads in the pool.
+ */
+size_t io_compressed_chunk_length(const size_t N, const int nr_threads) {
+
+  size_t chunk_length = N / (4 * (size_t)nr_threads);
+  if (chunk_length > (1 << 20)) chunk_length = 1 << 20;
+  if (chunk_length < (1 << 16)) chunk_length = 1 << 16;
+  if (chunk_length > N) chunk_length = N;
+  return chunk_length;
+}
+
+/**
+ * @brief Runs the shuffle, deflate and Fletcher-32 filters on all the chunks
+ * of a field using the threadpool.
+ *
+ * The output is what HDF5 would store for a dataset created with
+ * H5Pset_shuffle(), H5Pset_deflate() and H5Pset_fletcher32() (in that order)
+ * and chunks of chunk_length rows.
+ *
+ * @param temp The field, already converted to snapshot units.
+ * @param N The number of rows in the field.
+ * @param dimension The number of elements per row.
+ * @param type The type of the elements.
+ * @param chunk_length The number of rows per chunk.
+ * @param gzip_level The deflate level.
+ * @param tp The #threadpool to use.
+ * @return The array of compressed chunks.
+ */
+struct io_chunk* io_compress_chunks(const void* temp, const size_t N,
+                                    const int dimension,
+                                    const enum IO_DATA_TYPE type,
+                                    const size_t chunk_length,
+                                    const int gzip_level,
+                                    struct threadpool* tp) {
+
+  const size_t num_chunks = (N + chunk_length - 1) / chunk_length;
+
+  struct io_chunk* chunks =
+      (struct io_chunk*)malloc(num_chunks * sizeof(struct io_chunk));
+  if (chunks == NULL) error("Unable to allocate compressed chunks list.");
+
+  struct io_compress_data data;
+  data.temp = (const char*)temp;
+  data.N = N;
+  data.chunk_length = chunk_length;
+  data.element_size = io_sizeof_type(type);
+  data.row_size = data.element_size * dimension;
+  data.gzip_level = gzip_level;
+  data.chunks = chunks;
+  data.slice_offsets = NULL;
+  data.chunk_slice = NULL;
+  data.slice_first_chunk = NULL;
+
+  threadpool_map(tp, io_compress_mapper, chunks, num_chunks,
+                 sizeof(struct io_chunk), /*chunk=*/1, &data);
+
+  return chunks;
+}
+
+/**
+ * @brief Number of rows per chunk of a slice compressed by
+ * io_compress_slices().
+ *
+ * @param N The number of rows in the slice.
+ * @param max_chunk_length The maximal number of rows per chunk.
+ */
+size_t io_slice_chunk_length(const size_t N, const size_t max_chunk_length) {
+  return N < max_chunk_length ? N : max_chunk_length;
+}
+
+/**
+ * @brief Runs the shuffle, deflate and Fletcher-32 filters on a field split
+ * into many small slices, each written as its own dataset, using the
+ * threadpool.
+ *
+ * Each slice of N rows is split into chunks of io_slice_chunk_length(N,
+ * max_chunk_length) rows. All the chunks of all the slices are compressed in
+ * one go, such that the threads are kept busy even when the individual slices
+ * are small. The chunks of slice i start at index first_chunk[i] of the
+ * returned array.
+ *
+ * @param temp The field, already converted to snapshot units.
+ * @param num_slices The number of slices.
+ * @param slice_offsets The first row of each slice (num_slices + 1 entries).
+ * @param dimension The number of elements per row.
+ * @param type The type of the elements.
+ * @param max_chunk_length The maximal number of rows per chunk.
+ * @param gzip_level The deflate level.
+ * @param tp The #threadpool to use.
+ * @param first_chunk (return) The index of the first chunk of each slice
+ * (num_slices + 1 entries).
+ * @return The array of compressed chunks.
+ */
+struct io_chunk* io_compress_slices(const void* temp, const size_t num_slices,
+                                    const size_t* slice_offsets,
+                                    const int dimension,
+                                    const enum IO_DATA_TYPE type,
+                                    const size_t max_chunk_length,
+                                    const int gzip_level,
+                                    struct threadpool* tp,
+                                    size_t* first_chunk) {
+
+  /* Count the chunks of each slice */
+  first_chunk[0] = 0;
+  for (size_t i = 0; i < num_slices; ++i) {
+    const size_t N = slice_offsets[i + 1] - slice_offsets[i];
+    const size_t chunk_length = io_slice_chunk_length(N, max_chunk_length);
+    const size_t num = N > 0 ? (N + chunk_length - 1) / chunk_length : 0;
+    first_chunk[i + 1] = first_chunk[i] + num;
+  }
+  const size_t num_chunks = first_chunk[num_slices];
+
+  struct io_chunk* chunks =
+      (struct io_chunk*)malloc(num_chunks * sizeof(struct io_chunk));
+  size_t* chunk_slice = (size_t*)malloc(num_chunks * sizeof(size_t));
+  if (chunks == NULL || chunk_slice == NULL)
+    error("Unable to allocate compressed chunks list.");
+  for (size_t i = 0; i < num_slices; ++i)
+    for (size_t k = first_chunk[i]; k < first_chunk[i + 1]; ++k)
+      chunk_slice[k] = i;
+
+  struct io_compress_data data;
+  data.temp = (const char*)temp;
+  data.N = slice_offsets[num_slices];
+  data.chunk_length = max_chunk_length;
+  data.element_size = io_sizeof_type(type);
+  data.row_size = data.element_size * dimension;
+  data.gzip_level = gzip_level;
+  data.chunks = chunks;
+  data.slice_offsets = slice_offsets;
+  data.chunk_slice = chunk_slice;
+  data.slice_first_chunk = first_chunk;
+
+  threadpool_map(tp, io_compress_mapper, chunks, num_chunks,
+                 sizeof(struct io_chunk), threadpool_auto_chunk_size, &data);
+
+  free(chunk_slice);
+  return chunks;
+}
+
+/**
+ * @brief Writes pre-compressed chunks to a dataset.
+ *
+ * The dataset must have been created with chunks of chunk_length rows and
+ * the filters applied by io_compress_chunks().
+ *
+ * @param h_data The HDF5 dataset.
+ * @param chunks The compressed chunks.
+ * @param N The number of rows in the field.
+ * @param chunk_length The number of rows per chunk.
+ */
+void io_write_compressed_chunks(hid_t h_data, const struct io_chunk* chunks,
+                                const size_t N, const size_t chunk_length) {
+
+  const size_t num_chunks = (N + chunk_length - 1) / chunk_length;
+
+  for (size_t i = 0; i < num_chunks; ++i) {
+    hsize_t offset[2] = {i * chunk_length, 0};
+    if (H5Dwrite_chunk(h_data, H5P_DEFAULT, /*filter_mask=*/0, offset,
+                       chunks[i].size, chunks[i].data) < 0)
+      error("Error while writing compressed chunk %zd.", i);
+  }
+}
+
+/**
+ * @brief Number of bytes held by the chunks returned by io_compress_chunks().
+ *
+ * @param chunks The compressed chunks.
+ * @param N The number of rows in the field.
+ * @param chunk_length The number of rows per chunk.
+ */
+size_t io_compressed_chunks_size(const struct io_chunk* chunks, const size_t N,
+                                 const size_t chunk_length) {
+
+  const size_t num_chunks = (N + chunk_length - 1) / chunk_length;
+  size_t size = num_chunks * sizeof(struct io_chunk);
+  for (size_t i = 0; i < num_chunks; ++i) size += chunks[i].size;
+  return size;
+}
+
+/**
+ * @brief Frees the chunks returned by io_compress_chunks().
+ *
+ * @param chunks The compressed chunks.
+ * @param N The number of rows in the field.
+ * @param chunk_length The number of rows per chunk.
+ */
+void io_free_compressed_chunks(struct io_chunk* chunks, const size_t N,
+                               const size_t chunk_length) {
+
+  const size_t num_chunks = (N + chunk_length - 1) / chunk_length;
+  for (size_t i = 0; i < num_chunks; ++i) free(chunks[i].data);
+  free(chunks);
+}
+
+#endif /* IO_THREADED_COMPRESSION */
+
+/**
+ * @brief Compresses a field on the threadpool if the snapshot settings allow
+ * it.
+ *
+ * This is only done for fields written with the lossless filters (shuffle,
+ * deflate and Fletcher-32) and if Snapshots:threaded_compression is set.
+ * Otherwise, the compression is left to the HDF5 library.
+ *
+ * @param e The #engine.
+ * @param temp The field, already converted to snapshot units.
+ * @param props The #io_props of the field.
+ * @param N The number of rows in the field.
+ * @param lossless Is the field free of any lossy filter?
+ * @param chunk_length (return) The number of rows per chunk.
+ * @return The compressed chunks or NULL if HDF5 has to do the work.
+ */
+struct io_chunk* io_compress_field(const struct engine* e, const void* temp,
+                                   const struct io_props props, const size_t N,
+                                   const int lossless, size_t* chunk_length) {
+
+  *chunk_length = 0;
+
+#if defined(IO_THREADED_COMPRESSION)
+  if (!e->snapshot_threaded_compression || e->snapshot_compression <= 0 ||
+      !lossless || N == 0)
+    return NULL;
+
+  *chunk_length = io_compressed_chunk_length(N, e->threadpool.num_threads);
+  return io_compress_chunks(temp, N, props.dimension, props.type,
+                            *chunk_length, e->snapshot_compression,
+                            (struct threadpool*)&e->threadpool);
+#else
+  return NULL;
+#endif
+}
+
+#endif /* HAVE_HDF5 */
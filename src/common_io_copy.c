@@ -23,9 +23,13 @@
 /* This object's header. */
 #include "common_io.h"
 
+/* Standard headers. */
+#include <math.h>
+
 /* Local includes. */
 #include "engine.h"
 #include "io_properties.h"
+#include "random.h"
 #include "threadpool.h"
 
 /**
@@ -751,3 +755,103 @@ void io_copy_temp_buffer(void* temp, const struct engine* e,
     }
   }
 }
+
+/**
+ * @brief Computes the random offset of the stratified subsample of a given
+ * particle type in a given snapshot.
+ */
+static double io_stratified_offset(const int ptype, const int snap_num) {
+  return random_unit_interval(ptype, snap_num,
+                              random_number_snapshot_sampling);
+}
+
+/**
+ * @brief Number of rows in the stratified subsample of an array.
+ *
+ * The subsample is drawn by systematic sampling along the array: with a
+ * random offset u, row i is kept iff floor((i + 1) * f + u) > floor(i * f +
+ * u). As the particles are written in the order of the cell tree, every
+ * region of the volume is represented in proportion to its content.
+ *
+ * @param N The number of rows of the full array.
+ * @param fraction The fraction f of rows to keep.
+ * @param ptype The particle type (used as random seed).
+ * @param snap_num The snapshot number (used as random seed).
+ */
+size_t io_stratified_subsample_count(const size_t N, const float fraction,
+                                     const int ptype, const int snap_num) {
+
+  if (fraction <= 0.f) return 0;
+  const double u = io_stratified_offset(ptype, snap_num);
+  return (size_t)floor(N * (double)fraction + u);
+}
+
+/**
+ * @brief Gathers the rows of the stratified subsample of an array already
+ * converted to snapshot units.
+ *
+ * See io_stratified_subsample_count() for the selection.
+ *
+ * @param dest The buffer to fill (of size io_stratified_subsample_count()
+ * rows).
+ * @param temp The full array.
+ * @param props The #io_props of the field.
+ * @param N The number of rows of the full array.
+ * @param fraction The fraction of rows to keep.
+ * @param ptype The particle type (used as random seed).
+ * @param snap_num The snapshot number (used as random seed).
+ */
+static void io_stratified_subsample_copy(void* dest, const void* temp,
+                                         const struct io_props props,
+                                         const size_t N, const float fraction,
+                                         const int ptype, const int snap_num) {
+
+  const size_t copySize = io_sizeof_type(props.type) * props.dimension;
+  const double u = io_stratified_offset(ptype, snap_num);
+  const double f = fraction;
+
+  char* dest_c = (char*)dest;
+  const char* temp_c = (const char*)temp;
+  double last = floor(u);
+  for (size_t i = 0; i < N; ++i) {
+    const double next = floor((i + 1) * f + u);
+    if (next > last) {
+      memcpy(dest_c, temp_c + i * copySize, copySize);
+      dest_c += copySize;
+    }
+    last = next;
+  }
+}
+
+/**
+ * @brief Extracts the stratified subsample of an array already converted to
+ * snapshot units.
+ *
+ * @param e The #engine we are writing from.
+ * @param temp The full array.
+ * @param props The #io_props of the field.
+ * @param N The number of particles in the full array.
+ * @param ptype The particle type.
+ * @param N_sub (return) The number of particles in the subsample.
+ *
+ * @return A newly allocated buffer with the subsample, to be freed with
+ * swift_free().
+ */
+void* io_stratified_subsample(const struct engine* e, const void* temp,
+                              const struct io_props props, const size_t N,
+                              const int ptype, size_t* N_sub) {
+
+  const float fraction = e->snapshot_stratified_fraction[ptype];
+  *N_sub = io_stratified_subsample_count(N, fraction, ptype,
+                                         e->snapshot_output_count);
+
+  void* temp_sub = NULL;
+  if (swift_memalign("writebuff", (void**)&temp_sub, IO_BUFFER_ALIGNMENT,
+                     *N_sub * io_sizeof_type(props.type) * props.dimension) !=
+      0)
+    error("Unable to allocate temporary i/o buffer");
+
+  io_stratified_subsample_copy(temp_sub, temp, props, N, fraction, ptype,
+                               e->snapshot_output_count);
+  return temp_sub;
+}
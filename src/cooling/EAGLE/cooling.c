@@ -42,6 +42,7 @@
 #include "exp10.h"
 #include "hydro.h"
 #include "interpolate.h"
+#include "io_async.h"
 #include "io_properties.h"
 #include "parser.h"
 #include "part.h"
@@ -57,6 +58,104 @@ static const float explicit_tolerance = 0.05;
 static const float bisection_tolerance = 1.0e-6;
 static const double bracket_factor = 1.5;
 
+/**
+ * @brief Per-particle state of a batch of particles cooled together by
+ * cooling_cool_part_batch().
+ *
+ * Every quantity is an array over the particles (lanes) of the batch.
+ */
+struct cooling_batch {
+
+  /*! Internal energy at the last kick (internal units) */
+  float u_start[cooling_batch_size];
+
+  /*! Change in internal energy due to hydro forces (internal units) */
+  float hydro_du_dt[cooling_batch_size];
+
+  /*! Internal energy at the end of the step without cooling (CGS) */
+  double u_0_cgs[cooling_batch_size];
+
+  /*! Cooling time-step (CGS) */
+  double dt_cgs[cooling_batch_size];
+
+  /*! Hydrogen number density (CGS) */
+  double n_H_cgs[cooling_batch_size];
+
+  /*! Multiplication factor to get a cooling rate (CGS) */
+  double ratefact_cgs[cooling_batch_size];
+
+  /*! Heating rate coming from He reionization (CGS) */
+  double Lambda_He_reion_cgs[cooling_batch_size];
+
+  /*! Index and offset along the density dimension of the tables */
+  int n_H_index[cooling_batch_size];
+  float d_n_H[cooling_batch_size];
+
+  /*! Index and offset along the Helium fraction dimension of the tables */
+  int He_index[cooling_batch_size];
+  float d_He[cooling_batch_size];
+
+  /*! Ratios of the element abundances to solar */
+  float abundance_ratio[cooling_batch_size][eagle_cooling_N_abundances];
+
+  /*! Bounds on the internal energy at the end of the step (CGS) */
+  double u_lower_cgs[cooling_batch_size];
+  double u_upper_cgs[cooling_batch_size];
+
+  /*! Energy at which the rate is evaluated next (CGS) */
+  double u_eval_cgs[cooling_batch_size];
+
+  /*! Net cooling rate at u_eval_cgs (CGS) */
+  double LambdaNet_cgs[cooling_batch_size];
+
+  /*! Internal energy at the end of the step (CGS) */
+  double u_final_cgs[cooling_batch_size];
+
+  /*! Number of iterations done in the current stage of the solver */
+  int iter[cooling_batch_size];
+
+  /*! Stage of the solver the particle is in */
+  char stage[cooling_batch_size];
+
+  /*! Is the particle cooling (as opposed to heating)? */
+  char is_cooling[cooling_batch_size];
+
+  /*! Does the rate of the particle need evaluating? */
+  char eval[cooling_batch_size];
+};
+
+/*! Stages of the batched solver */
+enum cooling_batch_stage {
+  cooling_batch_done = 0,
+  cooling_batch_bracket,
+  cooling_batch_bisect
+};
+
+/**
+ * @brief Compute the net cooling rate of the particles of a batch whose
+ * mask is set, at their energy u_eval_cgs.
+ *
+ * @param b The #cooling_batch.
+ * @param count The number of particles in the batch.
+ * @param redshift The current redshift.
+ * @param cooling The #cooling_function_data used in the run.
+ */
+static void cooling_batch_rates(struct cooling_batch *b, const int count,
+                                const double redshift,
+                                const struct cooling_function_data *cooling) {
+
+  for (int k = 0; k < count; k++) {
+    if (!b->eval[k]) continue;
+
+    b->LambdaNet_cgs[k] =
+        b->Lambda_He_reion_cgs[k] +
+        eagle_cooling_rate(log10(b->u_eval_cgs[k]), redshift, b->n_H_cgs[k],
+                           b->abundance_ratio[k], b->n_H_index[k],
+                           b->d_n_H[k], b->He_index[k], b->d_He[k], cooling);
+    b->eval[k] = 0;
+  }
+}
+
 /**
  * @brief Find the index of the current redshift along the redshift dimension
  * of the cooling tables.
@@ -163,6 +262,12 @@ void cooling_update(const struct phys_const *phys_const,
   /* Do we already have the correct tables loaded? */
   if (cooling->z_index == z_index) return;
 
+  /* Wait for the tables being read ahead of time */
+  io_async_wait(cooling->slab_reader);
+
+  /* The tables may be read while a snapshot is written asynchronously */
+  io_hdf5_lock();
+
   /* Which table should we load ? */
   if (z_index >= eagle_cooling_N_redshifts) {
 
@@ -186,8 +291,19 @@ void cooling_update(const struct phys_const *phys_const,
     get_cooling_table(cooling, low_z_index, high_z_index);
   }
 
+  io_hdf5_unlock();
+
   /* Store the currently loaded index */
   cooling->z_index = z_index;
+
+  /* Start reading the tables we will need next. As the redshift decreases,
+   * these are the ones of the redshift below the current ones, or the first
+   * two if we are still using the redshift invariant tables. */
+  if (z_index >= eagle_cooling_N_redshifts)
+    prefetch_cooling_tables(cooling, eagle_cooling_N_redshifts - 2,
+                            eagle_cooling_N_redshifts - 1);
+  else
+    prefetch_cooling_tables(cooling, z_index - 1, z_index - 1);
 }
 
 /**
@@ -530,6 +646,318 @@ void cooling_cool_part(const struct phys_const *phys_const,
       hydro_get_mass(p) * (cooling_du_dt - hydro_du_dt) * dt;
 }
 
+/**
+ * @brief Apply the cooling function to a batch of particles.
+ *
+ * This solves the same problem as cooling_cool_part() for up to
+ * #cooling_batch_size particles of a cell and gives the same results.
+ *
+ * The quantities that do not depend on the final energy are first gathered
+ * for all the particles into a #cooling_batch, with the table indices along
+ * the density and Helium fraction dimensions computed there once per
+ * particle and the time unit conversion once for the whole batch. The
+ * explicit step, the bracketing and the bisection are then run as passes
+ * over the lanes of the batch. Each pass only evaluates the rates of the
+ * lanes whose mask is set and the solver carries on until all the lanes have
+ * converged.
+ *
+ * @param phys_const The physical constants in internal units.
+ * @param us The internal system of units.
+ * @param cosmo The current cosmological model.
+ * @param hydro_properties the hydro_props struct
+ * @param floor_props Properties of the entropy floor.
+ * @param pressure_floor Properties of the pressure floor.
+ * @param cooling The #cooling_function_data used in the run.
+ * @param parts The particles of the cell.
+ * @param xparts The extended particle data of the cell.
+ * @param ind The indices in parts of the particles to cool.
+ * @param dt The cooling time-steps of the particles.
+ * @param dt_therm The hydro time-steps of the particles.
+ * @param count The number of particles to cool (at most #cooling_batch_size).
+ * @param time The current time (since the Big Bang or start of the run) in
+ * internal units.
+ */
+void cooling_cool_part_batch(
+    const struct phys_const *phys_const, const struct unit_system *us,
+    const struct cosmology *cosmo, const struct hydro_props *hydro_properties,
+    const struct entropy_floor_properties *floor_props,
+    const struct pressure_floor_props *pressure_floor,
+    const struct cooling_function_data *cooling, struct part *parts,
+    struct xpart *xparts, const int *ind, const float *dt,
+    const float *dt_therm, const int count, const double time) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (count > cooling_batch_size) error("Too many particles in the batch.");
+  if (cooling->Redshifts == NULL)
+    error(
+        "Cooling function has not been initialised. Did you forget the "
+        "--cooling runtime flag?");
+#endif
+
+  struct cooling_batch b;
+
+  /* Quantities shared by the whole batch */
+  const double time_to_cgs = units_cgs_conversion_factor(us, UNIT_CONV_TIME);
+  const double redshift = cosmo->z;
+
+  /*************************************/
+  /* Gather the particles              */
+  /*************************************/
+
+  for (int k = 0; k < count; k++) {
+
+    const struct part *restrict p = &parts[ind[k]];
+    const struct xpart *restrict xp = &xparts[ind[k]];
+
+    /* No cooling happens over zero time */
+    b.eval[k] = 0;
+    b.stage[k] = cooling_batch_done;
+    if (dt[k] == 0.) continue;
+
+    /* Get internal energy at the last kick step */
+    const float u_start = hydro_get_physical_internal_energy(p, xp, cosmo);
+
+    /* Get the change in internal energy due to hydro forces */
+    const float hydro_du_dt = hydro_get_physical_internal_energy_dt(p, cosmo);
+
+    /* Get internal energy at the end of the step (assuming dt does not
+     * increase) */
+    double u_0 = (u_start + hydro_du_dt * dt_therm[k]);
+
+    /* Check for minimal energy */
+    u_0 = max(u_0, hydro_properties->minimal_internal_energy);
+
+    /* Convert to CGS units */
+    const double u_0_cgs = u_0 * cooling->internal_energy_to_cgs;
+    const double dt_cgs = dt[k] * time_to_cgs;
+
+    /* Change in redshift over the course of this time-step */
+    const double delta_redshift = -dt[k] * cosmo->H * cosmo->a_inv;
+
+    /* Get this particle's abundance ratios compared to solar */
+    abundance_ratio_to_solar(p, cooling, b.abundance_ratio[k]);
+
+    /* Get the Hydrogen and Helium mass fractions */
+    const float *const metal_fraction =
+        chemistry_get_metal_mass_fraction_for_cooling(p);
+    const float XH = metal_fraction[chemistry_element_H];
+    const float XHe = metal_fraction[chemistry_element_He];
+
+    /* Metal-free Helium mass fraction (Wiersma+08 definition) */
+    const float HeFrac = XHe / (XH + XHe);
+
+    /* convert Hydrogen mass fraction into physical Hydrogen number density */
+    const double n_H = hydro_get_physical_density(p, cosmo) * XH /
+                       phys_const->const_proton_mass;
+    const double n_H_cgs = n_H * cooling->number_density_to_cgs;
+
+    /* ratefact = n_H * n_H / rho */
+    const double ratefact_cgs = n_H_cgs * (XH * cooling->inv_proton_mass_cgs);
+
+    /* Table indices and offsets along the Helium fraction and density
+     * dimensions. These are fixed for any value of u. */
+    get_index_1d(cooling->HeFrac, eagle_cooling_N_He_frac, HeFrac,
+                 &b.He_index[k], &b.d_He[k]);
+    get_index_1d(cooling->nH, eagle_cooling_N_density, log10(n_H_cgs),
+                 &b.n_H_index[k], &b.d_n_H[k]);
+
+    /* Heating rate from Helium re-ionization */
+    const double Helium_reion_heat_cgs =
+        eagle_helium_reionization_extraheat(redshift, delta_redshift, cooling);
+
+    b.u_start[k] = u_start;
+    b.hydro_du_dt[k] = hydro_du_dt;
+    b.u_0_cgs[k] = u_0_cgs;
+    b.dt_cgs[k] = dt_cgs;
+    b.n_H_cgs[k] = n_H_cgs;
+    b.ratefact_cgs[k] = ratefact_cgs;
+    b.Lambda_He_reion_cgs[k] = Helium_reion_heat_cgs / (dt_cgs * ratefact_cgs);
+
+    /* The explicit step needs the rate at the initial energy */
+    b.u_eval_cgs[k] = u_0_cgs;
+    b.eval[k] = 1;
+  }
+
+  /*************************************/
+  /* Explicit integration              */
+  /*************************************/
+
+  cooling_batch_rates(&b, count, redshift, cooling);
+
+  for (int k = 0; k < count; k++) {
+    if (dt[k] == 0.) continue;
+
+    const double u_0_cgs = b.u_0_cgs[k];
+    const double rate = b.ratefact_cgs[k] * b.LambdaNet_cgs[k] * b.dt_cgs[k];
+
+    /* if cooling rate is small, take the explicit solution */
+    if (fabs(rate) < explicit_tolerance * u_0_cgs) {
+      b.u_final_cgs[k] = u_0_cgs + rate;
+      continue;
+    }
+
+    /* Otherwise, bracket the solution starting from the same first guess as
+     * bisection_iter(), i.e. the rate we just computed. */
+    b.stage[k] = cooling_batch_bracket;
+    b.is_cooling[k] = (b.LambdaNet_cgs[k] < 0);
+    b.iter[k] = 0;
+    b.u_lower_cgs[k] = u_0_cgs / bracket_factor;
+    b.u_upper_cgs[k] = u_0_cgs * bracket_factor;
+    b.u_eval_cgs[k] = b.is_cooling[k] ? b.u_lower_cgs[k] : b.u_upper_cgs[k];
+    b.eval[k] = 1;
+  }
+
+  /*************************************/
+  /* Bracket the solutions             */
+  /*************************************/
+
+  int still_active;
+  do {
+
+    cooling_batch_rates(&b, count, redshift, cooling);
+
+    still_active = 0;
+    for (int k = 0; k < count; k++) {
+      if (b.stage[k] != cooling_batch_bracket) continue;
+
+      const double u_0_cgs = b.u_0_cgs[k];
+      const double rate_dt =
+          b.LambdaNet_cgs[k] * b.ratefact_cgs[k] * b.dt_cgs[k];
+
+      /* Is the bracket still on the wrong side of the solution? */
+      const int shift = b.is_cooling[k]
+                            ? (b.u_lower_cgs[k] - u_0_cgs - rate_dt > 0)
+                            : (b.u_upper_cgs[k] - u_0_cgs - rate_dt < 0);
+
+      if (shift && b.iter[k] < bisection_max_iterations) {
+
+        if (b.is_cooling[k]) {
+          b.u_lower_cgs[k] /= bracket_factor;
+          b.u_upper_cgs[k] /= bracket_factor;
+          b.u_eval_cgs[k] = b.u_lower_cgs[k];
+        } else {
+          b.u_lower_cgs[k] *= bracket_factor;
+          b.u_upper_cgs[k] *= bracket_factor;
+          b.u_eval_cgs[k] = b.u_upper_cgs[k];
+        }
+        b.eval[k] = 1;
+        b.iter[k]++;
+        still_active = 1;
+
+      } else {
+
+        if (b.iter[k] >= bisection_max_iterations)
+          error(
+              "particle %llu exceeded max iterations searching for bounds "
+              "when %s, u_ini_cgs %.5e n_H_cgs %.5e",
+              parts[ind[k]].id, b.is_cooling[k] ? "cooling" : "heating",
+              u_0_cgs, b.n_H_cgs[k]);
+
+        /* We now have an upper and lower bound. */
+        b.stage[k] = cooling_batch_bisect;
+        b.iter[k] = 0;
+      }
+    }
+  } while (still_active);
+
+  /********************************************/
+  /* Iterate by reducing the bracketing       */
+  /********************************************/
+
+  do {
+
+    for (int k = 0; k < count; k++) {
+      if (b.stage[k] != cooling_batch_bisect) continue;
+
+      /* New guess */
+      b.u_eval_cgs[k] = 0.5 * (b.u_lower_cgs[k] + b.u_upper_cgs[k]);
+      b.eval[k] = 1;
+    }
+
+    cooling_batch_rates(&b, count, redshift, cooling);
+
+    still_active = 0;
+    for (int k = 0; k < count; k++) {
+      if (b.stage[k] != cooling_batch_bisect) continue;
+
+      const double u_next_cgs = b.u_eval_cgs[k];
+
+#ifdef SWIFT_DEBUG_CHECKS
+      if (u_next_cgs <= 0)
+        error(
+            "Got negative energy! u_next_cgs=%.5e u_upper=%.5e u_lower=%.5e "
+            "Lambda=%.5e",
+            u_next_cgs, b.u_upper_cgs[k], b.u_lower_cgs[k],
+            b.LambdaNet_cgs[k]);
+#endif
+
+      /* Where do we go next? */
+      if (u_next_cgs - b.u_0_cgs[k] -
+              b.LambdaNet_cgs[k] * b.ratefact_cgs[k] * b.dt_cgs[k] >
+          0.0) {
+        b.u_upper_cgs[k] = u_next_cgs;
+      } else {
+        b.u_lower_cgs[k] = u_next_cgs;
+      }
+
+      b.iter[k]++;
+
+      if (fabs(b.u_upper_cgs[k] - b.u_lower_cgs[k]) / u_next_cgs >
+              bisection_tolerance &&
+          b.iter[k] < bisection_max_iterations) {
+        still_active = 1;
+      } else {
+        if (b.iter[k] >= bisection_max_iterations)
+          error("Particle id %llu failed to converge", parts[ind[k]].id);
+
+        b.u_final_cgs[k] = b.u_upper_cgs[k];
+        b.stage[k] = cooling_batch_done;
+      }
+    }
+  } while (still_active);
+
+  /*************************************/
+  /* Update the particles              */
+  /*************************************/
+
+  for (int k = 0; k < count; k++) {
+    if (dt[k] == 0.) continue;
+
+    struct part *restrict p = &parts[ind[k]];
+    struct xpart *restrict xp = &xparts[ind[k]];
+    const float u_start = b.u_start[k];
+    const float hydro_du_dt = b.hydro_du_dt[k];
+
+    /* Convert back to internal units */
+    double u_final = b.u_final_cgs[k] * cooling->internal_energy_from_cgs;
+
+    /* Absolute minimum */
+    const double u_minimal = hydro_properties->minimal_internal_energy;
+    u_final = max(u_final, u_minimal);
+
+    /* Limit imposed by the entropy floor */
+    const double A_floor = entropy_floor(p, cosmo, floor_props);
+    const double rho_physical = hydro_get_physical_density(p, cosmo);
+    const double u_floor =
+        gas_internal_energy_from_entropy(rho_physical, A_floor);
+    u_final = max(u_final, u_floor);
+
+    /* Expected change in energy over the next kick step
+       (assuming no change in dt) */
+    const double delta_u = u_final - max(u_start, u_floor);
+
+    /* Turn this into a rate of change (including cosmology term) */
+    const float cooling_du_dt = delta_u / dt_therm[k];
+
+    /* Update the internal energy time derivative */
+    hydro_set_physical_internal_energy_dt(p, cosmo, cooling_du_dt);
+
+    /* Store the radiated energy */
+    xp->cooling_data.radiated_energy -=
+        hydro_get_mass(p) * (cooling_du_dt - hydro_du_dt) * dt[k];
+  }
+}
+
 /**
  * @brief Computes the cooling time-step.
  *
@@ -1147,6 +1575,9 @@ void cooling_clean(struct cooling_function_data *cooling) {
   swift_free("cooling-tables", cooling->table.temperature);
   swift_free("cooling-tables", cooling->table.H_plus_He_heating);
   swift_free("cooling-tables", cooling->table.H_plus_He_electron_abundance);
+
+  /* Free the tables of single redshifts */
+  clean_cooling_tables(cooling);
 }
 
 /**
@@ -1173,6 +1604,15 @@ void cooling_struct_dump(const struct cooling_function_data *cooling,
   cooling_copy.table.H_plus_He_electron_abundance = NULL;
   cooling_copy.table.temperature = NULL;
   cooling_copy.table.electron_abundance = NULL;
+  for (int i = 0; i < eagle_cooling_N_slabs; i++) {
+    cooling_copy.slabs[i].metal_heating = NULL;
+    cooling_copy.slabs[i].H_plus_He_heating = NULL;
+    cooling_copy.slabs[i].H_plus_He_electron_abundance = NULL;
+    cooling_copy.slabs[i].temperature = NULL;
+    cooling_copy.slabs[i].electron_abundance = NULL;
+  }
+  cooling_copy.slab_segment.data = NULL;
+  cooling_copy.slab_reader = NULL;
 
   restart_write_blocks((void *)&cooling_copy,
                        sizeof(struct cooling_function_data), 1, stream,
@@ -19,8 +19,17 @@
 #ifndef SWIFT_COOLING_PROPERTIES_EAGLE_H
 #define SWIFT_COOLING_PROPERTIES_EAGLE_H
 
+/* Local includes. */
+#include "shared_table.h"
+
 #define eagle_table_path_name_length 500
 
+/*! Number of single-redshift tables kept in memory */
+#define eagle_cooling_N_slabs 2
+
+/* Forward declarations */
+struct io_async;
+
 /**
  * @brief struct containing cooling tables
  */
@@ -42,6 +51,35 @@ struct cooling_tables {
   float *electron_abundance;
 };
 
+/**
+ * @brief The cooling tables of a single redshift, as read from the files.
+ *
+ * The tables of the two redshifts bracketing the current one are combined
+ * into the #cooling_tables used by the cooling routines.
+ */
+struct cooling_slab {
+
+  /*! Index of the tables along the redshift axis (-1 if none) */
+  int z_index;
+
+  /* array of heating rates due to metals (density, temperature, metal) */
+  float *metal_heating;
+
+  /* array of heating rates due to hydrogen and helium (density, helium
+   * fraction, temperature) */
+  float *H_plus_He_heating;
+
+  /* array of electron abundances due to hydrogen and helium (density, helium
+   * fraction, temperature) */
+  float *H_plus_He_electron_abundance;
+
+  /* array of temperatures (density, helium fraction, internal energy) */
+  float *temperature;
+
+  /* array of electron abundances due to metals (density, temperature) */
+  float *electron_abundance;
+};
+
 /**
  * @brief Properties of the cooling function.
  */
@@ -127,6 +165,16 @@ struct cooling_function_data {
   /*! Index of the previous tables along the redshift index of the tables */
   int previous_z_index;
 
+  /*! Tables of single redshifts read from the files */
+  struct cooling_slab slabs[eagle_cooling_N_slabs];
+
+  /*! Node-wide memory holding the arrays of all the slabs */
+  struct shared_table slab_segment;
+
+  /*! Thread reading the tables of the next redshift in the background (NULL
+   * on the ranks that do not fill the slabs) */
+  struct io_async *slab_reader;
+
   /*! Dummy temporary value to compile the new temporary (?) BH model */
   float dlogT_EOS;
 };
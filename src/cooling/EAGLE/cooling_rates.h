@@ -144,10 +144,10 @@ eagle_helium_reionization_extraheat(
  *
  * For the low-z case, we interpolate the flattened 4D table 'u_to_temp' that
  * is arranged in the following way:
- * - 1st dim: redshift, length = eagle_cooling_N_loaded_redshifts
- * - 2nd dim: Hydrogen density, length = eagle_cooling_N_density
- * - 3rd dim: Helium fraction, length = eagle_cooling_N_He_frac
- * - 4th dim: Internal energy, length = eagle_cooling_N_temperature
+ * - 1st dim: Hydrogen density, length = eagle_cooling_N_density
+ * - 2nd dim: Helium fraction, length = eagle_cooling_N_He_frac
+ * - 3rd dim: Internal energy, length = eagle_cooling_N_temperature
+ * - 4th dim: redshift, length = eagle_cooling_N_loaded_redshifts
  *
  * For the high-z case, we interpolate the flattened 3D table 'u_to_temp' that
  * is arranged in the following way:
@@ -190,14 +190,14 @@ __attribute__((always_inline)) INLINE double eagle_convert_u_to_temp(
                                 eagle_cooling_N_temperature); /* */
   } else {
 
-    log_10_T =
-        interpolation_4d(cooling->table.temperature,                  /* */
-                         /*z_index=*/0, n_H_index, He_index, u_index, /* */
-                         cooling->dz, d_n_H, d_He, d_u,               /* */
-                         eagle_cooling_N_loaded_redshifts,            /* */
-                         eagle_cooling_N_density,                     /* */
-                         eagle_cooling_N_He_frac,                     /* */
-                         eagle_cooling_N_temperature);                /* */
+    log_10_T = interpolation_4d_strided(
+        cooling->table.temperature,                  /* */
+        /*z_index=*/0, n_H_index, He_index, u_index, /* */
+        cooling->dz, d_n_H, d_He, d_u,               /* */
+        eagle_cooling_HpHe_stride_z,                 /* */
+        eagle_cooling_HpHe_stride_nH,                /* */
+        eagle_cooling_HpHe_stride_He,                /* */
+        eagle_cooling_HpHe_stride_T);                /* */
   }
 
   /* Special case for temperatures below the start of the table */
@@ -248,38 +248,42 @@ __attribute__((always_inline)) INLINE double eagle_Compton_cooling_rate(
  * 1) Metal-free cooling:
  * We interpolate the flattened 4D table 'H_and_He_net_heating' that is
  * arranged in the following way:
- * - 1st dim: redshift, length = eagle_cooling_N_loaded_redshifts
- * - 2nd dim: Hydrogen density, length = eagle_cooling_N_density
- * - 3rd dim: Helium fraction, length = eagle_cooling_N_He_frac
- * - 4th dim: Internal energy, length = eagle_cooling_N_temperature
+ * - 1st dim: Hydrogen density, length = eagle_cooling_N_density
+ * - 2nd dim: Helium fraction, length = eagle_cooling_N_He_frac
+ * - 3rd dim: Temperature, length = eagle_cooling_N_temperature
+ * - 4th dim: redshift, length = eagle_cooling_N_loaded_redshifts
  *
  * 2) Electron abundance
  * We compute the electron abundance by interpolating the flattened 4d table
  * 'H_and_He_electron_abundance' that is arranged in the following way:
- * - 1st dim: redshift, length = eagle_cooling_N_loaded_redshifts
- * - 2nd dim: Hydrogen density, length = eagle_cooling_N_density
- * - 3rd dim: Helium fraction, length = eagle_cooling_N_He_frac
- * - 4th dim: Internal energy, length = eagle_cooling_N_temperature
+ * - 1st dim: Hydrogen density, length = eagle_cooling_N_density
+ * - 2nd dim: Helium fraction, length = eagle_cooling_N_He_frac
+ * - 3rd dim: Temperature, length = eagle_cooling_N_temperature
+ * - 4th dim: redshift, length = eagle_cooling_N_loaded_redshifts
  *
  * 3) Compton cooling is applied via the analytic formula.
  *
  * 4) Solar electron abudance
  * We compute the solar electron abundance by interpolating the flattened 3d
  * table 'solar_electron_abundance' that is arranged in the following way:
- * - 1st dim: redshift, length = eagle_cooling_N_loaded_redshifts
- * - 2nd dim: Hydrogen density, length = eagle_cooling_N_density
- * - 3rd dim: Internal energy, length = eagle_cooling_N_temperature
+ * - 1st dim: Hydrogen density, length = eagle_cooling_N_density
+ * - 2nd dim: Temperature, length = eagle_cooling_N_temperature
+ * - 3rd dim: redshift, length = eagle_cooling_N_loaded_redshifts
  *
  * 5) Metal-line cooling
  * For each tracked element we interpolate the flattened 4D table
  * 'table_metals_net_heating' that is arrange in the following way:
- * - 1st dim: element, length = eagle_cooling_N_metal
- * - 2nd dim: redshift, length = eagle_cooling_N_loaded_redshifts
- * - 3rd dim: Hydrogen density, length = eagle_cooling_N_density
- * - 4th dim: Internal energy, length = eagle_cooling_N_temperature
+ * - 1st dim: Hydrogen density, length = eagle_cooling_N_density
+ * - 2nd dim: Temperature, length = eagle_cooling_N_temperature
+ * - 3rd dim: redshift, length = eagle_cooling_N_loaded_redshifts
+ * - 4th dim: element, length = eagle_cooling_N_metal
+ *
+ * These are the layouts used below the redshift of the first table. Above
+ * it, the redshift invariant tables have no redshift dimension and use the
+ * order of the other dimensions as read from the files.
  *
  * Note that this is a fake 4D interpolation as we do not interpolate
- * along the 1st dimension. We just do this once per element.
+ * along the element dimension. We just do this once per element.
  *
  * Since only the temperature changes when cooling a given particle,
  * the redshift, hydrogen number density and helium fraction indices
@@ -339,14 +343,14 @@ INLINE static double eagle_metal_cooling_rate(
   } else {
 
     /* Using normal tables, have to interpolate in redshift */
-    Lambda_free =
-        interpolation_4d(cooling->table.H_plus_He_heating,            /* */
-                         /*z_index=*/0, n_H_index, He_index, T_index, /* */
-                         cooling->dz, d_n_H, d_He, d_T,               /* */
-                         eagle_cooling_N_loaded_redshifts,            /* */
-                         eagle_cooling_N_density,                     /* */
-                         eagle_cooling_N_He_frac,                     /* */
-                         eagle_cooling_N_temperature);                /* */
+    Lambda_free = interpolation_4d_strided(
+        cooling->table.H_plus_He_heating,            /* */
+        /*z_index=*/0, n_H_index, He_index, T_index, /* */
+        cooling->dz, d_n_H, d_He, d_T,               /* */
+        eagle_cooling_HpHe_stride_z,                 /* */
+        eagle_cooling_HpHe_stride_nH,                /* */
+        eagle_cooling_HpHe_stride_He,                /* */
+        eagle_cooling_HpHe_stride_T);                /* */
   }
 
   /* If we're testing cooling rate contributions write to array */
@@ -372,14 +376,14 @@ INLINE static double eagle_metal_cooling_rate(
 
   } else {
 
-    H_plus_He_electron_abundance =
-        interpolation_4d(cooling->table.H_plus_He_electron_abundance, /* */
-                         /*z_index=*/0, n_H_index, He_index, T_index, /* */
-                         cooling->dz, d_n_H, d_He, d_T,               /* */
-                         eagle_cooling_N_loaded_redshifts,            /* */
-                         eagle_cooling_N_density,                     /* */
-                         eagle_cooling_N_He_frac,                     /* */
-                         eagle_cooling_N_temperature);                /* */
+    H_plus_He_electron_abundance = interpolation_4d_strided(
+        cooling->table.H_plus_He_electron_abundance, /* */
+        /*z_index=*/0, n_H_index, He_index, T_index, /* */
+        cooling->dz, d_n_H, d_He, d_T,               /* */
+        eagle_cooling_HpHe_stride_z,                 /* */
+        eagle_cooling_HpHe_stride_nH,                /* */
+        eagle_cooling_HpHe_stride_He,                /* */
+        eagle_cooling_HpHe_stride_T);                /* */
   }
 
   /**********************/
@@ -425,13 +429,13 @@ INLINE static double eagle_metal_cooling_rate(
   } else {
 
     /* Using normal tables, have to interpolate in redshift */
-    solar_electron_abundance =
-        interpolation_3d(cooling->table.electron_abundance, /* */
-                         /*z_index=*/0, n_H_index, T_index, /* */
-                         cooling->dz, d_n_H, d_T,           /* */
-                         eagle_cooling_N_loaded_redshifts,  /* */
-                         eagle_cooling_N_density,           /* */
-                         eagle_cooling_N_temperature);      /* */
+    solar_electron_abundance = interpolation_3d_strided(
+        cooling->table.electron_abundance, /* */
+        /*z_index=*/0, n_H_index, T_index, /* */
+        cooling->dz, d_n_H, d_T,           /* */
+        eagle_cooling_elec_stride_z,       /* */
+        eagle_cooling_elec_stride_nH,      /* */
+        eagle_cooling_elec_stride_T);      /* */
   }
 
   const double electron_abundance_ratio =
@@ -478,14 +482,14 @@ INLINE static double eagle_metal_cooling_rate(
 
         /* Note that we do not interpolate along the x-axis
          * (element dimension) */
-        lambda_metal[elem] = interpolation_4d_no_x(
+        lambda_metal[elem] = interpolation_4d_no_x_strided(
             cooling->table.metal_heating,                /* */
             elem - 2, /*z_index=*/0, n_H_index, T_index, /* */
             /*delta_elem=*/0.f, cooling->dz, d_n_H, d_T, /* */
-            eagle_cooling_N_metal,                       /* */
-            eagle_cooling_N_loaded_redshifts,            /* */
-            eagle_cooling_N_density,                     /* */
-            eagle_cooling_N_temperature);                /* */
+            eagle_cooling_metal_stride_elem,             /* */
+            eagle_cooling_metal_stride_z,                /* */
+            eagle_cooling_metal_stride_nH,               /* */
+            eagle_cooling_metal_stride_T);               /* */
 
         lambda_metal[elem] *= electron_abundance_ratio;
         lambda_metal[elem] *= solar_ratio[elem];
@@ -37,6 +37,8 @@
 #include "cooling_tables.h"
 #include "error.h"
 #include "interpolate.h"
+#include "io_async.h"
+#include "minmax.h"
 
 /**
  * @brief Names of the elements in the order they are stored in the files
@@ -351,6 +353,68 @@ void allocate_cooling_tables(struct cooling_function_data *restrict cooling) {
                          num_elements_HpHe_electron_abundance *
                          sizeof(float)) != 0)
     error("Failed to allocate H_plus_He_electron_abundance array");
+
+  /* Allocate the tables of single redshifts. All the arrays of all the slabs
+   * are stored in one block (their sizes are multiples of the alignment)
+   * shared by the ranks of the node. Only one of them reads the files. */
+  const size_t slab_size =
+      num_elements_metal_heating + num_elements_HpHe_heating +
+      num_elements_HpHe_electron_abundance + num_elements_temperature +
+      num_elements_electron_abundance;
+
+  float *segment = (float *)shared_table_alloc(
+      &cooling->slab_segment, "cooling-tables",
+      eagle_cooling_N_slabs * slab_size * sizeof(float));
+
+  for (int i = 0; i < eagle_cooling_N_slabs; i++) {
+
+    struct cooling_slab *slab = &cooling->slabs[i];
+    float *block = segment + i * slab_size;
+
+    slab->z_index = -1;
+    slab->metal_heating = block;
+    slab->H_plus_He_heating = slab->metal_heating + num_elements_metal_heating;
+    slab->H_plus_He_electron_abundance =
+        slab->H_plus_He_heating + num_elements_HpHe_heating;
+    slab->temperature = slab->H_plus_He_electron_abundance +
+                        num_elements_HpHe_electron_abundance;
+    slab->electron_abundance = slab->temperature + num_elements_temperature;
+  }
+
+  /* Start the thread reading the tables ahead of time */
+  cooling->slab_reader = NULL;
+  if (shared_table_is_writer(&cooling->slab_segment)) {
+    cooling->slab_reader = (struct io_async *)malloc(sizeof(struct io_async));
+    if (cooling->slab_reader == NULL)
+      error("Failed to allocate cooling table reader");
+    io_async_init(cooling->slab_reader, /*budget=*/0);
+  }
+}
+
+/**
+ * @brief Free the tables of single redshifts and stop the thread reading
+ * them.
+ *
+ * @param cooling #cooling_function_data structure
+ */
+void clean_cooling_tables(struct cooling_function_data *restrict cooling) {
+
+  /* Finish any pending read */
+  if (cooling->slab_reader != NULL) {
+    io_async_clean(cooling->slab_reader, /*verbose=*/0);
+    free(cooling->slab_reader);
+    cooling->slab_reader = NULL;
+  }
+
+  shared_table_free(&cooling->slab_segment, "cooling-tables");
+  for (int i = 0; i < eagle_cooling_N_slabs; i++) {
+    cooling->slabs[i].z_index = -1;
+    cooling->slabs[i].metal_heating = NULL;
+    cooling->slabs[i].H_plus_He_heating = NULL;
+    cooling->slabs[i].H_plus_He_electron_abundance = NULL;
+    cooling->slabs[i].temperature = NULL;
+    cooling->slabs[i].electron_abundance = NULL;
+  }
 }
 
 /**
@@ -556,10 +620,12 @@ void get_redshift_invariant_table(
 #endif
 }
 
+
 /**
- * @brief Get redshift dependent table of cooling rates.
- * Reads in table of cooling rates and electron abundances due to
- * metals (depending on temperature, hydrogen number density), cooling rates and
+ * @brief Read the tables of a single redshift.
+ *
+ * Reads in table of cooling rates and electron abundances due to metals
+ * (depending on temperature, hydrogen number density), cooling rates and
  * electron abundances due to hydrogen and helium (depending on temperature,
  * hydrogen number density and helium fraction), and temperatures (depending on
  * internal energy, hydrogen number density and helium fraction; note: this is
@@ -567,12 +633,21 @@ void get_redshift_invariant_table(
  * is used to index the cooling, electron abundance tables, whereas this one is
  * used to obtain temperature of particle)
  *
+ * The caller must hold the HDF5 lock. Only the rank filling the shared
+ * slabs reads the files, the others only record which redshift the slab
+ * holds.
+ *
  * @param cooling #cooling_function_data structure
- * @param low_z_index Index of the lowest redshift table to load.
- * @param high_z_index Index of the highest redshift table to load.
+ * @param z_index Index of the redshift of the tables to read.
+ * @param slab (return) The #cooling_slab to fill.
  */
-void get_cooling_table(struct cooling_function_data *restrict cooling,
-                       const int low_z_index, const int high_z_index) {
+static void read_cooling_slab(const struct cooling_function_data *cooling,
+                              const int z_index, struct cooling_slab *slab) {
+
+  if (!shared_table_is_writer(&cooling->slab_segment)) {
+    slab->z_index = z_index;
+    return;
+  }
 
 #ifdef HAVE_HDF5
 
@@ -605,169 +680,381 @@ void get_cooling_table(struct cooling_function_data *restrict cooling,
                      num_elements_HpHe_electron_abundance * sizeof(float)) != 0)
     error("Failed to allocate he_electron_abundance array");
 
-  /* Read in tables, transpose so that values for indices which vary most are
-   * adjacent. Repeat for redshift above and redshift below current value.  */
-  for (int z_index = low_z_index; z_index <= high_z_index; z_index++) {
+  /* Open table for this redshift index */
+  char fname[eagle_table_path_name_length + 12];
+  sprintf(fname, "%sz_%1.3f.hdf5", cooling->cooling_table_path,
+          cooling->Redshifts[z_index]);
+  message("Reading cooling table 'z_%1.3f.hdf5'", cooling->Redshifts[z_index]);
 
-    /* Index along redhsift dimension for the subset of tables we read */
-    const int local_z_index = z_index - low_z_index;
-
-#ifdef SWIFT_DEBUG_CHECKS
-    if (local_z_index >= eagle_cooling_N_loaded_redshifts)
-      error("Reading invalid number of tables along z axis.");
-#endif
-
-    /* Open table for this redshift index */
-    char fname[eagle_table_path_name_length + 12];
-    sprintf(fname, "%sz_%1.3f.hdf5", cooling->cooling_table_path,
-            cooling->Redshifts[z_index]);
-    message("Reading cooling table 'z_%1.3f.hdf5'",
-            cooling->Redshifts[z_index]);
-
-    hid_t file_id = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
-    if (file_id < 0) error("unable to open file %s", fname);
-
-    char set_name[64];
-
-    /* read in cooling rates due to metals */
-    for (int specs = 0; specs < eagle_cooling_N_metal; specs++) {
-
-      sprintf(set_name, "/%s/Net_Cooling", eagle_tables_element_names[specs]);
-      hid_t dataset = H5Dopen(file_id, set_name, H5P_DEFAULT);
-      herr_t status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL,
-                              H5P_DEFAULT, net_cooling_rate);
-      if (status < 0) error("error reading metal cooling rate table");
-      status = H5Dclose(dataset);
-      if (status < 0) error("error closing cooling dataset");
-
-      /* Transpose from order tables are stored in (temperature, nH)
-       * to (metal species, redshift, nH, temperature) where fastest
-       * varying index is on right. Tables contain cooling rates but we
-       * want rate of change of internal energy, hence minus sign. */
-      for (int i = 0; i < eagle_cooling_N_density; i++) {
-        for (int j = 0; j < eagle_cooling_N_temperature; j++) {
+  hid_t file_id = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file_id < 0) error("unable to open file %s", fname);
 
-          /* Index in the HDF5 table */
-          const int hdf5_index = row_major_index_2d(
-              j, i, eagle_cooling_N_temperature, eagle_cooling_N_density);
-
-          /* Index in the internal table */
-          const int internal_index = row_major_index_4d(
-              specs, local_z_index, i, j, eagle_cooling_N_metal,
-              eagle_cooling_N_loaded_redshifts, eagle_cooling_N_density,
-              eagle_cooling_N_temperature);
+  char set_name[64];
 
-          /* Change the sign and transpose */
-          cooling->table.metal_heating[internal_index] =
-              -net_cooling_rate[hdf5_index];
-        }
-      }
-    }
+  /* read in cooling rates due to metals */
+  for (int specs = 0; specs < eagle_cooling_N_metal; specs++) {
 
-    /* read in cooling rates due to H + He */
-    strcpy(set_name, "/Metal_free/Net_Cooling");
+    sprintf(set_name, "/%s/Net_Cooling", eagle_tables_element_names[specs]);
     hid_t dataset = H5Dopen(file_id, set_name, H5P_DEFAULT);
     herr_t status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL,
-                            H5P_DEFAULT, he_net_cooling_rate);
-    if (status < 0) error("error reading metal free cooling rate table");
-    status = H5Dclose(dataset);
-    if (status < 0) error("error closing cooling dataset");
-
-    /* read in Temperature */
-    strcpy(set_name, "/Metal_free/Temperature/Temperature");
-    dataset = H5Dopen(file_id, set_name, H5P_DEFAULT);
-    status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                     temperature);
-    if (status < 0) error("error reading temperature table");
-    status = H5Dclose(dataset);
-    if (status < 0) error("error closing cooling dataset");
-
-    /* Read in H + He electron abundance */
-    strcpy(set_name, "/Metal_free/Electron_density_over_n_h");
-    dataset = H5Dopen(file_id, set_name, H5P_DEFAULT);
-    status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                     he_electron_abundance);
-    if (status < 0) error("error reading electron density table");
+                            H5P_DEFAULT, net_cooling_rate);
+    if (status < 0) error("error reading metal cooling rate table");
     status = H5Dclose(dataset);
     if (status < 0) error("error closing cooling dataset");
 
-    /* Transpose from order tables are stored in (helium fraction, temperature,
-     * nH) to (redshift, nH, helium fraction, temperature) where fastest
-     * varying index is on right. */
-    for (int i = 0; i < eagle_cooling_N_He_frac; i++) {
+    /* Transpose from order tables are stored in (temperature, nH)
+     * to (nH, temperature, metal species) where fastest
+     * varying index is on right. Tables contain cooling rates but we
+     * want rate of change of internal energy, hence minus sign. */
+    for (int i = 0; i < eagle_cooling_N_density; i++) {
       for (int j = 0; j < eagle_cooling_N_temperature; j++) {
-        for (int k = 0; k < eagle_cooling_N_density; k++) {
 
-          /* Index in the HDF5 table */
-          const int hdf5_index = row_major_index_3d(
-              i, j, k, eagle_cooling_N_He_frac, eagle_cooling_N_temperature,
-              eagle_cooling_N_density);
-
-          /* Index in the internal table */
-          const int internal_index = row_major_index_4d(
-              local_z_index, k, i, j, eagle_cooling_N_loaded_redshifts,
-              eagle_cooling_N_density, eagle_cooling_N_He_frac,
-              eagle_cooling_N_temperature);
-
-          /* Change the sign and transpose */
-          cooling->table.H_plus_He_heating[internal_index] =
-              -he_net_cooling_rate[hdf5_index];
+        /* Index in the HDF5 table */
+        const int hdf5_index = row_major_index_2d(
+            j, i, eagle_cooling_N_temperature, eagle_cooling_N_density);
 
-          /* Convert to log T and transpose */
-          cooling->table.temperature[internal_index] =
-              log10(temperature[hdf5_index]);
+        /* Index in the slab */
+        const int slab_index = row_major_index_3d(
+            i, j, specs, eagle_cooling_N_density, eagle_cooling_N_temperature,
+            eagle_cooling_N_metal);
 
-          /* Just transpose */
-          cooling->table.H_plus_He_electron_abundance[internal_index] =
-              he_electron_abundance[hdf5_index];
-        }
+        /* Change the sign and transpose */
+        slab->metal_heating[slab_index] = -net_cooling_rate[hdf5_index];
       }
     }
+  }
 
-    /* read in electron densities due to metals */
-    strcpy(set_name, "/Solar/Electron_density_over_n_h");
-    dataset = H5Dopen(file_id, set_name, H5P_DEFAULT);
-    status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                     electron_abundance);
-    if (status < 0) error("error reading solar electron density table");
-    status = H5Dclose(dataset);
-    if (status < 0) error("error closing cooling dataset");
+  /* read in cooling rates due to H + He */
+  strcpy(set_name, "/Metal_free/Net_Cooling");
+  hid_t dataset = H5Dopen(file_id, set_name, H5P_DEFAULT);
+  herr_t status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL,
+                          H5P_DEFAULT, he_net_cooling_rate);
+  if (status < 0) error("error reading metal free cooling rate table");
+  status = H5Dclose(dataset);
+  if (status < 0) error("error closing cooling dataset");
+
+  /* read in Temperature */
+  strcpy(set_name, "/Metal_free/Temperature/Temperature");
+  dataset = H5Dopen(file_id, set_name, H5P_DEFAULT);
+  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                   temperature);
+  if (status < 0) error("error reading temperature table");
+  status = H5Dclose(dataset);
+  if (status < 0) error("error closing cooling dataset");
+
+  /* Read in H + He electron abundance */
+  strcpy(set_name, "/Metal_free/Electron_density_over_n_h");
+  dataset = H5Dopen(file_id, set_name, H5P_DEFAULT);
+  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                   he_electron_abundance);
+  if (status < 0) error("error reading electron density table");
+  status = H5Dclose(dataset);
+  if (status < 0) error("error closing cooling dataset");
 
-    /* Transpose from order tables are stored in (temperature, nH) to
-     * (redshift, nH, temperature) where fastest varying index is on right. */
-    for (int i = 0; i < eagle_cooling_N_temperature; i++) {
-      for (int j = 0; j < eagle_cooling_N_density; j++) {
+  /* Transpose from order tables are stored in (helium fraction, temperature,
+   * nH) to (nH, helium fraction, temperature) where fastest
+   * varying index is on right. */
+  for (int i = 0; i < eagle_cooling_N_He_frac; i++) {
+    for (int j = 0; j < eagle_cooling_N_temperature; j++) {
+      for (int k = 0; k < eagle_cooling_N_density; k++) {
 
         /* Index in the HDF5 table */
-        const int hdf5_index = row_major_index_2d(
-            i, j, eagle_cooling_N_temperature, eagle_cooling_N_density);
+        const int hdf5_index = row_major_index_3d(
+            i, j, k, eagle_cooling_N_He_frac, eagle_cooling_N_temperature,
+            eagle_cooling_N_density);
 
-        /* Index in the internal table */
-        const int internal_index = row_major_index_3d(
-            local_z_index, j, i, eagle_cooling_N_loaded_redshifts,
-            eagle_cooling_N_density, eagle_cooling_N_temperature);
+        /* Index in the slab */
+        const int slab_index = row_major_index_3d(
+            k, i, j, eagle_cooling_N_density, eagle_cooling_N_He_frac,
+            eagle_cooling_N_temperature);
+
+        /* Change the sign and transpose */
+        slab->H_plus_He_heating[slab_index] = -he_net_cooling_rate[hdf5_index];
+
+        /* Convert to log T and transpose */
+        slab->temperature[slab_index] = log10(temperature[hdf5_index]);
 
         /* Just transpose */
-        cooling->table.electron_abundance[internal_index] =
-            electron_abundance[hdf5_index];
+        slab->H_plus_He_electron_abundance[slab_index] =
+            he_electron_abundance[hdf5_index];
       }
     }
+  }
+
+  /* read in electron densities due to metals */
+  strcpy(set_name, "/Solar/Electron_density_over_n_h");
+  dataset = H5Dopen(file_id, set_name, H5P_DEFAULT);
+  status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                   electron_abundance);
+  if (status < 0) error("error reading solar electron density table");
+  status = H5Dclose(dataset);
+  if (status < 0) error("error closing cooling dataset");
+
+  /* Transpose from order tables are stored in (temperature, nH) to
+   * (nH, temperature) where fastest varying index is on right. */
+  for (int i = 0; i < eagle_cooling_N_temperature; i++) {
+    for (int j = 0; j < eagle_cooling_N_density; j++) {
 
-    status = H5Fclose(file_id);
-    if (status < 0) error("error closing file");
+      /* Index in the HDF5 table */
+      const int hdf5_index = row_major_index_2d(
+          i, j, eagle_cooling_N_temperature, eagle_cooling_N_density);
+
+      /* Index in the slab */
+      const int slab_index = row_major_index_2d(
+          j, i, eagle_cooling_N_density, eagle_cooling_N_temperature);
+
+      /* Just transpose */
+      slab->electron_abundance[slab_index] = electron_abundance[hdf5_index];
+    }
   }
 
+  status = H5Fclose(file_id);
+  if (status < 0) error("error closing file");
+
   swift_free("cooling-temp", net_cooling_rate);
   swift_free("cooling-temp", electron_abundance);
   swift_free("cooling-temp", temperature);
   swift_free("cooling-temp", he_net_cooling_rate);
   swift_free("cooling-temp", he_electron_abundance);
 
-#ifdef SWIFT_DEBUG_CHECKS
-  message("Done reading in general cooling table");
-#endif
+  /* The slab is ready */
+  slab->z_index = z_index;
 
 #else
   error("Need HDF5 to read cooling tables");
 #endif
 }
+
+/**
+ * @brief A read of the tables of some redshifts done in the background.
+ */
+struct cooling_slab_job {
+
+  /*! The cooling properties */
+  const struct cooling_function_data *cooling;
+
+  /*! Number of redshifts to read */
+  int count;
+
+  /*! Indices of the redshifts to read */
+  int z_index[eagle_cooling_N_slabs];
+
+  /*! Where to store the tables */
+  struct cooling_slab *slab[eagle_cooling_N_slabs];
+};
+
+/**
+ * @brief Read the tables of a #cooling_slab_job. Runs on the reading thread
+ * with the HDF5 lock held, or directly on the ranks that do not fill the
+ * shared slabs.
+ *
+ * @param data The #cooling_slab_job (freed here).
+ */
+static void cooling_slab_job_run(void *data) {
+
+  struct cooling_slab_job *job = (struct cooling_slab_job *)data;
+  for (int i = 0; i < job->count; i++)
+    read_cooling_slab(job->cooling, job->z_index[i], job->slab[i]);
+  free(job);
+}
+
+/**
+ * @brief Return the #cooling_slab holding the tables of a given redshift,
+ * reading them if they are not in memory yet.
+ *
+ * The caller must hold the HDF5 lock and no read can be pending.
+ *
+ * @param cooling #cooling_function_data structure
+ * @param z_index Index of the redshift of the tables we want.
+ * @param keep_z_index Index of the redshift of a slab that must not be
+ * overwritten.
+ */
+static struct cooling_slab *get_cooling_slab(
+    struct cooling_function_data *restrict cooling, const int z_index,
+    const int keep_z_index) {
+
+  /* Do we have it already? */
+  for (int i = 0; i < eagle_cooling_N_slabs; i++)
+    if (cooling->slabs[i].z_index == z_index) return &cooling->slabs[i];
+
+  /* Read it in place of a slab we do not need */
+  for (int i = 0; i < eagle_cooling_N_slabs; i++) {
+    if (cooling->slabs[i].z_index != keep_z_index) {
+      read_cooling_slab(cooling, z_index, &cooling->slabs[i]);
+      return &cooling->slabs[i];
+    }
+  }
+
+  error("No cooling slab available to read the tables of z_index=%d",
+        z_index);
+  return NULL;
+}
+
+/**
+ * @brief Get redshift dependent table of cooling rates.
+ *
+ * The tables of the two redshifts are taken from the #cooling_slab in memory
+ * (or read from the files if they were not read in advance) and combined
+ * into the blocked layout of the #cooling_tables described in
+ * cooling_tables.h.
+ *
+ * The caller must hold the HDF5 lock and no read can be pending.
+ *
+ * @param cooling #cooling_function_data structure
+ * @param low_z_index Index of the lowest redshift table to load.
+ * @param high_z_index Index of the highest redshift table to load.
+ */
+void get_cooling_table(struct cooling_function_data *restrict cooling,
+                       const int low_z_index, const int high_z_index) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (high_z_index - low_z_index + 1 != eagle_cooling_N_loaded_redshifts)
+    error("Reading invalid number of tables along z axis.");
+#endif
+
+  const struct cooling_slab *slabs[eagle_cooling_N_loaded_redshifts];
+  slabs[1] = get_cooling_slab(cooling, high_z_index, low_z_index);
+  slabs[0] = get_cooling_slab(cooling, low_z_index, high_z_index);
+
+  /* Wait for the slabs to be filled by the rank reading them */
+  shared_table_ready(&cooling->slab_segment);
+
+  /* Interleave the two redshifts. */
+  for (int local_z_index = 0; local_z_index < eagle_cooling_N_loaded_redshifts;
+       local_z_index++) {
+
+    const struct cooling_slab *slab = slabs[local_z_index];
+
+    for (int i = 0; i < eagle_cooling_N_density; i++) {
+      for (int j = 0; j < eagle_cooling_N_temperature; j++) {
+
+        /* Metal heating rates */
+        for (int specs = 0; specs < eagle_cooling_N_metal; specs++) {
+
+          const int slab_index = row_major_index_3d(
+              i, j, specs, eagle_cooling_N_density,
+              eagle_cooling_N_temperature, eagle_cooling_N_metal);
+
+          const int internal_index =
+              specs * eagle_cooling_metal_stride_elem +
+              local_z_index * eagle_cooling_metal_stride_z +
+              i * eagle_cooling_metal_stride_nH +
+              j * eagle_cooling_metal_stride_T;
+
+          cooling->table.metal_heating[internal_index] =
+              slab->metal_heating[slab_index];
+        }
+
+        /* Solar electron abundances */
+        const int slab_index = row_major_index_2d(
+            i, j, eagle_cooling_N_density, eagle_cooling_N_temperature);
+
+        const int internal_index = local_z_index * eagle_cooling_elec_stride_z +
+                                   i * eagle_cooling_elec_stride_nH +
+                                   j * eagle_cooling_elec_stride_T;
+
+        cooling->table.electron_abundance[internal_index] =
+            slab->electron_abundance[slab_index];
+      }
+    }
+
+    /* H + He tables and temperatures */
+    for (int i = 0; i < eagle_cooling_N_density; i++) {
+      for (int k = 0; k < eagle_cooling_N_He_frac; k++) {
+        for (int j = 0; j < eagle_cooling_N_temperature; j++) {
+
+          const int slab_index = row_major_index_3d(
+              i, k, j, eagle_cooling_N_density, eagle_cooling_N_He_frac,
+              eagle_cooling_N_temperature);
+
+          const int internal_index =
+              local_z_index * eagle_cooling_HpHe_stride_z +
+              i * eagle_cooling_HpHe_stride_nH +
+              k * eagle_cooling_HpHe_stride_He +
+              j * eagle_cooling_HpHe_stride_T;
+
+          cooling->table.H_plus_He_heating[internal_index] =
+              slab->H_plus_He_heating[slab_index];
+          cooling->table.temperature[internal_index] =
+              slab->temperature[slab_index];
+          cooling->table.H_plus_He_electron_abundance[internal_index] =
+              slab->H_plus_He_electron_abundance[slab_index];
+        }
+      }
+    }
+  }
+
+  /* Do not let the next read overwrite the slabs before all the ranks are
+   * done with them */
+  shared_table_ready(&cooling->slab_segment);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  message("Done reading in general cooling table");
+#endif
+}
+
+/**
+ * @brief Start reading the tables of a range of redshifts in the background.
+ *
+ * Only the tables that are not in memory yet are read. The slab holding the
+ * tables of the redshift just above the range is preserved, as it will be
+ * needed together with the tables of the highest redshift of the range.
+ * With several ranks per node, only the rank filling the shared slabs reads
+ * them.
+ *
+ * The caller must not hold the HDF5 lock and no read can be pending.
+ *
+ * @param cooling #cooling_function_data structure
+ * @param low_z_index Index of the lowest redshift of the tables to read.
+ * @param high_z_index Index of the highest redshift of the tables to read.
+ */
+void prefetch_cooling_tables(struct cooling_function_data *restrict cooling,
+                             const int low_z_index, const int high_z_index) {
+
+  struct cooling_slab_job *job =
+      (struct cooling_slab_job *)malloc(sizeof(struct cooling_slab_job));
+  if (job == NULL) error("Failed to allocate cooling table read");
+  job->cooling = cooling;
+  job->count = 0;
+
+  for (int z_index = max(low_z_index, 0);
+       z_index <= min(high_z_index, eagle_cooling_N_redshifts - 1);
+       z_index++) {
+
+    /* Do we have it already? */
+    int found = 0;
+    for (int i = 0; i < eagle_cooling_N_slabs; i++)
+      if (cooling->slabs[i].z_index == z_index) found = 1;
+    if (found) continue;
+
+    /* Find a slab we can overwrite */
+    struct cooling_slab *slab = NULL;
+    for (int i = 0; i < eagle_cooling_N_slabs; i++) {
+      const int slab_z_index = cooling->slabs[i].z_index;
+      if (slab_z_index < low_z_index || slab_z_index > high_z_index + 1) {
+        slab = &cooling->slabs[i];
+        break;
+      }
+    }
+    if (slab == NULL) error("No cooling slab available for reading ahead");
+
+    /* The slab is not usable until the read is complete */
+    slab->z_index = -2;
+
+    job->z_index[job->count] = z_index;
+    job->slab[job->count] = slab;
+    job->count++;
+  }
+
+  if (job->count == 0) {
+    free(job);
+    return;
+  }
+
+  /* Only the rank filling the shared slabs reads them in the background */
+  if (cooling->slab_reader != NULL)
+    io_async_submit(cooling->slab_reader, cooling_slab_job_run, job,
+                    /*size=*/0);
+  else
+    cooling_slab_job_run(job);
+}
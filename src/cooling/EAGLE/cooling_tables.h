@@ -51,6 +51,38 @@
 /*! Number of different bins along the abundances axis of the tables */
 #define eagle_cooling_N_abundances 11
 
+/* The tables of the two loaded redshifts are stored with the redshift as the
+ * fastest varying index, followed by the temperature (or internal energy).
+ * The corners read by one interpolation along these two axes are then
+ * adjacent in memory. The metal tables also store all the elements of a
+ * given (density, temperature, redshift) point next to each other, such that
+ * the loop over the elements reads the same few cache lines. */
+
+/*! Strides of the (redshift, density, helium fraction, temperature) axes of
+ * the loaded H + He and temperature tables */
+#define eagle_cooling_HpHe_stride_z 1
+#define eagle_cooling_HpHe_stride_T eagle_cooling_N_loaded_redshifts
+#define eagle_cooling_HpHe_stride_He \
+  (eagle_cooling_HpHe_stride_T * eagle_cooling_N_temperature)
+#define eagle_cooling_HpHe_stride_nH \
+  (eagle_cooling_HpHe_stride_He * eagle_cooling_N_He_frac)
+
+/*! Strides of the (redshift, density, temperature) axes of the loaded solar
+ * electron abundance table */
+#define eagle_cooling_elec_stride_z 1
+#define eagle_cooling_elec_stride_T eagle_cooling_N_loaded_redshifts
+#define eagle_cooling_elec_stride_nH \
+  (eagle_cooling_elec_stride_T * eagle_cooling_N_temperature)
+
+/*! Strides of the (metal, redshift, density, temperature) axes of the loaded
+ * metal heating table */
+#define eagle_cooling_metal_stride_elem 1
+#define eagle_cooling_metal_stride_z eagle_cooling_N_metal
+#define eagle_cooling_metal_stride_T \
+  (eagle_cooling_metal_stride_z * eagle_cooling_N_loaded_redshifts)
+#define eagle_cooling_metal_stride_nH \
+  (eagle_cooling_metal_stride_T * eagle_cooling_N_temperature)
+
 void get_cooling_redshifts(struct cooling_function_data *cooling);
 
 void read_cooling_header(const char *fname,
@@ -62,5 +94,8 @@ void get_redshift_invariant_table(
     struct cooling_function_data *restrict cooling, const int photodis);
 void get_cooling_table(struct cooling_function_data *restrict cooling,
                        const int low_z_index, const int high_z_index);
+void prefetch_cooling_tables(struct cooling_function_data *restrict cooling,
+                             const int low_z_index, const int high_z_index);
+void clean_cooling_tables(struct cooling_function_data *restrict cooling);
 
 #endif
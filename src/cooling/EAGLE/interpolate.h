@@ -496,4 +496,171 @@ __attribute__((always_inline)) INLINE float interpolation_4d_no_x(
   return result;
 }
 
+/**
+ * @brief Interpolate a flattened 3D table stored with arbitrary strides.
+ *
+ * This is the same interpolation as interpolation_3d() but the position
+ * of the element (x,y,z) in the array is x * sx + y * sy + z * sz. This
+ * allows for tables whose dimensions are not stored in the order of the
+ * arguments. The table is read in the same order and the weights are
+ * combined in the same way as in interpolation_3d().
+ *
+ * @param table The 3D table to interpolate.
+ * @param xi, yi, zi Indices of element of interest.
+ * @param dx, dy, dz Distance between the point and the index in units of
+ * the grid spacing.
+ * @param sx, sy, sz Distance in the array between two consecutive elements
+ * along each dimension.
+ */
+__attribute__((always_inline)) INLINE float interpolation_3d_strided(
+    const float *table, const int xi, const int yi, const int zi,
+    const float dx, const float dy, const float dz, const int sx, const int sy,
+    const int sz) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (dx < -0.001f || dx > 1.001f) error("Invalid dx=%e", dx);
+  if (dy < -0.001f || dy > 1.001f) error("Invalid dy=%e", dy);
+  if (dz < -0.001f || dz > 1.001f) error("Invalid dz=%e", dz);
+#endif
+
+  const float tx = 1.f - dx;
+  const float ty = 1.f - dy;
+  const float tz = 1.f - dz;
+
+  /* Indicate that the whole array is aligned on page boundaries */
+  swift_align_information(float, table, SWIFT_STRUCT_ALIGNMENT);
+
+  /* Position of the first corner */
+  const float *t = table + xi * sx + yi * sy + zi * sz;
+
+  /* Linear interpolation along each axis. We read the table 2^3=8 times */
+  float result = tx * ty * tz * t[0];
+
+  result += tx * ty * dz * t[sz];
+  result += tx * dy * tz * t[sy];
+  result += dx * ty * tz * t[sx];
+
+  result += tx * dy * dz * t[sy + sz];
+  result += dx * ty * dz * t[sx + sz];
+  result += dx * dy * tz * t[sx + sy];
+
+  result += dx * dy * dz * t[sx + sy + sz];
+
+  return result;
+}
+
+/**
+ * @brief Interpolate a flattened 4D table stored with arbitrary strides.
+ *
+ * This is the same interpolation as interpolation_4d() but the position
+ * of the element (x,y,z,w) in the array is x * sx + y * sy + z * sz + w * sw.
+ *
+ * @param table The 4D table to interpolate.
+ * @param xi, yi, zi, wi Indices of element of interest.
+ * @param dx, dy, dz, dw Distance between the point and the index in units of
+ * the grid spacing.
+ * @param sx, sy, sz, sw Distance in the array between two consecutive
+ * elements along each dimension.
+ */
+__attribute__((always_inline)) INLINE float interpolation_4d_strided(
+    const float *table, const int xi, const int yi, const int zi, const int wi,
+    const float dx, const float dy, const float dz, const float dw,
+    const int sx, const int sy, const int sz, const int sw) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (dx < -0.001f || dx > 1.001f) error("Invalid dx=%e", dx);
+  if (dy < -0.001f || dy > 1.001f) error("Invalid dy=%e", dy);
+  if (dz < -0.001f || dz > 1.001f) error("Invalid dz=%e", dz);
+  if (dw < -0.001f || dw > 1.001f) error("Invalid dw=%e", dw);
+#endif
+
+  const float tx = 1.f - dx;
+  const float ty = 1.f - dy;
+  const float tz = 1.f - dz;
+  const float tw = 1.f - dw;
+
+  /* Indicate that the whole array is aligned on page boundaries */
+  swift_align_information(float, table, SWIFT_STRUCT_ALIGNMENT);
+
+  /* Position of the first corner */
+  const float *t = table + xi * sx + yi * sy + zi * sz + wi * sw;
+
+  /* Linear interpolation along each axis. We read the table 2^4=16 times */
+  float result = tx * ty * tz * tw * t[0];
+
+  result += tx * ty * tz * dw * t[sw];
+  result += tx * ty * dz * tw * t[sz];
+  result += tx * dy * tz * tw * t[sy];
+  result += dx * ty * tz * tw * t[sx];
+
+  result += tx * ty * dz * dw * t[sz + sw];
+  result += tx * dy * tz * dw * t[sy + sw];
+  result += dx * ty * tz * dw * t[sx + sw];
+  result += tx * dy * dz * tw * t[sy + sz];
+  result += dx * ty * dz * tw * t[sx + sz];
+  result += dx * dy * tz * tw * t[sx + sy];
+
+  result += dx * dy * dz * tw * t[sx + sy + sz];
+  result += dx * dy * tz * dw * t[sx + sy + sw];
+  result += dx * ty * dz * dw * t[sx + sz + sw];
+  result += tx * dy * dz * dw * t[sy + sz + sw];
+
+  result += dx * dy * dz * dw * t[sx + sy + sz + sw];
+
+  return result;
+}
+
+/**
+ * @brief Interpolate a flattened 4D table stored with arbitrary strides but
+ * avoid the x-dimension.
+ *
+ * This is the same interpolation as interpolation_4d_no_x() but the position
+ * of the element (x,y,z,w) in the array is x * sx + y * sy + z * sz + w * sw.
+ *
+ * @param table The 4D table to interpolate.
+ * @param xi, yi, zi, wi Indices of element of interest.
+ * @param dx, dy, dz, dw Distance between the point and the index in units of
+ * the grid spacing.
+ * @param sx, sy, sz, sw Distance in the array between two consecutive
+ * elements along each dimension.
+ */
+__attribute__((always_inline)) INLINE float interpolation_4d_no_x_strided(
+    const float *table, const int xi, const int yi, const int zi, const int wi,
+    const float dx, const float dy, const float dz, const float dw,
+    const int sx, const int sy, const int sz, const int sw) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (dx != 0.f) error("Attempting to interpolate along x!");
+  if (dy < -0.001f || dy > 1.001f) error("Invalid dy=%e", dy);
+  if (dz < -0.001f || dz > 1.001f) error("Invalid dz=%e", dz);
+  if (dw < -0.001f || dw > 1.001f) error("Invalid dw=%e", dw);
+#endif
+
+  const float tx = 1.f;
+  const float ty = 1.f - dy;
+  const float tz = 1.f - dz;
+  const float tw = 1.f - dw;
+
+  /* Indicate that the whole array is aligned on boundaries */
+  swift_align_information(float, table, SWIFT_STRUCT_ALIGNMENT);
+
+  /* Position of the first corner */
+  const float *t = table + xi * sx + yi * sy + zi * sz + wi * sw;
+
+  /* Linear interpolation along each axis. We read the table 2^3=8 times */
+  float result = tx * ty * tz * tw * t[0];
+
+  result += tx * ty * tz * dw * t[sw];
+  result += tx * ty * dz * tw * t[sz];
+  result += tx * dy * tz * tw * t[sy];
+
+  result += tx * ty * dz * dw * t[sz + sw];
+  result += tx * dy * tz * dw * t[sy + sw];
+  result += tx * dy * dz * tw * t[sy + sz];
+
+  result += tx * dy * dz * dw * t[sy + sz + sw];
+
+  return result;
+}
+
 #endif
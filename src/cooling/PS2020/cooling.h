@@ -37,6 +37,9 @@ struct pressure_floor_props;
 struct feedback_props;
 struct space;
 
+/*! Number of particles cooled together by cooling_cool_part_batch() */
+#define cooling_batch_size 16
+
 void cooling_update(const struct phys_const *phys_const,
                     const struct cosmology *cosmo,
                     const struct pressure_floor_props *pressure_floor,
@@ -53,6 +56,15 @@ void cooling_cool_part(const struct phys_const *phys_const,
                        struct part *p, struct xpart *xp, const float dt,
                        const float dt_therm, const double time);
 
+void cooling_cool_part_batch(
+    const struct phys_const *phys_const, const struct unit_system *us,
+    const struct cosmology *cosmo, const struct hydro_props *hydro_properties,
+    const struct entropy_floor_properties *floor_props,
+    const struct pressure_floor_props *pressure_floor,
+    const struct cooling_function_data *cooling, struct part *parts,
+    struct xpart *xparts, const int *ind, const float *dt,
+    const float *dt_therm, const int count, const double time);
+
 float cooling_timestep(const struct cooling_function_data *cooling,
                        const struct phys_const *phys_const,
                        const struct cosmology *cosmo,
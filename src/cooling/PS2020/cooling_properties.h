@@ -19,6 +19,9 @@
 #ifndef SWIFT_COOLING_PROPERTIES_PS2020_H
 #define SWIFT_COOLING_PROPERTIES_PS2020_H
 
+/* Local includes. */
+#include "shared_table.h"
+
 #define colibre_table_path_name_length 500
 
 /**
@@ -70,6 +73,9 @@ struct cooling_tables {
 
   /* array of all hydrogen fractions */
   float *logHfracs_all;
+
+  /* node-wide memory holding all the arrays above */
+  struct shared_table segment;
 };
 
 /**
@@ -35,6 +35,7 @@
 #include <string.h>
 
 /* Local includes. */
+#include "align.h"
 #include "chemistry_struct.h"
 #include "cooling_properties.h"
 #include "error.h"
@@ -232,17 +233,16 @@ void read_cooling_header(struct cooling_function_data *cooling) {
 #endif
 }
 
+#ifdef HAVE_HDF5
 /**
- * @brief Allocate space for cooling tables and read them
+ * @brief Read the cooling tables into the arrays allocated by
+ * read_cooling_tables() and compute the derived ones.
  *
  * @param cooling #cooling_function_data structure
  */
-void read_cooling_tables(struct cooling_function_data *restrict cooling) {
+static void read_cooling_table_data(
+    struct cooling_function_data *restrict cooling) {
 
-  /* Abort early if we were not using the cooling module */
-  if (strcmp(cooling->cooling_table_path, "") == 0) return;
-
-#ifdef HAVE_HDF5
   hid_t dataset;
   herr_t status;
 
@@ -252,17 +252,7 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (tempfile_id < 0)
     error("unable to open file %s\n", cooling->cooling_table_path);
 
-  /* Allocate and read arrays to store cooling tables. */
-
   /* Mean particle mass (temperature) */
-  if (swift_memalign("cooling_table.Tmu", (void **)&cooling->table.Tmu,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_temperature *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate Tmu array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/MeanParticleMass", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.Tmu);
@@ -271,14 +261,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing mean particle mass dataset");
 
   /* Mean particle mass (internal energy) */
-  if (swift_memalign("cooling_table.Umu", (void **)&cooling->table.Umu,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_internalenergy *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate Umu array\n");
-
   dataset = H5Dopen(tempfile_id, "/Udep/MeanParticleMass", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.Umu);
@@ -287,14 +269,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing mean particle mass dataset");
 
   /* Cooling (temperature) */
-  if (swift_memalign(
-          "cooling_table.Tcooling", (void **)&cooling->table.Tcooling,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_cooltypes * sizeof(float)) != 0)
-    error("Failed to allocate Tcooling array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/Cooling", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.Tcooling);
@@ -303,14 +277,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing cooling dataset");
 
   /* Cooling (internal energy) */
-  if (swift_memalign(
-          "cooling_table.Ucooling", (void **)&cooling->table.Ucooling,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_cooltypes * sizeof(float)) != 0)
-    error("Failed to allocate Ucooling array\n");
-
   dataset = H5Dopen(tempfile_id, "/Udep/Cooling", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.Ucooling);
@@ -319,14 +285,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing cooling dataset");
 
   /* Heating (temperature) */
-  if (swift_memalign(
-          "cooling_table.Theating", (void **)&cooling->table.Theating,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_heattypes * sizeof(float)) != 0)
-    error("Failed to allocate Theating array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/Heating", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.Theating);
@@ -335,14 +293,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing cooling dataset");
 
   /* Heating (internal energy) */
-  if (swift_memalign(
-          "cooling_table.Uheating", (void **)&cooling->table.Uheating,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_heattypes * sizeof(float)) != 0)
-    error("Failed to allocate Uheating array\n");
-
   dataset = H5Dopen(tempfile_id, "/Udep/Heating", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.Uheating);
@@ -351,14 +301,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing cooling dataset");
 
   /* Electron fraction (temperature) */
-  if (swift_memalign(
-          "cooling_table.Tefrac", (void **)&cooling->table.Telectron_fraction,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_electrontypes * sizeof(float)) != 0)
-    error("Failed to allocate Telectron_fraction array\n");
-
   /* Dataset is named /Tdep/ElectronFractions in the published version of the
    * tables and for historical reasons /Tdep/ElectronFractionsVol in the version
    * used in the PS2020 repository. Content is identical but we deal
@@ -379,14 +321,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing cooling dataset");
 
   /* Electron fraction (internal energy) */
-  if (swift_memalign(
-          "cooling_table.Uefrac", (void **)&cooling->table.Uelectron_fraction,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density *
-              colibre_cooling_N_electrontypes * sizeof(float)) != 0)
-    error("Failed to allocate Uelectron_fraction array\n");
-
   /* Dataset is named /Udep/ElectronFractions in the published version of the
    * tables and for historical reasons /Udep/ElectronFractionsVol in the version
    * used in the PS2020 repository. Content is identical but we deal
@@ -407,14 +341,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing cooling dataset");
 
   /* Internal energy from temperature */
-  if (swift_memalign("cooling_table.UfromT", (void **)&cooling->table.U_from_T,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_temperature *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate U_from_T array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/U_from_T", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.U_from_T);
@@ -423,14 +349,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing cooling dataset");
 
   /* Temperature from interal energy */
-  if (swift_memalign("cooling_table.TfromU", (void **)&cooling->table.T_from_U,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_internalenergy *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate T_from_U array\n");
-
   dataset = H5Dopen(tempfile_id, "/Udep/T_from_U", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.T_from_U);
@@ -439,13 +357,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing cooling dataset");
 
   /* Thermal equilibrium temperature */
-  if (swift_memalign("cooling_table.Teq", (void **)&cooling->table.logTeq,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate logTeq array\n");
-
   dataset = H5Dopen(tempfile_id, "/ThermEq/Temperature", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.logTeq);
@@ -454,14 +365,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing logTeq dataset");
 
   /* Mean particle mass at thermal equilibrium temperature */
-  if (swift_memalign(
-          "cooling_table.mueq", (void **)&cooling->table.meanpartmass_Teq,
-          SWIFT_STRUCT_ALIGNMENT,
-
-          colibre_cooling_N_redshifts * colibre_cooling_N_metallicity *
-              colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate mu array\n");
-
   dataset = H5Dopen(tempfile_id, "/ThermEq/MeanParticleMass", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.meanpartmass_Teq);
@@ -470,13 +373,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing mu dataset");
 
   /* Hydrogen fractions at thermal equilibirum temperature */
-  if (swift_memalign(
-          "cooling_table.Hfracs", (void **)&cooling->table.logHfracs_Teq,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_metallicity *
-              colibre_cooling_N_density * 3 * sizeof(float)) != 0)
-    error("Failed to allocate hydrogen fractions array\n");
-
   dataset = H5Dopen(tempfile_id, "/ThermEq/HydrogenFractionsVol", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.logHfracs_Teq);
@@ -485,14 +381,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   if (status < 0) error("error closing hydrogen fractions dataset");
 
   /* All hydrogen fractions */
-  if (swift_memalign(
-          "cooling_table.Hfracs", (void **)&cooling->table.logHfracs_all,
-          SWIFT_STRUCT_ALIGNMENT,
-          colibre_cooling_N_redshifts * colibre_cooling_N_temperature *
-              colibre_cooling_N_metallicity * colibre_cooling_N_density * 3 *
-              sizeof(float)) != 0)
-    error("Failed to allocate big hydrogen fractions array\n");
-
   dataset = H5Dopen(tempfile_id, "/Tdep/HydrogenFractionsVol", H5P_DEFAULT);
   status = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
                    cooling->table.logHfracs_all);
@@ -503,14 +391,6 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
   /* Close the file */
   H5Fclose(tempfile_id);
 
-  /* Pressure at thermal equilibrium temperature */
-  if (swift_memalign("cooling_table.Peq", (void **)&cooling->table.logPeq,
-                     SWIFT_STRUCT_ALIGNMENT,
-                     colibre_cooling_N_redshifts *
-                         colibre_cooling_N_metallicity *
-                         colibre_cooling_N_density * sizeof(float)) != 0)
-    error("Failed to allocate logPeq array\n");
-
   const float log10_kB_cgs = cooling->log10_kB_cgs;
 
   /* Compute the pressures at thermal eq. */
@@ -535,6 +415,80 @@ void read_cooling_tables(struct cooling_function_data *restrict cooling) {
       }
     }
   }
+}
+#endif
+
+/**
+ * @brief Allocate space for cooling tables and read them
+ *
+ * All the tables live in a single block of memory shared by the ranks of
+ * the node. Only one of them reads the file, the others wait for it.
+ *
+ * @param cooling #cooling_function_data structure
+ */
+void read_cooling_tables(struct cooling_function_data *restrict cooling) {
+
+  cooling->table.segment.data = NULL;
+
+  /* Abort early if we were not using the cooling module */
+  if (strcmp(cooling->cooling_table_path, "") == 0) return;
+
+#ifdef HAVE_HDF5
+
+  /* Number of entries of the tables */
+  const size_t n_T = (size_t)colibre_cooling_N_redshifts *
+                     colibre_cooling_N_temperature *
+                     colibre_cooling_N_metallicity * colibre_cooling_N_density;
+  const size_t n_U =
+      (size_t)colibre_cooling_N_redshifts * colibre_cooling_N_internalenergy *
+      colibre_cooling_N_metallicity * colibre_cooling_N_density;
+  const size_t n_eq = (size_t)colibre_cooling_N_redshifts *
+                      colibre_cooling_N_metallicity * colibre_cooling_N_density;
+
+  struct {
+    float **table;
+    size_t count;
+  } tables[] = {
+      {&cooling->table.Tmu, n_T},
+      {&cooling->table.Umu, n_U},
+      {&cooling->table.Tcooling, n_T * colibre_cooling_N_cooltypes},
+      {&cooling->table.Ucooling, n_U * colibre_cooling_N_cooltypes},
+      {&cooling->table.Theating, n_T * colibre_cooling_N_heattypes},
+      {&cooling->table.Uheating, n_U * colibre_cooling_N_heattypes},
+      {&cooling->table.Telectron_fraction,
+       n_T * colibre_cooling_N_electrontypes},
+      {&cooling->table.Uelectron_fraction,
+       n_U * colibre_cooling_N_electrontypes},
+      {&cooling->table.U_from_T, n_T},
+      {&cooling->table.T_from_U, n_U},
+      {&cooling->table.logTeq, n_eq},
+      {&cooling->table.meanpartmass_Teq, n_eq},
+      {&cooling->table.logHfracs_Teq, n_eq * 3},
+      {&cooling->table.logHfracs_all, n_T * 3},
+      {&cooling->table.logPeq, n_eq}};
+  const int num_tables = sizeof(tables) / sizeof(tables[0]);
+
+  /* Each table starts on an aligned boundary */
+  const size_t align = SWIFT_STRUCT_ALIGNMENT;
+  size_t padded[sizeof(tables) / sizeof(tables[0])];
+  size_t size = 0;
+  for (int i = 0; i < num_tables; i++) {
+    padded[i] = ((tables[i].count * sizeof(float) + align - 1) / align) * align;
+    size += padded[i];
+  }
+
+  /* Allocate the node-wide block and carve the tables out of it */
+  char *next = (char *)shared_table_alloc(&cooling->table.segment,
+                                          "cooling_table", size);
+  for (int i = 0; i < num_tables; i++) {
+    *tables[i].table = (float *)next;
+    next += padded[i];
+  }
+
+  /* One rank of the node reads the tables for everyone */
+  if (shared_table_is_writer(&cooling->table.segment))
+    read_cooling_table_data(cooling);
+  shared_table_ready(&cooling->table.segment);
 
 #ifdef SWIFT_DEBUG_CHECKS
   message("Done reading in general cooling table");
@@ -42,6 +42,7 @@
 #include "exp10.h"
 #include "hydro.h"
 #include "interpolate.h"
+#include "io_async.h"
 #include "io_properties.h"
 #include "parser.h"
 #include "part.h"
@@ -163,6 +164,9 @@ void cooling_update(const struct phys_const *phys_const,
   /* Do we already have the correct tables loaded? */
   if (cooling->z_index == z_index) return;
 
+  /* The tables may be read while a snapshot is written asynchronously */
+  io_hdf5_lock();
+
   /* Which table should we load ? */
   if (z_index >= qla_eagle_cooling_N_redshifts) {
 
@@ -186,6 +190,8 @@ void cooling_update(const struct phys_const *phys_const,
     get_cooling_table(cooling, low_z_index, high_z_index);
   }
 
+  io_hdf5_unlock();
+
   /* Store the currently loaded index */
   cooling->z_index = z_index;
 }
@@ -49,6 +49,323 @@
 #include "stars_csds.h"
 #include "units.h"
 
+/*! Header of a record staged in a #csds_batch */
+struct csds_staged_segment {
+  /* Where the record goes in the logfile. */
+  char *dest;
+
+  /* Size of the record. */
+  size_t size;
+};
+
+/**
+ * @brief Size taken by a staged record in a #csds_batch (keeping the headers
+ * aligned).
+ */
+INLINE static size_t csds_staged_size(size_t size) {
+  return sizeof(struct csds_staged_segment) + ((size + 7) & ~((size_t)7));
+}
+
+/**
+ * @brief Copy the records of a batch to their place in the logfile.
+ *
+ * @param b The #csds_batch.
+ */
+static void csds_copy_batch(struct csds_batch *b) {
+  size_t pos = 0;
+  while (pos < b->count) {
+    const struct csds_staged_segment *seg =
+        (const struct csds_staged_segment *)(b->data + pos);
+    memcpy(seg->dest, seg + 1, seg->size);
+    pos += csds_staged_size(seg->size);
+  }
+  b->count = 0;
+}
+
+/**
+ * @brief The main function of the flush thread.
+ *
+ * Waits for batches to be handed over and copies them into the logfile,
+ * which takes the page faults and file system work off the runners.
+ *
+ * @param arg The #csds_writer.
+ */
+static void *csds_flush_thread(void *arg) {
+
+  struct csds_writer *log = (struct csds_writer *)arg;
+
+  while (1) {
+
+    /* Wait for something to do */
+    pthread_mutex_lock(&log->flush_mutex);
+    while (log->flush_queue == NULL && !log->flush_stop)
+      pthread_cond_wait(&log->flush_cond, &log->flush_mutex);
+    const int stop = (log->flush_queue == NULL);
+    pthread_mutex_unlock(&log->flush_mutex);
+    if (stop) break;
+
+    /* Grab all the batches at once */
+    struct csds_batch *b =
+        (struct csds_batch *)atomic_swap(&log->flush_queue, NULL);
+
+    const ticks tic = getticks();
+    while (b != NULL) {
+      struct csds_batch *next = b->next;
+      csds_copy_batch(b);
+
+      /* Hand the batch back to its thread */
+      pthread_mutex_lock(&log->flush_mutex);
+      b->in_flight = 0;
+      atomic_dec(&log->flush_pending);
+      pthread_cond_broadcast(&log->done_cond);
+      pthread_mutex_unlock(&log->flush_mutex);
+
+      b = next;
+    }
+    atomic_add(&log->time_flushing, getticks() - tic);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Hand a batch over to the flush thread.
+ *
+ * @param log The #csds_writer.
+ * @param b The #csds_batch.
+ */
+static void csds_submit_batch(struct csds_writer *log, struct csds_batch *b) {
+
+  if (b->count == 0) return;
+
+  b->in_flight = 1;
+  atomic_inc(&log->flush_pending);
+
+  /* Push it on the queue */
+  struct csds_batch *head;
+  do {
+    head = log->flush_queue;
+    b->next = head;
+  } while (atomic_cas(&log->flush_queue, head, b) != head);
+
+  /* Wake up the flush thread */
+  pthread_mutex_lock(&log->flush_mutex);
+  pthread_cond_signal(&log->flush_cond);
+  pthread_mutex_unlock(&log->flush_mutex);
+}
+
+/**
+ * @brief Wait until a batch is back from the flush thread.
+ *
+ * @param log The #csds_writer.
+ * @param b The #csds_batch.
+ */
+static void csds_wait_batch(struct csds_writer *log, struct csds_batch *b) {
+
+  const ticks tic = getticks();
+  pthread_mutex_lock(&log->flush_mutex);
+  while (b->in_flight) pthread_cond_wait(&log->done_cond, &log->flush_mutex);
+  pthread_mutex_unlock(&log->flush_mutex);
+  atomic_add(&log->time_stalled, getticks() - tic);
+}
+
+/**
+ * @brief Get the staging buffers of the current thread.
+ *
+ * @param log The #csds_writer.
+ */
+static struct csds_thread_buffers *csds_get_thread_buffers(
+    struct csds_writer *log) {
+
+  struct csds_thread_buffers *t =
+      (struct csds_thread_buffers *)pthread_getspecific(log->thread_key);
+  if (t != NULL) return t;
+
+  /* First record logged by this thread */
+  t = (struct csds_thread_buffers *)calloc(1,
+                                           sizeof(struct csds_thread_buffers));
+  if (t == NULL) error("Unable to allocate the CSDS staging buffers.");
+  for (int k = 0; k < 2; k++) {
+    if (swift_memalign("csds_batch", (void **)&t->batches[k].data,
+                       SWIFT_CACHE_ALIGNMENT, log->batch_size) != 0)
+      error("Unable to allocate the CSDS staging buffers.");
+  }
+  pthread_setspecific(log->thread_key, t);
+
+  /* Register it such that it can be flushed and freed */
+  struct csds_thread_buffers *head;
+  do {
+    head = log->thread_buffers;
+    t->next = head;
+  } while (atomic_cas(&log->thread_buffers, head, t) != head);
+
+  return t;
+}
+
+/**
+ * @brief Reserve the space for some records in the logfile.
+ *
+ * When staging batches are used, the returned pointer is in the batch of the
+ * current thread and the records are copied into the logfile by the flush
+ * thread. Otherwise, the records are written directly into the logfile.
+ *
+ * @param log The #csds_writer.
+ * @param size The size of the records.
+ * @param offset (output) The offset of the records in the logfile.
+ *
+ * @return Where to write the records.
+ */
+static char *csds_reserve(struct csds_writer *log, size_t size,
+                          size_t *offset) {
+
+  char *dest = (char *)csds_logfile_writer_get(&log->logfile, size, offset);
+  atomic_add(&log->bytes_logged, size);
+
+  /* Large groups of records are not worth staging */
+  const size_t staged_size = csds_staged_size(size);
+  if (log->batch_size == 0 || size == 0 || staged_size > log->batch_size)
+    return dest;
+
+  struct csds_thread_buffers *t = csds_get_thread_buffers(log);
+  struct csds_batch *b = &t->batches[t->active];
+
+  /* Not enough space left? Hand this one over and use the other one. */
+  if (b->count + staged_size > log->batch_size) {
+    csds_submit_batch(log, b);
+    t->active = !t->active;
+    b = &t->batches[t->active];
+    csds_wait_batch(log, b);
+  }
+
+  struct csds_staged_segment *seg =
+      (struct csds_staged_segment *)(b->data + b->count);
+  seg->dest = dest;
+  seg->size = size;
+  b->count += staged_size;
+  return (char *)(seg + 1);
+}
+
+/**
+ * @brief Make sure all the staged records are in the logfile.
+ *
+ * Must be called when no other thread is logging (e.g. between steps) and
+ * before the logfile is remapped.
+ *
+ * @param log The #csds_writer.
+ */
+void csds_flush(struct csds_writer *log) {
+
+  if (log->batch_size == 0) return;
+
+  const ticks tic = getticks();
+
+  /* Hand over the batches of all the threads */
+  for (struct csds_thread_buffers *t = log->thread_buffers; t != NULL;
+       t = t->next) {
+    csds_submit_batch(log, &t->batches[t->active]);
+  }
+
+  /* And wait for the flush thread to be done */
+  pthread_mutex_lock(&log->flush_mutex);
+  while (log->flush_pending > 0)
+    pthread_cond_wait(&log->done_cond, &log->flush_mutex);
+  pthread_mutex_unlock(&log->flush_mutex);
+
+  atomic_add(&log->time_stalled, getticks() - tic);
+}
+
+/**
+ * @brief Start the flush thread and prepare the staging buffers.
+ *
+ * @param log The #csds_writer.
+ */
+static void csds_start_flush_thread(struct csds_writer *log) {
+
+  log->flush_queue = NULL;
+  log->flush_pending = 0;
+  log->thread_buffers = NULL;
+  log->flush_stop = 0;
+  log->time_logging = 0;
+  log->time_stalled = 0;
+  log->time_flushing = 0;
+  log->bytes_logged = 0;
+
+  if (log->batch_size == 0) return;
+
+  if (pthread_key_create(&log->thread_key, NULL) != 0)
+    error("Failed to create the CSDS thread key.");
+  if (pthread_mutex_init(&log->flush_mutex, NULL) != 0 ||
+      pthread_cond_init(&log->flush_cond, NULL) != 0 ||
+      pthread_cond_init(&log->done_cond, NULL) != 0)
+    error("Failed to initialise the CSDS flush thread conditions.");
+  if (pthread_create(&log->flush_thread, NULL, csds_flush_thread, log) != 0)
+    error("Failed to create the CSDS flush thread.");
+}
+
+/**
+ * @brief Flush everything, stop the flush thread and free the staging
+ * buffers.
+ *
+ * @param log The #csds_writer.
+ */
+static void csds_stop_flush_thread(struct csds_writer *log) {
+
+  if (log->batch_size == 0) return;
+
+  csds_flush(log);
+
+  pthread_mutex_lock(&log->flush_mutex);
+  log->flush_stop = 1;
+  pthread_cond_signal(&log->flush_cond);
+  pthread_mutex_unlock(&log->flush_mutex);
+  pthread_join(log->flush_thread, NULL);
+
+  struct csds_thread_buffers *t = log->thread_buffers;
+  while (t != NULL) {
+    struct csds_thread_buffers *next = t->next;
+    swift_free("csds_batch", t->batches[0].data);
+    swift_free("csds_batch", t->batches[1].data);
+    free(t);
+    t = next;
+  }
+  log->thread_buffers = NULL;
+
+  pthread_key_delete(log->thread_key);
+  pthread_mutex_destroy(&log->flush_mutex);
+  pthread_cond_destroy(&log->flush_cond);
+  pthread_cond_destroy(&log->done_cond);
+}
+
+/**
+ * @brief Report the time spent logging during the last step and reset the
+ * counters.
+ *
+ * @param log The #csds_writer.
+ * @param e The #engine.
+ */
+void csds_report_overhead(struct csds_writer *log, const struct engine *e) {
+
+  if (e->verbose) {
+    if (log->batch_size > 0)
+      message(
+          "Logged %.3f MB in %.3f %s (runners), stalled %.3f %s, flush "
+          "thread busy %.3f %s.",
+          log->bytes_logged / (1024. * 1024.),
+          clocks_from_ticks(log->time_logging), clocks_getunit(),
+          clocks_from_ticks(log->time_stalled), clocks_getunit(),
+          clocks_from_ticks(log->time_flushing), clocks_getunit());
+    else
+      message("Logged %.3f MB in %.3f %s (runners).",
+              log->bytes_logged / (1024. * 1024.),
+              clocks_from_ticks(log->time_logging), clocks_getunit());
+  }
+
+  log->bytes_logged = 0;
+  log->time_logging = 0;
+  log->time_stalled = 0;
+  log->time_flushing = 0;
+}
+
 /**
  * @brief log all particles in the engine.
  *
@@ -242,6 +559,8 @@ void csds_log_parts(struct csds_writer *log, const struct part *p,
                     const int log_all_fields,
                     const enum csds_special_flags flag, const int flag_data) {
 
+  const ticks tic = getticks();
+
   /* Build the special flag */
   const int size_special_flag = log->list_fields[CSDS_SPECIAL_FLAGS_INDEX].size;
   const uint32_t special_flags =
@@ -263,8 +582,7 @@ void csds_log_parts(struct csds_writer *log, const struct part *p,
 
   /* Allocate a chunk of memory in the logfile of the right size. */
   size_t offset_new;
-  char *buff =
-      (char *)csds_logfile_writer_get(&log->logfile, size_total, &offset_new);
+  char *buff = csds_reserve(log, size_total, &offset_new);
 
 #ifdef SWIFT_DEBUG_CHECKS
   /* Save the buffer position in order to test if the requested buffer was
@@ -291,6 +609,8 @@ void csds_log_parts(struct csds_writer *log, const struct part *p,
     offset_new += size;
   }
 
+  atomic_add(&log->time_logging, getticks() - tic);
+
 #ifdef SWIFT_DEBUG_CHECKS
   /* Ensure that the buffer was fully used */
   const int diff = buff - buff_before;
@@ -398,6 +718,8 @@ void csds_log_spart(struct csds_writer *log, struct spart *sp,
 void csds_log_sparts(struct csds_writer *log, struct spart *sp, int count,
                      const struct engine *e, const int log_all_fields,
                      const enum csds_special_flags flag, const int flag_data) {
+  const ticks tic = getticks();
+
   /* Build the special flag */
   const int size_special_flag = log->list_fields[CSDS_SPECIAL_FLAGS_INDEX].size;
   const uint32_t special_flags =
@@ -421,8 +743,7 @@ void csds_log_sparts(struct csds_writer *log, struct spart *sp, int count,
 
   /* Allocate a chunk of memory in the logfile of the right size. */
   size_t offset_new;
-  char *buff =
-      (char *)csds_logfile_writer_get(&log->logfile, size_total, &offset_new);
+  char *buff = csds_reserve(log, size_total, &offset_new);
 #ifdef SWIFT_DEBUG_CHECKS
   /* Save the buffer position in order to test if the requested buffer was
    * really used */
@@ -445,6 +766,8 @@ void csds_log_sparts(struct csds_writer *log, struct spart *sp, int count,
     buff += size;
     offset_new += size;
   }
+  atomic_add(&log->time_logging, getticks() - tic);
+
 #ifdef SWIFT_DEBUG_CHECKS
   /* Ensure that the buffer was fully used */
   const int diff = buff - buff_before;
@@ -552,6 +875,8 @@ void csds_log_gpart(struct csds_writer *log, struct gpart *p,
 void csds_log_gparts(struct csds_writer *log, struct gpart *p, int count,
                      const struct engine *e, const int log_all_fields,
                      const enum csds_special_flags flag, const int flag_data) {
+  const ticks tic = getticks();
+
   /* Build the special flag */
   const int size_special_flag = log->list_fields[CSDS_SPECIAL_FLAGS_INDEX].size;
   const uint32_t special_flags =
@@ -585,8 +910,7 @@ void csds_log_gparts(struct csds_writer *log, struct gpart *p, int count,
 
   /* Allocate a chunk of memory in the logfile of the right size. */
   size_t offset_new;
-  char *buff =
-      (char *)csds_logfile_writer_get(&log->logfile, size_total, &offset_new);
+  char *buff = csds_reserve(log, size_total, &offset_new);
 #ifdef SWIFT_DEBUG_CHECKS
   /* Save the buffer position in order to test if the requested buffer was
    * really used */
@@ -614,6 +938,8 @@ void csds_log_gparts(struct csds_writer *log, struct gpart *p, int count,
     buff += size;
     offset_new += size;
   }
+  atomic_add(&log->time_logging, getticks() - tic);
+
 #ifdef SWIFT_DEBUG_CHECKS
   /* Ensure that the buffer was fully used */
   const int diff = buff - buff_before;
@@ -672,6 +998,9 @@ void csds_ensure_size(struct csds_writer *log, const struct engine *e) {
 
   ticks tic = getticks();
 
+  /* The staged records point into the current mapping of the logfile */
+  csds_flush(log);
+
   /* count part memory */
   size_t limit = 0;
 
@@ -894,6 +1223,8 @@ void csds_init(struct csds_writer *log, const struct engine *e,
   log->buffer_scale =
       parser_get_opt_param_float(params, "CSDS:buffer_scale", 10);
   parser_get_param_string(params, "CSDS:basename", log->base_name);
+  log->batch_size =
+      parser_get_opt_param_int(params, "CSDS:batch_size_kB", 0) * 1024;
 
   /* Initialize the list_fields */
   csds_init_masks(log, e);
@@ -920,6 +1251,12 @@ void csds_init(struct csds_writer *log, const struct engine *e,
   /* init logfile. */
   csds_logfile_writer_init(&log->logfile, csds_name_file, buffer_size);
 
+  /* Stage the records of each thread? */
+  csds_start_flush_thread(log);
+  if (log->batch_size > 0 && e->verbose)
+    message("Staging the records in batches of %zd kB per thread.",
+            log->batch_size / 1024);
+
   if (e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
             clocks_getunit());
@@ -931,6 +1268,7 @@ void csds_init(struct csds_writer *log, const struct engine *e,
  * @param log The #csds_writer
  */
 void csds_free(struct csds_writer *log) {
+  csds_stop_flush_thread(log);
   csds_logfile_writer_close(&log->logfile);
 
   free(log->list_fields);
@@ -1201,6 +1539,9 @@ int csds_read_timestamp(const struct csds_writer *log, integertime_t *t,
  * @param stream the file stream
  */
 void csds_struct_dump(const struct csds_writer *log, FILE *stream) {
+  /* Make sure the logfile is complete */
+  csds_flush((struct csds_writer *)log);
+
   restart_write_blocks((void *)log, sizeof(struct csds_writer), 1, stream,
                        "csds", "csds");
 
@@ -1243,6 +1584,9 @@ void csds_struct_restore(struct csds_writer *log, FILE *stream) {
   csds_get_logfile_name(log, csds_name_file);
 
   csds_logfile_writer_restart(&log->logfile, csds_name_file);
+
+  /* The threads and staging buffers do not survive a restart */
+  csds_start_flush_thread(log);
 }
 
 #endif /* WITH_CSDS */
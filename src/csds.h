@@ -24,9 +24,13 @@
 
 #ifdef WITH_CSDS
 
+/* Some standard headers. */
+#include <pthread.h>
+
 /* Includes. */
 #include "align.h"
 #include "common_io.h"
+#include "cycle.h"
 #include "error.h"
 #include "inline.h"
 #include "timeline.h"
@@ -63,6 +67,42 @@ struct engine;
  * indicated that this is the first message for the given particle/timestamp.
  */
 
+/**
+ * @brief A batch of records staged by one thread.
+ *
+ * The records already have their place reserved in the logfile, the flush
+ * thread copies them there.
+ */
+struct csds_batch {
+  /* Next batch in the queue of the flush thread. */
+  struct csds_batch *next;
+
+  /* The staged records, each preceded by their destination. */
+  char *data;
+
+  /* Number of bytes used in data. */
+  size_t count;
+
+  /* Is this batch waiting for the flush thread? */
+  volatile int in_flight;
+};
+
+/**
+ * @brief The staging buffers of a thread.
+ *
+ * A thread fills one batch while the other one is being flushed.
+ */
+struct csds_thread_buffers {
+  /* Next thread in the list of the #csds_writer. */
+  struct csds_thread_buffers *next;
+
+  /* The two batches. */
+  struct csds_batch batches[2];
+
+  /* Index of the batch being filled. */
+  int active;
+};
+
 /**
  * @brief structure containing global data for the particle csds.
  */
@@ -97,6 +137,38 @@ struct csds_writer {
   /* Number of elements in list_fields. */
   int total_number_fields;
 
+  /* Size of the staging batches of each thread (0 to write the records
+   * directly into the logfile). */
+  size_t batch_size;
+
+  /* Batches handed over to the flush thread (lock-free stack). */
+  struct csds_batch *volatile flush_queue;
+
+  /* Number of batches handed over and not yet flushed. */
+  volatile int flush_pending;
+
+  /* Staging buffers of all the threads that logged something. */
+  struct csds_thread_buffers *volatile thread_buffers;
+
+  /* Key to the staging buffers of the current thread. */
+  pthread_key_t thread_key;
+
+  /* The flush thread and the conditions it waits on. */
+  pthread_t flush_thread;
+  pthread_mutex_t flush_mutex;
+  pthread_cond_t flush_cond;
+  pthread_cond_t done_cond;
+  int flush_stop;
+
+  /* Time spent logging, waiting for a batch and flushing since the last
+   * report. */
+  volatile ticks time_logging;
+  volatile ticks time_stalled;
+  volatile ticks time_flushing;
+
+  /* Number of bytes logged since the last report. */
+  volatile size_t bytes_logged;
+
 } SWIFT_STRUCT_ALIGN;
 
 /* required structure for each particle type. */
@@ -137,6 +209,8 @@ void csds_free(struct csds_writer *log);
 void csds_log_timestamp(struct csds_writer *log, integertime_t t, double time,
                         size_t *offset);
 void csds_ensure_size(struct csds_writer *log, const struct engine *e);
+void csds_flush(struct csds_writer *log);
+void csds_report_overhead(struct csds_writer *log, const struct engine *e);
 void csds_write_file_header(struct csds_writer *log);
 
 int csds_read_part(const struct csds_writer *log, struct part *p,
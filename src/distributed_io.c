@@ -23,7 +23,9 @@
 #if defined(HAVE_HDF5) && defined(WITH_MPI)
 
 /* Some standard headers. */
+#include <errno.h>
 #include <hdf5.h>
+#include <limits.h>
 #include <math.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -46,6 +48,7 @@
 #include "gravity_properties.h"
 #include "hydro_io.h"
 #include "hydro_properties.h"
+#include "io_async.h"
 #include "io_compression.h"
 #include "io_properties.h"
 #include "memuse.h"
@@ -67,57 +70,37 @@
 /* Max number of entries that can be written for a given particle type */
 static const int io_max_size_output_list = 100;
 
+/* Header of the binary index of a distributed snapshot. */
+struct distributed_index_header {
+  char signature[8]; /* "SWIFTIDX" */
+  int version;
+  int num_files;
+  int num_types;
+  int padding;
+  double time;         /* In internal units. */
+  double scale_factor; /* 1 without cosmology. */
+};
+
 /**
- * @brief Writes a data array in given HDF5 group.
+ * @brief Writes an already converted data array in given HDF5 group.
  *
- * @param e The #engine we are writing from.
  * @param grp The group in which to write.
- * @param fileName The name of the file in which the data is written
- * @param partTypeGroupName The name of the group containing the particles in
- * the HDF5 file.
- * @param props The #io_props of the field to read
+ * @param temp The buffer containing the data in snapshot units.
+ * @param props The #io_props of the field to write
  * @param N The number of particles to write.
  * @param lossy_compression Level of lossy compression to use for this field.
- * @param internal_units The #unit_system used internally
+ * @param gzip_level Level of lossless (GZIP) compression to use.
+ * @param a The scale-factor at which the snapshot is written.
  * @param snapshot_units The #unit_system used in the snapshots
- *
- * @todo A better version using HDF5 hyper-slabs to write the file directly from
- * the part array will be written once the structures have been stabilized.
+ * @param chunks The data already compressed on the threadpool (or NULL).
+ * @param chunk_length The number of rows per compressed chunk.
  */
-void write_distributed_array(
-    const struct engine* e, hid_t grp, const char* fileName,
-    const char* partTypeGroupName, const struct io_props props, const size_t N,
+static void write_distributed_array_hdf5(
+    hid_t grp, const void* temp, const struct io_props props, const size_t N,
     const enum lossy_compression_schemes lossy_compression,
-    const struct unit_system* internal_units,
-    const struct unit_system* snapshot_units) {
-
-#ifdef IO_SPEED_MEASUREMENT
-  const ticks tic_total = getticks();
-#endif
-
-  const size_t typeSize = io_sizeof_type(props.type);
-  const size_t num_elements = N * props.dimension;
-
-  /* message("Writing '%s' array...", props.name); */
-
-  /* Allocate temporary buffer */
-  void* temp = NULL;
-  if (swift_memalign("writebuff", (void**)&temp, IO_BUFFER_ALIGNMENT,
-                     num_elements * typeSize) != 0)
-    error("Unable to allocate temporary i/o buffer");
-
-#ifdef IO_SPEED_MEASUREMENT
-  ticks tic = getticks();
-#endif
-
-  /* Copy the particle data to the temporary buffer */
-  io_copy_temp_buffer(temp, e, props, N, internal_units, snapshot_units);
-
-#ifdef IO_SPEED_MEASUREMENT
-  if (engine_rank == IO_SPEED_MEASUREMENT || IO_SPEED_MEASUREMENT == -1)
-    message("Copying for '%s' took %.3f %s.", props.name,
-            clocks_from_ticks(getticks() - tic), clocks_getunit());
-#endif
+    const int gzip_level, const double a,
+    const struct unit_system* snapshot_units, const struct io_chunk* chunks,
+    const size_t chunk_length) {
 
   /* Create data space */
   hid_t h_space;
@@ -153,6 +136,9 @@ void write_distributed_array(
   /* Make sure the chunks are not larger than the dataset */
   if (chunk_shape[0] > N) chunk_shape[0] = N;
 
+  /* Pre-compressed data comes with its own chunking */
+  if (chunks != NULL) chunk_shape[0] = chunk_length;
+
   /* Change shape of data space */
   hid_t h_err = H5Sset_extent_simple(h_space, rank, shape, shape);
   if (h_err < 0)
@@ -181,13 +167,13 @@ void write_distributed_array(
                                  props.name, comp_buffer);
 
     /* Impose GZIP data compression */
-    if (e->snapshot_compression > 0) {
+    if (gzip_level > 0) {
       h_err = H5Pset_shuffle(h_prop);
       if (h_err < 0)
         error("Error while setting shuffling options for field '%s'.",
               props.name);
 
-      h_err = H5Pset_deflate(h_prop, e->snapshot_compression);
+      h_err = H5Pset_deflate(h_prop, gzip_level);
       if (h_err < 0)
         error("Error while setting compression options for field '%s'.",
               props.name);
@@ -205,18 +191,29 @@ void write_distributed_array(
   if (h_data < 0) error("Error while creating dataspace '%s'.", props.name);
 
 #ifdef IO_SPEED_MEASUREMENT
-  tic = getticks();
+  const ticks tic = getticks();
+#endif
+
+  if (chunks != NULL) {
+
+#if defined(IO_THREADED_COMPRESSION)
+    /* Write the compressed chunks as they are */
+    io_write_compressed_chunks(h_data, chunks, N, chunk_length);
 #endif
 
-  /* Write temporary buffer to HDF5 dataspace */
-  h_err = H5Dwrite(h_data, io_hdf5_type(props.type), h_space, H5S_ALL,
-                   H5P_DEFAULT, temp);
-  if (h_err < 0) error("Error while writing data array '%s'.", props.name);
+  } else {
+
+    /* Write temporary buffer to HDF5 dataspace */
+    h_err = H5Dwrite(h_data, io_hdf5_type(props.type), h_space, H5S_ALL,
+                     H5P_DEFAULT, temp);
+    if (h_err < 0) error("Error while writing data array '%s'.", props.name);
+  }
 
 #ifdef IO_SPEED_MEASUREMENT
   ticks toc = getticks();
   float ms = clocks_from_ticks(toc - tic);
-  int megaBytes = N * props.dimension * typeSize / (1024 * 1024);
+  int megaBytes =
+      N * props.dimension * io_sizeof_type(props.type) / (1024 * 1024);
   if (engine_rank == IO_SPEED_MEASUREMENT || IO_SPEED_MEASUREMENT == -1)
     message(
         "H5Dwrite for '%s' (%d MB) on rank %d took %.3f %s (speed = %f MB/s).",
@@ -250,7 +247,7 @@ void write_distributed_array(
   io_write_attribute_d(
       h_data,
       "Conversion factor to physical CGS (including cosmological corrections)",
-      factor * pow(e->cosmology->a, props.scale_factor_exponent));
+      factor * pow(a, props.scale_factor_exponent));
 
 #ifdef SWIFT_DEBUG_CHECKS
   if (strlen(props.description) == 0)
@@ -260,37 +257,258 @@ void write_distributed_array(
   /* Write the full description */
   io_write_attribute_s(h_data, "Description", props.description);
 
-  /* Free and close everything */
-  swift_free("writebuff", temp);
+  /* Close everything */
   H5Tclose(h_type);
   H5Pclose(h_prop);
   H5Dclose(h_data);
   H5Sclose(h_space);
+}
+
+/*! Data needed to write one array from the asynchronous i/o thread */
+struct write_distributed_array_job {
+  hid_t h_file;
+  char partTypeGroupName[PARTICLE_GROUP_BUFFER_SIZE];
+  struct io_props props;
+  size_t N;
+  enum lossy_compression_schemes lossy_compression;
+  int gzip_level;
+  double a;
+  const struct unit_system* snapshot_units;
+  void* temp;
+  struct io_chunk* chunks;
+  size_t chunk_length;
+};
+
+/**
+ * @brief Writes a staged array from the asynchronous i/o thread.
+ *
+ * @param data The #write_distributed_array_job.
+ */
+static void write_distributed_array_async(void* data) {
+
+  struct write_distributed_array_job* job =
+      (struct write_distributed_array_job*)data;
+
+  const hid_t h_grp = H5Gopen(job->h_file, job->partTypeGroupName, H5P_DEFAULT);
+  if (h_grp < 0) error("Error while opening particle group.");
+
+  write_distributed_array_hdf5(h_grp, job->temp, job->props, job->N,
+                               job->lossy_compression, job->gzip_level, job->a,
+                               job->snapshot_units, job->chunks,
+                               job->chunk_length);
+
+  /* The file is really closed once the last job releases it */
+  H5Gclose(h_grp);
+  H5Fclose(job->h_file);
+#if defined(IO_THREADED_COMPRESSION)
+  if (job->chunks != NULL)
+    io_free_compressed_chunks(job->chunks, job->N, job->chunk_length);
+#endif
+  if (job->temp != NULL) swift_free("writebuff", job->temp);
+  free(job);
+}
+
+/**
+ * @brief Writes a data array in given HDF5 group.
+ *
+ * With asynchronous snapshots, the data is only converted into a staging
+ * buffer here and the HDF5 calls are left to the i/o thread. The caller must
+ * then hold the HDF5 lock.
+ *
+ * @param e The #engine we are writing from.
+ * @param grp The group in which to write.
+ * @param fileName The name of the file in which the data is written
+ * @param partTypeGroupName The name of the group containing the particles in
+ * the HDF5 file.
+ * @param props The #io_props of the field to read
+ * @param N The number of particles to write.
+ * @param ptype The type of the particles.
+ * @param lossy_compression Level of lossy compression to use for this field.
+ * @param internal_units The #unit_system used internally
+ * @param snapshot_units The #unit_system used in the snapshots
+ *
+ * @todo A better version using HDF5 hyper-slabs to write the file directly from
+ * the part array will be written once the structures have been stabilized.
+ */
+void write_distributed_array(
+    const struct engine* e, hid_t grp, const char* fileName,
+    const char* partTypeGroupName, const struct io_props props, const size_t N,
+    const int ptype, const enum lossy_compression_schemes lossy_compression,
+    const struct unit_system* internal_units,
+    const struct unit_system* snapshot_units) {
+
+#ifdef IO_SPEED_MEASUREMENT
+  const ticks tic_total = getticks();
+#endif
+
+  const size_t typeSize = io_sizeof_type(props.type);
+  const size_t num_elements = N * props.dimension;
+
+  /* Are we also writing a stratified subsample of this type? */
+  const int with_subsample = e->snapshot_stratified_fraction[ptype] > 0.f;
+  char subsampleGroupName[PARTICLE_GROUP_BUFFER_SIZE];
+  snprintf(subsampleGroupName, PARTICLE_GROUP_BUFFER_SIZE,
+           "/Subsample/PartType%d", ptype);
+  size_t N_sub = 0;
+  void* temp_sub = NULL;
+
+  /* message("Writing '%s' array...", props.name); */
+
+  if (e->snapshot_async != NULL) {
+
+    /* Let the i/o thread use the library while we convert the data */
+    io_hdf5_unlock();
+    void* temp =
+        io_async_alloc(e->snapshot_async, "writebuff", num_elements * typeSize);
+    io_copy_temp_buffer(temp, e, props, N, internal_units, snapshot_units);
+    if (with_subsample)
+      temp_sub = io_stratified_subsample(e, temp, props, N, ptype, &N_sub);
+
+    /* Compress the data now while we still have the threadpool */
+    size_t chunk_length = 0;
+    struct io_chunk* chunks = io_compress_field(
+        e, temp, props, N, lossy_compression == compression_write_lossless,
+        &chunk_length);
+    size_t staged_size = num_elements * typeSize;
+    if (chunks != NULL) {
+      swift_free("writebuff", temp);
+      temp = NULL;
+
+      /* Only the compressed chunks are held from now on */
+#if defined(IO_THREADED_COMPRESSION)
+      const size_t compressed_size =
+          io_compressed_chunks_size(chunks, N, chunk_length);
+      io_async_restage(e->snapshot_async, staged_size, compressed_size);
+      staged_size = compressed_size;
+#endif
+    }
+    io_hdf5_lock();
+
+    struct write_distributed_array_job* job =
+        (struct write_distributed_array_job*)malloc(
+            sizeof(struct write_distributed_array_job));
+    if (job == NULL) error("Unable to allocate asynchronous i/o job");
+    job->h_file = H5Iget_file_id(grp);
+    strcpy(job->partTypeGroupName, partTypeGroupName);
+    job->props = props;
+    job->N = N;
+    job->lossy_compression = lossy_compression;
+    job->gzip_level = e->snapshot_compression;
+    job->a = e->cosmology->a;
+    job->snapshot_units = snapshot_units;
+    job->temp = temp;
+    job->chunks = chunks;
+    job->chunk_length = chunk_length;
+
+    io_async_submit(e->snapshot_async, write_distributed_array_async, job,
+                    staged_size);
+
+    /* The subsample is small and not accounted for in the staging budget */
+    if (with_subsample) {
+      struct write_distributed_array_job* sub_job =
+          (struct write_distributed_array_job*)malloc(
+              sizeof(struct write_distributed_array_job));
+      if (sub_job == NULL) error("Unable to allocate asynchronous i/o job");
+      *sub_job = *job;
+      sub_job->h_file = H5Iget_file_id(grp);
+      strcpy(sub_job->partTypeGroupName, subsampleGroupName);
+      sub_job->N = N_sub;
+      sub_job->temp = temp_sub;
+      sub_job->chunks = NULL;
+      sub_job->chunk_length = 0;
+      io_async_submit(e->snapshot_async, write_distributed_array_async,
+                      sub_job, /*size=*/0);
+    }
+    return;
+  }
+
+  /* Allocate temporary buffer */
+  void* temp = NULL;
+  if (swift_memalign("writebuff", (void**)&temp, IO_BUFFER_ALIGNMENT,
+                     num_elements * typeSize) != 0)
+    error("Unable to allocate temporary i/o buffer");
+
+#ifdef IO_SPEED_MEASUREMENT
+  ticks tic = getticks();
+#endif
+
+  /* Copy the particle data to the temporary buffer */
+  io_copy_temp_buffer(temp, e, props, N, internal_units, snapshot_units);
+  if (with_subsample)
+    temp_sub = io_stratified_subsample(e, temp, props, N, ptype, &N_sub);
 
 #ifdef IO_SPEED_MEASUREMENT
   if (engine_rank == IO_SPEED_MEASUREMENT || IO_SPEED_MEASUREMENT == -1)
-    message("'%s' took %.3f %s.", props.name,
+    message("Copying for '%s' took %.3f %s.", props.name,
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 #endif
+
+  /* Run the compression filters on the threadpool if we can */
+  size_t chunk_length = 0;
+  struct io_chunk* chunks = io_compress_field(
+      e, temp, props, N, lossy_compression == compression_write_lossless,
+      &chunk_length);
+  if (chunks != NULL) {
+    swift_free("writebuff", temp);
+    temp = NULL;
+  }
+
+  write_distributed_array_hdf5(grp, temp, props, N, lossy_compression,
+                               e->snapshot_compression, e->cosmology->a,
+                               snapshot_units, chunks, chunk_length);
+
+#if defined(IO_THREADED_COMPRESSION)
+  if (chunks != NULL) io_free_compressed_chunks(chunks, N, chunk_length);
+#endif
+  if (temp != NULL) swift_free("writebuff", temp);
+
+  /* And the subsample next to the other ones */
+  if (with_subsample) {
+    const hid_t h_grp_sub = H5Gopen(grp, subsampleGroupName, H5P_DEFAULT);
+    if (h_grp_sub < 0) error("Error while opening subsample group.");
+    write_distributed_array_hdf5(h_grp_sub, temp_sub, props, N_sub,
+                                 lossy_compression, e->snapshot_compression,
+                                 e->cosmology->a, snapshot_units,
+                                 /*chunks=*/NULL, /*chunk_length=*/0);
+    H5Gclose(h_grp_sub);
+    swift_free("writebuff", temp_sub);
+  }
+
+#ifdef IO_SPEED_MEASUREMENT
+  if (engine_rank == IO_SPEED_MEASUREMENT || IO_SPEED_MEASUREMENT == -1)
+    message("'%s' took %.3f %s.", props.name,
+            clocks_from_ticks(getticks() - tic_total), clocks_getunit());
+#endif
 }
 
 /**
  * @brief Prepares an array in the snapshot.
  *
+ * The virtual mappings are built from the number of particles written by
+ * each rank, which we know from the write phase. Ranks that did not write
+ * any particle of this type are not mapped.
+ *
  * @param e The #engine we are writing from.
  * @param grp The HDF5 grp to write to.
- * @param fileName The name of the file we are writing to.
- * @param xmfFile The (opened) XMF file we are appending to.
+ * @param fileName_base The base name of the files we are writing to.
+ * @param fileName_relative_base The same without its directory.
+ * @param xmfFile The (opened) XMF file we are appending to (can be NULL).
  * @param partTypeGroupName The name of the group we are writing to.
+ * @param sourceGroupName The name of the group to map to in the other files.
  * @param props The #io_props of the field to write.
  * @param N_total The total number of particles to write in this array.
+ * @param N_counts The number of particles of each type written by each rank.
+ * @param num_ranks The number of ranks (i.e. files).
+ * @param ptype The particle type.
+ * @param lossy_compression The lossy filter applied to this field.
  * @param snapshot_units The units used for the data in this snapshot.
  */
 void write_array_virtual(struct engine* e, hid_t grp, const char* fileName_base,
-                         FILE* xmfFile, char* partTypeGroupName,
-                         struct io_props props, long long N_total,
-                         const long long* N_counts, const int num_ranks,
-                         const int ptype,
+                         const char* fileName_relative_base, FILE* xmfFile,
+                         char* partTypeGroupName, const char* sourceGroupName,
+                         struct io_props props,
+                         long long N_total, const long long* N_counts,
+                         const int num_ranks, const int ptype,
                          const enum lossy_compression_schemes lossy_compression,
                          const struct unit_system* snapshot_units) {
 
@@ -344,15 +562,7 @@ void write_array_virtual(struct engine* e, hid_t grp, const char* fileName_base,
 
   /* The name of the dataset to map to in the other files */
   char source_dataset_name[256];
-  sprintf(source_dataset_name, "PartType%d/%s", ptype, props.name);
-
-  /* Construct a relative base name */
-  char fileName_relative_base[256];
-  int pos_last_slash = strlen(fileName_base) - 1;
-  for (/* */; pos_last_slash >= 0; --pos_last_slash)
-    if (fileName_base[pos_last_slash] == '/') break;
-
-  sprintf(fileName_relative_base, "%s", &fileName_base[pos_last_slash + 1]);
+  sprintf(source_dataset_name, "%s/%s", sourceGroupName, props.name);
 
   /* Create all the virtual mappings */
   for (int i = 0; i < num_ranks; ++i) {
@@ -360,6 +570,9 @@ void write_array_virtual(struct engine* e, hid_t grp, const char* fileName_base,
     /* Get the number of particles of this type written on this rank */
     count[0] = N_counts[i * swift_type_count + ptype];
 
+    /* Nothing to map to in this file */
+    if (count[0] == 0) continue;
+
     /* Select the space in the virtual file */
     h_err = H5Sselect_hyperslab(h_space, H5S_SELECT_SET, start, /*stride=*/NULL,
                                 count, /*block=*/NULL);
@@ -450,9 +663,15 @@ void write_array_virtual(struct engine* e, hid_t grp, const char* fileName_base,
  * @brief Prepares a file for a parallel write.
  *
  * @param e The #engine.
- * @param fileName The file name to write to.
+ * @param fileName_base The base name of the files of this snapshot.
+ * @param xmfFileName The name of the XMF file (NULL to skip it).
+ * @param systemname The name of the system written in the header.
  * @param N_total The total number of particles of each type to write.
+ * @param N_counts The number of particles of each type written by each rank.
+ * @param num_ranks The number of ranks (i.e. files).
+ * @param to_write Whether or not specific particle types must be written.
  * @param numFields The number of fields to write for each particle type.
+ * @param current_selection_name The name of the current output selection.
  * @param internal_units The #unit_system used internally.
  * @param snapshot_units The #unit_system used in the snapshots.
  * @param fof Is this a snapshot related to a stand-alone FOF call?
@@ -460,7 +679,7 @@ void write_array_virtual(struct engine* e, hid_t grp, const char* fileName_base,
  * @param subsample_fraction The subsampling fraction of each particle type.
  */
 void write_virtual_file(struct engine* e, const char* fileName_base,
-                        const char* xmfFileName,
+                        const char* xmfFileName, const char* systemname,
                         const long long N_total[swift_type_count],
                         const long long* N_counts, const int num_ranks,
                         const int to_write[swift_type_count],
@@ -486,21 +705,37 @@ void write_virtual_file(struct engine* e, const char* fileName_base,
 #endif
   const int with_rt = e->policy & engine_policy_rt;
 
-  FILE* xmfFile = 0;
+  FILE* xmfFile = NULL;
   int numFiles = 1;
 
-  /* First time, we need to create the XMF file */
-  if (e->snapshot_output_count == 0) xmf_create_file(xmfFileName);
-
-  /* Prepare the XMF file for the new entry */
-  xmfFile = xmf_prepare_file(xmfFileName);
+  /* Number of particles in the stratified subsample of each rank */
+  long long* N_sub_counts =
+      (long long*)calloc(num_ranks * swift_type_count, sizeof(long long));
+  if (N_sub_counts == NULL) error("Unable to allocate subsample counts.");
 
   char fileName[1024];
   sprintf(fileName, "%s.hdf5", fileName_base);
 
-  /* Write the part of the XMF file corresponding to this
-   * specific output */
-  xmf_write_outputheader(xmfFile, fileName, e->time);
+  if (xmfFileName != NULL) {
+
+    /* First time, we need to create the XMF file */
+    if (e->snapshot_output_count == 0) xmf_create_file(xmfFileName);
+
+    /* Prepare the XMF file for the new entry */
+    xmfFile = xmf_prepare_file(xmfFileName);
+
+    /* Write the part of the XMF file corresponding to this
+     * specific output */
+    xmf_write_outputheader(xmfFile, fileName, e->time);
+  }
+
+  /* Construct a relative base name for the virtual mappings */
+  char fileName_relative_base[256];
+  int pos_last_slash = strlen(fileName_base) - 1;
+  for (/* */; pos_last_slash >= 0; --pos_last_slash)
+    if (fileName_base[pos_last_slash] == '/') break;
+
+  sprintf(fileName_relative_base, "%s", &fileName_base[pos_last_slash + 1]);
 
   /* Open HDF5 file with the chosen parameters */
   hid_t h_file = H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
@@ -531,7 +766,7 @@ void write_virtual_file(struct engine* e, const char* fileName_base,
   io_write_attribute(h_grp, "Scale-factor", DOUBLE, &e->cosmology->a, 1);
   io_write_attribute_s(h_grp, "Code", "SWIFT");
   io_write_attribute_s(h_grp, "RunName", e->run_name);
-  io_write_attribute_s(h_grp, "System", hostname());
+  io_write_attribute_s(h_grp, "System", systemname);
   io_write_attribute(h_grp, "Shift", DOUBLE, e->s->initial_shift, 3);
 
   /* Write out the particle types */
@@ -620,8 +855,9 @@ void write_virtual_file(struct engine* e, const char* fileName_base,
 
     /* Add the global information for that particle type to
      * the XMF meta-file */
-    xmf_write_groupheader(xmfFile, fileName, /*distributed=*/1, N_total[ptype],
-                          (enum part_type)ptype);
+    if (xmfFile != NULL)
+      xmf_write_groupheader(xmfFile, fileName, /*distributed=*/1,
+                            N_total[ptype], (enum part_type)ptype);
 
     /* Create the particle group in the file */
     char partTypeGroupName[PARTICLE_GROUP_BUFFER_SIZE];
@@ -644,6 +880,27 @@ void write_virtual_file(struct engine* e, const char* fileName_base,
     io_write_attribute_ll(h_grp, "NumberOfParticles", N_total[ptype]);
     io_write_attribute_ll(h_grp, "TotalNumberOfParticles", N_total[ptype]);
 
+    /* And the group of the stratified subsample */
+    const float stratified_fraction = e->snapshot_stratified_fraction[ptype];
+    char subsampleGroupName[PARTICLE_GROUP_BUFFER_SIZE];
+    snprintf(subsampleGroupName, PARTICLE_GROUP_BUFFER_SIZE,
+             "Subsample/PartType%d", ptype);
+    hid_t h_grp_sub = -1;
+    long long N_sub_total = 0;
+    if (stratified_fraction > 0.f) {
+      for (int i = 0; i < num_ranks; ++i) {
+        N_sub_counts[i * swift_type_count + ptype] =
+            io_stratified_subsample_count(
+                N_counts[i * swift_type_count + ptype], stratified_fraction,
+                ptype, e->snapshot_output_count);
+        N_sub_total += N_sub_counts[i * swift_type_count + ptype];
+      }
+      io_create_stratified_subsample_group(h_file, ptype, stratified_fraction,
+                                           N_sub_total);
+      h_grp_sub = H5Gopen(h_file, subsampleGroupName, H5P_DEFAULT);
+      if (h_grp_sub < 0) error("Error while opening subsample group.");
+    }
+
     int num_fields = 0;
     struct io_props list[io_max_size_output_list];
     bzero(list, io_max_size_output_list * sizeof(struct io_props));
@@ -715,9 +972,16 @@ void write_virtual_file(struct engine* e, const char* fileName_base,
               e->verbose);
 
       if (compression_level != compression_do_not_write) {
-        write_array_virtual(e, h_grp, fileName_base, xmfFile, partTypeGroupName,
-                            list[i], N_total[ptype], N_counts, num_ranks, ptype,
-                            compression_level, snapshot_units);
+        write_array_virtual(e, h_grp, fileName_base, fileName_relative_base,
+                            xmfFile, partTypeGroupName, partTypeGroupName + 1,
+                            list[i], N_total[ptype], N_counts, num_ranks,
+                            ptype, compression_level, snapshot_units);
+        if (h_grp_sub >= 0)
+          write_array_virtual(e, h_grp_sub, fileName_base,
+                              fileName_relative_base, /*xmfFile=*/NULL,
+                              subsampleGroupName, subsampleGroupName, list[i],
+                              N_sub_total, N_sub_counts, num_ranks, ptype,
+                              compression_level, snapshot_units);
         num_fields_written++;
       }
     }
@@ -727,16 +991,19 @@ void write_virtual_file(struct engine* e, const char* fileName_base,
 
     /* Close particle group */
     H5Gclose(h_grp);
+    if (h_grp_sub >= 0) H5Gclose(h_grp_sub);
 
     /* Close this particle group in the XMF file as well */
-    xmf_write_groupfooter(xmfFile, (enum part_type)ptype);
+    if (xmfFile != NULL) xmf_write_groupfooter(xmfFile, (enum part_type)ptype);
   }
 
   /* Write LXMF file descriptor */
-  xmf_write_outputfooter(xmfFile, e->snapshot_output_count, e->time);
+  if (xmfFile != NULL)
+    xmf_write_outputfooter(xmfFile, e->snapshot_output_count, e->time);
 
   /* Close the file for now */
   H5Fclose(h_file);
+  free(N_sub_counts);
 
 #else
   error(
@@ -745,6 +1012,49 @@ void write_virtual_file(struct engine* e, const char* fileName_base,
 #endif
 }
 
+/**
+ * @brief Writes a compact binary index of a distributed snapshot.
+ *
+ * The file <fileName_base>.index contains a #distributed_index_header
+ * followed by the number of particles of each type written in each file
+ * (num_files x num_types 64-bit integers). The position of the particles of
+ * a file in the virtual snapshot follows from the counts of the files before
+ * it.
+ *
+ * @param e The #engine.
+ * @param fileName_base The base name of the files of this snapshot.
+ * @param N_counts The number of particles of each type written by each rank.
+ * @param num_ranks The number of ranks (i.e. files).
+ */
+void write_distributed_index(const struct engine* e,
+                             const char* fileName_base,
+                             const long long* N_counts, const int num_ranks) {
+
+  char fileName[1040];
+  sprintf(fileName, "%s.index", fileName_base);
+
+  struct distributed_index_header header;
+  bzero(&header, sizeof(struct distributed_index_header));
+  memcpy(header.signature, "SWIFTIDX", sizeof(header.signature));
+  header.version = 1;
+  header.num_files = num_ranks;
+  header.num_types = swift_type_count;
+  header.time = e->time;
+  header.scale_factor = e->cosmology->a;
+
+  FILE* file = fopen(fileName, "wb");
+  if (file == NULL)
+    error("Error while opening file '%s' (%s).", fileName, strerror(errno));
+
+  if (fwrite(&header, sizeof(struct distributed_index_header), 1, file) != 1 ||
+      fwrite(N_counts, sizeof(long long), (size_t)num_ranks * swift_type_count,
+             file) != (size_t)num_ranks * swift_type_count)
+    error("Error while writing file '%s' (%s).", fileName, strerror(errno));
+
+  if (fclose(file) != 0)
+    error("Error while closing file '%s' (%s).", fileName, strerror(errno));
+}
+
 /**
  * @brief Writes a snapshot distributed into multiple files.
  *
@@ -966,8 +1276,23 @@ void write_output_distributed(struct engine* e,
   /* Collect the number of particles written by each rank */
   long long* N_counts =
       (long long*)malloc(mpi_size * swift_type_count * sizeof(long long));
-  MPI_Gather(N, swift_type_count, MPI_LONG_LONG_INT, N_counts, swift_type_count,
-             MPI_LONG_LONG_INT, 0, comm);
+  MPI_Allgather(N, swift_type_count, MPI_LONG_LONG_INT, N_counts,
+                swift_type_count, MPI_LONG_LONG_INT, comm);
+
+  /* The meta-data files are written by the rank with the least particles to
+   * write such that it can get to them while the others still write their
+   * own data. */
+  int meta_rank = 0;
+  long long meta_rank_count = LLONG_MAX;
+  for (int i = 0; i < mpi_size; ++i) {
+    long long count = 0;
+    for (int ptype = 0; ptype < swift_type_count; ++ptype)
+      count += N_counts[i * swift_type_count + ptype];
+    if (count < meta_rank_count) {
+      meta_rank = i;
+      meta_rank_count = count;
+    }
+  }
 
   /* List what fields to write.
    * Note that we want to want to write a 0-size dataset for some species
@@ -996,6 +1321,10 @@ void write_output_distributed(struct engine* e,
     }
   }
 
+  /* Keep the library to ourselves while an asynchronous write of the
+   * fields may be going on in the background */
+  if (e->snapshot_async != NULL) io_hdf5_lock();
+
   /* Open file */
   /* message("Opening file '%s'.", fileName); */
   h_file = H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
@@ -1127,7 +1456,8 @@ void write_output_distributed(struct engine* e,
                         e->s->nr_cells, e->s->width, mpi_rank,
                         /*distributed=*/1, subsample, subsample_fraction,
                         e->snapshot_output_count, N_total, global_offsets,
-                        to_write, numFields, internal_units, snapshot_units);
+                        to_write, numFields, e->snapshot_cell_index_depth,
+                        internal_units, snapshot_units);
   H5Gclose(h_grp);
 
   /* Loop over all particle types */
@@ -1158,6 +1488,14 @@ void write_output_distributed(struct engine* e,
     io_write_attribute_ll(h_grp, "NumberOfParticles", N[ptype]);
     io_write_attribute_ll(h_grp, "TotalNumberOfParticles", N_total[ptype]);
 
+    /* Prepare the group of the stratified subsample */
+    if (e->snapshot_stratified_fraction[ptype] > 0.f)
+      io_create_stratified_subsample_group(
+          h_file, ptype, e->snapshot_stratified_fraction[ptype],
+          io_stratified_subsample_count(N[ptype],
+                                        e->snapshot_stratified_fraction[ptype],
+                                        ptype, e->snapshot_output_count));
+
     int num_fields = 0;
     struct io_props list[io_max_size_output_list];
     bzero(list, io_max_size_output_list * sizeof(struct io_props));
@@ -1457,8 +1795,8 @@ void write_output_distributed(struct engine* e,
 
       if (compression_level != compression_do_not_write) {
         write_distributed_array(e, h_grp, fileName, partTypeGroupName, list[i],
-                                Nparticles, compression_level, internal_units,
-                                snapshot_units);
+                                Nparticles, ptype, compression_level,
+                                internal_units, snapshot_units);
         num_fields_written++;
       }
     }
@@ -1482,19 +1820,24 @@ void write_output_distributed(struct engine* e,
 
   /* message("Done writing particles..."); */
 
-  /* Close file */
+  /* Close file (only done once all the fields have been written) */
   H5Fclose(h_file);
 
+  /* Write the binary index instead of the XMF entry? */
+  if (e->snapshot_distributed_index && mpi_rank == meta_rank)
+    write_distributed_index(e, fileName_base, N_counts, mpi_size);
+
 #if H5_VERSION_GE(1, 10, 0)
 
   /* Write the virtual meta-file */
-  if (mpi_rank == 0)
-    write_virtual_file(e, fileName_base, xmfFileName, N_total, N_counts,
-                       mpi_size, to_write, numFields, current_selection_name,
-                       internal_units, snapshot_units, fof, subsample_any,
-                       subsample_fraction);
-
-  /* Make sure nobody is allowed to progress until rank 0 is done. */
+  if (mpi_rank == meta_rank)
+    write_virtual_file(e, fileName_base,
+                       e->snapshot_distributed_index ? NULL : xmfFileName,
+                       systemname, N_total, N_counts, mpi_size, to_write,
+                       numFields, current_selection_name, internal_units,
+                       snapshot_units, fof, subsample_any, subsample_fraction);
+
+  /* Make sure nobody is allowed to progress until the meta-file is done. */
   MPI_Barrier(comm);
 
   /* Now write the top-level cell structure in the virtual file
@@ -1529,7 +1872,8 @@ void write_output_distributed(struct engine* e,
                         e->s->nr_cells, e->s->width, mpi_rank,
                         /*distributed=*/0, subsample, subsample_fraction,
                         e->snapshot_output_count, N_total, global_offsets,
-                        to_write, numFields, internal_units, snapshot_units);
+                        to_write, numFields, e->snapshot_cell_index_depth,
+                        internal_units, snapshot_units);
 
   /* Close everything */
   if (mpi_rank == 0) {
@@ -1539,6 +1883,8 @@ void write_output_distributed(struct engine* e,
 
 #endif
 
+  if (e->snapshot_async != NULL) io_hdf5_unlock();
+
   /* Free the counts-per-rank array */
   free(N_counts);
 
@@ -49,12 +49,13 @@
  * @param ti_current Integer end of time-step (for debugging checks).
  * @param grav_props The properties of the gravity scheme.
  * @param e the #engine
+ * @param lightcone_crossings The lightcone crossing checks of the #cell.
  */
 __attribute__((always_inline)) INLINE static void drift_gpart(
     struct gpart *restrict gp, double dt_drift, integertime_t ti_old,
     integertime_t ti_current, const struct gravity_props *grav_props,
-    const struct engine *e, struct replication_list *replication_list,
-    const double cell_loc[3]) {
+    const struct engine *e,
+    const struct lightcone_cell_crossings *lightcone_crossings) {
 
 #ifdef SWIFT_DEBUG_CHECKS
   if (gp->time_bin == time_bin_not_created) {
@@ -115,8 +116,8 @@ __attribute__((always_inline)) INLINE static void drift_gpart(
     case swift_type_neutrino:
       /* This particle has no *part counterpart, so check for lightcone crossing
        * here */
-      lightcone_check_particle_crosses(e, replication_list, x, v_full, gp,
-                                       dt_drift, ti_old, ti_current, cell_loc);
+      lightcone_check_particle_crosses(lightcone_crossings, x, v_full, gp,
+                                       dt_drift);
       break;
     default:
       /* Particle has a counterpart or is of a type not supported in lightcones
@@ -140,12 +141,13 @@ __attribute__((always_inline)) INLINE static void drift_gpart(
  * @param cosmo The cosmological model.
  * @param hydro_props The properties of the hydro scheme.
  * @param floor The properties of the entropy floor.
+ * @param lightcone_crossings The lightcone crossing checks of the #cell.
  */
 __attribute__((always_inline)) INLINE static void drift_part(
     struct part *restrict p, struct xpart *restrict xp, double dt_drift,
     double dt_kick_hydro, double dt_kick_grav, double dt_therm,
     integertime_t ti_old, integertime_t ti_current, const struct engine *e,
-    struct replication_list *replication_list, const double cell_loc[3]) {
+    const struct lightcone_cell_crossings *lightcone_crossings) {
 
   const struct cosmology *cosmo = e->cosmology;
   const struct hydro_props *hydro_props = e->hydro_properties;
@@ -228,8 +230,8 @@ __attribute__((always_inline)) INLINE static void drift_part(
 #ifdef WITH_LIGHTCONE
   /* Check if the particle crossed the lightcone */
   if (p->gpart)
-    lightcone_check_particle_crosses(e, replication_list, x, v_full, p->gpart,
-                                     dt_drift, ti_old, ti_current, cell_loc);
+    lightcone_check_particle_crosses(lightcone_crossings, x, v_full,
+                                     p->gpart, dt_drift);
 #endif
 }
 
@@ -240,11 +242,12 @@ __attribute__((always_inline)) INLINE static void drift_part(
  * @param dt_drift The drift time-step.
  * @param ti_old Integer start of time-step (for debugging checks).
  * @param ti_current Integer end of time-step (for debugging checks).
+ * @param lightcone_crossings The lightcone crossing checks of the #cell.
  */
 __attribute__((always_inline)) INLINE static void drift_spart(
     struct spart *restrict sp, double dt_drift, integertime_t ti_old,
     integertime_t ti_current, const struct engine *e,
-    struct replication_list *replication_list, const double cell_loc[3]) {
+    const struct lightcone_cell_crossings *lightcone_crossings) {
 
 #ifdef SWIFT_DEBUG_CHECKS
   if (sp->ti_drift != ti_old)
@@ -296,8 +299,8 @@ __attribute__((always_inline)) INLINE static void drift_spart(
 #ifdef WITH_LIGHTCONE
   /* Check for lightcone crossing */
   if (sp->gpart)
-    lightcone_check_particle_crosses(e, replication_list, x, v_full, sp->gpart,
-                                     dt_drift, ti_old, ti_current, cell_loc);
+    lightcone_check_particle_crosses(lightcone_crossings, x, v_full,
+                                     sp->gpart, dt_drift);
 #endif
 }
 
@@ -308,11 +311,12 @@ __attribute__((always_inline)) INLINE static void drift_spart(
  * @param dt_drift The drift time-step.
  * @param ti_old Integer start of time-step (for debugging checks).
  * @param ti_current Integer end of time-step (for debugging checks).
+ * @param lightcone_crossings The lightcone crossing checks of the #cell.
  */
 __attribute__((always_inline)) INLINE static void drift_bpart(
     struct bpart *restrict bp, double dt_drift, integertime_t ti_old,
     integertime_t ti_current, const struct engine *e,
-    struct replication_list *replication_list, const double cell_loc[3]) {
+    const struct lightcone_cell_crossings *lightcone_crossings) {
 
 #ifdef SWIFT_DEBUG_CHECKS
   if (bp->ti_drift != ti_old)
@@ -363,8 +367,8 @@ __attribute__((always_inline)) INLINE static void drift_bpart(
 #ifdef WITH_LIGHTCONE
   /* Check for lightcone crossing */
   if (bp->gpart)
-    lightcone_check_particle_crosses(e, replication_list, x, v_full, bp->gpart,
-                                     dt_drift, ti_old, ti_current, cell_loc);
+    lightcone_check_particle_crosses(lightcone_crossings, x, v_full,
+                                     bp->gpart, dt_drift);
 #endif
 }
 
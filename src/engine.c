@@ -1530,6 +1530,14 @@ int engine_prepare(struct engine *e) {
   if (e->tasks_age % engine_tasksreweight == 1) {
     scheduler_reweight(&e->sched, e->verbose);
   }
+
+  /* Re-weight the tasks using the latest fits of the measured cost model.
+   * The tasks are always re-weighted when they are rebuilt. */
+  const struct scheduler_cost_model *cost_model = e->sched.cost_model;
+  if (cost_model != NULL && cost_model->reweight_frequency > 0 &&
+      e->tasks_age > 0 && e->tasks_age % cost_model->reweight_frequency == 0) {
+    scheduler_reweight(&e->sched, e->verbose);
+  }
   e->tasks_age += 1;
 
   TIMER_TOC2(timer_prepare);
@@ -1763,12 +1771,19 @@ void engine_launch(struct engine *e, const char *call) {
   e->sched.total_ticks += getticks() - tic;
 
   /* accumulate active counts for all runners */
+  const ticks toc = getticks();
   ticks active_time = 0;
+  ticks tail_time = 0;
   for (int i = 0; i < e->nr_threads; ++i) {
     active_time += runner_get_active_time(&e->runners[i]);
+
+    /* Time left idle after the last task of this runner. */
+    const ticks last_task_end = runner_get_last_task_end(&e->runners[i]);
+    tail_time += toc - (last_task_end > tic ? last_task_end : tic);
   }
   e->sched.deadtime.active_ticks += active_time;
-  e->sched.deadtime.waiting_ticks += getticks() - tic;
+  e->sched.deadtime.waiting_ticks += toc - tic;
+  e->sched.deadtime.tail_ticks += tail_time;
 
 #ifdef SWIFT_DEBUG_CHECKS
   e->sched.last_successful_task_fetch = 0LL;
@@ -1923,6 +1938,7 @@ void engine_run_rt_sub_cycles(struct engine *e) {
     /* reset the deadtime information in the scheduler */
     e->sched.deadtime.active_ticks = 0;
     e->sched.deadtime.waiting_ticks = 0;
+    e->sched.deadtime.tail_ticks = 0;
 
     /* Set and re-set times, bins, etc. */
     e->rt_updates = 0ll;
@@ -2032,6 +2048,7 @@ void engine_init_particles(struct engine *e, int flag_entropy_ICs,
   /* reset the deadtime information in the scheduler */
   e->sched.deadtime.active_ticks = 0;
   e->sched.deadtime.waiting_ticks = 0;
+  e->sched.deadtime.tail_ticks = 0;
 
   /* Update the softening lengths */
   if (e->policy & engine_policy_self_gravity)
@@ -2231,6 +2248,7 @@ void engine_init_particles(struct engine *e, int flag_entropy_ICs,
   const ticks deadticks = (e->nr_threads * e->sched.deadtime.waiting_ticks) -
                           e->sched.deadtime.active_ticks;
   e->local_deadtime = clocks_from_ticks(deadticks);
+  e->local_tailtime = clocks_from_ticks(e->sched.deadtime.tail_ticks);
 
   /* Recover the (integer) end of the next time-step */
   engine_collect_end_of_step(e, 1);
@@ -2389,6 +2407,7 @@ int engine_step(struct engine *e) {
   /* reset the deadtime information in the scheduler */
   e->sched.deadtime.active_ticks = 0;
   e->sched.deadtime.waiting_ticks = 0;
+  e->sched.deadtime.tail_ticks = 0;
 
 #if defined(SWIFT_MPIUSE_REPORTS) && defined(WITH_MPI)
   /* We may want to compare times across ranks, so make sure all steps start
@@ -2400,17 +2419,18 @@ int engine_step(struct engine *e) {
   if (e->nodeID == 0) {
 
     const double dead_time = e->global_deadtime / (e->nr_nodes * e->nr_threads);
+    const double tail_time = e->global_tailtime / (e->nr_nodes * e->nr_threads);
 
     const ticks tic_files = getticks();
 
     /* Print some information to the screen */
     printf(
         "  %6d %14e %12.7f %12.7f %14e %4d %4d %12lld %12lld %12lld "
-        "%12lld %12lld %21.3f %6d %17.3f\n",
+        "%12lld %12lld %21.3f %6d %17.3f %17.3f\n",
         e->step, e->time, e->cosmology->a, e->cosmology->z, e->time_step,
         e->min_active_bin, e->max_active_bin, e->updates, e->g_updates,
         e->s_updates, e->sink_updates, e->b_updates, e->wallclock_time,
-        e->step_props, dead_time);
+        e->step_props, dead_time, tail_time);
 #ifdef SWIFT_DEBUG_CHECKS
     fflush(stdout);
 #endif
@@ -2433,11 +2453,11 @@ int engine_step(struct engine *e) {
       fprintf(
           e->file_timesteps,
           "  %6d %14e %12.7f %12.7f %14e %4d %4d %12lld %12lld %12lld %12lld "
-          "%12lld %21.3f %6d %17.3f\n",
+          "%12lld %21.3f %6d %17.3f %17.3f\n",
           e->step, e->time, e->cosmology->a, e->cosmology->z, e->time_step,
           e->min_active_bin, e->max_active_bin, e->updates, e->g_updates,
           e->s_updates, e->sink_updates, e->b_updates, e->wallclock_time,
-          e->step_props, dead_time);
+          e->step_props, dead_time, tail_time);
 #ifdef SWIFT_DEBUG_CHECKS
     fflush(e->file_timesteps);
 #endif
@@ -2725,6 +2745,14 @@ int engine_step(struct engine *e) {
   engine_launch(e, "tasks");
   TIMER_TOC(timer_runners);
 
+  /* Update the measured task costs with the timings of this step. */
+  if (e->sched.cost_model != NULL) {
+    scheduler_cost_model_update(&e->sched, e->tic_step, e->verbose);
+    if (e->sched.cost_model->dump_frequency != 0 &&
+        e->step % e->sched.cost_model->dump_frequency == 0)
+      scheduler_cost_model_dump(&e->sched, e->step);
+  }
+
   /* Now record the CPU times used by the tasks. */
 // #ifdef WITH_MPI
 //   double end_usertime = 0.0;
@@ -2788,6 +2816,7 @@ int engine_step(struct engine *e) {
   const ticks deadticks = (e->nr_threads * e->sched.deadtime.waiting_ticks) -
                           e->sched.deadtime.active_ticks;
   e->local_deadtime = clocks_from_ticks(deadticks);
+  e->local_tailtime = clocks_from_ticks(e->sched.deadtime.tail_ticks);
 
   /* Collect information about the next time-step */
   engine_collect_end_of_step(e, 1);
@@ -2821,6 +2850,7 @@ int engine_step(struct engine *e) {
   if (e->policy & engine_policy_csds && e->verbose)
     message("The CSDS currently uses %f GB of storage",
             e->collect_group1.csds_file_size_gb);
+  if (e->policy & engine_policy_csds) csds_report_overhead(e->csds, e);
 #endif
 
     /********************************************************/
@@ -3277,8 +3307,28 @@ void engine_init(
   }
   e->snapshot_compression =
       parser_get_opt_param_int(params, "Snapshots:compression", 0);
+  e->snapshot_threaded_compression =
+      parser_get_opt_param_int(params, "Snapshots:threaded_compression", 0);
   e->snapshot_distributed =
       parser_get_opt_param_int(params, "Snapshots:distributed", 0);
+  e->snapshot_distributed_index =
+      parser_get_opt_param_int(params, "Snapshots:distributed_index", 0);
+  e->snapshot_cell_index_depth =
+      parser_get_opt_param_int(params, "Snapshots:cell_index_depth", 0);
+  if (e->snapshot_cell_index_depth < 0)
+    error("Snapshots:cell_index_depth must be positive or zero.");
+  parser_get_opt_param_float_array(params,
+                                   "Snapshots:stratified_subsample_fraction",
+                                   swift_type_count,
+                                   e->snapshot_stratified_fraction);
+  for (int ptype = 0; ptype < swift_type_count; ++ptype)
+    if (e->snapshot_stratified_fraction[ptype] < 0.f ||
+        e->snapshot_stratified_fraction[ptype] >= 1.f)
+      error(
+          "Snapshots:stratified_subsample_fraction must be in [0, 1[ "
+          "(type %d: %f).",
+          ptype, e->snapshot_stratified_fraction[ptype]);
+  e->snapshot_async = NULL;
   e->snapshot_lustre_OST_count =
       parser_get_opt_param_int(params, "Snapshots:lustre_OST_count", 0);
   e->snapshot_invoke_stf =
@@ -3710,6 +3760,13 @@ void engine_recompute_displacement_constraint(struct engine *e) {
  * @param restart Was this a run that was restarted from check-point files?
  */
 void engine_clean(struct engine *e, const int fof, const int restart) {
+  /* Complete any snapshot still being written in the background. */
+  if (e->snapshot_async != NULL) {
+    io_async_clean(e->snapshot_async, e->verbose);
+    free(e->snapshot_async);
+    e->snapshot_async = NULL;
+  }
+
   /* Start by telling the runners to stop. */
   e->step_props = engine_step_prop_done;
   swift_barrier_wait(&e->run_barrier);
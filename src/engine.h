@@ -37,6 +37,7 @@
 #include "clocks.h"
 #include "collectgroup.h"
 #include "ic_info.h"
+#include "io_async.h"
 #include "lightcone/lightcone.h"
 #include "lightcone/lightcone_array.h"
 #include "mesh_gravity.h"
@@ -348,8 +349,13 @@ struct engine {
   float snapshot_subsample_fraction[swift_type_count];
   int snapshot_run_on_dump;
   int snapshot_distributed;
+  int snapshot_distributed_index;
+  int snapshot_cell_index_depth;
+  float snapshot_stratified_fraction[swift_type_count];
   int snapshot_lustre_OST_count;
   int snapshot_compression;
+  int snapshot_threaded_compression;
+  struct io_async *snapshot_async;
   int snapshot_invoke_stf;
   int snapshot_invoke_fof;
   int snapshot_invoke_ps;
@@ -465,6 +471,10 @@ struct engine {
   /* Use synchronous redistributes. */
   int syncredist;
 
+  /* Maximum number of bytes received per round when streaming the
+   * redistribution of particles, 0 to exchange everything at once. */
+  size_t redist_stream_bytes;
+
 #endif
 
   /* Wallclock time of the last time-step */
@@ -590,6 +600,9 @@ struct engine {
   /* Number of Lustre OSTs on the system to use as rank-based striping offset */
   int restart_lustre_OST_count;
 
+  /* Number of restart dumps between two full dumps (<= 1 for only full ones) */
+  int restart_full_every;
+
   /* Do we free the foreign data before writing restart files? */
   int free_foreign_when_dumping_restart;
 
@@ -637,6 +650,12 @@ struct engine {
   /* The globally accumulated deadtime. */
   double global_deadtime;
 
+  /* The locally accumulated idle time at the end of the step. */
+  double local_tailtime;
+
+  /* The globally accumulated idle time at the end of the step. */
+  double global_tailtime;
+
   /* Time-integration mesh kick to apply to the particle velocities for
    * snapshots */
   float dt_kick_grav_mesh_for_io;
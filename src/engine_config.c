@@ -36,6 +36,7 @@
 #include "engine.h"
 
 /* Local headers. */
+#include "common_io.h"
 #include "fof.h"
 #include "line_of_sight.h"
 #include "mpiuse.h"
@@ -417,6 +418,12 @@ void engine_config(int restart, int fof, struct engine *e,
     e->syncredist =
         parser_get_opt_param_int(params, "DomainDecomposition:synchronous", 0);
 
+    /* Exchange particles in bounded rounds when redistributing. */
+    e->redist_stream_bytes =
+        parser_get_opt_param_float(params, "DomainDecomposition:stream_MB",
+                                   0.f) *
+        1024 * 1024;
+
     /* Collect the hostname of each rank into a file */
 
     const int hostname_buffer_length = 256;
@@ -533,11 +540,11 @@ void engine_config(int restart, int fof, struct engine *e,
 
       fprintf(e->file_timesteps,
               "# %6s %14s %12s %12s %14s %9s %12s %12s %12s %12s %12s %16s "
-              "[%s] %6s %12s [%s]\n",
+              "[%s] %6s %12s [%s] %12s [%s]\n",
               "Step", "Time", "Scale-factor", "Redshift", "Time-step",
               "Time-bins", "Updates", "g-Updates", "s-Updates", "Sink-Updates",
               "b-Updates", "Wall-clock time", clocks_getunit(), "Props",
-              "Dead time", clocks_getunit());
+              "Dead time", clocks_getunit(), "Tail idle", clocks_getunit());
       fflush(e->file_timesteps);
 
 #ifndef RT_NONE
@@ -834,6 +841,11 @@ void engine_config(int restart, int fof, struct engine *e,
     e->restart_lustre_OST_count =
         parser_get_opt_param_int(params, "Restarts:lustre_OST_count", 0);
 
+    /* How often to write a full dump rather than a delta against the last
+     * full one. Can be changed on restart. */
+    e->restart_full_every =
+        parser_get_opt_param_int(params, "Restarts:full_dump_every", 0);
+
     /* Hours between restart dumps. Can be changed on restart. */
     float dhours =
         parser_get_opt_param_float(params, "Restarts:delta_hours", 5.0f);
@@ -845,6 +857,10 @@ void engine_config(int restart, int fof, struct engine *e,
 
       if (e->verbose && e->restart_onexit)
         message("Restarts will be dumped after the final step");
+
+      if (e->restart_dump && e->restart_full_every > 1)
+        message("A full set of restarts will be dumped every %d dumps",
+                e->restart_full_every);
     }
 
     /* Internally we use ticks, so convert into a delta ticks. Assumes we can
@@ -919,6 +935,50 @@ void engine_config(int restart, int fof, struct engine *e,
   e->sched.mpi_message_limit =
       parser_get_opt_param_int(params, "Scheduler:mpi_message_limit", 4) * 1024;
 
+  /* Do we want to weight the tasks using their measured costs? The fits are
+   * not kept in the restart files and start again from scratch. */
+  if (parser_get_opt_param_int(params, "Scheduler:cost_model", 0)) {
+    scheduler_cost_model_init(&e->sched);
+    struct scheduler_cost_model *model = e->sched.cost_model;
+    model->decay =
+        parser_get_opt_param_float(params, "Scheduler:cost_model_decay", 0.8f);
+    if (model->decay < 0.f || model->decay > 1.f)
+      error("Scheduler:cost_model_decay should be in [0, 1]");
+    model->min_samples = parser_get_opt_param_float(
+        params, "Scheduler:cost_model_min_samples", 10.f);
+    model->dump_frequency = parser_get_opt_param_int(
+        params, "Scheduler:cost_model_dump_frequency", 0);
+    if (model->dump_frequency < 0)
+      error("Scheduler:cost_model_dump_frequency should be >= 0");
+    model->reweight_frequency = parser_get_opt_param_int(
+        params, "Scheduler:cost_model_reweight_frequency", 0);
+    if (model->reweight_frequency < 0)
+      error("Scheduler:cost_model_reweight_frequency should be >= 0");
+  }
+
+  /* Do we want to reserve some runners for the critical path? */
+  e->sched.critical_path_queues =
+      parser_get_opt_param_int(params, "Scheduler:critical_path_queues", 0);
+  if (e->sched.critical_path_queues < 0 ||
+      e->sched.critical_path_queues >= nr_queues)
+    error("Scheduler:critical_path_queues should be in [0, %d]",
+          nr_queues - 1);
+
+  /* The tasks the reserved runners leave in their queues are run by the other
+   * runners, which needs them to be able to steal. */
+  if (e->sched.critical_path_queues > 0 &&
+      !(e->sched.flags & scheduler_flag_steal))
+    error("Scheduler:critical_path_queues needs task stealing to be enabled");
+  e->sched.critical_path_slack = parser_get_opt_param_float(
+      params, "Scheduler:critical_path_slack", 0.8f);
+  if (e->sched.critical_path_slack < 0.f ||
+      e->sched.critical_path_slack > 1.f)
+    error("Scheduler:critical_path_slack should be in [0, 1]");
+  e->sched.critical_path_lookahead = parser_get_opt_param_float(
+      params, "Scheduler:critical_path_lookahead", 0.25f);
+  if (e->sched.critical_path_lookahead < 0.f)
+    error("Scheduler:critical_path_lookahead should be >= 0");
+
   if (restart) {
 
     /* Overwrite the constants for the scheduler */
@@ -1037,6 +1097,63 @@ void engine_config(int restart, int fof, struct engine *e,
     }
   }
 
+  /* Hand the snapshot writes over to a separate i/o thread? Only the
+   * single-file and distributed writers can do so, the collective ones need
+   * all the ranks to call HDF5 together. */
+  e->snapshot_async = NULL;
+
+#ifdef WITH_MPI
+  /* The stratified subsamples are only written by the single-file and
+   * distributed writers. */
+  if (!e->snapshot_distributed) {
+    int stratified = 0;
+    for (int ptype = 0; ptype < swift_type_count; ++ptype) {
+      stratified |= (e->snapshot_stratified_fraction[ptype] > 0.f);
+      e->snapshot_stratified_fraction[ptype] = 0.f;
+    }
+    if (stratified && nodeID == 0)
+      message(
+          "WARNING: Snapshots:stratified_subsample_fraction requires "
+          "Snapshots:distributed, not writing the subsamples.");
+  }
+#endif
+
+  int async_write =
+      parser_get_opt_param_int(params, "Snapshots:async_write", 0);
+#ifdef WITH_MPI
+  if (async_write && !e->snapshot_distributed) {
+    if (nodeID == 0)
+      message(
+          "WARNING: Snapshots:async_write requires Snapshots:distributed, "
+          "writing synchronously.");
+    async_write = 0;
+  }
+#endif
+  if (async_write) {
+    const size_t budget =
+        parser_get_opt_param_float(params, "Snapshots:async_buffer_MB",
+                                   1024.f) *
+        1024 * 1024;
+    e->snapshot_async = (struct io_async *)malloc(sizeof(struct io_async));
+    if (e->snapshot_async == NULL)
+      error("Failed to allocate the asynchronous i/o writer.");
+    io_async_init(e->snapshot_async, budget);
+    if (verbose && nodeID == 0)
+      message("Writing snapshots asynchronously with a %zd MB buffer.",
+              budget / (1024 * 1024));
+  }
+
+  /* Can we run the snapshot compression filters on the threadpool? */
+#if !defined(IO_THREADED_COMPRESSION)
+  if (e->snapshot_threaded_compression) {
+    if (nodeID == 0)
+      message(
+          "WARNING: Snapshots:threaded_compression requires zlib and HDF5 >= "
+          "1.10.3, leaving the compression to HDF5.");
+    e->snapshot_threaded_compression = 0;
+  }
+#endif
+
 #ifdef WITH_CSDS
   if ((e->policy & engine_policy_csds) && !restart) {
     /* Write the particle csds header */
@@ -370,7 +370,8 @@ void engine_dump_snapshot(struct engine *e, const int fof) {
 
   clocks_gettime(&time2);
   if (e->verbose)
-    message("writing particle properties took %.3f %s.",
+    message("%s particle properties took %.3f %s.",
+            e->snapshot_async != NULL ? "staging" : "writing",
             (float)clocks_diff(&time1, &time2), clocks_getunit());
 
   /* Run the post-dump command if required */
@@ -379,11 +380,31 @@ void engine_dump_snapshot(struct engine *e, const int fof) {
   }
 }
 
+/**
+ * @brief Runs a snapshot dump command.
+ *
+ * @param data The command to run, freed on exit.
+ */
+static void engine_run_dump_command(void *data) {
+
+  char *dump_command = (char *)data;
+
+  /* Let's trust the user's command... */
+  const int result = system(dump_command);
+  if (result != 0) {
+    message("Snapshot dump command returned error code %d", result);
+  }
+  free(dump_command);
+}
+
 /**
  * @brief Runs the snapshot_dump_command if relevant. Note that we
  *        perform no error checking on this command, and assume
  *        it works fine.
  *
+ * With asynchronous snapshots, the command is queued behind the writes
+ * so that it only runs once the file is complete.
+ *
  * @param e The #engine.
  */
 void engine_run_on_dump(struct engine *e) {
@@ -392,15 +413,17 @@ void engine_run_on_dump(struct engine *e) {
      * Note that -1 is used because snapshot_output_count was just
      * increased when the write_output_* functions are called. */
     const int buf_size = PARSER_MAX_LINE_SIZE * 3;
-    char dump_command_buf[buf_size];
+    char *dump_command_buf = (char *)malloc(buf_size);
+    if (dump_command_buf == NULL)
+      error("Failed to allocate the dump command buffer.");
     snprintf(dump_command_buf, buf_size, "%s %s %04d", e->snapshot_dump_command,
              e->snapshot_base_name, e->snapshot_output_count - 1);
 
-    /* Let's trust the user's command... */
-    const int result = system(dump_command_buf);
-    if (result != 0) {
-      message("Snapshot dump command returned error code %d", result);
-    }
+    if (e->snapshot_async != NULL)
+      io_async_submit(e->snapshot_async, engine_run_dump_command,
+                      dump_command_buf, /*size=*/0);
+    else
+      engine_run_dump_command(dump_command_buf);
   }
 }
 
@@ -531,6 +554,10 @@ void engine_io(struct engine *e) {
         if (with_stf && e->snapshot_invoke_stf && !e->stf_this_timestep) {
 
 #ifdef HAVE_VELOCIRAPTOR
+          /* Let any previous snapshot complete before VELOCIraptor accesses
+           * the HDF5 library */
+          io_async_wait(e->snapshot_async);
+
           velociraptor_invoke(e, /*linked_with_snap=*/1);
           e->step_props |= engine_step_prop_stf;
 #else
@@ -580,6 +607,9 @@ void engine_io(struct engine *e) {
 
       case output_stf:
 
+        /* VR writes its own HDF5 files */
+        io_async_wait(e->snapshot_async);
+
         /* Free the mesh memory to get some breathing space */
         if ((e->policy & engine_policy_self_gravity) && e->s->periodic)
           pm_mesh_free(e->mesh);
@@ -612,7 +642,7 @@ void engine_io(struct engine *e) {
 
       case output_los:
 
-        /* Compute the LoS */
+        /* Compute the LoS (written by the i/o thread with async snapshots) */
         do_line_of_sight(e);
 
         /* Move on */
@@ -236,6 +236,408 @@ static void *engine_do_redistribute(const char *label, int *counts, char *parts,
   /* And return new memory. */
   return parts_new;
 }
+
+/**
+ * A run of particles in the array used by engine_do_redistribute_streamed(),
+ * recording where the particles are and where they belong.
+ */
+struct redist_extent {
+
+  /*! Index of the first particle in the array */
+  size_t offset;
+
+  /*! Number of particles */
+  size_t count;
+
+  /*! Index of the first particle once the exchange is complete */
+  size_t final_offset;
+};
+
+/**
+ * Sort #redist_extent by their position in the array.
+ */
+static int redist_extent_cmp(const void *a, const void *b) {
+  const struct redist_extent *ea = (const struct redist_extent *)a;
+  const struct redist_extent *eb = (const struct redist_extent *)b;
+  return (ea->offset > eb->offset) - (ea->offset < eb->offset);
+}
+
+/**
+ * Find the #redist_extent containing a given index of the array.
+ *
+ * @param extents the extents, sorted by offset.
+ * @param nr_extents the number of extents.
+ * @param index the index in the array.
+ *
+ * @result the extent or NULL if that index is free.
+ */
+static const struct redist_extent *redist_extent_find(
+    const struct redist_extent *extents, size_t nr_extents, size_t index) {
+
+  size_t lo = 0, hi = nr_extents;
+  while (hi - lo > 1) {
+    const size_t mid = (lo + hi) / 2;
+    if (extents[mid].offset <= index)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  if (nr_extents == 0 || extents[lo].offset > index ||
+      index >= extents[lo].offset + extents[lo].count)
+    return NULL;
+  return &extents[lo];
+}
+
+/**
+ * Do the exchange of one type of particles with all the other nodes in
+ * rounds of bounded size, re-using the existing particle array.
+ *
+ * In each round every pair of nodes exchanges at most a fixed number of
+ * particles, chosen so that no node receives more than stream_bytes in a
+ * round. The incoming particles of a round are received into a staging
+ * buffer of that size and then copied into the parts of the array freed by
+ * the particles sent so far (or the unused end of the array). Once all the
+ * rounds are done, the particles are permuted in place into the same order
+ * as engine_do_redistribute(), so the part-gpart links can be restored in
+ * the same way.
+ *
+ * The array is only replaced if it is too small to hold the particles of
+ * this node at some point of the exchange, which is always the case if the
+ * node ends up with more particles than the array can hold.
+ *
+ * @param label a label for the memory allocations of this particle type.
+ * @param counts 2D array with the counts of particles to exchange with
+ *               each other node.
+ * @param parts the particle data to exchange, freed if replaced.
+ * @param size_parts the number of particles the current array can hold.
+ * @param new_nr_parts the number of particles this node will have after all
+ *                     exchanges have completed.
+ * @param new_size_parts on exit the number of particles the returned array
+ *                       can hold.
+ * @param sizeofparts sizeof the particle struct.
+ * @param alignsize the memory alignment required for this particle type.
+ * @param mpi_type the MPI_Datatype for these particles.
+ * @param nr_nodes the number of nodes to exchange with.
+ * @param nodeID the id of this node.
+ * @param stream_bytes the maximum number of bytes received in a round.
+ * @param verbose whether to report on the rounds used.
+ *
+ * @result the particle data after all the exchanges.
+ */
+static void *engine_do_redistribute_streamed(
+    const char *label, int *counts, char *parts, size_t size_parts,
+    size_t new_nr_parts, size_t *new_size_parts, size_t sizeofparts,
+    size_t alignsize, MPI_Datatype mpi_type, int nr_nodes, int nodeID,
+    size_t stream_bytes, int verbose) {
+
+  /* Offsets of the blocks of particles to send and of the blocks of
+   * particles in the final array. */
+  size_t *send_offsets = NULL;
+  size_t *recv_offsets = NULL;
+  if ((send_offsets = (size_t *)malloc(sizeof(size_t) * nr_nodes)) == NULL ||
+      (recv_offsets = (size_t *)malloc(sizeof(size_t) * nr_nodes)) == NULL)
+    error("Failed to allocate redistribute offsets.");
+  size_t offset_send = 0, offset_recv = 0;
+  int nr_sources = 0;
+  for (int k = 0; k < nr_nodes; k++) {
+    send_offsets[k] = offset_send;
+    recv_offsets[k] = offset_recv;
+    offset_send += counts[nodeID * nr_nodes + k];
+    offset_recv += counts[k * nr_nodes + nodeID];
+    if (k != nodeID && counts[k * nr_nodes + nodeID] > 0) nr_sources++;
+  }
+  const size_t nr_parts = offset_send;
+  const size_t nr_kept = counts[nodeID * nr_nodes + nodeID];
+
+  /* The largest number of nodes any node exchanges with and the largest
+   * single exchange. All nodes see the same counts so agree on these. */
+  int max_partners = 1;
+  int max_count = 0;
+  for (int i = 0; i < nr_nodes; i++) {
+    int nsend = 0, nrecv = 0;
+    for (int j = 0; j < nr_nodes; j++) {
+      if (i == j) continue;
+      if (counts[i * nr_nodes + j] > 0) nsend++;
+      if (counts[j * nr_nodes + i] > 0) nrecv++;
+      max_count = max(max_count, counts[i * nr_nodes + j]);
+    }
+    max_partners = max(max_partners, nsend);
+    max_partners = max(max_partners, nrecv);
+  }
+
+  /* Number of particles exchanged by a pair of nodes per round, keeping
+   * the messages below 2GB. */
+  size_t chunk = stream_bytes / (sizeofparts * max_partners);
+  chunk = max(chunk, (size_t)1);
+  chunk = min(chunk, (size_t)(INT_MAX / sizeofparts));
+  const int nr_rounds = (max_count + chunk - 1) / chunk;
+
+  /* The largest number of particles we hold during the exchange. Received
+   * particles only take space once the sends of their round are done. */
+  size_t nr_held = nr_parts, max_held = max(nr_parts, new_nr_parts);
+  for (int round = 0; round < nr_rounds; round++) {
+    const size_t done = round * chunk;
+    for (int k = 0; k < nr_nodes; k++) {
+      if (k == nodeID) continue;
+      const size_t nsend = counts[nodeID * nr_nodes + k];
+      const size_t nrecv = counts[k * nr_nodes + nodeID];
+      if (nsend > done) nr_held -= min(chunk, nsend - done);
+      if (nrecv > done) nr_held += min(chunk, nrecv - done);
+    }
+    max_held = max(max_held, nr_held);
+  }
+
+  /* Only replace the array if it cannot hold all that. */
+  int grown = 0;
+  if (max_held > size_parts) {
+    char *parts_new = NULL;
+    if (swift_memalign(label, (void **)&parts_new, alignsize,
+                       sizeofparts * max_held) != 0)
+      error("Failed to allocate new particle data.");
+    memcpy(parts_new, parts, sizeofparts * nr_parts);
+    swift_free(label, parts);
+    parts = parts_new;
+    size_parts = max_held;
+    grown = 1;
+  }
+  *new_size_parts = size_parts;
+
+  /* Staging buffer for the particles received in one round. */
+  char *parts_in = NULL;
+  if (nr_sources > 0 &&
+      (parts_in = (char *)swift_malloc(
+           label, sizeofparts * chunk * nr_sources)) == NULL)
+    error("Failed to allocate incoming particle buffer.");
+
+  /* The free parts of the array: the particles sent to each node so far,
+   * plus the end of the array. */
+  size_t *free_start = NULL;
+  size_t *free_end = NULL;
+  if ((free_start = (size_t *)malloc(sizeof(size_t) * (nr_nodes + 1))) ==
+          NULL ||
+      (free_end = (size_t *)malloc(sizeof(size_t) * (nr_nodes + 1))) == NULL)
+    error("Failed to allocate free space list.");
+  for (int k = 0; k < nr_nodes; k++) {
+    free_start[k] = send_offsets[k];
+    free_end[k] = send_offsets[k];
+  }
+  free_start[nr_nodes] = nr_parts;
+  free_end[nr_nodes] = size_parts;
+
+  /* Where the particles we hold are and where they will go. We start with
+   * just our own particles, which never move until the end. */
+  size_t size_extents = 2 * (nr_sources + 1);
+  size_t nr_extents = 0;
+  struct redist_extent *extents = NULL;
+  if ((extents = (struct redist_extent *)malloc(
+           sizeof(struct redist_extent) * size_extents)) == NULL)
+    error("Failed to allocate redistribute extents.");
+  if (nr_kept > 0) {
+    extents[0].offset = send_offsets[nodeID];
+    extents[0].count = nr_kept;
+    extents[0].final_offset = recv_offsets[nodeID];
+    nr_extents = 1;
+  }
+
+  /* Prepare MPI requests for the asynchronous communications */
+  MPI_Request *reqs;
+  if ((reqs = (MPI_Request *)malloc(sizeof(MPI_Request) * 2 * nr_nodes)) ==
+      NULL)
+    error("Failed to allocate MPI request list.");
+
+  for (int round = 0; round < nr_rounds; round++) {
+
+    for (int k = 0; k < 2 * nr_nodes; k++) reqs[k] = MPI_REQUEST_NULL;
+    const size_t done = round * chunk;
+
+    size_t nr_in = 0;
+    for (int k = 0; k < nr_nodes; k++) {
+      if (k == nodeID) continue;
+
+      /* Indices in the count arrays of the node of interest */
+      const int ind_send = nodeID * nr_nodes + k;
+      const int ind_recv = k * nr_nodes + nodeID;
+
+      /* Next part of the block of particles for this node. */
+      if ((size_t)counts[ind_send] > done) {
+        const int sending = min(chunk, counts[ind_send] - done);
+        int res = MPI_Isend(&parts[(send_offsets[k] + done) * sizeofparts],
+                            sending, mpi_type, k, ind_send, MPI_COMM_WORLD,
+                            &reqs[2 * k + 0]);
+        if (res != MPI_SUCCESS)
+          mpi_error(res, "Failed to isend parts to node %i.", k);
+      }
+
+      /* And the next part of the block from this node. */
+      if ((size_t)counts[ind_recv] > done) {
+        const int receiving = min(chunk, counts[ind_recv] - done);
+        int res = MPI_Irecv(&parts_in[nr_in * sizeofparts], receiving,
+                            mpi_type, k, ind_recv, MPI_COMM_WORLD,
+                            &reqs[2 * k + 1]);
+        if (res != MPI_SUCCESS)
+          mpi_error(res, "Failed to emit irecv of parts from node %i.", k);
+        nr_in += receiving;
+      }
+    }
+
+    /* Wait for all the sends and recvs of this round to tumble in. */
+    MPI_Status stats[2 * nr_nodes];
+    int res;
+    if ((res = MPI_Waitall(2 * nr_nodes, reqs, stats)) != MPI_SUCCESS) {
+      for (int k = 0; k < 2 * nr_nodes; k++) {
+        char buff[MPI_MAX_ERROR_STRING];
+        MPI_Error_string(stats[k].MPI_ERROR, buff, &res);
+        message("request from source %i, tag %i has error '%s'.",
+                stats[k].MPI_SOURCE, stats[k].MPI_TAG, buff);
+      }
+      error("Failed during waitall for part data.");
+    }
+
+    /* The particles sent in this round have freed their space. */
+    for (int k = 0; k < nr_nodes; k++) {
+      const size_t nsend = counts[nodeID * nr_nodes + k];
+      if (k != nodeID && nsend > done)
+        free_end[k] = send_offsets[k] + min(nsend, done + chunk);
+    }
+
+    /* Move the particles received in this round into the free space. */
+    nr_in = 0;
+    for (int k = 0; k < nr_nodes; k++) {
+      const size_t nrecv = counts[k * nr_nodes + nodeID];
+      if (k == nodeID || nrecv <= done) continue;
+
+      size_t left = min(chunk, nrecv - done);
+      size_t final_offset = recv_offsets[k] + done;
+      int j = 0;
+      while (left > 0) {
+        while (j <= nr_nodes && free_start[j] == free_end[j]) j++;
+        if (j > nr_nodes) error("No space left for the incoming particles.");
+
+        const size_t count = min(left, free_end[j] - free_start[j]);
+        memcpy(&parts[free_start[j] * sizeofparts],
+               &parts_in[nr_in * sizeofparts], sizeofparts * count);
+
+        if (nr_extents == size_extents) {
+          size_extents *= 2;
+          if ((extents = (struct redist_extent *)realloc(
+                   extents, sizeof(struct redist_extent) * size_extents)) ==
+              NULL)
+            error("Failed to reallocate redistribute extents.");
+        }
+        extents[nr_extents].offset = free_start[j];
+        extents[nr_extents].count = count;
+        extents[nr_extents].final_offset = final_offset;
+        nr_extents++;
+
+        free_start[j] += count;
+        final_offset += count;
+        nr_in += count;
+        left -= count;
+      }
+    }
+  }
+  free(reqs);
+  free(free_start);
+  free(free_end);
+  if (parts_in != NULL) swift_free(label, parts_in);
+
+  /* Now put every particle in its final place, following the cycles of the
+   * permutation. A particle is picked up once, which frees its slot. */
+  qsort(extents, nr_extents, sizeof(struct redist_extent), redist_extent_cmp);
+  unsigned char *picked = NULL;
+  char *carry = NULL, *swap = NULL;
+  if ((picked = (unsigned char *)calloc(size_parts / 8 + 1, 1)) == NULL ||
+      (carry = (char *)malloc(sizeofparts)) == NULL ||
+      (swap = (char *)malloc(sizeofparts)) == NULL)
+    error("Failed to allocate redistribute permutation buffers.");
+
+  for (size_t n = 0; n < nr_extents; n++) {
+    for (size_t i = 0; i < extents[n].count; i++) {
+      const size_t start = extents[n].offset + i;
+      size_t dest = extents[n].final_offset + i;
+      if (dest == start || (picked[start / 8] & (1 << (start % 8)))) continue;
+
+      memcpy(carry, &parts[start * sizeofparts], sizeofparts);
+      picked[start / 8] |= 1 << (start % 8);
+
+      while (1) {
+        const struct redist_extent *ext =
+            redist_extent_find(extents, nr_extents, dest);
+
+        /* Free slot, we are done with this cycle. */
+        if (ext == NULL || (picked[dest / 8] & (1 << (dest % 8)))) {
+          memcpy(&parts[dest * sizeofparts], carry, sizeofparts);
+          break;
+        }
+
+        /* Otherwise take the particle that is there along. */
+        const size_t next = ext->final_offset + (dest - ext->offset);
+        memcpy(swap, &parts[dest * sizeofparts], sizeofparts);
+        memcpy(&parts[dest * sizeofparts], carry, sizeofparts);
+        picked[dest / 8] |= 1 << (dest % 8);
+        char *temp = carry;
+        carry = swap;
+        swap = temp;
+        dest = next;
+      }
+    }
+  }
+
+  if (verbose)
+    message("%s: %d rounds of up to %zu particles per node pair, %s.", label,
+            nr_rounds, chunk, grown ? "array replaced" : "in place");
+
+  free(picked);
+  free(carry);
+  free(swap);
+  free(extents);
+  free(send_offsets);
+  free(recv_offsets);
+
+  return parts;
+}
+
+/**
+ * Exchange one type of particles with all the other nodes and replace the
+ * local array with the result.
+ *
+ * Uses engine_do_redistribute_streamed() when a streaming buffer size is
+ * set, otherwise engine_do_redistribute().
+ *
+ * @param e the #engine.
+ * @param label a label for the memory allocations of this particle type.
+ * @param counts 2D array with the counts of particles to exchange with
+ *               each other node.
+ * @param parts the particle data to exchange, freed unless reused.
+ * @param size_parts the number of particles the current array can hold.
+ * @param new_nr_parts the number of particles this node will have after all
+ *                     exchanges have completed.
+ * @param new_size_parts on exit the number of particles the returned array
+ *                       can hold.
+ * @param sizeofparts sizeof the particle struct.
+ * @param alignsize the memory alignment required for this particle type.
+ * @param mpi_type the MPI_Datatype for these particles.
+ *
+ * @result the new particle data.
+ */
+static void *engine_redistribute_exchange(
+    const struct engine *e, const char *label, int *counts, char *parts,
+    size_t size_parts, size_t new_nr_parts, size_t *new_size_parts,
+    size_t sizeofparts, size_t alignsize, MPI_Datatype mpi_type) {
+
+  if (e->redist_stream_bytes > 0)
+    return engine_do_redistribute_streamed(
+        label, counts, parts, size_parts, new_nr_parts, new_size_parts,
+        sizeofparts, alignsize, mpi_type, e->nr_nodes, e->nodeID,
+        e->redist_stream_bytes, e->verbose);
+
+  void *parts_new = engine_do_redistribute(
+      label, counts, parts, new_nr_parts, sizeofparts, alignsize, mpi_type,
+      e->nr_nodes, e->nodeID, e->syncredist);
+  *new_size_parts = engine_redistribute_alloc_margin * new_nr_parts;
+  swift_free(label, parts);
+  return parts_new;
+}
 #endif
 
 #ifdef WITH_MPI /* redist_mapper */
@@ -1036,50 +1438,40 @@ void engine_redistribute(struct engine *e) {
    * under control. */
 
   /* SPH particles. */
-  void *new_parts = engine_do_redistribute(
-      "parts", counts, (char *)s->parts, nr_parts_new, sizeof(struct part),
-      part_align, part_mpi_type, nr_nodes, nodeID, e->syncredist);
-  swift_free("parts", s->parts);
+  const size_t size_parts = s->size_parts;
+  void *new_parts = engine_redistribute_exchange(
+      e, "parts", counts, (char *)s->parts, size_parts, nr_parts_new,
+      &s->size_parts, sizeof(struct part), part_align, part_mpi_type);
   s->parts = (struct part *)new_parts;
   s->nr_parts = nr_parts_new;
-  s->size_parts = engine_redistribute_alloc_margin * nr_parts_new;
 
   /* Extra SPH particle properties. */
-  new_parts = engine_do_redistribute(
-      "xparts", counts, (char *)s->xparts, nr_parts_new, sizeof(struct xpart),
-      xpart_align, xpart_mpi_type, nr_nodes, nodeID, e->syncredist);
-  swift_free("xparts", s->xparts);
+  size_t size_xparts = 0;
+  new_parts = engine_redistribute_exchange(
+      e, "xparts", counts, (char *)s->xparts, size_parts, nr_parts_new,
+      &size_xparts, sizeof(struct xpart), xpart_align, xpart_mpi_type);
   s->xparts = (struct xpart *)new_parts;
 
   /* Gravity particles. */
-  new_parts =
-      engine_do_redistribute("gparts", g_counts, (char *)s->gparts,
-                             nr_gparts_new, sizeof(struct gpart), gpart_align,
-                             gpart_mpi_type, nr_nodes, nodeID, e->syncredist);
-  swift_free("gparts", s->gparts);
+  new_parts = engine_redistribute_exchange(
+      e, "gparts", g_counts, (char *)s->gparts, s->size_gparts, nr_gparts_new,
+      &s->size_gparts, sizeof(struct gpart), gpart_align, gpart_mpi_type);
   s->gparts = (struct gpart *)new_parts;
   s->nr_gparts = nr_gparts_new;
-  s->size_gparts = engine_redistribute_alloc_margin * nr_gparts_new;
 
   /* Star particles. */
-  new_parts =
-      engine_do_redistribute("sparts", s_counts, (char *)s->sparts,
-                             nr_sparts_new, sizeof(struct spart), spart_align,
-                             spart_mpi_type, nr_nodes, nodeID, e->syncredist);
-  swift_free("sparts", s->sparts);
+  new_parts = engine_redistribute_exchange(
+      e, "sparts", s_counts, (char *)s->sparts, s->size_sparts, nr_sparts_new,
+      &s->size_sparts, sizeof(struct spart), spart_align, spart_mpi_type);
   s->sparts = (struct spart *)new_parts;
   s->nr_sparts = nr_sparts_new;
-  s->size_sparts = engine_redistribute_alloc_margin * nr_sparts_new;
 
   /* Black holes particles. */
-  new_parts =
-      engine_do_redistribute("bparts", b_counts, (char *)s->bparts,
-                             nr_bparts_new, sizeof(struct bpart), bpart_align,
-                             bpart_mpi_type, nr_nodes, nodeID, e->syncredist);
-  swift_free("bparts", s->bparts);
+  new_parts = engine_redistribute_exchange(
+      e, "bparts", b_counts, (char *)s->bparts, s->size_bparts, nr_bparts_new,
+      &s->size_bparts, sizeof(struct bpart), bpart_align, bpart_mpi_type);
   s->bparts = (struct bpart *)new_parts;
   s->nr_bparts = nr_bparts_new;
-  s->size_bparts = engine_redistribute_alloc_margin * nr_bparts_new;
 
   /* All particles have now arrived. Time for some final operations on the
      stuff we just received */
@@ -37,6 +37,7 @@
 #include "equation_of_state.h"
 #include "inline.h"
 #include "physical_constants.h"
+#include "shared_table.h"
 #include "units.h"
 #include "utilities.h"
 
@@ -50,6 +51,7 @@ struct SESAME_params {
   int version_date, num_rho, num_T;
   float u_tiny, P_tiny, c_tiny, s_tiny;
   enum eos_planetary_material_id mat_id;
+  struct shared_table segment;
 };
 
 // Parameter values for each material
@@ -174,16 +176,23 @@ INLINE static void load_table_SESAME(struct SESAME_params *mat,
   mat->num_T--;
   float ignore;
 
-  // Allocate table memory
-  mat->table_log_rho = (float *)malloc(mat->num_rho * sizeof(float));
-  mat->table_log_u_rho_T =
-      (float *)malloc(mat->num_rho * mat->num_T * sizeof(float));
-  mat->table_P_rho_T =
-      (float *)malloc(mat->num_rho * mat->num_T * sizeof(float));
-  mat->table_c_rho_T =
-      (float *)malloc(mat->num_rho * mat->num_T * sizeof(float));
-  mat->table_log_s_rho_T =
-      (float *)malloc(mat->num_rho * mat->num_T * sizeof(float));
+  // Allocate table memory, shared by all the ranks of the node, with room
+  // at the end for the tiny values
+  const size_t num_rho_T = (size_t)mat->num_rho * mat->num_T;
+  float *table = (float *)shared_table_alloc(
+      &mat->segment, "eos.SESAME",
+      (mat->num_rho + 4 * num_rho_T + 4) * sizeof(float));
+  mat->table_log_rho = table;
+  mat->table_log_u_rho_T = mat->table_log_rho + mat->num_rho;
+  mat->table_P_rho_T = mat->table_log_u_rho_T + num_rho_T;
+  mat->table_c_rho_T = mat->table_P_rho_T + num_rho_T;
+  mat->table_log_s_rho_T = mat->table_c_rho_T + num_rho_T;
+
+  // Only one rank of the node reads and prepares the tables
+  if (!shared_table_is_writer(&mat->segment)) {
+    fclose(f);
+    return;
+  }
 
   // Densities (not log yet)
   for (int i_rho = -1; i_rho < mat->num_rho; i_rho++) {
@@ -228,6 +237,8 @@ INLINE static void load_table_SESAME(struct SESAME_params *mat,
 // Misc. modifications
 INLINE static void prepare_table_SESAME(struct SESAME_params *mat) {
 
+  if (!shared_table_is_writer(&mat->segment)) return;
+
   // Convert densities to log(density)
   for (int i_rho = 0; i_rho < mat->num_rho; i_rho++) {
     mat->table_log_rho[i_rho] = logf(mat->table_log_rho[i_rho]);
@@ -305,6 +316,8 @@ INLINE static void prepare_table_SESAME(struct SESAME_params *mat) {
 INLINE static void convert_units_SESAME(struct SESAME_params *mat,
                                         const struct unit_system *us) {
 
+  if (!shared_table_is_writer(&mat->segment)) return;
+
   // Convert input table values from all-SI to internal units
   struct unit_system si;
   units_init_si(&si);
@@ -350,6 +363,26 @@ INLINE static void convert_units_SESAME(struct SESAME_params *mat,
       units_cgs_conversion_factor(us, UNIT_CONV_PHYSICAL_ENTROPY_PER_UNIT_MASS);
 }
 
+// Make the tables and tiny values of the rank that prepared them available to
+// all the ranks of the node
+INLINE static void share_table_SESAME(struct SESAME_params *mat) {
+
+  float *tiny = mat->table_log_s_rho_T + (size_t)mat->num_rho * mat->num_T;
+  if (shared_table_is_writer(&mat->segment)) {
+    tiny[0] = mat->u_tiny;
+    tiny[1] = mat->P_tiny;
+    tiny[2] = mat->c_tiny;
+    tiny[3] = mat->s_tiny;
+  }
+
+  shared_table_ready(&mat->segment);
+
+  mat->u_tiny = tiny[0];
+  mat->P_tiny = tiny[1];
+  mat->c_tiny = tiny[2];
+  mat->s_tiny = tiny[3];
+}
+
 // gas_internal_energy_from_entropy
 INLINE static float SESAME_internal_energy_from_entropy(
     float density, float entropy, const struct SESAME_params *mat) {
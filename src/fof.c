@@ -76,6 +76,37 @@ enum fof_halo_seeding_props {
   fof_halo_has_too_low_mass = -3LL
 };
 
+/**
+ * @brief The contribution of a set of particles to the properties of a group.
+ *
+ * Positions are taken relative to the first particle of the fragment.
+ */
+struct fof_group_fragment {
+
+  /*! Local index of the group or, if foreign, global index of its root */
+  size_t key;
+
+  /*! Is the root of the group on another node? */
+  int is_foreign;
+
+  /*! Mass and number of particles */
+  double mass;
+  long long size;
+
+  /*! Position of the first particle */
+  double first_position[3];
+
+  /*! Sum of m r */
+  double centre_of_mass[3];
+
+  /*! Index of the densest gas particle (or black hole flag) and its density */
+  long long max_part_density_index;
+  float max_part_density;
+
+  /*! The optional group properties */
+  struct fof_group_moments moments;
+};
+
 #ifdef WITH_MPI
 
 /* MPI types used for communications */
@@ -83,6 +114,7 @@ MPI_Datatype fof_mpi_type;
 MPI_Datatype group_length_mpi_type;
 MPI_Datatype fof_final_index_type;
 MPI_Datatype fof_final_mass_type;
+MPI_Datatype fof_group_moments_type;
 
 /*! Offset between the first particle on this MPI rank and the first particle in
  * the global order */
@@ -197,6 +229,18 @@ void fof_init(struct fof_props *props, struct swift_params *params,
       error("FOF can't use a type (%s) as both linking and attaching type!",
             part_type_names[i]);
 
+  /* Read which optional group properties we want in the catalogues */
+  props->extra_group_properties = 0;
+  if (parser_get_opt_param_int(params, "FOF:output_masses_per_type", 0))
+    props->extra_group_properties |= fof_group_property_masses_per_type;
+  if (parser_get_opt_param_int(params, "FOF:output_velocities", 0))
+    props->extra_group_properties |= fof_group_property_velocities;
+  if (parser_get_opt_param_int(params, "FOF:output_rms_radii", 0))
+    props->extra_group_properties |= fof_group_property_rms_radii;
+  if (parser_get_opt_param_int(params, "FOF:output_angular_momenta", 0))
+    props->extra_group_properties |= fof_group_property_angular_momenta;
+  props->group_moments = NULL;
+
   /* Set the current FOF types */
   fof_set_current_types(props);
 
@@ -257,6 +301,12 @@ void fof_create_mpi_types(void) {
       MPI_Type_commit(&fof_final_mass_type) != MPI_SUCCESS) {
     error("Failed to create MPI type for fof_final_mass.");
   }
+  /* Define type for sending fof_group_moments struct */
+  if (MPI_Type_contiguous(sizeof(struct fof_group_moments), MPI_BYTE,
+                          &fof_group_moments_type) != MPI_SUCCESS ||
+      MPI_Type_commit(&fof_group_moments_type) != MPI_SUCCESS) {
+    error("Failed to create MPI type for fof_group_moments.");
+  }
 #else
   error("Calling an MPI function in non-MPI code.");
 #endif
@@ -569,17 +619,19 @@ int compare_fof_final_index_global_root(const void *a, const void *b) {
 /**
  * @brief Comparison function for qsort call comparing group global roots
  *
- * @param a The first #fof_final_mass object.
- * @param b The second #fof_final_mass object.
+ * @param a The first #fof_group_fragment object.
+ * @param b The second #fof_group_fragment object.
  * @return 1 if the global of the group b is *smaller* than the global group of
  * group a, -1 if a is the smaller one and 0 if they are equal.
  */
-int compare_fof_final_mass_global_root(const void *a, const void *b) {
-  struct fof_final_mass *fof_final_mass_a = (struct fof_final_mass *)a;
-  struct fof_final_mass *fof_final_mass_b = (struct fof_final_mass *)b;
-  if (fof_final_mass_b->global_root < fof_final_mass_a->global_root)
+int compare_fof_group_fragment_global_root(const void *a, const void *b) {
+  const struct fof_group_fragment *fragment_a =
+      (const struct fof_group_fragment *)a;
+  const struct fof_group_fragment *fragment_b =
+      (const struct fof_group_fragment *)b;
+  if (fragment_b->key < fragment_a->key)
     return 1;
-  else if (fof_final_mass_b->global_root > fof_final_mass_a->global_root)
+  else if (fragment_b->key > fragment_a->key)
     return -1;
   else
     return 0;
@@ -2127,261 +2179,476 @@ void fof_calc_group_size_mapper(void *map_data, int num_elements,
   hashmap_free(&map);
 }
 
-/* Mapper function to atomically update the group mass array. */
-static INLINE void fof_update_group_mass_iterator(hashmap_key_t key,
-                                                  hashmap_value_t *value,
-                                                  void *data) {
-
-  double *group_mass = (double *)data;
-
-  /* Use key to index into group mass array. */
-  atomic_add_d(&group_mass[key], value->value_dbl);
-}
-
-/* Mapper function to atomically update the group size array. */
-static INLINE void fof_update_group_size_iterator(hashmap_key_t key,
-                                                  hashmap_value_t *value,
-                                                  void *data) {
-  long long *group_size = (long long *)data;
-
-  /* Use key to index into group mass array. */
-  atomic_add(&group_size[key], value->value_st);
+/**
+ * @brief Start a new #fof_group_fragment.
+ *
+ * @param f The #fof_group_fragment.
+ * @param key The local index or the global root of the group.
+ * @param is_foreign Is the root of the group on another node?
+ * @param x The position of the first particle of the fragment.
+ */
+__attribute__((always_inline)) INLINE static void fof_group_fragment_init(
+    struct fof_group_fragment *f, const size_t key, const int is_foreign,
+    const double x[3]) {
+
+  bzero(f, sizeof(struct fof_group_fragment));
+  f->key = key;
+  f->is_foreign = is_foreign;
+  f->first_position[0] = x[0];
+  f->first_position[1] = x[1];
+  f->first_position[2] = x[2];
+  f->max_part_density_index = fof_halo_has_no_gas;
 }
 
 /**
- * @brief Mapper function to calculate the group masses.
+ * @brief Add the contribution of a #gpart to a #fof_group_fragment.
  *
- * @param map_data An array of #gpart%s.
- * @param num_elements Chunk size.
- * @param extra_data Pointer to a #space.
+ * @param f The #fof_group_fragment.
+ * @param gp The #gpart.
+ * @param parts The #part array.
+ * @param with_moments Do we need the optional group properties?
+ * @param periodic Are we using periodic boundary conditions?
+ * @param dim The dimension of the simulation volume.
  */
-void fof_calc_group_mass_mapper(void *map_data, int num_elements,
-                                void *extra_data) {
+__attribute__((always_inline)) INLINE static void fof_group_fragment_add(
+    struct fof_group_fragment *f, const struct gpart *gp,
+    const struct part *parts, const int with_moments, const int periodic,
+    const double dim[3]) {
 
-  /* Retrieve mapped data. */
-  struct space *s = (struct space *)extra_data;
-  struct gpart *gparts = (struct gpart *)map_data;
-  double *group_mass = s->e->fof_properties->group_mass;
-  long long *group_size = s->e->fof_properties->final_group_size;
-  const size_t group_id_default = s->e->fof_properties->group_id_default;
-  const size_t group_id_offset = s->e->fof_properties->group_id_offset;
+  const double mass = gp->mass;
 
-  /* Create hash table. */
-  hashmap_t map;
-  hashmap_init(&map);
+  /* Position relative to the first particle of the fragment */
+  double dx[3] = {gp->x[0] - f->first_position[0],
+                  gp->x[1] - f->first_position[1],
+                  gp->x[2] - f->first_position[2]};
+  if (periodic) {
+    dx[0] = nearest(dx[0], dim[0]);
+    dx[1] = nearest(dx[1], dim[1]);
+    dx[2] = nearest(dx[2], dim[2]);
+  }
 
-  /* Loop over particles and increment the group mass for groups above
-   * min_group_size. */
-  for (int ind = 0; ind < num_elements; ind++) {
+  f->mass += mass;
+  f->size++;
+  f->centre_of_mass[0] += mass * dx[0];
+  f->centre_of_mass[1] += mass * dx[1];
+  f->centre_of_mass[2] += mass * dx[2];
 
-    /* Only check groups above the minimum size. */
-    if (gparts[ind].fof_data.group_id != group_id_default) {
+  /* Also accumulate the densest gas particle and its index */
+  if (gp->type == swift_type_gas &&
+      f->max_part_density_index != fof_halo_has_black_hole) {
 
-      hashmap_key_t index = gparts[ind].fof_data.group_id - group_id_offset;
-      hashmap_value_t *data = hashmap_get(&map, index);
+    const size_t gas_index = -gp->id_or_neg_offset;
+    const float rho_com = hydro_get_comoving_density(&parts[gas_index]);
 
-      /* Update group mass */
-      if (data != NULL) {
-        (*data).value_dbl += gparts[ind].mass;
-        (*data).value_st += 1;
-      } else
-        error("Couldn't find key (%zu) or create new one.", index);
+    /* Update index if a denser gas particle is found. */
+    if (rho_com > f->max_part_density) {
+      f->max_part_density = rho_com;
+      f->max_part_density_index = gas_index;
     }
-  }
 
-  /* Update the group mass array. */
-  if (map.size > 0)
-    hashmap_iterate(&map, fof_update_group_mass_iterator, group_mass);
-  if (map.size > 0)
-    hashmap_iterate(&map, fof_update_group_size_iterator, group_size);
+  } else if (gp->type == swift_type_black_hole) {
 
-  hashmap_free(&map);
-}
+    /* If there is already a black hole in the fragment we don't need to
+     * create a new one. */
+    f->max_part_density_index = fof_halo_has_black_hole;
+    f->max_part_density = 0.f;
+  }
 
-#ifdef WITH_MPI
-/* Mapper function to unpack hash table into array. */
-void fof_unpack_group_mass_mapper(hashmap_key_t key, hashmap_value_t *value,
-                                  void *data) {
+  if (with_moments) {
+
+    const double v[3] = {gp->v_full[0], gp->v_full[1], gp->v_full[2]};
+    struct fof_group_moments *m = &f->moments;
 
-  struct fof_mass_send_hashmap *fof_mass_send =
-      (struct fof_mass_send_hashmap *)data;
-  struct fof_final_mass *mass_send = fof_mass_send->mass_send;
-  size_t *nsend = &fof_mass_send->nsend;
-
-  /* Store elements from hash table in array. */
-  mass_send[*nsend].global_root = key;
-  mass_send[*nsend].group_mass = value->value_dbl;
-  mass_send[*nsend].final_group_size = value->value_ll;
-  mass_send[*nsend].first_position[0] = value->value_array2_dbl[0];
-  mass_send[*nsend].first_position[1] = value->value_array2_dbl[1];
-  mass_send[*nsend].first_position[2] = value->value_array2_dbl[2];
-  mass_send[*nsend].centre_of_mass[0] = value->value_array_dbl[0];
-  mass_send[*nsend].centre_of_mass[1] = value->value_array_dbl[1];
-  mass_send[*nsend].centre_of_mass[2] = value->value_array_dbl[2];
-  mass_send[*nsend].max_part_density_index = value->value_st;
-  mass_send[*nsend].max_part_density = value->value_flt;
-
-  (*nsend)++;
+    m->mass_per_type[gp->type] += mass;
+    m->velocity[0] += mass * v[0];
+    m->velocity[1] += mass * v[1];
+    m->velocity[2] += mass * v[2];
+    m->velocity_dispersion += mass * (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    m->rms_radius += mass * (dx[0] * dx[0] + dx[1] * dx[1] + dx[2] * dx[2]);
+    m->angular_momentum[0] += mass * (dx[1] * v[2] - dx[2] * v[1]);
+    m->angular_momentum[1] += mass * (dx[2] * v[0] - dx[0] * v[2]);
+    m->angular_momentum[2] += mass * (dx[0] * v[1] - dx[1] * v[0]);
+  }
 }
 
-#endif /* WITH_MPI */
+/**
+ * @brief Add the moments of a set of particles to the moments of a group
+ * measured from a different reference position.
+ *
+ * @param dst The #fof_group_moments to update.
+ * @param src The #fof_group_moments to add.
+ * @param src_mass The total mass of the added particles.
+ * @param src_centre_of_mass The sum of m r of the added particles.
+ * @param d The reference position of src relative to the one of dst.
+ */
+__attribute__((always_inline)) INLINE static void fof_group_moments_add(
+    struct fof_group_moments *dst, const struct fof_group_moments *src,
+    const double src_mass, const double src_centre_of_mass[3],
+    const double d[3]) {
+
+  for (int k = 0; k < swift_type_count; k++)
+    dst->mass_per_type[k] += src->mass_per_type[k];
+
+  dst->velocity[0] += src->velocity[0];
+  dst->velocity[1] += src->velocity[1];
+  dst->velocity[2] += src->velocity[2];
+  dst->velocity_dispersion += src->velocity_dispersion;
+
+  /* Sum of m |r + d|^2 */
+  dst->rms_radius += src->rms_radius +
+                     2. * (d[0] * src_centre_of_mass[0] +
+                           d[1] * src_centre_of_mass[1] +
+                           d[2] * src_centre_of_mass[2]) +
+                     src_mass * (d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+  /* Sum of m (r + d) x v */
+  dst->angular_momentum[0] += src->angular_momentum[0] +
+                              d[1] * src->velocity[2] - d[2] * src->velocity[1];
+  dst->angular_momentum[1] += src->angular_momentum[1] +
+                              d[2] * src->velocity[0] - d[0] * src->velocity[2];
+  dst->angular_momentum[2] += src->angular_momentum[2] +
+                              d[0] * src->velocity[1] - d[1] * src->velocity[0];
+}
 
 /**
- * @brief Calculates the total mass and CoM of each group above min_group_size
- * and finds the densest particle for black hole seeding.
+ * @brief Add a #fof_group_fragment to the properties of a group.
+ *
+ * @param f The #fof_group_fragment to add.
+ * @param mass The mass of the group.
+ * @param size The number of particles in the group.
+ * @param first_position The reference position of the group.
+ * @param centre_of_mass The sum of m r of the group.
+ * @param max_part_density_index The index of the densest gas particle (or
+ * black hole flag) of the group.
+ * @param max_part_density The density of the densest gas particle.
+ * @param moments The optional #fof_group_moments of the group (can be NULL).
+ * @param periodic Are we using periodic boundary conditions?
+ * @param dim The dimension of the simulation volume.
  */
-void fof_calc_group_mass(struct fof_props *props, const struct space *s,
-                         const int seed_black_holes,
-                         const size_t num_groups_local,
-                         const size_t num_groups_prev,
-                         size_t *restrict num_on_node,
-                         size_t *restrict first_on_node,
-                         double *restrict group_mass) {
+static void fof_group_fragment_merge(
+    const struct fof_group_fragment *f, double *mass, long long *size,
+    const double first_position[3], double centre_of_mass[3],
+    long long *max_part_density_index, float *max_part_density,
+    struct fof_group_moments *moments, const int periodic,
+    const double dim[3]) {
 
-  const size_t nr_gparts = s->nr_gparts;
-  struct gpart *gparts = s->gparts;
-  const struct part *parts = s->parts;
-  const size_t group_id_offset = props->group_id_offset;
-  const size_t group_id_default = props->group_id_default;
-  const double seed_halo_mass = props->seed_halo_mass;
-  const int periodic = s->periodic;
-  const double dim[3] = {s->dim[0], s->dim[1], s->dim[2]};
+  /* Reference position of the fragment relative to the one of the group */
+  double d[3] = {f->first_position[0] - first_position[0],
+                 f->first_position[1] - first_position[1],
+                 f->first_position[2] - first_position[2]};
+  if (periodic) {
+    d[0] = nearest(d[0], dim[0]);
+    d[1] = nearest(d[1], dim[1]);
+    d[2] = nearest(d[2], dim[2]);
+  }
 
-#ifdef WITH_MPI
-  size_t *group_index = props->group_index;
-  const int nr_nodes = s->e->nr_nodes;
+  if (moments != NULL)
+    fof_group_moments_add(moments, &f->moments, f->mass, f->centre_of_mass,
+                          d);
+
+  *mass += f->mass;
+  *size += f->size;
+  centre_of_mass[0] += f->centre_of_mass[0] + f->mass * d[0];
+  centre_of_mass[1] += f->centre_of_mass[1] + f->mass * d[1];
+  centre_of_mass[2] += f->centre_of_mass[2] + f->mass * d[2];
+
+  /* A black hole anywhere in the group prevents seeding. Otherwise keep the
+   * densest gas particle, using the index to break ties so that the result
+   * does not depend on the order in which the fragments arrive. */
+  if (f->max_part_density_index == fof_halo_has_black_hole) {
+    *max_part_density_index = fof_halo_has_black_hole;
+    *max_part_density = 0.f;
+  } else if (f->max_part_density_index >= 0 &&
+             *max_part_density_index != fof_halo_has_black_hole) {
+    if (f->max_part_density > *max_part_density ||
+        (f->max_part_density == *max_part_density &&
+         f->max_part_density_index < *max_part_density_index)) {
+      *max_part_density = f->max_part_density;
+      *max_part_density_index = f->max_part_density_index;
+    }
+  }
+}
 
-  /* Direct pointers to the arrays */
-  long long *max_part_density_index = props->max_part_density_index;
-  float *max_part_density = props->max_part_density;
-  double *centre_of_mass = props->group_centre_of_mass;
-  double *first_position = props->group_first_position;
-  long long *final_group_size = props->final_group_size;
+/**
+ * @brief Data used by the mapper computing the group properties.
+ */
+struct fof_calc_group_props_data {
 
-  /* Start the hash map */
-  hashmap_t map;
-  hashmap_init(&map);
+  /*! The #space we act on */
+  const struct space *s;
 
-  /* Collect information about the local particles and update the local AND
-   * foreign group fragments */
-  for (size_t i = 0; i < nr_gparts; i++) {
+  /*! The FOF properties holding the group arrays */
+  struct fof_props *props;
 
-    /* Ignore inhibited particles */
-    if (gparts[i].time_bin >= time_bin_inhibited) continue;
+  /*! Number of groups on lower numbered MPI ranks */
+  size_t num_groups_prev;
 
-    /* Check whether we ignore this particle type altogether */
-    if (gpart_is_ignorable(&gparts[i])) continue;
+  /*! Do we need the optional group properties? */
+  int with_moments;
 
-    /* Check if the particle is in a group above the threshold. */
-    if (gparts[i].fof_data.group_id != group_id_default) {
+  /*! Lock protecting the group arrays and the foreign fragments */
+  swift_lock_type lock;
+
+#ifdef WITH_MPI
+  /*! Map from the global roots to the foreign fragments */
+  hashmap_t foreign_map;
 
-      const size_t root = fof_find_global(i, group_index, nr_gparts);
+  /*! The fragments of groups whose root is on another node */
+  struct fof_group_fragment *foreign;
 
-      if (is_local(root, nr_gparts)) {
+  /*! Number of foreign fragments and allocated size of the array */
+  size_t num_foreign, size_foreign;
+#endif
+};
 
-        /* The root is local */
+/**
+ * @brief Mapper function computing the properties of the groups.
+ *
+ * The particles of the chunk are first accumulated into one fragment per
+ * group. The fragments are then added to the groups whose root is on this
+ * node and, over MPI, to the list of fragments to send to the other nodes.
+ *
+ * @param map_data An array of #gpart%s.
+ * @param num_elements Chunk size.
+ * @param extra_data Pointer to a #fof_calc_group_props_data.
+ */
+void fof_calc_group_props_mapper(void *map_data, int num_elements,
+                                 void *extra_data) {
 
-        const size_t index =
-            gparts[i].fof_data.group_id - group_id_offset - num_groups_prev;
+  /* Retrieve mapped data. */
+  struct fof_calc_group_props_data *data =
+      (struct fof_calc_group_props_data *)extra_data;
+  const struct gpart *gparts = (const struct gpart *)map_data;
+  const struct space *s = data->s;
+  struct fof_props *props = data->props;
+  const struct part *parts = s->parts;
+  const size_t group_id_default = props->group_id_default;
+  const size_t group_id_offset = props->group_id_offset + data->num_groups_prev;
+  const int with_moments = data->with_moments;
+  const int periodic = s->periodic;
+  const double dim[3] = {s->dim[0], s->dim[1], s->dim[2]};
+#ifdef WITH_MPI
+  const size_t nr_gparts = s->nr_gparts;
+  const size_t *group_index = props->group_index;
+  const size_t gparts_offset = (size_t)(gparts - s->gparts);
+#endif
 
-        /* Update group mass */
-        group_mass[index] += gparts[i].mass;
+  /* Map from the group keys to the fragments of this chunk. Local and
+   * foreign groups use different keys so they get a map each. */
+  hashmap_t maps[2];
+  hashmap_init(&maps[0]);
+  hashmap_init(&maps[1]);
 
-        /* Update group size */
-        final_group_size[index]++;
+  size_t num_fragments = 0;
+  size_t size_fragments = 64;
+  struct fof_group_fragment *fragments = (struct fof_group_fragment *)malloc(
+      size_fragments * sizeof(struct fof_group_fragment));
+  if (fragments == NULL) error("Failed to allocate FOF group fragments.");
 
-      } else {
+  for (int ind = 0; ind < num_elements; ind++) {
 
-        /* The root is *not* local */
+    const struct gpart *gp = &gparts[ind];
 
-        /* Get the root in the foreign hashmap (create if necessary) */
-        hashmap_value_t *const data = hashmap_get(&map, (hashmap_key_t)root);
-        if (data == NULL)
-          error("Couldn't find key (%zu) or create new one.", root);
+    /* Ignore inhibited particles */
+    if (gp->time_bin >= time_bin_inhibited) continue;
 
-        /* Compute the centre of mass */
-        const double mass = gparts[i].mass;
-        double x[3] = {gparts[i].x[0], gparts[i].x[1], gparts[i].x[2]};
+    /* Check whether we ignore this particle type altogether */
+    if (gpart_is_ignorable(gp)) continue;
 
-        /* Add mass fragments of groups */
-        data->value_dbl += mass;
+    /* Only check groups above the minimum size. */
+    if (gp->fof_data.group_id == group_id_default) continue;
 
-        /* Increase fragment size */
-        data->value_ll++;
+#ifdef WITH_MPI
+    const size_t root =
+        fof_find_global(gparts_offset + ind, group_index, nr_gparts);
+    const int is_foreign = !is_local(root, nr_gparts);
+    const size_t key =
+        is_foreign ? root : gp->fof_data.group_id - group_id_offset;
+#else
+    const int is_foreign = 0;
+    const size_t key = gp->fof_data.group_id - group_id_offset;
+#endif
 
-        /* Record the first particle of this fragment that we encounter so we
-         * we can use it as reference frame for the centre of mass calculation
-         */
-        if (data->value_array2_dbl[0] == (double)(-FLT_MAX)) {
-          data->value_array2_dbl[0] = gparts[i].x[0];
-          data->value_array2_dbl[1] = gparts[i].x[1];
-          data->value_array2_dbl[2] = gparts[i].x[2];
-        }
+    /* Get the fragment of this group (create if necessary) */
+    int created = 0;
+    hashmap_value_t *value =
+        hashmap_get_new(&maps[is_foreign], (hashmap_key_t)key, &created);
+    if (value == NULL)
+      error("Couldn't find key (%zu) or create new one.", key);
+
+    if (created) {
+      if (num_fragments == size_fragments) {
+        size_fragments *= 2;
+        fragments = (struct fof_group_fragment *)realloc(
+            fragments, size_fragments * sizeof(struct fof_group_fragment));
+        if (fragments == NULL)
+          error("Failed to re-allocate FOF group fragments.");
+      }
+      const double x[3] = {gp->x[0], gp->x[1], gp->x[2]};
+      fof_group_fragment_init(&fragments[num_fragments], key, is_foreign, x);
+      value->value_st = num_fragments;
+      num_fragments++;
+    }
 
-        if (periodic) {
-          x[0] = nearest(x[0] - data->value_array2_dbl[0], dim[0]);
-          x[1] = nearest(x[1] - data->value_array2_dbl[1], dim[1]);
-          x[2] = nearest(x[2] - data->value_array2_dbl[2], dim[2]);
-        }
+    fof_group_fragment_add(&fragments[value->value_st], gp, parts,
+                           with_moments, periodic, dim);
+  }
 
-        data->value_array_dbl[0] += mass * x[0];
-        data->value_array_dbl[1] += mass * x[1];
-        data->value_array_dbl[2] += mass * x[2];
+  hashmap_free(&maps[0]);
+  hashmap_free(&maps[1]);
 
-        /* Also accumulate the densest gas particle and its index */
-        if (gparts[i].type == swift_type_gas &&
-            data->value_st != fof_halo_has_black_hole) {
+  /* Add the fragments to the groups */
+  if (lock_lock(&data->lock) != 0) error("Failed to lock the group arrays.");
 
-          const size_t gas_index = -gparts[i].id_or_neg_offset;
-          const float rho_com = hydro_get_comoving_density(&parts[gas_index]);
+  for (size_t k = 0; k < num_fragments; k++) {
 
-          /* Update index if a denser gas particle is found. */
-          if (rho_com > data->value_flt) {
-            data->value_flt = rho_com;
-            data->value_st = gas_index;
-          }
+    const struct fof_group_fragment *f = &fragments[k];
 
-        } else if (gparts[i].type == swift_type_black_hole) {
+    if (!f->is_foreign) {
 
-          /* If there is already a black hole in the fragment we don't need to
-           create a new one. */
-          data->value_st = fof_halo_has_black_hole;
-          data->value_flt = 0.f;
+      const size_t index = f->key;
+      fof_group_fragment_merge(
+          f, &props->group_mass[index], &props->final_group_size[index],
+          &props->group_first_position[3 * index],
+          &props->group_centre_of_mass[3 * index],
+          &props->max_part_density_index[index],
+          &props->max_part_density[index],
+          with_moments ? &props->group_moments[index] : NULL, periodic, dim);
+    }
+#ifdef WITH_MPI
+    else {
+
+      int created = 0;
+      hashmap_value_t *value = hashmap_get_new(
+          &data->foreign_map, (hashmap_key_t)f->key, &created);
+      if (value == NULL)
+        error("Couldn't find key (%zu) or create new one.", f->key);
+
+      if (created) {
+        if (data->num_foreign == data->size_foreign) {
+          data->size_foreign = max(2 * data->size_foreign, (size_t)64);
+          data->foreign = (struct fof_group_fragment *)realloc(
+              data->foreign,
+              data->size_foreign * sizeof(struct fof_group_fragment));
+          if (data->foreign == NULL)
+            error("Failed to re-allocate foreign FOF group fragments.");
         }
+        data->foreign[data->num_foreign] = *f;
+        value->value_st = data->num_foreign;
+        data->num_foreign++;
+      } else {
+        struct fof_group_fragment *g = &data->foreign[value->value_st];
+        fof_group_fragment_merge(f, &g->mass, &g->size, g->first_position,
+                                 g->centre_of_mass, &g->max_part_density_index,
+                                 &g->max_part_density,
+                                 with_moments ? &g->moments : NULL, periodic,
+                                 dim);
+      }
+    }
+#endif
+  }
 
-      } /* Foreign root */
-    }   /* Particle is in a group */
-  }     /* Loop over particles */
+  if (lock_unlock(&data->lock) != 0)
+    error("Failed to unlock the group arrays.");
 
-  size_t nsend = map.size;
-  struct fof_mass_send_hashmap hashmap_mass_send = {NULL, 0};
+  free(fragments);
+}
 
-  /* Allocate and initialise a mass array. */
-  if (posix_memalign((void **)&hashmap_mass_send.mass_send, 32,
-                     nsend * sizeof(struct fof_final_mass)) != 0)
-    error("Failed to allocate list of group masses for FOF search.");
+/**
+ * @brief Calculates the total mass and CoM of each group above min_group_size
+ * and finds the densest particle for black hole seeding.
+ *
+ * All the properties, including the optional ones, are accumulated in a
+ * single parallel pass over the particles. Over MPI, the fragments of groups
+ * whose root is on another node are only sent to that node.
+ */
+void fof_calc_group_mass(struct fof_props *props, const struct space *s,
+                         const int seed_black_holes,
+                         const size_t num_groups_local,
+                         const size_t num_groups_prev,
+                         size_t *restrict num_on_node,
+                         size_t *restrict first_on_node,
+                         double *restrict group_mass) {
 
-  hashmap_mass_send.nsend = 0;
+  const double seed_halo_mass = props->seed_halo_mass;
+  const int with_moments = (props->group_moments != NULL);
 
-  struct fof_final_mass *fof_mass_send = hashmap_mass_send.mass_send;
+  /* Direct pointers to the arrays */
+  long long *max_part_density_index = props->max_part_density_index;
 
-  /* Unpack mass fragments and roots from hash table. */
-  if (map.size > 0)
-    hashmap_iterate(&map, fof_unpack_group_mass_mapper, &hashmap_mass_send);
+  /* Collect the contributions of all the particles to the groups */
+  struct fof_calc_group_props_data data;
+  data.s = s;
+  data.props = props;
+  data.num_groups_prev = num_groups_prev;
+  data.with_moments = with_moments;
+  lock_init(&data.lock);
+#ifdef WITH_MPI
+  hashmap_init(&data.foreign_map);
+  data.foreign = NULL;
+  data.num_foreign = 0;
+  data.size_foreign = 0;
+#endif
+
+  threadpool_map(&s->e->threadpool, fof_calc_group_props_mapper, s->gparts,
+                 s->nr_gparts, sizeof(struct gpart), threadpool_auto_chunk_size,
+                 &data);
 
-  nsend = hashmap_mass_send.nsend;
+  if (lock_destroy(&data.lock) != 0) error("Failed to destroy lock.");
 
+#ifdef WITH_MPI
 #ifdef SWIFT_DEBUG_CHECKS
-  if (nsend != map.size)
-    error("No. of mass fragments to send != elements in hash table.");
+  const size_t nr_gparts = s->nr_gparts;
 #endif
+  const struct gpart *gparts = s->gparts;
+  const size_t group_id_offset = props->group_id_offset;
+  const int nr_nodes = s->e->nr_nodes;
+  const int periodic = s->periodic;
+  const double dim[3] = {s->dim[0], s->dim[1], s->dim[2]};
 
-  hashmap_free(&map);
+  /* Direct pointers to the arrays */
+  float *max_part_density = props->max_part_density;
+  double *centre_of_mass = props->group_centre_of_mass;
+  double *first_position = props->group_first_position;
+  long long *final_group_size = props->final_group_size;
+  struct fof_group_moments *group_moments = props->group_moments;
+
+  hashmap_free(&data.foreign_map);
+  struct fof_group_fragment *fragments = data.foreign;
+  const size_t nsend = data.num_foreign;
 
   /* Sort by global root - this puts the groups in order of which node they're
    * stored on */
-  qsort(fof_mass_send, nsend, sizeof(struct fof_final_mass),
-        compare_fof_final_mass_global_root);
+  qsort(fragments, nsend, sizeof(struct fof_group_fragment),
+        compare_fof_group_fragment_global_root);
+
+  /* Pack the fragments to send. The optional properties are only sent if
+   * they were asked for. */
+  struct fof_final_mass *fof_mass_send =
+      (struct fof_final_mass *)malloc(nsend * sizeof(struct fof_final_mass));
+  struct fof_group_moments *moments_send = NULL;
+  if (with_moments)
+    moments_send = (struct fof_group_moments *)malloc(
+        nsend * sizeof(struct fof_group_moments));
+  if (fof_mass_send == NULL || (with_moments && moments_send == NULL))
+    error("Failed to allocate list of group masses for FOF search.");
+
+  for (size_t i = 0; i < nsend; i++) {
+    const struct fof_group_fragment *f = &fragments[i];
+    fof_mass_send[i].global_root = f->key;
+    fof_mass_send[i].group_mass = f->mass;
+    fof_mass_send[i].final_group_size = f->size;
+    fof_mass_send[i].first_position[0] = f->first_position[0];
+    fof_mass_send[i].first_position[1] = f->first_position[1];
+    fof_mass_send[i].first_position[2] = f->first_position[2];
+    fof_mass_send[i].centre_of_mass[0] = f->centre_of_mass[0];
+    fof_mass_send[i].centre_of_mass[1] = f->centre_of_mass[1];
+    fof_mass_send[i].centre_of_mass[2] = f->centre_of_mass[2];
+    fof_mass_send[i].max_part_density_index = f->max_part_density_index;
+    fof_mass_send[i].max_part_density = f->max_part_density;
+    if (with_moments) moments_send[i] = f->moments;
+  }
+  free(fragments);
 
   /* Determine how many entries go to each node */
   int *sendcount = (int *)calloc(nr_nodes, sizeof(int));
@@ -2409,6 +2676,18 @@ void fof_calc_group_mass(struct fof_props *props, const struct space *s,
                 fof_mass_recv, recvcount, recvoffset, fof_final_mass_type,
                 MPI_COMM_WORLD);
 
+  /* Exchange the optional properties with the same pattern */
+  struct fof_group_moments *moments_recv = NULL;
+  if (with_moments) {
+    moments_recv = (struct fof_group_moments *)malloc(
+        nrecv * sizeof(struct fof_group_moments));
+    if (moments_recv == NULL)
+      error("Failed to allocate list of received group properties.");
+    MPI_Alltoallv(moments_send, sendcount, sendoffset, fof_group_moments_type,
+                  moments_recv, recvcount, recvoffset, fof_group_moments_type,
+                  MPI_COMM_WORLD);
+  }
+
   /* For each received global root, look up the group ID we assigned and
    * increment the group mass */
   for (size_t i = 0; i < nrecv; i++) {
@@ -2426,78 +2705,11 @@ void fof_calc_group_mass(struct fof_props *props, const struct space *s,
     final_group_size[index] += fof_mass_recv[i].final_group_size;
   }
 
-  /* Loop over particles, densest particle in each *local* group.
-   * We can do this now as we eventually have the total group mass */
-  for (size_t i = 0; i < nr_gparts; i++) {
-
-    /* Ignore inhibited particles */
-    if (gparts[i].time_bin >= time_bin_inhibited) continue;
-
-    /* Check whether we ignore this particle type altogether */
-    if (current_fof_ignore_type & (1 << (gparts[i].type + 1))) continue;
-
-    /* Only check groups above the minimum mass threshold. */
-    if (gparts[i].fof_data.group_id != group_id_default) {
-
-      const size_t root = fof_find_global(i, group_index, nr_gparts);
-
-      if (is_local(root, nr_gparts)) {
-
-        const size_t index =
-            gparts[i].fof_data.group_id - group_id_offset - num_groups_prev;
-
-        /* Compute the centre of mass */
-        const double mass = gparts[i].mass;
-        double x[3] = {gparts[i].x[0], gparts[i].x[1], gparts[i].x[2]};
-
-        /* Record the first particle of this group that we encounter so we
-         * can use it as reference frame for the centre of mass calculation */
-        if (first_position[index * 3 + 0] == (double)(-FLT_MAX)) {
-          first_position[index * 3 + 0] = x[0];
-          first_position[index * 3 + 1] = x[1];
-          first_position[index * 3 + 2] = x[2];
-        }
-
-        if (periodic) {
-          x[0] = nearest(x[0] - first_position[index * 3 + 0], dim[0]);
-          x[1] = nearest(x[1] - first_position[index * 3 + 1], dim[1]);
-          x[2] = nearest(x[2] - first_position[index * 3 + 2], dim[2]);
-        }
-
-        centre_of_mass[index * 3 + 0] += mass * x[0];
-        centre_of_mass[index * 3 + 1] += mass * x[1];
-        centre_of_mass[index * 3 + 2] += mass * x[2];
-
-        /* Check haloes above the seeding threshold */
-        if (group_mass[index] > seed_halo_mass) {
-
-          /* Find the densest gas particle.
-           * Account for groups that already have a black hole and groups that
-           * contain no gas. */
-          if (gparts[i].type == swift_type_gas &&
-              max_part_density_index[index] != fof_halo_has_black_hole) {
-
-            const size_t gas_index = -gparts[i].id_or_neg_offset;
-            const float rho_com = hydro_get_comoving_density(&parts[gas_index]);
-
-            /* Update index if a denser gas particle is found. */
-            if (rho_com > max_part_density[index]) {
-              max_part_density_index[index] = gas_index;
-              max_part_density[index] = rho_com;
-            }
-          }
-          /* If there is already a black hole in the group we don't need to
-             create a new one. */
-          else if (gparts[i].type == swift_type_black_hole) {
-            max_part_density_index[index] = fof_halo_has_black_hole;
-          }
-
-        } else {
-          max_part_density_index[index] = fof_halo_has_too_low_mass;
-        }
-      }
-    }
-  }
+  /* Now that we have the total group masses, only keep the candidates for
+   * seeding above the mass threshold */
+  for (size_t i = 0; i < num_groups_local; i++)
+    if (group_mass[i] <= seed_halo_mass)
+      max_part_density_index[i] = fof_halo_has_too_low_mass;
 
   /* For each received global root, look up the group ID we assigned and find
    * the global maximum gas density */
@@ -2508,27 +2720,28 @@ void fof_calc_group_mass(struct fof_props *props, const struct space *s,
     const size_t index =
         gparts[local_root_index].fof_data.group_id - local_group_offset;
 
-    double fragment_mass = fof_mass_recv[i].group_mass;
-    double fragment_centre_of_mass[3] = {
-        fof_mass_recv[i].centre_of_mass[0] / fof_mass_recv[i].group_mass,
-        fof_mass_recv[i].centre_of_mass[1] / fof_mass_recv[i].group_mass,
-        fof_mass_recv[i].centre_of_mass[2] / fof_mass_recv[i].group_mass};
-    fragment_centre_of_mass[0] += fof_mass_recv[i].first_position[0];
-    fragment_centre_of_mass[1] += fof_mass_recv[i].first_position[1];
-    fragment_centre_of_mass[2] += fof_mass_recv[i].first_position[2];
-
+    /* Reference position of the fragment relative to the one of the group */
+    double d[3] = {
+        fof_mass_recv[i].first_position[0] - first_position[3 * index + 0],
+        fof_mass_recv[i].first_position[1] - first_position[3 * index + 1],
+        fof_mass_recv[i].first_position[2] - first_position[3 * index + 2]};
     if (periodic) {
-      fragment_centre_of_mass[0] = nearest(
-          fragment_centre_of_mass[0] - first_position[3 * index + 0], dim[0]);
-      fragment_centre_of_mass[1] = nearest(
-          fragment_centre_of_mass[1] - first_position[3 * index + 1], dim[1]);
-      fragment_centre_of_mass[2] = nearest(
-          fragment_centre_of_mass[2] - first_position[3 * index + 2], dim[2]);
+      d[0] = nearest(d[0], dim[0]);
+      d[1] = nearest(d[1], dim[1]);
+      d[2] = nearest(d[2], dim[2]);
     }
 
-    centre_of_mass[index * 3 + 0] += fragment_mass * fragment_centre_of_mass[0];
-    centre_of_mass[index * 3 + 1] += fragment_mass * fragment_centre_of_mass[1];
-    centre_of_mass[index * 3 + 2] += fragment_mass * fragment_centre_of_mass[2];
+    const double fragment_mass = fof_mass_recv[i].group_mass;
+    centre_of_mass[index * 3 + 0] +=
+        fof_mass_recv[i].centre_of_mass[0] + fragment_mass * d[0];
+    centre_of_mass[index * 3 + 1] +=
+        fof_mass_recv[i].centre_of_mass[1] + fragment_mass * d[1];
+    centre_of_mass[index * 3 + 2] +=
+        fof_mass_recv[i].centre_of_mass[2] + fragment_mass * d[2];
+
+    if (with_moments)
+      fof_group_moments_add(&group_moments[index], &moments_recv[i],
+                            fragment_mass, fof_mass_recv[i].centre_of_mass, d);
 
     /* Only seed groups above the mass threshold. */
     if (group_mass[index] > seed_halo_mass) {
@@ -2633,87 +2846,15 @@ void fof_calc_group_mass(struct fof_props *props, const struct space *s,
   free(recvoffset);
   free(fof_mass_send);
   free(fof_mass_recv);
+  free(moments_send);
+  free(moments_recv);
 
 #else
 
-  /* Increment the group mass for groups above min_group_size. */
-  threadpool_map(&s->e->threadpool, fof_calc_group_mass_mapper, gparts,
-                 nr_gparts, sizeof(struct gpart), threadpool_auto_chunk_size,
-                 (struct space *)s);
-
-  /* Direct pointers to the arrays */
-  long long *max_part_density_index = props->max_part_density_index;
-  float *max_part_density = props->max_part_density;
-  double *centre_of_mass = props->group_centre_of_mass;
-  double *first_position = props->group_first_position;
-
-  /* Loop over particles, compute CoM and find the densest particle in each
-   * group. */
-  /* JSW TODO: Parallelise with threadpool*/
-  for (size_t i = 0; i < nr_gparts; i++) {
-
-    /* Ignore inhibited particles */
-    if (gparts[i].time_bin >= time_bin_inhibited) continue;
-
-    /* Check whether we ignore this particle type altogether */
-    if (gpart_is_ignorable(&gparts[i])) continue;
-
-    const size_t index = gparts[i].fof_data.group_id - group_id_offset;
-
-    /* Only check groups above the minimum mass threshold. */
-    if (gparts[i].fof_data.group_id != group_id_default) {
-
-      /* Compute the centre of mass */
-      const double mass = gparts[i].mass;
-      double x[3] = {gparts[i].x[0], gparts[i].x[1], gparts[i].x[2]};
-
-      /* Record the first particle of this group that we encounter so we
-       * can use it as reference frame for the centre of mass calculation */
-      if (first_position[index * 3 + 0] == (double)(-FLT_MAX)) {
-        first_position[index * 3 + 0] = x[0];
-        first_position[index * 3 + 1] = x[1];
-        first_position[index * 3 + 2] = x[2];
-      }
-
-      if (periodic) {
-        x[0] = nearest(x[0] - first_position[index * 3 + 0], dim[0]);
-        x[1] = nearest(x[1] - first_position[index * 3 + 1], dim[1]);
-        x[2] = nearest(x[2] - first_position[index * 3 + 2], dim[2]);
-      }
-
-      centre_of_mass[index * 3 + 0] += mass * x[0];
-      centre_of_mass[index * 3 + 1] += mass * x[1];
-      centre_of_mass[index * 3 + 2] += mass * x[2];
-
-      /* Check haloes above the seeding threshold */
-      if (group_mass[index] > seed_halo_mass) {
-
-        /* Find the densest gas particle.
-         * Account for groups that already have a black hole and groups that
-         * contain no gas. */
-        if (gparts[i].type == swift_type_gas &&
-            max_part_density_index[index] != fof_halo_has_black_hole) {
-
-          const size_t gas_index = -gparts[i].id_or_neg_offset;
-          const float rho_com = hydro_get_comoving_density(&parts[gas_index]);
-
-          /* Update index if a denser gas particle is found. */
-          if (rho_com > max_part_density[index]) {
-            max_part_density_index[index] = gas_index;
-            max_part_density[index] = rho_com;
-          }
-        }
-        /* If there is already a black hole in the group we don't need to
-           create a new one. */
-        else if (gparts[i].type == swift_type_black_hole) {
-          max_part_density_index[index] = fof_halo_has_black_hole;
-        }
-
-      } else {
-        max_part_density_index[index] = fof_halo_has_too_low_mass;
-      }
-    }
-  }
+  /* Only keep the candidates for seeding above the mass threshold */
+  for (size_t i = 0; i < num_groups_local; i++)
+    if (group_mass[i] <= seed_halo_mass)
+      max_part_density_index[i] = fof_halo_has_too_low_mass;
 
   props->extra_bh_seed_count = 0;
 #endif
@@ -2831,9 +2972,22 @@ void fof_find_foreign_links_mapper(void *map_data, int num_elements,
 #endif
 }
 
+/**
+ * @brief Turn the sums accumulated over the particles into the group
+ * properties written to the catalogues.
+ *
+ * @param props The properties of the FOF scheme.
+ * @param group_sizes List of groups sorted in size order.
+ * @param gparts The #gpart array.
+ * @param cosmo The current cosmological model.
+ * @param periodic Are we using periodic boundary conditions?
+ * @param dim The dimension of the simulation volume.
+ * @param num_groups The number of groups on the current MPI rank.
+ */
 void fof_finalise_group_data(struct fof_props *props,
                              const struct group_length *group_sizes,
-                             const struct gpart *gparts, const int periodic,
+                             const struct gpart *gparts,
+                             const struct cosmology *cosmo, const int periodic,
                              const double dim[3], const int num_groups) {
 
   size_t *group_size =
@@ -2846,19 +3000,55 @@ void fof_finalise_group_data(struct fof_props *props,
   for (int i = 0; i < num_groups; i++) {
 
     const size_t group_offset = group_sizes[i].index;
+    const double mass = props->group_mass[i];
+
+    /* Centre of mass relative to the first position of the group */
+    const double r_com[3] = {props->group_centre_of_mass[i * 3 + 0] / mass,
+                             props->group_centre_of_mass[i * 3 + 1] / mass,
+                             props->group_centre_of_mass[i * 3 + 2] / mass};
 
     /* Centre of mass, including possible box wrapping */
-    double CoM[3] = {
-        props->group_centre_of_mass[i * 3 + 0] / props->group_mass[i],
-        props->group_centre_of_mass[i * 3 + 1] / props->group_mass[i],
-        props->group_centre_of_mass[i * 3 + 2] / props->group_mass[i]};
+    double CoM[3] = {r_com[0] + props->group_first_position[i * 3 + 0],
+                     r_com[1] + props->group_first_position[i * 3 + 1],
+                     r_com[2] + props->group_first_position[i * 3 + 2]};
     if (periodic) {
-      CoM[0] =
-          box_wrap(CoM[0] + props->group_first_position[i * 3 + 0], 0., dim[0]);
-      CoM[1] =
-          box_wrap(CoM[1] + props->group_first_position[i * 3 + 1], 0., dim[1]);
-      CoM[2] =
-          box_wrap(CoM[2] + props->group_first_position[i * 3 + 2], 0., dim[2]);
+      CoM[0] = box_wrap(CoM[0], 0., dim[0]);
+      CoM[1] = box_wrap(CoM[1], 0., dim[1]);
+      CoM[2] = box_wrap(CoM[2], 0., dim[2]);
+    }
+
+    /* Optional properties, with peculiar velocities and co-moving
+     * distances */
+    if (props->group_moments != NULL) {
+
+      struct fof_group_moments *m = &props->group_moments[i];
+
+      const double v_com[3] = {m->velocity[0] / mass, m->velocity[1] / mass,
+                               m->velocity[2] / mass};
+      const double v2 = m->velocity_dispersion / mass -
+                        (v_com[0] * v_com[0] + v_com[1] * v_com[1] +
+                         v_com[2] * v_com[2]);
+      const double r2 = m->rms_radius / mass -
+                        (r_com[0] * r_com[0] + r_com[1] * r_com[1] +
+                         r_com[2] * r_com[2]);
+
+      /* Move the angular momentum to the centre of mass frame */
+      const double L[3] = {
+          m->angular_momentum[0] -
+              mass * (r_com[1] * v_com[2] - r_com[2] * v_com[1]),
+          m->angular_momentum[1] -
+              mass * (r_com[2] * v_com[0] - r_com[0] * v_com[2]),
+          m->angular_momentum[2] -
+              mass * (r_com[0] * v_com[1] - r_com[1] * v_com[0])};
+
+      m->velocity[0] = v_com[0] * cosmo->a_inv;
+      m->velocity[1] = v_com[1] * cosmo->a_inv;
+      m->velocity[2] = v_com[2] * cosmo->a_inv;
+      m->velocity_dispersion = sqrt(max(v2, 0.)) * cosmo->a_inv;
+      m->rms_radius = sqrt(max(r2, 0.));
+      m->angular_momentum[0] = L[0] * cosmo->a_inv;
+      m->angular_momentum[1] = L[1] * cosmo->a_inv;
+      m->angular_momentum[2] = L[2] * cosmo->a_inv;
     }
 
 #ifdef WITH_MPI
@@ -4236,8 +4426,28 @@ void fof_compute_group_props(struct fof_props *props,
   bzero(props->group_mass, num_groups_local * sizeof(double));
   bzero(props->final_group_size, num_groups_local * sizeof(long long));
   bzero(props->group_centre_of_mass, num_groups_local * 3 * sizeof(double));
-  for (size_t i = 0; i < 3 * num_groups_local; i++) {
-    props->group_first_position[i] = -FLT_MAX;
+
+  /* Use the root of each group as the reference position for its centre of
+   * mass and other properties */
+  for (size_t i = 0; i < num_groups_local; i++) {
+#ifdef WITH_MPI
+    const struct gpart *root = &gparts[high_group_sizes[i].index - node_offset];
+#else
+    const struct gpart *root = &gparts[high_group_sizes[i].index];
+#endif
+    props->group_first_position[i * 3 + 0] = root->x[0];
+    props->group_first_position[i * 3 + 1] = root->x[1];
+    props->group_first_position[i * 3 + 2] = root->x[2];
+  }
+
+  /* Allocate and initialise the optional group properties. */
+  if (props->extra_group_properties) {
+    const size_t moments_size =
+        num_groups_local * sizeof(struct fof_group_moments);
+    if (swift_memalign("fof_group_moments", (void **)&props->group_moments, 32,
+                       moments_size) != 0)
+      error("Failed to allocate list of group properties for FOF search.");
+    bzero(props->group_moments, moments_size);
   }
 
   /* Allocate and initialise arrays to identify the densest gas particle. */
@@ -4275,8 +4485,8 @@ void fof_compute_group_props(struct fof_props *props,
 #endif
 
   /* Finalise the group data before dump */
-  fof_finalise_group_data(props, high_group_sizes, s->gparts, s->periodic,
-                          s->dim, num_groups_local);
+  fof_finalise_group_data(props, high_group_sizes, s->gparts, cosmo,
+                          s->periodic, s->dim, num_groups_local);
 
   if (verbose)
     message("Computing group properties took: %.3f %s.",
@@ -4321,11 +4531,14 @@ void fof_compute_group_props(struct fof_props *props,
   swift_free("fof_group_first_position", props->group_first_position);
   swift_free("fof_max_part_density_index", props->max_part_density_index);
   swift_free("fof_max_part_density", props->max_part_density);
+  if (props->group_moments != NULL)
+    swift_free("fof_group_moments", props->group_moments);
   props->group_mass = NULL;
   props->final_group_size = NULL;
   props->group_centre_of_mass = NULL;
   props->max_part_density_index = NULL;
   props->max_part_density = NULL;
+  props->group_moments = NULL;
 
   swift_free("fof_distance", props->distance_to_link);
   swift_free("fof_group_index", props->group_index);
@@ -37,6 +37,52 @@ struct phys_const;
 struct black_holes_props;
 struct cosmology;
 
+/**
+ * @brief The optional group properties that can be added to the catalogues.
+ *
+ * The values can be combined with a bitwise or.
+ */
+enum fof_group_property {
+
+  /*! Mass of each particle type in the group */
+  fof_group_property_masses_per_type = (1 << 0),
+
+  /*! Centre of mass velocity and velocity dispersion */
+  fof_group_property_velocities = (1 << 1),
+
+  /*! Mass-weighted root mean square radius */
+  fof_group_property_rms_radii = (1 << 2),
+
+  /*! Angular momentum around the centre of mass */
+  fof_group_property_angular_momenta = (1 << 3),
+};
+
+/**
+ * @brief The optional properties of a group.
+ *
+ * While the group properties are computed, the fields hold mass-weighted sums
+ * over the particles with positions taken relative to the first position of
+ * the group. fof_finalise_group_data() then turns them into the quantities
+ * written to the catalogue.
+ */
+struct fof_group_moments {
+
+  /*! Mass of each particle type */
+  double mass_per_type[swift_type_count];
+
+  /*! Sum of m v, then the peculiar velocity of the centre of mass */
+  double velocity[3];
+
+  /*! Sum of m v^2, then the 3D velocity dispersion */
+  double velocity_dispersion;
+
+  /*! Sum of m r^2, then the RMS distance to the centre of mass */
+  double rms_radius;
+
+  /*! Sum of m r x v, then the angular momentum around the centre of mass */
+  double angular_momentum[3];
+};
+
 struct fof_props {
 
   /*! Whether we're doing periodic FoF calls to seed black holes. */
@@ -75,6 +121,10 @@ struct fof_props {
   /*! The types of particles to use for attaching */
   int fof_attach_types[swift_type_count];
 
+  /*! The optional properties to add to the catalogues (#fof_group_property
+   * flags) */
+  int extra_group_properties;
+
   /* ------------  Group properties ----------------- */
 
   /*! Number of groups */
@@ -120,6 +170,9 @@ struct fof_props {
   /*! Maximal density of all parts of each group. */
   float *max_part_density;
 
+  /*! Optional properties of each group (if any were requested). */
+  struct fof_group_moments *group_moments;
+
   /* ------------ MPI-related arrays --------------- */
 
   /*! The number of links between pairs of particles on this node and
@@ -176,13 +229,6 @@ struct fof_final_mass {
   float max_part_density;
 };
 
-/* Struct used to iterate over the hash table and unpack the mass fragments of a
- * group when using MPI */
-struct fof_mass_send_hashmap {
-  struct fof_final_mass *mass_send;
-  size_t nsend;
-};
-
 /* Store local and foreign cell indices that touch. */
 struct cell_pair_indices {
   struct cell *local, *foreign;
@@ -32,6 +32,75 @@
 #include "tools.h"
 #include "version.h"
 
+/*! Maximal number of fields in a FOF catalogue */
+#define FOF_CATALOGUE_MAX_FIELDS 9
+
+/**
+ * @brief Build the list of fields to write to a FOF catalogue.
+ *
+ * @param props The properties of the FOF scheme.
+ * @param list (return) The fields (of size at least
+ * #FOF_CATALOGUE_MAX_FIELDS).
+ * @return The number of fields.
+ */
+static int fof_catalogue_fields(const struct fof_props* props,
+                                struct io_props* list) {
+
+  int num_fields = 0;
+
+  list[num_fields++] = io_make_output_field_(
+      "Masses", DOUBLE, 1, UNIT_CONV_MASS, 0.f, (char*)props->group_mass,
+      sizeof(double), "FOF group masses");
+  list[num_fields++] =
+      io_make_output_field_("Centres", DOUBLE, 3, UNIT_CONV_LENGTH, 1.f,
+                            (char*)props->group_centre_of_mass,
+                            3 * sizeof(double), "FOF group centres of mass");
+  list[num_fields++] = io_make_output_field_(
+      "GroupIDs", LONGLONG, 1, UNIT_CONV_NO_UNITS, 0.f,
+      (char*)props->group_index, sizeof(size_t), "FOF group IDs");
+  list[num_fields++] =
+      io_make_output_field_("Sizes", LONGLONG, 1, UNIT_CONV_NO_UNITS, 0.f,
+                            (char*)props->final_group_size, sizeof(long long),
+                            "FOF group length (number of particles)");
+
+  /* The optional properties */
+  const struct fof_group_moments* m = props->group_moments;
+  const int extra = props->extra_group_properties;
+
+  if (extra & fof_group_property_masses_per_type)
+    list[num_fields++] = io_make_output_field_(
+        "MassesPerType", DOUBLE, swift_type_count, UNIT_CONV_MASS, 0.f,
+        (char*)m->mass_per_type, sizeof(struct fof_group_moments),
+        "Mass of each particle type in the FOF groups");
+
+  if (extra & fof_group_property_velocities) {
+    list[num_fields++] = io_make_output_field_(
+        "Velocities", DOUBLE, 3, UNIT_CONV_VELOCITY, 0.f, (char*)m->velocity,
+        sizeof(struct fof_group_moments),
+        "Peculiar velocities of the centres of mass of the FOF groups");
+    list[num_fields++] = io_make_output_field_(
+        "VelocityDispersions", DOUBLE, 1, UNIT_CONV_VELOCITY, 0.f,
+        (char*)&m->velocity_dispersion, sizeof(struct fof_group_moments),
+        "Mass-weighted 3D peculiar velocity dispersions of the FOF groups");
+  }
+
+  if (extra & fof_group_property_rms_radii)
+    list[num_fields++] = io_make_output_field_(
+        "RMSRadii", DOUBLE, 1, UNIT_CONV_LENGTH, 1.f, (char*)&m->rms_radius,
+        sizeof(struct fof_group_moments),
+        "Co-moving mass-weighted root mean square distances of the particles "
+        "to the centres of mass of the FOF groups");
+
+  if (extra & fof_group_property_angular_momenta)
+    list[num_fields++] = io_make_output_field_(
+        "AngularMomenta", DOUBLE, 3, UNIT_CONV_ANGULAR_MOMENTUM, 1.f,
+        (char*)m->angular_momentum, sizeof(struct fof_group_moments),
+        "Angular momenta of the FOF groups around their centres of mass, "
+        "using co-moving positions and peculiar velocities");
+
+  return num_fields;
+}
+
 void write_fof_hdf5_header(hid_t h_file, const struct engine* e,
                            const long long num_groups_total,
                            const long long num_groups_this_file,
@@ -313,37 +382,13 @@ void write_fof_virtual_file(const struct fof_props* props,
       H5Gcreate(h_file, "/Groups", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
   if (h_grp < 0) error("Error while creating groups group.\n");
 
-  struct io_props output_prop;
-  output_prop = io_make_output_field_("Masses", DOUBLE, 1, UNIT_CONV_MASS, 0.f,
-                                      (char*)props->group_mass, sizeof(double),
-                                      "FOF group masses");
-  write_virtual_fof_hdf5_array(e, h_grp, file_name_base, "Groups", output_prop,
-                               num_groups_total, N_counts,
-                               compression_write_lossless, e->internal_units,
-                               e->snapshot_units);
-  output_prop =
-      io_make_output_field_("Centres", DOUBLE, 3, UNIT_CONV_LENGTH, 1.f,
-                            (char*)props->group_centre_of_mass,
-                            3 * sizeof(double), "FOF group centres of mass");
-  write_virtual_fof_hdf5_array(e, h_grp, file_name_base, "Groups", output_prop,
-                               num_groups_total, N_counts,
-                               compression_write_lossless, e->internal_units,
-                               e->snapshot_units);
-  output_prop = io_make_output_field_(
-      "GroupIDs", LONGLONG, 1, UNIT_CONV_NO_UNITS, 0.f,
-      (char*)props->group_index, sizeof(size_t), "FOF group IDs");
-  write_virtual_fof_hdf5_array(e, h_grp, file_name_base, "Groups", output_prop,
-                               num_groups_total, N_counts,
-                               compression_write_lossless, e->internal_units,
-                               e->snapshot_units);
-  output_prop =
-      io_make_output_field_("Sizes", LONGLONG, 1, UNIT_CONV_NO_UNITS, 0.f,
-                            (char*)props->final_group_size, sizeof(long long),
-                            "FOF group length (number of particles)");
-  write_virtual_fof_hdf5_array(e, h_grp, file_name_base, "Groups", output_prop,
-                               num_groups_total, N_counts,
-                               compression_write_lossless, e->internal_units,
-                               e->snapshot_units);
+  struct io_props fields[FOF_CATALOGUE_MAX_FIELDS];
+  const int num_fields = fof_catalogue_fields(props, fields);
+  for (int i = 0; i < num_fields; i++)
+    write_virtual_fof_hdf5_array(e, h_grp, file_name_base, "Groups", fields[i],
+                                 num_groups_total, N_counts,
+                                 compression_write_lossless, e->internal_units,
+                                 e->snapshot_units);
 
   /* Close everything */
   H5Gclose(h_grp);
@@ -351,26 +396,25 @@ void write_fof_virtual_file(const struct fof_props* props,
 #endif
 }
 
-void write_fof_hdf5_array(
-    const struct engine* e, hid_t grp, const char* fileName,
-    const char* partTypeGroupName, const struct io_props props, const size_t N,
+/**
+ * @brief Create a dataset of a FOF catalogue and write an already converted
+ * field to it.
+ *
+ * @param grp The HDF5 group to write to.
+ * @param temp The converted data.
+ * @param props The #io_props of the field.
+ * @param N The number of groups.
+ * @param lossy_compression The lossy compression filter to apply.
+ * @param gzip_level The level of lossless compression.
+ * @param a The current scale-factor.
+ * @param snapshot_units The units used in the outputs.
+ */
+static void write_fof_hdf5_dataset(
+    hid_t grp, const void* temp, const struct io_props props, const size_t N,
     const enum lossy_compression_schemes lossy_compression,
-    const struct unit_system* internal_units,
+    const int gzip_level, const double a,
     const struct unit_system* snapshot_units) {
 
-  const size_t typeSize = io_sizeof_type(props.type);
-  const size_t num_elements = N * props.dimension;
-
-  /* message("Writing '%s' array...", props.name); */
-
-  /* Allocate temporary buffer */
-  void* temp = NULL;
-  if (swift_memalign("writebuff", (void**)&temp, IO_BUFFER_ALIGNMENT,
-                     num_elements * typeSize) != 0)
-    error("Unable to allocate temporary i/o buffer");
-  /* Copy the particle data to the temporary buffer */
-  io_copy_temp_buffer(temp, e, props, N, internal_units, snapshot_units);
-
   /* Create data space */
   hid_t h_space;
   if (N > 0)
@@ -433,13 +477,13 @@ void write_fof_hdf5_array(
                                  props.name, comp_buffer);
 
     /* Impose GZIP data compression */
-    if (e->snapshot_compression > 0) {
+    if (gzip_level > 0) {
       h_err = H5Pset_shuffle(h_prop);
       if (h_err < 0)
         error("Error while setting shuffling options for field '%s'.",
               props.name);
 
-      h_err = H5Pset_deflate(h_prop, e->snapshot_compression);
+      h_err = H5Pset_deflate(h_prop, gzip_level);
       if (h_err < 0)
         error("Error while setting compression options for field '%s'.",
               props.name);
@@ -487,7 +531,7 @@ void write_fof_hdf5_array(
   io_write_attribute_d(
       h_data,
       "Conversion factor to physical CGS (including cosmological corrections)",
-      factor * pow(e->cosmology->a, props.scale_factor_exponent));
+      factor * pow(a, props.scale_factor_exponent));
 
 #ifdef SWIFT_DEBUG_CHECKS
   if (strlen(props.description) == 0)
@@ -497,14 +541,113 @@ void write_fof_hdf5_array(
   /* Write the full description */
   io_write_attribute_s(h_data, "Description", props.description);
 
-  /* Free and close everything */
-  swift_free("writebuff", temp);
+  /* Close everything */
   H5Tclose(h_type);
   H5Pclose(h_prop);
   H5Dclose(h_data);
   H5Sclose(h_space);
 }
 
+/**
+ * @brief A FOF catalogue field waiting to be written by the asynchronous
+ * i/o thread.
+ */
+struct write_fof_array_job {
+
+  /*! The file to write to (we hold a reference to it) */
+  hid_t h_file;
+
+  /*! The field, its converted data and the number of groups */
+  struct io_props props;
+  void* temp;
+  size_t N;
+
+  /*! Compression filters, scale-factor and units of the outputs */
+  enum lossy_compression_schemes lossy_compression;
+  int gzip_level;
+  double a;
+  const struct unit_system* snapshot_units;
+};
+
+/**
+ * @brief Write a FOF catalogue field from the asynchronous i/o thread.
+ *
+ * @param data The #write_fof_array_job.
+ */
+static void write_fof_hdf5_array_async(void* data) {
+
+  struct write_fof_array_job* job = (struct write_fof_array_job*)data;
+
+  const hid_t h_grp = H5Gopen(job->h_file, "/Groups", H5P_DEFAULT);
+  if (h_grp < 0) error("Error while opening groups group.");
+
+  write_fof_hdf5_dataset(h_grp, job->temp, job->props, job->N,
+                         job->lossy_compression, job->gzip_level, job->a,
+                         job->snapshot_units);
+
+  /* Closing the last reference closes the file */
+  H5Gclose(h_grp);
+  H5Fclose(job->h_file);
+  swift_free("writebuff", job->temp);
+  free(job);
+}
+
+void write_fof_hdf5_array(
+    const struct engine* e, hid_t grp, const char* fileName,
+    const char* partTypeGroupName, const struct io_props props, const size_t N,
+    const enum lossy_compression_schemes lossy_compression,
+    const struct unit_system* internal_units,
+    const struct unit_system* snapshot_units) {
+
+  const size_t typeSize = io_sizeof_type(props.type);
+  const size_t num_elements = N * props.dimension;
+
+  /* message("Writing '%s' array...", props.name); */
+
+  if (e->snapshot_async != NULL) {
+
+    /* Let the i/o thread use the library while we convert the data */
+    io_hdf5_unlock();
+    void* temp =
+        io_async_alloc(e->snapshot_async, "writebuff", num_elements * typeSize);
+    io_copy_temp_buffer(temp, e, props, N, internal_units, snapshot_units);
+    io_hdf5_lock();
+
+    struct write_fof_array_job* job =
+        (struct write_fof_array_job*)malloc(sizeof(struct write_fof_array_job));
+    if (job == NULL) error("Unable to allocate asynchronous i/o job");
+    job->h_file = H5Iget_file_id(grp);
+    job->props = props;
+    job->temp = temp;
+    job->N = N;
+    job->lossy_compression = lossy_compression;
+    job->gzip_level = e->snapshot_compression;
+    job->a = e->cosmology->a;
+    job->snapshot_units = snapshot_units;
+
+    io_async_submit(e->snapshot_async, write_fof_hdf5_array_async, job,
+                    num_elements * typeSize);
+    return;
+  }
+
+  /* Allocate temporary buffer */
+  void* temp = NULL;
+  if (swift_memalign("writebuff", (void**)&temp, IO_BUFFER_ALIGNMENT,
+                     num_elements * typeSize) != 0)
+    error("Unable to allocate temporary i/o buffer");
+
+  /* Copy the particle data to the temporary buffer */
+  io_copy_temp_buffer(temp, e, props, N, internal_units, snapshot_units);
+
+  /* Create the dataset and write the data */
+  write_fof_hdf5_dataset(grp, temp, props, N, lossy_compression,
+                         e->snapshot_compression, e->cosmology->a,
+                         snapshot_units);
+
+  /* Free everything */
+  swift_free("writebuff", temp);
+}
+
 void write_fof_hdf5_catalogue(const struct fof_props* props,
                               long long num_groups, const struct engine* e) {
 
@@ -522,9 +665,6 @@ void write_fof_hdf5_catalogue(const struct fof_props* props,
           e->snapshot_output_count);
 #endif
 
-  hid_t h_file = H5Fcreate(file_name, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-  if (h_file < 0) error("Error while opening file '%s'.", file_name);
-
   /* Compute the number of groups */
   long long num_groups_local = num_groups;
   long long num_groups_total = num_groups;
@@ -538,6 +678,14 @@ void write_fof_hdf5_catalogue(const struct fof_props* props,
              MPI_LONG_LONG_INT, 0, MPI_COMM_WORLD);
 #endif
 
+  /* When writing asynchronously, the fields are converted now and written
+   * by the i/o thread. We can only use the HDF5 library while holding its
+   * lock. */
+  if (e->snapshot_async != NULL) io_hdf5_lock();
+
+  hid_t h_file = H5Fcreate(file_name, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  if (h_file < 0) error("Error while opening file '%s'.", file_name);
+
   /* Start by writing the header */
   write_fof_hdf5_header(h_file, e, num_groups_total, num_groups_local, props,
                         /*virtual_file=*/0);
@@ -546,46 +694,27 @@ void write_fof_hdf5_catalogue(const struct fof_props* props,
       H5Gcreate(h_file, "/Groups", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
   if (h_grp < 0) error("Error while creating groups group.\n");
 
-  struct io_props output_prop;
-  output_prop = io_make_output_field_("Masses", DOUBLE, 1, UNIT_CONV_MASS, 0.f,
-                                      (char*)props->group_mass, sizeof(double),
-                                      "FOF group masses");
-  write_fof_hdf5_array(e, h_grp, file_name, "Groups", output_prop,
-                       num_groups_local, compression_write_lossless,
-                       e->internal_units, e->snapshot_units);
-  output_prop =
-      io_make_output_field_("Centres", DOUBLE, 3, UNIT_CONV_LENGTH, 1.f,
-                            (char*)props->group_centre_of_mass,
-                            3 * sizeof(double), "FOF group centres of mass");
-  write_fof_hdf5_array(e, h_grp, file_name, "Groups", output_prop,
-                       num_groups_local, compression_write_lossless,
-                       e->internal_units, e->snapshot_units);
-  output_prop = io_make_output_field_(
-      "GroupIDs", LONGLONG, 1, UNIT_CONV_NO_UNITS, 0.f,
-      (char*)props->group_index, sizeof(size_t), "FOF group IDs");
-  write_fof_hdf5_array(e, h_grp, file_name, "Groups", output_prop,
-                       num_groups_local, compression_write_lossless,
-                       e->internal_units, e->snapshot_units);
-  output_prop =
-      io_make_output_field_("Sizes", LONGLONG, 1, UNIT_CONV_NO_UNITS, 0.f,
-                            (char*)props->final_group_size, sizeof(long long),
-                            "FOF group length (number of particles)");
-  write_fof_hdf5_array(e, h_grp, file_name, "Groups", output_prop,
-                       num_groups_local, compression_write_lossless,
-                       e->internal_units, e->snapshot_units);
+  struct io_props fields[FOF_CATALOGUE_MAX_FIELDS];
+  const int num_fields = fof_catalogue_fields(props, fields);
+  for (int i = 0; i < num_fields; i++)
+    write_fof_hdf5_array(e, h_grp, file_name, "Groups", fields[i],
+                         num_groups_local, compression_write_lossless,
+                         e->internal_units, e->snapshot_units);
 
   /* Close everything */
   H5Gclose(h_grp);
   H5Fclose(h_file);
 
-#ifdef WITH_MPI
-#if H5_VERSION_GE(1, 10, 0)
+#if defined(WITH_MPI) && H5_VERSION_GE(1, 10, 0)
 
   /* Write the virtual meta-file */
   if (e->nodeID == 0)
     write_fof_virtual_file(props, num_groups_total, N_counts, e);
 #endif
 
+  if (e->snapshot_async != NULL) io_hdf5_unlock();
+
+#ifdef WITH_MPI
   /* Free the counts-per-rank array */
   free(N_counts);
 
@@ -0,0 +1,258 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers */
+#include <stdlib.h>
+
+/* This object's header. */
+#include "io_async.h"
+
+/* Local includes. */
+#include "clocks.h"
+#include "common_io.h"
+#include "error.h"
+#include "memuse.h"
+
+/*! Lock serialising all the calls made to the HDF5 library. */
+static pthread_mutex_t io_hdf5_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Acquire exclusive access to the HDF5 library.
+ *
+ * The library is not assumed to be thread-safe. Any code that may call it
+ * while an asynchronous snapshot is being written must hold this lock.
+ */
+void io_hdf5_lock(void) {
+  if (pthread_mutex_lock(&io_hdf5_mutex) != 0)
+    error("Failed to lock the HDF5 mutex.");
+}
+
+/**
+ * @brief Release the access to the HDF5 library.
+ */
+void io_hdf5_unlock(void) {
+  if (pthread_mutex_unlock(&io_hdf5_mutex) != 0)
+    error("Failed to unlock the HDF5 mutex.");
+}
+
+/**
+ * @brief Main loop of the i/o thread.
+ *
+ * Pops the jobs in the order they were submitted and runs them with the
+ * HDF5 lock held. Returns once asked to stop and the queue is empty.
+ *
+ * @param data The #io_async we belong to.
+ */
+static void *io_async_runner(void *data) {
+
+  struct io_async *w = (struct io_async *)data;
+
+  pthread_mutex_lock(&w->mutex);
+  while (1) {
+
+    /* Wait for something to do. */
+    while (w->head == NULL && !w->stop)
+      pthread_cond_wait(&w->work_cond, &w->mutex);
+    if (w->head == NULL) break;
+
+    /* Grab the oldest job. */
+    struct io_async_job *job = w->head;
+    w->head = job->next;
+    if (w->head == NULL) w->tail = NULL;
+    w->busy = 1;
+    pthread_mutex_unlock(&w->mutex);
+
+    /* Do the actual writing. */
+    const ticks tic = getticks();
+    io_hdf5_lock();
+    job->func(job->data);
+    io_hdf5_unlock();
+    const ticks toc = getticks();
+
+    /* Release the staged memory and wake up anyone waiting for it. */
+    pthread_mutex_lock(&w->mutex);
+    w->busy = 0;
+    w->staged -= job->size;
+    w->bytes_written += job->size;
+    w->time_writing += toc - tic;
+    pthread_cond_broadcast(&w->done_cond);
+    free(job);
+  }
+  pthread_mutex_unlock(&w->mutex);
+
+  return NULL;
+}
+
+/**
+ * @brief Initialise an asynchronous writer and start its i/o thread.
+ *
+ * @param w The #io_async.
+ * @param budget Maximal number of bytes that can be staged at any time.
+ */
+void io_async_init(struct io_async *w, size_t budget) {
+
+  w->head = NULL;
+  w->tail = NULL;
+  w->budget = budget;
+  w->staged = 0;
+  w->busy = 0;
+  w->stop = 0;
+  w->bytes_written = 0;
+  w->time_writing = 0;
+  w->time_stalled = 0;
+
+  if (pthread_mutex_init(&w->mutex, NULL) != 0 ||
+      pthread_cond_init(&w->work_cond, NULL) != 0 ||
+      pthread_cond_init(&w->done_cond, NULL) != 0)
+    error("Failed to initialise the asynchronous i/o locks.");
+
+  if (pthread_create(&w->thread, NULL, &io_async_runner, w) != 0)
+    error("Failed to create the asynchronous i/o thread.");
+}
+
+/**
+ * @brief Allocate a staging buffer, waiting for earlier jobs to complete
+ * if that would exceed the memory budget.
+ *
+ * A buffer larger than the whole budget is granted once nothing else is
+ * staged. The caller must not hold the HDF5 lock.
+ *
+ * @param w The #io_async.
+ * @param label The label used for the memory logging.
+ * @param size The size of the buffer in bytes.
+ * @return The (aligned) buffer.
+ */
+void *io_async_alloc(struct io_async *w, const char *label, size_t size) {
+
+  const ticks tic = getticks();
+
+  pthread_mutex_lock(&w->mutex);
+  while (w->staged > 0 && w->staged + size > w->budget)
+    pthread_cond_wait(&w->done_cond, &w->mutex);
+  w->staged += size;
+  w->time_stalled += getticks() - tic;
+  pthread_mutex_unlock(&w->mutex);
+
+  void *buffer = NULL;
+  if (swift_memalign(label, &buffer, IO_BUFFER_ALIGNMENT, size) != 0)
+    error("Unable to allocate asynchronous i/o buffer of %zd bytes", size);
+
+  return buffer;
+}
+
+/**
+ * @brief Change the number of bytes charged for data staged with
+ * io_async_alloc().
+ *
+ * This is used when the staged data is replaced by a smaller version of
+ * itself, for instance once it has been compressed. The new size is the
+ * one to pass to io_async_submit().
+ *
+ * @param w The #io_async.
+ * @param old_size The number of bytes charged so far.
+ * @param new_size The number of bytes held from now on.
+ */
+void io_async_restage(struct io_async *w, size_t old_size, size_t new_size) {
+
+  pthread_mutex_lock(&w->mutex);
+  w->staged = w->staged - old_size + new_size;
+  if (new_size < old_size) pthread_cond_broadcast(&w->done_cond);
+  pthread_mutex_unlock(&w->mutex);
+}
+
+/**
+ * @brief Append a job to the queue of the i/o thread.
+ *
+ * The job is responsible for freeing its data and any buffer obtained
+ * from io_async_alloc().
+ *
+ * @param w The #io_async.
+ * @param func The function to run.
+ * @param data The argument of the function.
+ * @param size The number of staged bytes the job releases.
+ */
+void io_async_submit(struct io_async *w, io_async_function func, void *data,
+                     size_t size) {
+
+  struct io_async_job *job =
+      (struct io_async_job *)malloc(sizeof(struct io_async_job));
+  if (job == NULL) error("Failed to allocate asynchronous i/o job.");
+  job->func = func;
+  job->data = data;
+  job->size = size;
+  job->next = NULL;
+
+  pthread_mutex_lock(&w->mutex);
+  if (w->tail == NULL)
+    w->head = job;
+  else
+    w->tail->next = job;
+  w->tail = job;
+  pthread_cond_signal(&w->work_cond);
+  pthread_mutex_unlock(&w->mutex);
+}
+
+/**
+ * @brief Wait until all the submitted jobs have completed.
+ *
+ * @param w The #io_async (can be NULL).
+ */
+void io_async_wait(struct io_async *w) {
+
+  if (w == NULL) return;
+
+  const ticks tic = getticks();
+
+  pthread_mutex_lock(&w->mutex);
+  while (w->head != NULL || w->busy)
+    pthread_cond_wait(&w->done_cond, &w->mutex);
+  w->time_stalled += getticks() - tic;
+  pthread_mutex_unlock(&w->mutex);
+}
+
+/**
+ * @brief Complete all the pending jobs and stop the i/o thread.
+ *
+ * @param w The #io_async.
+ * @param verbose Are we talkative?
+ */
+void io_async_clean(struct io_async *w, int verbose) {
+
+  pthread_mutex_lock(&w->mutex);
+  w->stop = 1;
+  pthread_cond_signal(&w->work_cond);
+  pthread_mutex_unlock(&w->mutex);
+
+  if (pthread_join(w->thread, NULL) != 0)
+    error("Failed to join the asynchronous i/o thread.");
+
+  if (verbose)
+    message(
+        "Asynchronous i/o wrote %.3f MB in %.3f %s, callers stalled for "
+        "%.3f %s.",
+        w->bytes_written / (1024. * 1024.),
+        clocks_from_ticks(w->time_writing), clocks_getunit(),
+        clocks_from_ticks(w->time_stalled), clocks_getunit());
+
+  pthread_cond_destroy(&w->done_cond);
+  pthread_cond_destroy(&w->work_cond);
+  pthread_mutex_destroy(&w->mutex);
+}
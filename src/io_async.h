@@ -0,0 +1,90 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_IO_ASYNC_H
+#define SWIFT_IO_ASYNC_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers */
+#include <pthread.h>
+#include <stddef.h>
+
+/* Local includes. */
+#include "cycle.h"
+
+/* Function type for the jobs executed by the i/o thread. */
+typedef void (*io_async_function)(void *data);
+
+/* A pending piece of i/o work. */
+struct io_async_job {
+
+  /* The function to call and its argument. */
+  io_async_function func;
+  void *data;
+
+  /* Number of staged bytes released once the job is done. */
+  size_t size;
+
+  /* Next job in the queue. */
+  struct io_async_job *next;
+};
+
+/* Data of an asynchronous writer. */
+struct io_async {
+
+  /* The i/o thread. */
+  pthread_t thread;
+
+  /* Lock and conditions protecting everything below. */
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+
+  /* FIFO of pending jobs. */
+  struct io_async_job *head, *tail;
+
+  /* Maximal number of staged bytes and number currently staged. */
+  size_t budget;
+  size_t staged;
+
+  /* Is the i/o thread currently running a job? */
+  int busy;
+
+  /* Has the i/o thread been asked to terminate? */
+  int stop;
+
+  /* Statistics: bytes written, time spent writing and time spent waiting
+   * for the budget or for completion on the calling side. */
+  size_t bytes_written;
+  ticks time_writing;
+  ticks time_stalled;
+};
+
+void io_async_init(struct io_async *w, size_t budget);
+void *io_async_alloc(struct io_async *w, const char *label, size_t size);
+void io_async_restage(struct io_async *w, size_t old_size, size_t new_size);
+void io_async_submit(struct io_async *w, io_async_function func, void *data,
+                     size_t size);
+void io_async_wait(struct io_async *w);
+void io_async_clean(struct io_async *w, int verbose);
+
+void io_hdf5_lock(void);
+void io_hdf5_unlock(void);
+
+#endif /* SWIFT_IO_ASYNC_H */
@@ -157,7 +157,8 @@ static double ring2z(int nside, int ir) {
  *
  * If nr_ranges and range are both not NULL, returns a newly
  * allocated array of struct pixel_range with the ranges of
- * pixels which overlap the disc.
+ * pixels which overlap the disc. Each range lies within a
+ * single ring, the index of which is also returned.
  *
  * @param nside HEALPix resolution parameter
  * @param vec vector specifying the disc centre
@@ -287,6 +288,7 @@ void healpix_query_disc_range(int nside, double vec[3], double radius,
         if (nr_ranges && range) {
           (*range)[*nr_ranges].first = first;
           (*range)[*nr_ranges].last = last;
+          (*range)[*nr_ranges].ring = iring;
           *nr_ranges += 1;
         }
       } else {
@@ -298,6 +300,7 @@ void healpix_query_disc_range(int nside, double vec[3], double radius,
         if (nr_ranges && range) {
           (*range)[*nr_ranges].first = first;
           (*range)[*nr_ranges].last = last;
+          (*range)[*nr_ranges].ring = iring;
           *nr_ranges += 1;
         }
         /* my_low to end of ring */
@@ -307,6 +310,7 @@ void healpix_query_disc_range(int nside, double vec[3], double radius,
         if (nr_ranges && range) {
           (*range)[*nr_ranges].first = first;
           (*range)[*nr_ranges].last = last;
+          (*range)[*nr_ranges].ring = iring;
           *nr_ranges += 1;
         }
       }
@@ -319,6 +323,37 @@ void healpix_query_disc_range(int nside, double vec[3], double radius,
   *pix_max = (pixel_index_t)pix_max_ll;
 }
 
+/**
+ * @brief Return the position of the pixel centres in a HEALPix ring
+ *
+ * All pixel centres in a ring have the same z coordinate and are
+ * equally spaced in phi, so the centre of pixel pix in the ring is
+ * at phi = phi_start + (pix - ring_start) * dphi. This is much
+ * cheaper than calling pix2vec_ring() for each pixel.
+ *
+ * @param nside HEALPix resolution parameter
+ * @param ring the ring index in range 1 to 4*nside-1
+ * @param z returns the z coordinate of the ring
+ * @param ring_start returns the index of the first pixel in the ring
+ * @param phi_start returns the phi coordinate of the first pixel
+ * @param dphi returns the spacing in phi between pixels in the ring
+ *
+ */
+void healpix_ring_geometry(int nside, int ring, double *z,
+                           pixel_index_t *ring_start, double *phi_start,
+                           double *dphi) {
+
+  /* Look up number of pixels in this ring */
+  int npr, kshift;
+  long long npnorth;
+  pixels_per_ring(nside, ring, &npr, &kshift, &npnorth);
+
+  *z = ring2z(nside, ring);
+  *ring_start = (pixel_index_t)(npnorth - npr);
+  *dphi = 2 * M_PI / npr;
+  *phi_start = 0.5 * kshift * (*dphi);
+}
+
 /**
  * @brief Make a 3D vector given z and phi coordinates
  *
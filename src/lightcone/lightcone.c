@@ -44,6 +44,7 @@
 #include "extra_io.h"
 #include "gravity_io.h"
 #include "hydro.h"
+#include "io_async.h"
 #include "lightcone/lightcone_particle_io.h"
 #include "lightcone/lightcone_replications.h"
 #include "lock.h"
@@ -832,12 +833,14 @@ static void particle_file_name(char *buf, int len, char *subdir, char *basename,
  * @param snapshot_units swift snapshot unit system
  * @param flush_all flag to force flush of all buffers
  * @param end_file if true, subsequent calls write to a new file
+ * @param tp the #threadpool used to copy the buffered particles
  *
  */
 void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
                                       const struct unit_system *internal_units,
                                       const struct unit_system *snapshot_units,
-                                      int flush_all, int end_file) {
+                                      int flush_all, int end_file,
+                                      struct threadpool *tp) {
 
   ticks tic = getticks();
 
@@ -863,9 +866,11 @@ void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
   /* Check if there's anything to do */
   if ((types_to_flush > 0) || (end_file && props->file_needs_finalizing)) {
 
-    /* We have data to flush, so open or create the output file */
+    /* We have data to flush, so open or create the output file. The HDF5
+       lock is only held around the library calls, not the buffer copies. */
     hid_t file_id;
     char fname[FILENAME_BUFFER_SIZE];
+    io_hdf5_lock();
     if (props->start_new_file) {
 
       /* Get the name of the next file */
@@ -931,6 +936,7 @@ void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
       if (file_id < 0)
         error("Unable to open current lightcone file: %s", fname);
     }
+    io_hdf5_unlock();
 
     /* Loop over particle types */
     for (int ptype = 0; ptype < swift_type_count; ptype += 1) {
@@ -939,7 +945,7 @@ void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
             particle_buffer_num_elements(&props->buffer[ptype]);
         if (num_to_write >= max_to_buffer && num_to_write > 0) {
           lightcone_write_particles(props, internal_units, snapshot_units,
-                                    ptype, file_id);
+                                    ptype, file_id, tp);
           particle_buffer_empty(&props->buffer[ptype]);
           props->num_particles_written_to_file[ptype] += num_to_write;
           props->num_particles_written_this_rank[ptype] += num_to_write;
@@ -948,6 +954,7 @@ void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
     }
 
     /* Check if this is the last write to this file */
+    io_hdf5_lock();
     if (end_file) {
       hid_t group_id = H5Gopen(file_id, "Lightcone", H5P_DEFAULT);
       /* Flag the file as complete */
@@ -969,6 +976,7 @@ void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
 
     /* We're done updating the output file */
     H5Fclose(file_id);
+    io_hdf5_unlock();
   }
 
   /* If we need to start a new file next time, record this */
@@ -995,10 +1003,15 @@ void lightcone_flush_map_updates(struct lightcone_props *props,
   /* Apply updates to all current shells */
   for (int shell_nr = 0; shell_nr < props->nr_shells; shell_nr += 1) {
     if (props->shell[shell_nr].state == shell_current) {
+      ticks tic_shell = getticks();
       lightcone_shell_flush_map_updates(&props->shell[shell_nr], tp,
                                         props->part_type,
                                         props->max_map_update_send_size_mb,
                                         &props->kernel_table, props->verbose);
+      if (props->verbose && engine_rank == 0)
+        message("lightcone %d: Applying map updates for shell %d took %.3f %s.",
+                props->index, shell_nr,
+                clocks_from_ticks(getticks() - tic_shell), clocks_getunit());
     }
   }
 
@@ -1069,10 +1082,16 @@ void lightcone_dump_completed_shells(struct lightcone_props *props,
 
         /* Apply any buffered updates for this shell, if we didn't already */
         if (need_flush) {
+          ticks tic_shell = getticks();
           lightcone_shell_flush_map_updates(
               &props->shell[shell_nr], tp, props->part_type,
               props->max_map_update_send_size_mb, &props->kernel_table,
               props->verbose);
+          if (props->verbose && engine_rank == 0)
+            message(
+                "lightcone %d: Applying map updates for shell %d took %.3f %s.",
+                props->index, shell_nr,
+                clocks_from_ticks(getticks() - tic_shell), clocks_getunit());
         }
 
         /* Set the baseline value for the maps */
@@ -1099,6 +1118,7 @@ void lightcone_dump_completed_shells(struct lightcone_props *props,
                        props->basename, shell_nr, file_num);
 
         /* Create the output file for this shell */
+        io_hdf5_lock();
         hid_t fapl_id = H5Pcreate(H5P_FILE_ACCESS);
 
         /* Set MPI collective mode, if necessary */
@@ -1141,8 +1161,10 @@ void lightcone_dump_completed_shells(struct lightcone_props *props,
 
         /* Write the system of Units used internally */
         io_write_unit_system(file_id, internal_units, "InternalCodeUnits");
+        io_hdf5_unlock();
 
-        /* Write the lightcone maps for this shell */
+        /* Write the lightcone maps for this shell (takes the HDF5 lock
+           itself, after converting the units of the pixel data) */
         for (int map_nr = 0; map_nr < nr_maps; map_nr += 1)
           lightcone_map_write(&(props->shell[shell_nr].map[map_nr]), file_id,
                               props->map_type[map_nr].name, internal_units,
@@ -1151,8 +1173,10 @@ void lightcone_dump_completed_shells(struct lightcone_props *props,
                               props->map_type[map_nr].compression);
 
         /* Close the file */
+        io_hdf5_lock();
         H5Pclose(fapl_id);
         H5Fclose(file_id);
+        io_hdf5_unlock();
 
         /* Free the pixel data associated with this shell */
         for (int map_nr = 0; map_nr < nr_maps; map_nr += 1)
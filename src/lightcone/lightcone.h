@@ -240,7 +240,8 @@ void lightcone_buffer_particle(struct lightcone_props *props,
 void lightcone_flush_particle_buffers(struct lightcone_props *props, double a,
                                       const struct unit_system *internal_units,
                                       const struct unit_system *snapshot_units,
-                                      int flush_all, int end_file);
+                                      int flush_all, int end_file,
+                                      struct threadpool *tp);
 
 void lightcone_buffer_map_update(struct lightcone_props *props,
                                  const struct engine *e, const struct gpart *gp,
@@ -28,6 +28,7 @@
 #include "lightcone/lightcone_array.h"
 
 /* Local headers */
+#include "atomic.h"
 #include "common_io.h"
 #include "cosmology.h"
 #include "engine.h"
@@ -43,6 +44,19 @@
 #include "timeline.h"
 #include "tools.h"
 
+/**
+ * @brief Set up the per-thread scratch space of the crossing checks.
+ *
+ * props the #lightcone_array_props struct
+ */
+static void lightcone_array_init_crossing_scratch(
+    struct lightcone_array_props *props) {
+
+  if (pthread_key_create(&props->crossing_scratch_key, NULL) != 0)
+    error("Failed to create the lightcone crossing scratch key");
+  props->crossing_scratch = NULL;
+}
+
 /**
  * @brief Initialise the properties of the lightcone code.
  *
@@ -103,6 +117,8 @@ void lightcone_array_init(struct lightcone_array_props *props,
   }
 
   props->verbose = verbose;
+
+  lightcone_array_init_crossing_scratch(props);
 }
 
 void lightcone_array_clean(struct lightcone_array_props *props) {
@@ -110,6 +126,17 @@ void lightcone_array_clean(struct lightcone_array_props *props) {
   for (int i = 0; i < props->nr_lightcones; i += 1)
     lightcone_clean(props->lightcone + i);
   free(props->lightcone);
+
+  /* Free the scratch space of all the threads */
+  struct lightcone_crossing_scratch *scratch = props->crossing_scratch;
+  while (scratch != NULL) {
+    struct lightcone_crossing_scratch *next = scratch->next;
+    free(scratch->buffer);
+    free(scratch);
+    scratch = next;
+  }
+  props->crossing_scratch = NULL;
+  pthread_key_delete(props->crossing_scratch_key);
 }
 
 void lightcone_array_struct_dump(const struct lightcone_array_props *props,
@@ -137,6 +164,8 @@ void lightcone_array_struct_restore(struct lightcone_array_props *props,
 
   for (int i = 0; i < props->nr_lightcones; i += 1)
     lightcone_struct_restore(props->lightcone + i, stream);
+
+  lightcone_array_init_crossing_scratch(props);
 }
 
 void lightcone_array_prepare_for_step(struct lightcone_array_props *props,
@@ -205,7 +234,8 @@ void lightcone_array_flush(struct lightcone_array_props *props,
 
     /* Flush particle buffers if they're large or flag is set */
     lightcone_flush_particle_buffers(lc_props, cosmo->a, internal_units,
-                                     snapshot_units, flush_particles, end_file);
+                                     snapshot_units, flush_particles, end_file,
+                                     tp);
 
     /* Write out any completed healpix maps */
     lightcone_dump_completed_shells(lc_props, tp, cosmo, internal_units,
@@ -340,3 +370,46 @@ void lightcone_array_report_memory_use(struct lightcone_array_props *props) {
             memuse_min[3] / MB, memuse_max[3] / MB);
   }
 }
+
+/**
+ * @brief Get the crossing check scratch space of the calling thread
+ *
+ * The space is kept from one call to the next and only grows, such that
+ * the drift of a cell does not need to allocate anything.
+ *
+ * props the #lightcone_array_props struct
+ * size the number of doubles needed
+ */
+double *lightcone_array_get_crossing_scratch(
+    struct lightcone_array_props *props, const size_t size) {
+
+  struct lightcone_crossing_scratch *scratch =
+      (struct lightcone_crossing_scratch *)pthread_getspecific(
+          props->crossing_scratch_key);
+
+  /* First call from this thread? */
+  if (scratch == NULL) {
+    scratch = (struct lightcone_crossing_scratch *)calloc(
+        1, sizeof(struct lightcone_crossing_scratch));
+    if (scratch == NULL)
+      error("Failed to allocate lightcone crossing scratch space");
+    pthread_setspecific(props->crossing_scratch_key, scratch);
+
+    /* Register it such that it can be freed */
+    struct lightcone_crossing_scratch *head;
+    do {
+      head = props->crossing_scratch;
+      scratch->next = head;
+    } while (atomic_cas(&props->crossing_scratch, head, scratch) != head);
+  }
+
+  if (scratch->size < size) {
+    free(scratch->buffer);
+    scratch->buffer = (double *)malloc(size * sizeof(double));
+    if (scratch->buffer == NULL)
+      error("Failed to allocate lightcone crossing replication arrays");
+    scratch->size = size;
+  }
+
+  return scratch->buffer;
+}
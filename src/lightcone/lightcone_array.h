@@ -23,6 +23,10 @@
 /* Config parameters. */
 #include <config.h>
 
+/* Standard headers */
+#include <pthread.h>
+#include <stddef.h>
+
 /* Local headers */
 #include "lightcone/lightcone.h"
 #include "lightcone/lightcone_replications.h"
@@ -39,6 +43,21 @@ struct space;
 
 #define MAX_LIGHTCONES 8
 
+/**
+ * @brief Scratch space of one thread for the lightcone crossing checks
+ */
+struct lightcone_crossing_scratch {
+
+  /*! Space for the replication arrays of a cell */
+  double *buffer;
+
+  /*! Number of doubles in the buffer */
+  size_t size;
+
+  /*! Scratch space of the next thread */
+  struct lightcone_crossing_scratch *next;
+};
+
 /**
  * @brief Lightcone data for multiple lightcones
  */
@@ -56,6 +75,12 @@ struct lightcone_array_props {
 
   /*! Whether to generate memory usage reports */
   int verbose;
+
+  /*! Key to the crossing check scratch space of each thread */
+  pthread_key_t crossing_scratch_key;
+
+  /*! All the crossing check scratch spaces handed out so far */
+  struct lightcone_crossing_scratch *crossing_scratch;
 };
 
 void lightcone_array_init(struct lightcone_array_props *props,
@@ -99,4 +124,7 @@ void lightcone_array_write_index(struct lightcone_array_props *props,
 
 void lightcone_array_report_memory_use(struct lightcone_array_props *props);
 
+double *lightcone_array_get_crossing_scratch(
+    struct lightcone_array_props *props, const size_t size);
+
 #endif /* SWIFT_LIGHTCONE_ARRAY_H */
@@ -0,0 +1,245 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local headers */
+#include "cosmology.h"
+#include "engine.h"
+#include "error.h"
+
+/* This object's header. */
+#include "lightcone/lightcone_crossing.h"
+
+/* Standard headers */
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+/**
+ * @brief Relative amount by which the bounding sphere of the particles is
+ * enlarged to protect the replication pre-filter against round-off.
+ */
+#define LIGHTCONE_BOUNDS_PADDING 1.0e-2
+
+/**
+ * @brief Start setting up the lightcone crossing checks for the drift of a
+ * leaf #cell.
+ *
+ * The positions of the particles to check must then be added with
+ * lightcone_cell_crossings_add_to_bounds() before calling
+ * lightcone_cell_crossings_prepare().
+ *
+ * @param lc the #lightcone_cell_crossings to initialise
+ * @param e the #engine
+ * @param replication_list_array one replication list for each lightcone
+ * (NULL if no lightcones are made)
+ * @param ti_old beginning of the drift on the integer time line
+ * @param ti_current end of the drift on the integer time line
+ * @param cell_loc coordinates of the #cell
+ */
+void lightcone_cell_crossings_init(
+    struct lightcone_cell_crossings *lc, const struct engine *e,
+    const struct replication_list *replication_list_array,
+    const integertime_t ti_old, const integertime_t ti_current,
+    const double cell_loc[3]) {
+
+  lc->e = e;
+  lc->replication_list_array = replication_list_array;
+  lc->ti_old = ti_old;
+  lc->ti_current = ti_current;
+  lc->comoving_dist_start = 0.;
+  lc->comoving_dist_end = 0.;
+  lc->count = 0;
+  lc->nrep_max = 0;
+  lc->nrep_tot = 0;
+  for (int k = 0; k < 3; k++) {
+    lc->cell_loc[k] = cell_loc[k];
+    lc->bound_min[k] = DBL_MAX;
+    lc->bound_max[k] = -DBL_MAX;
+  }
+  for (int i = 0; i < MAX_LIGHTCONES; i++) {
+    lc->nrep[i] = 0;
+    lc->first[i] = 0;
+  }
+  lc->rep_x = NULL;
+  lc->rep_y = NULL;
+  lc->rep_z = NULL;
+  lc->r2_start = NULL;
+  lc->r2_end = NULL;
+
+  /* Count the replications we may have to check */
+  if (replication_list_array != NULL) {
+    const int nr_lightcones = e->lightcone_array_properties->nr_lightcones;
+    for (int lightcone_nr = 0; lightcone_nr < nr_lightcones; lightcone_nr += 1)
+      lc->nrep_max += (size_t)replication_list_array[lightcone_nr].nrep;
+  }
+}
+
+/**
+ * @brief Select the replications in which the particles of a #cell may
+ * cross the lightcones during this drift.
+ *
+ * This works out the comoving distances to the lightcone surface at the
+ * start and end of the drift once for the whole #cell. Then, for each
+ * replication, the sphere enclosing the bounding box of the particles is
+ * compared to the shell swept by the lightcone surface. A replication is
+ * dropped if the whole sphere lies beyond the surface at the start of the
+ * drift, or if it lies so far inside the surface at the end of the drift
+ * that no particle moving slower than light can reach it.
+ *
+ * @param lc the #lightcone_cell_crossings with all the particles added
+ */
+void lightcone_cell_crossings_prepare(struct lightcone_cell_crossings *lc) {
+
+  /* Nothing to do if there are no replications or no particles to check */
+  const size_t nrep_max = lc->nrep_max;
+  if (nrep_max == 0 || lc->count == 0) return;
+
+  const struct engine *e = lc->e;
+  struct lightcone_array_props *lightcone_array_properties =
+      e->lightcone_array_properties;
+  const int nr_lightcones = lightcone_array_properties->nr_lightcones;
+
+  /* Determine expansion factor at start and end of the drift */
+  const struct cosmology *c = e->cosmology;
+  const double a_start = c->a_begin * exp(lc->ti_old * c->time_base);
+  const double a_end = c->a_begin * exp(lc->ti_current * c->time_base);
+
+  /* Find comoving distance to these expansion factors */
+  const double comoving_dist_start =
+      cosmology_get_comoving_distance(c, a_start);
+  const double comoving_dist_2_start =
+      comoving_dist_start * comoving_dist_start;
+  const double comoving_dist_end = cosmology_get_comoving_distance(c, a_end);
+  const double comoving_dist_2_end = comoving_dist_end * comoving_dist_end;
+  lc->comoving_dist_start = comoving_dist_start;
+  lc->comoving_dist_end = comoving_dist_end;
+
+  /* Thickness of the 'shell' between the lightcone surfaces at start and end
+     of drift. We use this as a limit on how far a particle can drift (i.e.
+     assume v < c). */
+  const double boundary = comoving_dist_2_start - comoving_dist_2_end;
+  const double max_drift = comoving_dist_start - comoving_dist_end;
+
+  /* Sphere enclosing the (wrapped) particle positions */
+  double centre[3], radius2 = 0.;
+  for (int k = 0; k < 3; k++) {
+    centre[k] = 0.5 * (lc->bound_min[k] + lc->bound_max[k]);
+    const double half_width = 0.5 * (lc->bound_max[k] - lc->bound_min[k]);
+    radius2 += half_width * half_width;
+  }
+  const double radius = (1. + LIGHTCONE_BOUNDS_PADDING) * sqrt(radius2) +
+                        LIGHTCONE_BOUNDS_PADDING * e->s->width[0];
+
+  /* Make room for all the replications in the scratch space of this
+   * thread. We'll only fill in the ones that pass the test. */
+  double *buffer = lightcone_array_get_crossing_scratch(
+      lightcone_array_properties, 5 * nrep_max);
+  lc->rep_x = buffer;
+  lc->rep_y = buffer + nrep_max;
+  lc->rep_z = buffer + 2 * nrep_max;
+  lc->r2_start = buffer + 3 * nrep_max;
+  lc->r2_end = buffer + 4 * nrep_max;
+
+  for (int lightcone_nr = 0; lightcone_nr < nr_lightcones; lightcone_nr += 1) {
+
+    /* Find the current lightcone and its replication list */
+    const struct lightcone_props *props =
+        lightcone_array_properties->lightcone + lightcone_nr;
+    const struct replication_list *replication_list =
+        lc->replication_list_array + lightcone_nr;
+
+    lc->first[lightcone_nr] = lc->nrep_tot;
+    lc->nrep[lightcone_nr] = 0;
+
+    /* Consistency check - are our limits on the drift endpoints good? */
+    if (lc->ti_old < props->ti_old || lc->ti_current > props->ti_current)
+      error(
+          "Particle drift is outside the range used to make replication list!");
+
+    /* Are there any replications to check at this timestep? */
+    const size_t nreps = (size_t)replication_list->nrep;
+    if (nreps == 0) continue;
+    const struct replication *rep = replication_list->replication;
+
+    /* Does this drift overlap the lightcone redshift range? If not, nothing
+     * to do. */
+    if ((a_start > props->a_max) || (a_end < props->a_min)) continue;
+
+    /* Position of the centre of the sphere relative to the observer */
+    const double *observer_position = props->observer_position;
+    const double centre_rel[3] = {centre[0] - observer_position[0],
+                                  centre[1] - observer_position[1],
+                                  centre[2] - observer_position[2]};
+
+    for (size_t i = 0; i < nreps; i += 1) {
+
+      /* If all particles in this periodic replica are beyond the lightcone
+         surface at the earlier time, then they already crossed the lightcone.
+         Since the replications are in ascending order of rmin we don't need
+         to check any more. */
+      if (rep[i].rmin2 > comoving_dist_2_start) break;
+
+      /* If all particles in this periodic replica start their drifts inside
+         the lightcone surface, and are sufficiently far inside that their
+         velocity can't cause them to cross the lightcone, then we don't need
+         to consider this replication */
+      if (rep[i].rmax2 + boundary < comoving_dist_2_end) continue;
+
+      /* Now do the same with the sphere around the particles of this cell */
+      const double dx = centre_rel[0] + rep[i].coord[0];
+      const double dy = centre_rel[1] + rep[i].coord[1];
+      const double dz = centre_rel[2] + rep[i].coord[2];
+      const double dist = sqrt(dx * dx + dy * dy + dz * dz);
+
+      const double dist_min = max(dist - radius, 0.);
+      if (dist_min * dist_min > comoving_dist_2_start) continue;
+
+      const double dist_max = dist + radius + max_drift;
+      if (dist_max * dist_max < comoving_dist_2_end) continue;
+
+      /* Some particles may cross in this replication */
+      const size_t j = lc->nrep_tot;
+      lc->rep_x[j] = rep[i].coord[0];
+      lc->rep_y[j] = rep[i].coord[1];
+      lc->rep_z[j] = rep[i].coord[2];
+      lc->nrep[lightcone_nr] += 1;
+      lc->nrep_tot += 1;
+    }
+  }
+}
+
+/**
+ * @brief Release the replication arrays of a #lightcone_cell_crossings.
+ *
+ * The arrays live in the scratch space of the thread, which is kept for
+ * the next cell.
+ *
+ * @param lc the #lightcone_cell_crossings
+ */
+void lightcone_cell_crossings_clean(struct lightcone_cell_crossings *lc) {
+
+  lc->rep_x = NULL;
+  lc->rep_y = NULL;
+  lc->rep_z = NULL;
+  lc->r2_start = NULL;
+  lc->r2_end = NULL;
+  lc->nrep_tot = 0;
+}
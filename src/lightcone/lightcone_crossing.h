@@ -24,8 +24,10 @@
 #include "cosmology.h"
 #include "gravity.h"
 #include "lightcone/lightcone.h"
+#include "lightcone/lightcone_array.h"
 #include "lightcone/lightcone_particle_io.h"
 #include "lightcone/lightcone_replications.h"
+#include "minmax.h"
 #include "part.h"
 #include "stars.h"
 #include "timeline.h"
@@ -33,6 +35,154 @@
 #ifndef SWIFT_LIGHTCONE_CROSSING_H
 #define SWIFT_LIGHTCONE_CROSSING_H
 
+/* Avoid cyclic inclusions */
+struct engine;
+
+/**
+ * @brief The periodic replications in which the particles of a leaf #cell
+ * may cross the lightcones during a drift.
+ *
+ * This is set up once per drift of the cell. The shell swept by each
+ * lightcone surface during the drift is compared to the bounding sphere of
+ * the particles of the cell in each replication, and only the replications
+ * where the two overlap are kept. The particles are then only checked
+ * against these, in a loop over the replications that the compiler can
+ * vectorize.
+ */
+struct lightcone_cell_crossings {
+
+  /*! The #engine */
+  const struct engine *e;
+
+  /*! One (cell-level) replication list for each lightcone */
+  const struct replication_list *replication_list_array;
+
+  /*! Beginning of the drift on the integer time line */
+  integertime_t ti_old;
+
+  /*! End of the drift on the integer time line */
+  integertime_t ti_current;
+
+  /*! Coordinates of the #cell (used to wrap the particle positions) */
+  double cell_loc[3];
+
+  /*! Comoving distance to the lightcone surface at the start of the drift */
+  double comoving_dist_start;
+
+  /*! Comoving distance to the lightcone surface at the end of the drift */
+  double comoving_dist_end;
+
+  /*! Bounding box of the (wrapped) positions at the start of the drift */
+  double bound_min[3], bound_max[3];
+
+  /*! Number of particles in the bounding box */
+  size_t count;
+
+  /*! Total number of replications in the lists of all the lightcones */
+  size_t nrep_max;
+
+  /*! Total number of replications left to check (0 if nothing can cross) */
+  size_t nrep_tot;
+
+  /*! Number of replications left to check for each lightcone */
+  size_t nrep[MAX_LIGHTCONES];
+
+  /*! Index of the first replication of each lightcone in the arrays below */
+  size_t first[MAX_LIGHTCONES];
+
+  /*! Coordinates of the replications (one array per axis) */
+  double *rep_x, *rep_y, *rep_z;
+
+  /*! Scratch space for the squared distances to the observer at the start
+   * and end of the drift of a particle (one per replication) */
+  double *r2_start, *r2_end;
+};
+
+void lightcone_cell_crossings_init(
+    struct lightcone_cell_crossings *lc, const struct engine *e,
+    const struct replication_list *replication_list_array,
+    const integertime_t ti_old, const integertime_t ti_current,
+    const double cell_loc[3]);
+
+void lightcone_cell_crossings_prepare(struct lightcone_cell_crossings *lc);
+
+void lightcone_cell_crossings_clean(struct lightcone_cell_crossings *lc);
+
+/**
+ * @brief Does a particle type need to be checked for lightcone crossings?
+ *
+ * @param e the #engine struct
+ * @param gp pointer to the #gpart (may be NULL)
+ */
+__attribute__((always_inline)) INLINE static int lightcone_check_type(
+    const struct engine *e, const struct gpart *gp) {
+
+  return gp != NULL &&
+         e->lightcone_array_properties->check_type_for_crossing[gp->type];
+}
+
+/**
+ * @brief Wrap the position of a particle next to its #cell.
+ *
+ * @param x the position of the particle
+ * @param cell_loc coordinates of the #cell
+ * @param boxsize the size of the simulation box
+ * @param x_wrapped (return) the wrapped position
+ */
+__attribute__((always_inline)) INLINE static void lightcone_wrap_position(
+    const double *x, const double cell_loc[3], const double boxsize,
+    double x_wrapped[3]) {
+
+  x_wrapped[0] =
+      box_wrap(x[0], cell_loc[0] - 0.5 * boxsize, cell_loc[0] + 0.5 * boxsize);
+  x_wrapped[1] =
+      box_wrap(x[1], cell_loc[1] - 0.5 * boxsize, cell_loc[1] + 0.5 * boxsize);
+  x_wrapped[2] =
+      box_wrap(x[2], cell_loc[2] - 0.5 * boxsize, cell_loc[2] + 0.5 * boxsize);
+}
+
+/**
+ * @brief Do we need the bounding box of the particles of a #cell?
+ *
+ * False if no particle of the #cell can cross any lightcone during this
+ * drift, irrespective of its position, i.e. if we're not making lightcones
+ * or if the replication lists of the #cell are all empty.
+ *
+ * @param lc the #lightcone_cell_crossings of the #cell
+ */
+__attribute__((always_inline)) INLINE static int
+lightcone_cell_crossings_active(const struct lightcone_cell_crossings *lc) {
+  return lc->nrep_max > 0;
+}
+
+/**
+ * @brief Add a particle to the bounding box of the particles of a #cell.
+ *
+ * Must be called with the position of the particle BEFORE it is drifted,
+ * for all the particles of the #cell that will be checked for crossings,
+ * before lightcone_cell_crossings_prepare().
+ *
+ * @param lc the #lightcone_cell_crossings of the #cell
+ * @param x the position of the particle
+ * @param gp pointer to the #gpart of the particle (may be NULL)
+ */
+__attribute__((always_inline)) INLINE static void
+lightcone_cell_crossings_add_to_bounds(struct lightcone_cell_crossings *lc,
+                                       const double *x,
+                                       const struct gpart *gp) {
+
+  if (!lightcone_check_type(lc->e, gp)) return;
+
+  double x_wrapped[3];
+  lightcone_wrap_position(x, lc->cell_loc, lc->e->s->dim[0], x_wrapped);
+
+  for (int k = 0; k < 3; k++) {
+    lc->bound_min[k] = min(lc->bound_min[k], x_wrapped[k]);
+    lc->bound_max[k] = max(lc->bound_max[k], x_wrapped[k]);
+  }
+  lc->count++;
+}
+
 /**
  * @brief Check if a particle crosses the lightcone during a drift.
  *
@@ -44,97 +194,81 @@
  * the particle has been drifted to the end of the time step when this
  * function is called.
  *
- * @param e the #engine struct
- * @param replication_list_array one replication list for each lightcone
+ * @param lc the #lightcone_cell_crossings of the #cell containing the
+ * particle (NULL if not making lightcones)
  * @param x the position of the particle BEFORE it is drifted
  * @param v_full the velocity of the particle
  * @param gp pointer to the #gpart to check
  * @param dt_drift the time step size used to update the position
- * @param ti_old begining of the time step on the integer time line
- * @param ti_current end of the time step on the integer time line
- * @param cell_loc coordinates of the #cell containing the #gpart
- *
  */
 __attribute__((always_inline)) INLINE static void
-lightcone_check_particle_crosses(
-    const struct engine *e, struct replication_list *replication_list_array,
-    const double *x, const float *v_full, const struct gpart *gp,
-    const double dt_drift, const integertime_t ti_old,
-    const integertime_t ti_current, const double cell_loc[3]) {
+lightcone_check_particle_crosses(const struct lightcone_cell_crossings *lc,
+                                 const double *x, const float *v_full,
+                                 const struct gpart *gp,
+                                 const double dt_drift) {
+
+  /* Anything to check in this cell? */
+  if (lc == NULL || lc->nrep_tot == 0) return;
 
   /* Does this particle type contribute to any lightcone outputs at this
    * redshift? */
+  const struct engine *e = lc->e;
   if (e->lightcone_array_properties->check_type_for_crossing[gp->type] == 0)
     return;
 
-  /* Check if we have any replications to search */
-  /* TODO: pre-calculate this for each cell to save time */
-  int nrep_tot = 0;
-  const int nr_lightcones = e->lightcone_array_properties->nr_lightcones;
-  for (int lightcone_nr = 0; lightcone_nr < nr_lightcones; lightcone_nr += 1) {
-    nrep_tot += replication_list_array[lightcone_nr].nrep;
-  }
-  if (nrep_tot == 0) return;
-
   /* Unpack some variables we need */
   const struct cosmology *c = e->cosmology;
-
-  /* Determine expansion factor at start and end of the drift */
-  const double a_start = c->a_begin * exp(ti_old * c->time_base);
-  const double a_end = c->a_begin * exp(ti_current * c->time_base);
-
-  /* Find comoving distance to these expansion factors */
-  const double comoving_dist_start =
-      cosmology_get_comoving_distance(c, a_start);
+  const double comoving_dist_start = lc->comoving_dist_start;
   const double comoving_dist_2_start =
       comoving_dist_start * comoving_dist_start;
-  const double comoving_dist_end = cosmology_get_comoving_distance(c, a_end);
+  const double comoving_dist_end = lc->comoving_dist_end;
   const double comoving_dist_2_end = comoving_dist_end * comoving_dist_end;
 
-  /* Thickness of the 'shell' between the lightcone surfaces at start and end of
-     drift.
-     We use this as a limit on how far a particle can drift (i.e. assume v <
-     c).*/
-  const double boundary = comoving_dist_2_start - comoving_dist_2_end;
-
   /* Wrap particle starting coordinates to nearest it's parent cell */
-  const double boxsize = e->s->dim[0];
-  const double x_wrapped[3] = {
-      box_wrap(x[0], cell_loc[0] - 0.5 * boxsize, cell_loc[0] + 0.5 * boxsize),
-      box_wrap(x[1], cell_loc[1] - 0.5 * boxsize, cell_loc[1] + 0.5 * boxsize),
-      box_wrap(x[2], cell_loc[2] - 0.5 * boxsize, cell_loc[2] + 0.5 * boxsize)};
+  double x_wrapped[3];
+  lightcone_wrap_position(x, lc->cell_loc, e->s->dim[0], x_wrapped);
 
   /* Loop over lightcones to make */
+  const int nr_lightcones = e->lightcone_array_properties->nr_lightcones;
   for (int lightcone_nr = 0; lightcone_nr < nr_lightcones; lightcone_nr += 1) {
 
-    /* Find the current lightcone and its replication list */
+    /* Are there any replications to check in this cell at this timestep? */
+    const size_t nreps = lc->nrep[lightcone_nr];
+    if (nreps == 0) continue;
+    const size_t first = lc->first[lightcone_nr];
+
+    /* Find the current lightcone */
     struct lightcone_props *props =
         e->lightcone_array_properties->lightcone + lightcone_nr;
-    struct replication_list *replication_list =
-        replication_list_array + lightcone_nr;
-
-    /* Consistency check - are our limits on the drift endpoints good? */
-    if (ti_old < props->ti_old || ti_current > props->ti_current)
-      error(
-          "Particle drift is outside the range used to make replication list!");
-
-    /* Are there any replications to check at this timestep? */
-    const int nreps = replication_list->nrep;
-    if (nreps == 0) continue;
-    const struct replication *rep = replication_list->replication;
 
     /* Find observer position for this lightcone */
     const double *observer_position = props->observer_position;
 
-    /* Does this drift overlap the lightcone redshift range? If not, nothing to
-     * do. */
-    if ((a_start > props->a_max) || (a_end < props->a_min)) continue;
-
     /* Get wrapped position relative to observer */
     const double x_wrapped_rel[3] = {x_wrapped[0] - observer_position[0],
                                      x_wrapped[1] - observer_position[1],
                                      x_wrapped[2] - observer_position[2]};
 
+    /* Get the distance squared from the observer to all the periodic copies
+     * of the gpart at the start and end of the drift */
+    const double *restrict rep_x = lc->rep_x + first;
+    const double *restrict rep_y = lc->rep_y + first;
+    const double *restrict rep_z = lc->rep_z + first;
+    double *restrict r2_start = lc->r2_start;
+    double *restrict r2_end = lc->r2_end;
+    for (size_t i = 0; i < nreps; i += 1) {
+
+      const double xs = x_wrapped_rel[0] + rep_x[i];
+      const double ys = x_wrapped_rel[1] + rep_y[i];
+      const double zs = x_wrapped_rel[2] + rep_z[i];
+      r2_start[i] = xs * xs + ys * ys + zs * zs;
+
+      const double xe = xs + dt_drift * v_full[0];
+      const double ye = ys + dt_drift * v_full[1];
+      const double ze = zs + dt_drift * v_full[2];
+      r2_end[i] = xe * xe + ye * ye + ze * ze;
+    }
+
     /* Loop over periodic copies of the volume:
 
        Here we're looking for cases where a periodic copy of the particle
@@ -143,51 +277,24 @@ lightcone_check_particle_crosses(
        end of the drift. I.e. the surface of the lightcone has swept over
        the particle as it contracts towards the observer.
     */
-    for (int i = 0; i < nreps; i += 1) {
+    for (size_t i = 0; i < nreps; i += 1) {
 
-      /* If all particles in this periodic replica are beyond the lightcone
-         surface at the earlier time, then they already crossed the lightcone.
-         Since the replications are in ascending order of rmin we don't need to
-         check any more. */
-      if (rep[i].rmin2 > comoving_dist_2_start) break;
+      /* If particle is initially beyond the lightcone surface, it can't cross
+       */
+      if (r2_start[i] > comoving_dist_2_start) continue;
 
-      /* If all particles in this periodic replica start their drifts inside the
-         lightcone surface, and are sufficiently far inside that their velocity
-         can't cause them to cross the lightcone, then we don't need to consider
-         this replication */
-      if (rep[i].rmax2 + boundary < comoving_dist_2_end) continue;
+      /* If particle is still within the lightcone surface at the end of the
+         drift, it didn't cross*/
+      if (r2_end[i] < comoving_dist_2_end) continue;
 
       /* Get the coordinates of this periodic copy of the gpart relative to the
        * observer */
       const double x_start[3] = {
-          x_wrapped_rel[0] + rep[i].coord[0],
-          x_wrapped_rel[1] + rep[i].coord[1],
-          x_wrapped_rel[2] + rep[i].coord[2],
+          x_wrapped_rel[0] + rep_x[i],
+          x_wrapped_rel[1] + rep_y[i],
+          x_wrapped_rel[2] + rep_z[i],
       };
 
-      /* Get distance squared from the observer at start of drift */
-      const double r2_start = x_start[0] * x_start[0] +
-                              x_start[1] * x_start[1] + x_start[2] * x_start[2];
-
-      /* If particle is initially beyond the lightcone surface, it can't cross
-       */
-      if (r2_start > comoving_dist_2_start) continue;
-
-      /* Get position of this periodic copy at the end of the drift */
-      const double x_end[3] = {
-          x_start[0] + dt_drift * v_full[0],
-          x_start[1] + dt_drift * v_full[1],
-          x_start[2] + dt_drift * v_full[2],
-      };
-
-      /* Get distance squared from the observer at end of drift */
-      const double r2_end =
-          x_end[0] * x_end[0] + x_end[1] * x_end[1] + x_end[2] * x_end[2];
-
-      /* If particle is still within the lightcone surface at the end of the
-         drift, it didn't cross*/
-      if (r2_end < comoving_dist_2_end) continue;
-
       /* This periodic copy of the gpart crossed the lightcone during this
          drift. Now need to estimate when it crossed within the timestep.
 
@@ -209,9 +316,9 @@ lightcone_check_particle_crosses(
          f = (r_start - R_start) / (R_end - R_start - r_end + r_start)
 
       */
-      const double f = (sqrt(r2_start) - comoving_dist_start) /
-                       (comoving_dist_end - comoving_dist_start - sqrt(r2_end) +
-                        sqrt(r2_start));
+      const double f = (sqrt(r2_start[i]) - comoving_dist_start) /
+                       (comoving_dist_end - comoving_dist_start -
+                        sqrt(r2_end[i]) + sqrt(r2_start[i]));
 
       /* f should always be in the range 0-1 */
       const double eps = 1.0e-5;
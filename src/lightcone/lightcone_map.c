@@ -33,6 +33,7 @@
 #include "align.h"
 #include "common_io.h"
 #include "error.h"
+#include "io_async.h"
 #include "memuse.h"
 #include "restart.h"
 
@@ -183,6 +184,9 @@ void lightcone_map_write(struct lightcone_map *map, const hid_t loc_id,
   const double length_conversion_factor =
       units_conversion_factor(internal_units, snapshot_units, UNIT_CONV_LENGTH);
 
+  /* Only take the HDF5 lock now that the pixel data is ready */
+  io_hdf5_lock();
+
   /* Create dataspace in memory corresponding to local pixels */
   const hsize_t mem_dims[1] = {(hsize_t)map->local_nr_pix};
   hid_t mem_space_id = H5Screate_simple(1, mem_dims, NULL);
@@ -327,5 +331,6 @@ void lightcone_map_write(struct lightcone_map *map, const hid_t loc_id,
   H5Sclose(mem_space_id);
   H5Sclose(file_space_id);
   H5Pclose(h_plist_id);
+  io_hdf5_unlock();
 }
 #endif /* HAVE_HDF5*/
@@ -34,6 +34,7 @@
 #include "engine.h"
 #include "error.h"
 #include "gravity.h"
+#include "io_async.h"
 #include "lightcone/lightcone.h"
 #include "neutrino.h"
 #include "particle_buffer.h"
@@ -783,20 +784,108 @@ hid_t init_write(struct lightcone_props *props, hid_t file_id, int ptype,
   return group_id;
 }
 
+/*! Information needed to copy one output field from the particle buffer */
+struct lightcone_copy_field_data {
+
+  /*! Output array for the field */
+  char *outbuf;
+
+  /*! Size of the structs in the particle buffer */
+  size_t data_struct_size;
+
+  /*! Offset of the field in the structs */
+  size_t field_offset;
+
+  /*! Bytes per particle in the output array */
+  size_t field_size;
+
+  /*! Number of values per particle */
+  int dimension;
+
+  /*! Type of the values */
+  enum IO_DATA_TYPE type;
+
+  /*! Unit conversion factor to apply */
+  double conversion_factor;
+};
+
+/**
+ * @brief Copy an output field from one block of buffered particles to the
+ * output array and convert its units.
+ *
+ * @param data Pointer to the first buffered particle of the block
+ * @param num_elements Number of particles in the block
+ * @param offset Index of the first particle of the block in the buffer
+ * @param extra_data Pointer to a #lightcone_copy_field_data
+ */
+static void lightcone_copy_field_mapper(void *data, size_t num_elements,
+                                        size_t offset, void *extra_data) {
+
+  const struct lightcone_copy_field_data *copy_data =
+      (const struct lightcone_copy_field_data *)extra_data;
+  const char *block_data = (const char *)data;
+  const size_t data_struct_size = copy_data->data_struct_size;
+  const size_t field_size = copy_data->field_size;
+
+  /* Copy the field for all particles in the block */
+  char *outptr = copy_data->outbuf + offset * field_size;
+  for (size_t i = 0; i < num_elements; i += 1) {
+    const char *src = block_data + i * data_struct_size +
+                      copy_data->field_offset;
+    memcpy(outptr + i * field_size, src, field_size);
+  }
+
+  /* Convert units if necessary */
+  const double conversion_factor = copy_data->conversion_factor;
+  if (conversion_factor != 1.0) {
+    const size_t nr_values = num_elements * copy_data->dimension;
+    switch (copy_data->type) {
+      case INT: {
+        int *values = (int *)outptr;
+        for (size_t i = 0; i < nr_values; i += 1)
+          values[i] *= conversion_factor;
+      } break;
+      case LONGLONG: {
+        long long *values = (long long *)outptr;
+        for (size_t i = 0; i < nr_values; i += 1)
+          values[i] *= conversion_factor;
+      } break;
+      case FLOAT: {
+        float *values = (float *)outptr;
+        for (size_t i = 0; i < nr_values; i += 1)
+          values[i] *= conversion_factor;
+      } break;
+      case DOUBLE: {
+        double *values = (double *)outptr;
+        for (size_t i = 0; i < nr_values; i += 1)
+          values[i] *= conversion_factor;
+      } break;
+      default:
+        error("Unhandled data type");
+    }
+  }
+}
+
 /**
  * @brief Append buffered particles to the output file.
+ *
+ * The blocks of the particle buffer are copied to the output arrays in
+ * parallel using the threadpool.
  */
 void lightcone_write_particles(struct lightcone_props *props,
                                const struct unit_system *internal_units,
                                const struct unit_system *snapshot_units,
-                               int ptype, hid_t file_id) {
+                               int ptype, hid_t file_id,
+                               struct threadpool *tp) {
 
   if (props->particle_fields[ptype].num_fields > 0) {
 
     /* Open group and get number and offset of particles to write */
     size_t num_written, num_to_write;
+    io_hdf5_lock();
     hid_t group_id =
         init_write(props, file_id, ptype, &num_written, &num_to_write);
+    io_hdf5_unlock();
 
     /* Get size of the data struct for this type */
     const size_t data_struct_size = lightcone_io_struct_size(ptype);
@@ -806,7 +895,6 @@ void lightcone_write_particles(struct lightcone_props *props,
     while (f) {
 
       /* Find output field info */
-      hid_t dtype_id = io_hdf5_type(f->type);     /* HDF5 data type */
       size_t type_size = io_sizeof_type(f->type); /* Bytes per value */
       const size_t field_size =
           f->dimension * type_size; /* Bytes per particle */
@@ -820,62 +908,34 @@ void lightcone_write_particles(struct lightcone_props *props,
       /* Allocate output buffer */
       char *outbuf = (char *)malloc(num_to_write * field_size);
       if (!outbuf) error("Unable to allocate lightcone output buffer");
-      char *outptr = outbuf;
-
-      /* Loop over blocks of buffered particles and copy to output array */
-      size_t num_elements;
-      struct particle_buffer_block *block = NULL;
-      char *block_data;
-      do {
-        particle_buffer_iterate(&props->buffer[ptype], &block, &num_elements,
-                                (void **)&block_data);
-        for (size_t i = 0; i < num_elements; i += 1) {
-          char *src = block_data + i * data_struct_size + f->offset;
-          char *dest = outptr;
-          memcpy(dest, src, field_size);
-          outptr += field_size;
-        }
-      } while (block);
-
-      /* Convert units if necessary */
-      if (conversion_factor != 1.0) {
-        const size_t nr_values = num_to_write * f->dimension;
-        switch (f->type) {
-          case INT: {
-            int *values = (int *)outbuf;
-            for (size_t i = 0; i < nr_values; i += 1)
-              values[i] *= conversion_factor;
-          } break;
-          case LONGLONG: {
-            long long *values = (long long *)outbuf;
-            for (size_t i = 0; i < nr_values; i += 1)
-              values[i] *= conversion_factor;
-          } break;
-          case FLOAT: {
-            float *values = (float *)outbuf;
-            for (size_t i = 0; i < nr_values; i += 1)
-              values[i] *= conversion_factor;
-          } break;
-          case DOUBLE: {
-            double *values = (double *)outbuf;
-            for (size_t i = 0; i < nr_values; i += 1)
-              values[i] *= conversion_factor;
-          } break;
-          default:
-            error("Unhandled data type");
-        }
-      }
-
-      /* Write the data */
+
+      /* Copy the field from each block of buffered particles to the
+         output array in parallel */
+      struct lightcone_copy_field_data copy_data;
+      copy_data.outbuf = outbuf;
+      copy_data.data_struct_size = data_struct_size;
+      copy_data.field_offset = f->offset;
+      copy_data.field_size = field_size;
+      copy_data.dimension = f->dimension;
+      copy_data.type = f->type;
+      copy_data.conversion_factor = conversion_factor;
+      particle_buffer_threadpool_map(&props->buffer[ptype], tp,
+                                     lightcone_copy_field_mapper, &copy_data);
+
+      /* Write the data. Only this part needs the HDF5 library, so the
+         copy above can overlap with an asynchronous snapshot write. */
       const hsize_t chunk_size = props->hdf5_chunk_size;
       hsize_t dims[] = {(hsize_t)num_to_write, (hsize_t)f->dimension};
       int rank = 1;
       if (f->dimension > 1) rank = 2;
+      io_hdf5_lock();
+      hid_t dtype_id = io_hdf5_type(f->type); /* HDF5 data type */
       append_dataset(snapshot_units, f->units, f->scale_factor_exponent,
                      group_id, f->name, dtype_id, chunk_size,
                      props->particles_lossy_compression, compression_scheme,
                      props->particles_gzip_level, rank, dims, num_written,
                      outbuf);
+      io_hdf5_unlock();
 
       /* Free the output buffer */
       free(outbuf);
@@ -885,6 +945,8 @@ void lightcone_write_particles(struct lightcone_props *props,
     }
 
     /* If all fields are done, we can close the particle type group */
+    io_hdf5_lock();
     H5Gclose(group_id);
+    io_hdf5_unlock();
   }
 }
@@ -34,6 +34,7 @@
 #include "io_compression.h"
 #include "part_type.h"
 #include "stars.h"
+#include "threadpool.h"
 #include "units.h"
 
 /* Forward declarations */
@@ -233,7 +234,8 @@ int lightcone_store_neutrino(const struct engine *e,
 void lightcone_write_particles(struct lightcone_props *props,
                                const struct unit_system *internal_units,
                                const struct unit_system *snapshot_units,
-                               int ptype, hid_t file_id);
+                               int ptype, hid_t file_id,
+                               struct threadpool *tp);
 
 inline static size_t lightcone_io_struct_size(int ptype) {
   switch (ptype) {
@@ -39,6 +39,10 @@
 /* This object's header. */
 #include "lightcone/lightcone_shell.h"
 
+/*! Maximum size of the hash table in which each thread accumulates its
+ * updates to the lightcone map pixels */
+#define LIGHTCONE_MAX_ACCUMULATED_PIXELS (1 << 16)
+
 /**
  * @brief Read in shell radii for lightcone healpix maps
  *
@@ -596,6 +600,160 @@ static void store_elements_to_send_mapper(void *map_data, int num_elements,
 }
 #endif
 
+#ifdef HAVE_CHEALPIX
+
+/**
+ * @brief Per-thread accumulator for lightcone map updates
+ *
+ * This is an open addressing hash table keyed by local pixel index with
+ * one value for each map the particle type contributes to. All the
+ * contributions to a pixel from the updates processed by one thread are
+ * summed here before they are added to the shared maps, so that
+ * overlapping particles don't need an atomic update each.
+ */
+struct healpix_accumulator {
+
+  /*! Number of slots in the table (a power of two) */
+  size_t size;
+
+  /*! Number of slots in use */
+  size_t count;
+
+  /*! Number of values stored per pixel */
+  int nr_maps;
+
+  /*! Local pixel index in each slot (-1 for empty slots) */
+  pixel_index_t *pixel;
+
+  /*! Accumulated values, nr_maps per slot */
+  double *value;
+};
+
+/**
+ * @brief Allocate an empty #healpix_accumulator
+ *
+ * @param acc the #healpix_accumulator to initialise
+ * @param size initial number of slots (a power of two)
+ * @param nr_maps number of values per pixel
+ */
+static void healpix_accumulator_init(struct healpix_accumulator *acc,
+                                     const size_t size, const int nr_maps) {
+
+  acc->size = size;
+  acc->count = 0;
+  acc->nr_maps = nr_maps;
+  acc->pixel = (pixel_index_t *)malloc(size * sizeof(pixel_index_t));
+  acc->value = (double *)calloc(size * nr_maps, sizeof(double));
+  if (acc->pixel == NULL || acc->value == NULL)
+    error("Failed to allocate lightcone map update accumulator");
+  for (size_t k = 0; k < size; k += 1) acc->pixel[k] = -1;
+}
+
+/**
+ * @brief Free a #healpix_accumulator
+ *
+ * @param acc the #healpix_accumulator to free
+ */
+static void healpix_accumulator_clean(struct healpix_accumulator *acc) {
+  free(acc->pixel);
+  free(acc->value);
+}
+
+/**
+ * @brief Find the values accumulated for a pixel, adding it if necessary
+ *
+ * The table must not be full.
+ *
+ * @param acc the #healpix_accumulator
+ * @param local_pix local index of the pixel
+ * @return pointer to the nr_maps values of the pixel
+ */
+__attribute__((always_inline)) INLINE static double *healpix_accumulator_get(
+    struct healpix_accumulator *acc, const pixel_index_t local_pix) {
+
+  const size_t mask = acc->size - 1;
+  size_t slot = (((size_t)local_pix * 0x9E3779B97F4A7C15ull) >> 20) & mask;
+  while (acc->pixel[slot] != local_pix) {
+    if (acc->pixel[slot] < 0) {
+      acc->pixel[slot] = local_pix;
+      acc->count += 1;
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return acc->value + slot * acc->nr_maps;
+}
+
+/**
+ * @brief Add the contents of a #healpix_accumulator to the maps and empty it
+ *
+ * @param acc the #healpix_accumulator
+ * @param shell the #lightcone_shell we're updating
+ * @param part_type the particle type the updates are for
+ */
+static void healpix_accumulator_flush(
+    struct healpix_accumulator *acc, struct lightcone_shell *shell,
+    const struct lightcone_particle_type *part_type) {
+
+  const int nr_maps = acc->nr_maps;
+  for (size_t slot = 0; slot < acc->size; slot += 1) {
+    const pixel_index_t local_pix = acc->pixel[slot];
+    if (local_pix < 0) continue;
+    double *value = acc->value + slot * nr_maps;
+    for (int j = 0; j < nr_maps; j += 1) {
+      const int map_index = part_type->map_index[j];
+      if (value[j] != 0.) atomic_add_d(&shell->map[map_index].data[local_pix],
+                                       value[j]);
+      value[j] = 0.;
+    }
+    acc->pixel[slot] = -1;
+  }
+  acc->count = 0;
+}
+
+/**
+ * @brief Make sure a #healpix_accumulator has room for more pixels
+ *
+ * The table is doubled in size until it reaches
+ * LIGHTCONE_MAX_ACCUMULATED_PIXELS slots. After that, the accumulated
+ * values are added to the maps whenever the table becomes half full.
+ *
+ * @param acc the #healpix_accumulator
+ * @param nr_pix number of pixels we're about to add (at most half of
+ * LIGHTCONE_MAX_ACCUMULATED_PIXELS)
+ * @param shell the #lightcone_shell we're updating
+ * @param part_type the particle type the updates are for
+ */
+static void healpix_accumulator_reserve(
+    struct healpix_accumulator *acc, const size_t nr_pix,
+    struct lightcone_shell *shell,
+    const struct lightcone_particle_type *part_type) {
+
+  /* Keep the table at most half full */
+  while (2 * (acc->count + nr_pix) > acc->size) {
+
+    /* Empty the table into the maps if it can't grow any more */
+    if (acc->size >= LIGHTCONE_MAX_ACCUMULATED_PIXELS) {
+      healpix_accumulator_flush(acc, shell, part_type);
+      return;
+    }
+
+    /* Rehash into a table twice the size */
+    struct healpix_accumulator new_acc;
+    healpix_accumulator_init(&new_acc, 2 * acc->size, acc->nr_maps);
+    for (size_t slot = 0; slot < acc->size; slot += 1) {
+      if (acc->pixel[slot] < 0) continue;
+      double *value = healpix_accumulator_get(&new_acc, acc->pixel[slot]);
+      for (int j = 0; j < acc->nr_maps; j += 1)
+        value[j] = acc->value[slot * acc->nr_maps + j];
+    }
+    healpix_accumulator_clean(acc);
+    *acc = new_acc;
+  }
+}
+
+#endif /* HAVE_CHEALPIX */
+
 /**
  * @brief Mapper function for updating the healpix map
  *
@@ -607,6 +765,11 @@ static void store_elements_to_send_mapper(void *map_data, int num_elements,
  * smoothing length and the values are the quantities to add to the
  * healpix maps.
  *
+ * The contributions to each pixel are summed in a #healpix_accumulator
+ * private to this call, which is added to the shared maps at the end (or
+ * whenever it fills up). For smoothed particles the kernel is evaluated
+ * once per pixel, one ring of pixels at a time.
+ *
  * @param map_data Pointer to an array of doubles
  * @param num_elements Number of elements in map_data
  * @param extra_data Pointer to healpix_smoothing_mapper_data struct
@@ -623,6 +786,7 @@ void healpix_smoothing_mapper(void *map_data, int num_elements,
   struct lightcone_shell *shell = mapper_data->shell;
   struct lightcone_particle_type *part_type = mapper_data->part_type;
   struct projected_kernel_table *kernel_table = mapper_data->kernel_table;
+  const int nr_maps = part_type->nr_maps;
 
   /* Get maximum radius of any pixel in the map */
   const double max_pixrad = healpix_max_pixrad(shell->nside);
@@ -638,11 +802,20 @@ void healpix_smoothing_mapper(void *map_data, int num_elements,
   pixel_index_t local_pix_offset = shell->map[0].local_pix_offset;
   pixel_index_t local_nr_pix = shell->map[0].local_nr_pix;
 
+  /* Accumulator for the pixel values computed by this thread */
+  struct healpix_accumulator accumulator;
+  healpix_accumulator_init(&accumulator, 1024, nr_maps);
+
+  /* Scratch space for the kernel radii and weights of the smoothed pixels */
+  int pixel_buffer_size = 0;
+  double *pixel_u = NULL;
+  double *pixel_weight = NULL;
+
   /* Loop over updates to apply */
   for (int i = 0; i < num_elements; i += 1) {
 
     /* Find the data for this update */
-    size_t index = i * (3 + part_type->nr_maps);
+    size_t index = i * (3 + nr_maps);
     const double theta = int_to_angle(update_data[index + 0].i);
     const double phi = int_to_angle(update_data[index + 1].i);
     /* Retrieve angular smoothing length for this particle */
@@ -667,12 +840,14 @@ void healpix_smoothing_mapper(void *map_data, int num_elements,
         const pixel_index_t local_pix = global_pix - local_pix_offset;
 
         /* Add this particle to all healpix maps */
-        for (int j = 0; j < part_type->nr_maps; j += 1) {
+        healpix_accumulator_reserve(&accumulator, 1, shell, part_type);
+        double *sum = healpix_accumulator_get(&accumulator, local_pix);
+        for (int j = 0; j < nr_maps; j += 1) {
           const int map_index = part_type->map_index[j];
           const double buffered_value = value[j].f;
           const double fac_inv = shell->map[map_index].buffer_scale_factor_inv;
           const double value_to_add = buffered_value * fac_inv;
-          atomic_add_d(&shell->map[map_index].data[local_pix], value_to_add);
+          sum[j] += value_to_add;
         }
       }
 
@@ -695,70 +870,100 @@ void healpix_smoothing_mapper(void *map_data, int num_elements,
         healpix_query_disc_range(shell->nside, part_vec, search_radius,
                                  &pix_min, &pix_max, &nr_ranges, &range);
 
-        /* Compute total weight of pixels to update */
-        double total_weight = 0;
+        /* Make sure we have room for the weights of all these pixels */
+        int nr_pix = 0;
+        for (int range_nr = 0; range_nr < nr_ranges; range_nr += 1)
+          nr_pix += range[range_nr].last - range[range_nr].first + 1;
+        if (nr_pix > pixel_buffer_size) {
+          free(pixel_u);
+          free(pixel_weight);
+          pixel_buffer_size = max(nr_pix, 2 * pixel_buffer_size);
+          pixel_u = (double *)malloc(pixel_buffer_size * sizeof(double));
+          pixel_weight = (double *)malloc(pixel_buffer_size * sizeof(double));
+          if (pixel_u == NULL || pixel_weight == NULL)
+            error("Failed to allocate healpix smoothing buffers");
+        }
+
+        /* Find the angle between each pixel centre and the particle in
+           units of the smoothing length. The pixels in a range are in the
+           same ring, so they have the same z and are equally spaced in phi */
+        const double inv_smoothing_radius = 1.0 / smoothing_radius;
+        int offset = 0;
         for (int range_nr = 0; range_nr < nr_ranges; range_nr += 1) {
-          for (pixel_index_t pix = range[range_nr].first;
-               pix <= range[range_nr].last; pix += 1) {
 
-            /* Get vector at the centre of this pixel */
-            double pixel_vec[3];
-            pix2vec_ring64(shell->nside, pix, pixel_vec);
+          double z, phi_start, dphi;
+          pixel_index_t ring_start;
+          healpix_ring_geometry(shell->nside, range[range_nr].ring, &z,
+                                &ring_start, &phi_start, &dphi);
+          const double sin_theta = sqrt((1.0 - z) * (1.0 + z));
+          const double phi_first =
+              phi_start + (range[range_nr].first - ring_start) * dphi;
+          const double z_dp = z * part_vec[2];
+          const int n = range[range_nr].last - range[range_nr].first + 1;
+          double *restrict u = pixel_u + offset;
+
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+          for (int k = 0; k < n; k += 1) {
+            const double phi_k = phi_first + k * dphi;
 
-            /* Find angle between this pixel centre and the particle.
-               Dot product may be a tiny bit greater than one due to rounding
+            /* Dot product may be a tiny bit greater than one due to rounding
                error */
             const double dp =
-                (pixel_vec[0] * part_vec[0] + pixel_vec[1] * part_vec[1] +
-                 pixel_vec[2] * part_vec[2]);
+                z_dp + sin_theta * (part_vec[0] * cos(phi_k) +
+                                    part_vec[1] * sin(phi_k));
             const double angle = dp < 1.0 ? acos(dp) : 0.0;
-
-            /* Evaluate the kernel at this radius */
-            total_weight +=
-                projected_kernel_eval(kernel_table, angle / smoothing_radius);
+            u[k] = angle * inv_smoothing_radius;
           }
+          offset += n;
         }
 
+        /* Evaluate the kernel for all the pixels and the total weight */
+        projected_kernel_eval_array(kernel_table, nr_pix, pixel_u,
+                                    pixel_weight);
+        double total_weight = 0;
+        for (int k = 0; k < nr_pix; k += 1) total_weight += pixel_weight[k];
+
+        /* Particles covering more pixels than the accumulator can hold
+           have nothing to be merged with, so they go straight to the maps */
+        const int use_accumulator =
+            2 * nr_pix <= LIGHTCONE_MAX_ACCUMULATED_PIXELS;
+        if (use_accumulator)
+          healpix_accumulator_reserve(&accumulator, nr_pix, shell, part_type);
+
         /* Update the pixels */
+        offset = 0;
         for (int range_nr = 0; range_nr < nr_ranges; range_nr += 1) {
           for (pixel_index_t pix = range[range_nr].first;
-               pix <= range[range_nr].last; pix += 1) {
+               pix <= range[range_nr].last; pix += 1, offset += 1) {
 
             /* Check if this pixel is stored locally */
             pixel_index_t global_pix = pix;
             if ((global_pix >= local_pix_offset) &&
                 (global_pix < local_pix_offset + local_nr_pix)) {
 
-              /* Get vector at the centre of this pixel */
-              double pixel_vec[3];
-              pix2vec_ring64(shell->nside, pix, pixel_vec);
-
-              /* Find angle between this pixel centre and the particle.
-                 Dot product may be a tiny bit greater than one due to rounding
-                 error */
-              const double dp =
-                  (pixel_vec[0] * part_vec[0] + pixel_vec[1] * part_vec[1] +
-                   pixel_vec[2] * part_vec[2]);
-              const double angle = dp < 1.0 ? acos(dp) : 0.0;
-
-              /* Evaluate the kernel at this radius */
-              const double weight =
-                  projected_kernel_eval(kernel_table,
-                                        angle / smoothing_radius) /
-                  total_weight;
+              /* Normalised weight of this pixel */
+              const double weight = pixel_weight[offset] / total_weight;
 
               /* Find local index of the pixel to update */
               const pixel_index_t local_pix = global_pix - local_pix_offset;
 
               /* Update the smoothed healpix maps */
+              double *sum = use_accumulator ? healpix_accumulator_get(
+                                                  &accumulator, local_pix)
+                                            : NULL;
               for (int j = 0; j < part_type->nr_smoothed_maps; j += 1) {
                 const int map_index = part_type->map_index[j];
                 const double buffered_value = value[j].f;
                 const double fac_inv =
                     shell->map[map_index].buffer_scale_factor_inv;
                 const double value_to_add = buffered_value * fac_inv;
-                atomic_add_d(&shell->map[map_index].data[local_pix],
-                             value_to_add * weight);
+                if (use_accumulator)
+                  sum[j] += value_to_add * weight;
+                else
+                  atomic_add_d(&shell->map[map_index].data[local_pix],
+                               value_to_add * weight);
               } /* Next smoothed map */
             }
           } /* Next pixel in this range */
@@ -783,24 +988,122 @@ void healpix_smoothing_mapper(void *map_data, int num_elements,
           const pixel_index_t local_pix = global_pix - local_pix_offset;
 
           /* Update the un-smoothed healpix maps */
-          for (int j = part_type->nr_smoothed_maps; j < part_type->nr_maps;
-               j += 1) {
+          healpix_accumulator_reserve(&accumulator, 1, shell, part_type);
+          double *sum = healpix_accumulator_get(&accumulator, local_pix);
+          for (int j = part_type->nr_smoothed_maps; j < nr_maps; j += 1) {
             const int map_index = part_type->map_index[j];
             const double buffered_value = value[j].f;
             const double fac_inv =
                 shell->map[map_index].buffer_scale_factor_inv;
             const double value_to_add = buffered_value * fac_inv;
-            atomic_add_d(&shell->map[map_index].data[local_pix], value_to_add);
+            sum[j] += value_to_add;
           }
         }
       } /* if part_type->nr_unsmoothed_maps > 0 */
     }
+
   } /* End loop over updates to apply */
+
+  /* Add what we accumulated to the maps */
+  healpix_accumulator_flush(&accumulator, shell, part_type);
+  healpix_accumulator_clean(&accumulator);
+  free(pixel_u);
+  free(pixel_weight);
+
 #else
   error("Need HEALPix C API for lightcone maps");
 #endif
 }
 
+/**
+ * @brief Comparison function for sorting map updates by position on the sky
+ *
+ * Updates are sorted by theta and then phi. Since HEALPix rings have
+ * constant theta this puts updates to nearby pixels next to each other.
+ *
+ * @param a The first update
+ * @param b The second update
+ */
+static int compare_map_updates(const void *a, const void *b) {
+  const union lightcone_map_buffer_entry *update_a =
+      (union lightcone_map_buffer_entry *)a;
+  const union lightcone_map_buffer_entry *update_b =
+      (union lightcone_map_buffer_entry *)b;
+  if (update_a[0].i != update_b[0].i)
+    return update_a[0].i < update_b[0].i ? -1 : 1;
+  if (update_a[1].i != update_b[1].i)
+    return update_a[1].i < update_b[1].i ? -1 : 1;
+  return 0;
+}
+
+/**
+ * @brief Information needed to sort an array of map updates in pieces
+ */
+struct sort_map_updates_data {
+
+  /*! End of the array of updates */
+  char *end;
+
+  /*! Size of one update in bytes */
+  size_t element_size;
+
+  /*! Number of updates in each piece */
+  size_t piece_size;
+};
+
+/**
+ * @brief Mapper function to sort pieces of an array of map updates
+ *
+ * @param map_data Pointer to the first update in the first piece
+ * @param num_elements Number of pieces to sort
+ * @param extra_data Pointer to a sort_map_updates_data struct
+ */
+static void sort_map_updates_mapper(void *map_data, int num_elements,
+                                    void *extra_data) {
+
+  const struct sort_map_updates_data *data =
+      (struct sort_map_updates_data *)extra_data;
+
+  for (int i = 0; i < num_elements; i += 1) {
+    char *start = (char *)map_data + i * data->piece_size * data->element_size;
+    size_t count = (data->end - start) / data->element_size;
+    if (count > data->piece_size) count = data->piece_size;
+    qsort(start, count, data->element_size, compare_map_updates);
+  }
+}
+
+/**
+ * @brief Sort an array of map updates by position on the sky
+ *
+ * The array is split in one piece per thread and each piece is sorted
+ * separately. The updates in the chunks that the threads then take from
+ * each piece cover a small part of the sky, so the per-thread
+ * #healpix_accumulator can merge many of them and the pixel data they touch
+ * is more likely to be in cache.
+ *
+ * @param tp the #threadpool
+ * @param updates the array of updates
+ * @param num_elements the number of updates
+ * @param element_size the size of one update in bytes
+ */
+static void sort_map_updates(struct threadpool *tp, void *updates,
+                             const size_t num_elements,
+                             const size_t element_size) {
+
+  if (num_elements < 2) return;
+
+  const int nr_pieces = tp->num_threads;
+  const size_t piece_size = (num_elements + nr_pieces - 1) / nr_pieces;
+
+  struct sort_map_updates_data data;
+  data.end = (char *)updates + num_elements * element_size;
+  data.element_size = element_size;
+  data.piece_size = piece_size;
+  threadpool_map(tp, sort_map_updates_mapper, updates,
+                 (num_elements + piece_size - 1) / piece_size,
+                 piece_size * element_size, /*chunk=*/1, &data);
+}
+
 /**
  * @brief Apply updates for one particle type to all lightcone maps in a shell
  *
@@ -849,13 +1152,11 @@ void lightcone_shell_flush_map_updates_for_type(
 
 #ifdef WITH_MPI
 
-  /* Count data blocks and ensure number of elements is in range */
+  /* Count data blocks */
   int nr_blocks = 0;
   struct particle_buffer *buffer = &shell->buffer[ptype];
   struct particle_buffer_block *block = buffer->first_block;
   while (block) {
-    if (block->num_elements > buffer->elements_per_block)
-      block->num_elements = buffer->elements_per_block;
     nr_blocks += 1;
     block = block->next;
   }
@@ -982,6 +1283,8 @@ void lightcone_shell_flush_map_updates_for_type(
                      part_type[ptype].buffer_element_size);
 
     /* Apply received updates to the healpix map */
+    sort_map_updates(tp, recvbuf, total_nr_recv,
+                     part_type[ptype].buffer_element_size);
     threadpool_map(tp, healpix_smoothing_mapper, recvbuf, total_nr_recv,
                    part_type[ptype].buffer_element_size,
                    threadpool_auto_chunk_size, &mapper_data);
@@ -1021,6 +1324,8 @@ void lightcone_shell_flush_map_updates_for_type(
   do {
     particle_buffer_iterate(&shell->buffer[ptype], &block, &num_elements,
                             (void **)&update_data);
+    sort_map_updates(tp, update_data, num_elements,
+                     part_type[ptype].buffer_element_size);
     threadpool_map(tp, healpix_smoothing_mapper, update_data, num_elements,
                    part_type[ptype].buffer_element_size,
                    threadpool_auto_chunk_size, &mapper_data);
@@ -62,6 +62,41 @@ __attribute__((always_inline)) INLINE static double projected_kernel_eval(
   return (1.0 - f) * tab->value[i] + f * tab->value[i + 1];
 }
 
+/**
+ * @brief Computes the 2D projected kernel for an array of radii.
+ *
+ * Same as projected_kernel_eval() but without the range check on
+ * negative u, so that the loop can be vectorized.
+ *
+ * @param tab The projected kernel table
+ * @param n The number of values to evaluate
+ * @param u The ratios of the (2D) distances to the smoothing length (>= 0)
+ * @param w Returns the kernel values
+ */
+__attribute__((always_inline)) INLINE static void projected_kernel_eval_array(
+    const struct projected_kernel_table *tab, const int n,
+    const double *restrict u, double *restrict w) {
+
+  const double u_max = tab->u_max;
+  const double du = tab->du;
+  const double inv_du = tab->inv_du;
+  const double *restrict value = tab->value;
+  const int i_max = tab->n - 2;
+
+#if !defined(SWIFT_DEBUG_CHECKS) && _OPENMP >= 201307
+#pragma omp simd
+#endif
+  for (int k = 0; k < n; k++) {
+
+    /* Clamp to the end of the table, where the kernel is zero */
+    const double uk = u[k] < u_max ? u[k] : u_max;
+    const int i_uk = (int)(uk * inv_du);
+    const int i = i_uk < i_max ? i_uk : i_max;
+    const double f = (uk - i * du) * inv_du;
+    w[k] = (1.0 - f) * value[i] + f * value[i + 1];
+  }
+}
+
 void projected_kernel_init(struct projected_kernel_table *tab);
 void projected_kernel_clean(struct projected_kernel_table *tab);
 void projected_kernel_dump(void);
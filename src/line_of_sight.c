@@ -29,67 +29,255 @@
 #include "atomic.h"
 #include "engine.h"
 #include "hydro_io.h"
+#include "io_async.h"
 #include "io_properties.h"
 #include "kernel_hydro.h"
 #include "line_of_sight.h"
 #include "periodic.h"
 #include "version.h"
 
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /**
- * @brief Will the line of sight intersect a given cell?
+ * @brief Index of the sightlines shooting down one simulation axis.
  *
- * Also return 0 if the cell is empty.
- *
- * @param c The top level cell.
- * @param los The line of sight structure.
+ * The plane orthogonal to the sightlines is split into a regular grid of
+ * bins and the sightlines are sorted by bin such that the ones a particle
+ * can contribute to are found without looping over all of them.
  */
-static INLINE int does_los_intersect(const struct cell *c,
-                                     const struct line_of_sight *los) {
+struct los_plane_index {
 
-  /* Empty cell? */
-  if (c->hydro.count == 0) return 0;
+  /*! The two axes defining the plane. */
+  enum los_direction xaxis, yaxis;
 
-#ifdef SWIFT_DEBUG_CHECKS
-  if (c->hydro.h_max <= 0.) error("Invalid h_max for does_los_intersect");
-#endif
+  /*! Number of bins along each side of the plane (0 if no sightline). */
+  int nbins;
+
+  /*! Is the simulation periodic? */
+  int periodic;
+
+  /*! Inverse of the size of the bins along each side of the plane. */
+  double inv_bin_width[2];
+
+  /*! Index in #los_ids of the first sightline of each bin (nbins^2 + 1). */
+  int *bin_offsets;
+
+  /*! Index in the list of sightlines of the sightlines sorted by bin. */
+  int *los_ids;
+};
+
+/**
+ * @brief Data passed to the mappers looking for the particles in the
+ * sightlines.
+ */
+struct los_mapper_data {
+
+  /*! The index of the sightlines shooting down each simulation axis. */
+  const struct los_plane_index *index;
+
+  /*! The list of sightlines. */
+  const struct line_of_sight *LOS_list;
+
+  /*! The local particles. */
+  const struct part *parts;
+
+  /*! The local extended particles. */
+  const struct xpart *xparts;
+
+  /*! Number of particles found in each sightline. */
+  int *counts;
+
+  /*! Offset of each sightline in #part_ids (NULL when only counting). */
+  const size_t *offsets;
+
+  /*! Index of the particles in each sightline. */
+  size_t *part_ids;
 
-  /* Distance from LOS to left and bottom cell edge. */
-  const double cx_min = c->loc[los->xaxis];
-  const double cy_min = c->loc[los->yaxis];
+  /*! The particles in the sightlines (by sightline). */
+  struct part *LOS_parts;
 
-  /* Distance from LOS to right and top cell edge. */
-  const double cx_max = c->loc[los->xaxis] + c->width[los->xaxis];
-  const double cy_max = c->loc[los->yaxis] + c->width[los->yaxis];
+  /*! The extended particles in the sightlines (by sightline). */
+  struct xpart *LOS_xparts;
 
-  /* Maximum smoothing length of a part in this top level cell. */
-  const double hsml = c->hydro.h_max * kernel_gamma;
+  /*! The gravity particles in the sightlines (by sightline). */
+  struct gpart *LOS_gparts;
+};
+
+/**
+ * @brief Does a particle contribute to a given line of sight?
+ *
+ * @param p The #part.
+ * @param los The #line_of_sight.
+ */
+INLINE static int los_part_in_sightline(const struct part *p,
+                                        const struct line_of_sight *los) {
+
+  /* Don't consider part if outwith allowed z-range. */
+  if (p->x[los->zaxis] < los->range_when_shooting_down_axis[0] ||
+      p->x[los->zaxis] > los->range_when_shooting_down_axis[1])
+    return 0;
+
+  /* Smoothing length of this part. */
+  const double hsml = p->h * kernel_gamma;
   const double hsml2 = hsml * hsml;
 
-  double dx, dy;
+  /* Distance from this part to LOS along x dim. */
+  double dx = p->x[los->xaxis] - los->Xpos;
+  if (los->periodic) dx = nearest(dx, los->dim[los->xaxis]);
+  const double dx2 = dx * dx;
+  if (dx2 >= hsml2) return 0;
+
+  /* Distance from this part to LOS along y dim. */
+  double dy = p->x[los->yaxis] - los->Ypos;
+  if (los->periodic) dy = nearest(dy, los->dim[los->yaxis]);
+  const double dy2 = dy * dy;
+  if (dy2 >= hsml2) return 0;
 
-  if (los->periodic) {
-    dx = min(fabs(nearest(cx_min - los->Xpos, los->dim[los->xaxis])),
-             fabs(nearest(cx_max - los->Xpos, los->dim[los->xaxis])));
-    dy = min(fabs(nearest(cy_min - los->Ypos, los->dim[los->yaxis])),
-             fabs(nearest(cy_max - los->Ypos, los->dim[los->yaxis])));
+  /* 2D distance to LOS. */
+  return (dx2 + dy2 <= hsml2);
+}
+
+/**
+ * @brief Bin of a position along one side of a #los_plane_index.
+ *
+ * @param x The position.
+ * @param inv_bin_width The inverse of the size of the bins.
+ * @param nbins The number of bins along this side.
+ */
+INLINE static int los_bin(const double x, const double inv_bin_width,
+                          const int nbins) {
+  const int i = (int)floor(x * inv_bin_width);
+  if (i < 0) return 0;
+  if (i >= nbins) return nbins - 1;
+  return i;
+}
+
+/**
+ * @brief Range of bins along one side of a #los_plane_index a particle can
+ * contribute to.
+ *
+ * In periodic boxes, the range may extend beyond [0, nbins[ and must be
+ * wrapped when used.
+ *
+ * @param x The position of the particle.
+ * @param hsml The kernel radius of the particle.
+ * @param index The #los_plane_index.
+ * @param side Which side of the plane (0 or 1).
+ * @param first (return) The first bin.
+ * @param last (return) The last bin.
+ */
+INLINE static void los_bin_range(const double x, const double hsml,
+                                 const struct los_plane_index *index,
+                                 const int side, int *first, int *last) {
+
+  const int nbins = index->nbins;
+  int i_min = (int)floor((x - hsml) * index->inv_bin_width[side]);
+  int i_max = (int)floor((x + hsml) * index->inv_bin_width[side]);
+
+  if (index->periodic) {
+
+    /* Leave some room for round-off when wrapping around the box */
+    if (i_min < 0 || i_max >= nbins) {
+      i_min--;
+      i_max++;
+    }
+
+    /* Don't visit any bin twice */
+    if (i_max - i_min + 1 >= nbins) {
+      i_min = 0;
+      i_max = nbins - 1;
+    }
   } else {
-    dx = fabs(cx_max - los->Xpos);
-    dy = fabs(cy_max - los->Ypos);
+    i_min = max(i_min, 0);
+    i_max = min(i_max, nbins - 1);
   }
 
-  /* Is sightline directly within this top level cell? */
-  if (dx < (1.01 * c->width[los->xaxis]) / 2. &&
-      dy < (1.01 * c->width[los->yaxis]) / 2.) {
-    return 1;
-    /* Could a part from this top level cell smooth into the sightline? */
-  } else if (dx * dx + dy * dy < hsml2) {
-    return 1;
-    /* Don't need to work with this top level cell. */
-  } else {
-    return 0;
+  *first = i_min;
+  *last = i_max;
+}
+
+/**
+ * @brief Build the index of the sightlines in each of the three projection
+ * planes.
+ *
+ * @param index (return) The index for each simulation axis.
+ * @param LOS_list The list of sightlines.
+ * @param num_los The number of sightlines.
+ * @param periodic Is the simulation periodic?
+ * @param dim The dimension of the volume along the three axis.
+ */
+static void los_index_init(struct los_plane_index index[3],
+                           const struct line_of_sight *LOS_list,
+                           const int num_los, const int periodic,
+                           const double dim[3]) {
+
+  for (int axis = 0; axis < 3; axis++) {
+
+    struct los_plane_index *ind = &index[axis];
+    bzero(ind, sizeof(struct los_plane_index));
+    ind->periodic = periodic;
+
+    /* How many sightlines shoot down this axis? */
+    int num_along_axis = 0;
+    for (int j = 0; j < num_los; j++) {
+      if (LOS_list[j].zaxis != (enum los_direction)axis) continue;
+      ind->xaxis = LOS_list[j].xaxis;
+      ind->yaxis = LOS_list[j].yaxis;
+      num_along_axis++;
+    }
+    if (num_along_axis == 0) continue;
+
+    /* Aim for about one sightline per bin */
+    ind->nbins = (int)ceil(sqrt((double)num_along_axis));
+    ind->nbins = min(ind->nbins, 1024);
+    const int nr_bins = ind->nbins * ind->nbins;
+    ind->inv_bin_width[0] = ind->nbins / dim[ind->xaxis];
+    ind->inv_bin_width[1] = ind->nbins / dim[ind->yaxis];
+
+    ind->bin_offsets = (int *)calloc(nr_bins + 1, sizeof(int));
+    ind->los_ids = (int *)malloc(num_along_axis * sizeof(int));
+    if (ind->bin_offsets == NULL || ind->los_ids == NULL)
+      error("Failed to allocate the LOS index.");
+
+    /* Sort the sightlines by bin */
+    for (int j = 0; j < num_los; j++) {
+      if (LOS_list[j].zaxis != (enum los_direction)axis) continue;
+      const int bin =
+          los_bin(LOS_list[j].Xpos, ind->inv_bin_width[0], ind->nbins) *
+              ind->nbins +
+          los_bin(LOS_list[j].Ypos, ind->inv_bin_width[1], ind->nbins);
+      ind->bin_offsets[bin + 1]++;
+    }
+    for (int k = 0; k < nr_bins; k++)
+      ind->bin_offsets[k + 1] += ind->bin_offsets[k];
+
+    int *fill = (int *)calloc(nr_bins, sizeof(int));
+    if (fill == NULL) error("Failed to allocate the LOS index.");
+    for (int j = 0; j < num_los; j++) {
+      if (LOS_list[j].zaxis != (enum los_direction)axis) continue;
+      const int bin =
+          los_bin(LOS_list[j].Xpos, ind->inv_bin_width[0], ind->nbins) *
+              ind->nbins +
+          los_bin(LOS_list[j].Ypos, ind->inv_bin_width[1], ind->nbins);
+      ind->los_ids[ind->bin_offsets[bin] + fill[bin]++] = j;
+    }
+    free(fill);
+  }
+}
+
+/**
+ * @brief Free the memory allocated by los_index_init().
+ *
+ * @param index The index for each simulation axis.
+ */
+static void los_index_clean(struct los_plane_index index[3]) {
+  for (int axis = 0; axis < 3; axis++) {
+    free(index[axis].bin_offsets);
+    free(index[axis].los_ids);
   }
 }
 
@@ -205,7 +393,6 @@ void create_sightline(const double Xpos, const double Ypos,
   los->dim[0] = dim[0];
   los->dim[1] = dim[1];
   los->dim[2] = dim[2];
-  los->num_intersecting_top_level_cells = 0;
   los->range_when_shooting_down_axis[0] = range_when_shooting_down_axis[0];
   los->range_when_shooting_down_axis[1] = range_when_shooting_down_axis[1];
 }
@@ -291,11 +478,8 @@ void generate_sightlines(struct line_of_sight *Los,
  */
 void print_los_info(const struct line_of_sight *Los, const int i) {
 
-  message(
-      "[LOS %i] Xpos:%g Ypos:%g parts_in_los:%i "
-      "num_intersecting_top_level_cells:%i",
-      i, Los[i].Xpos, Los[i].Ypos, Los[i].particles_in_los_total,
-      Los[i].num_intersecting_top_level_cells);
+  message("[LOS %i] Xpos:%g Ypos:%g parts_in_los:%i", i, Los[i].Xpos,
+          Los[i].Ypos, Los[i].particles_in_los_total);
 }
 
 /**
@@ -304,11 +488,19 @@ void print_los_info(const struct line_of_sight *Los, const int i) {
  * @param props dataset for this attribute.
  * @param N number of parts in this line of sight.
  * @param j Line of sight ID.
- * @param e The engine.
- * @param grp HDF5 group to write to.
+ * @param gzip_level The level of lossless compression of the snapshots.
+ * @param a The current scale-factor.
+ * @param snapshot_units The #unit_system used in the snapshots.
+ * @param grp HDF5 file or group to write to.
+ * @param temp The attribute of the parts, already converted to snapshot units.
+ * @param chunks The compressed chunks of the attribute (NULL to let HDF5
+ * compress the data).
  */
 void write_los_hdf5_dataset(const struct io_props props, const size_t N,
-                            const int j, const struct engine *e, hid_t grp) {
+                            const int j, const int gzip_level, const double a,
+                            const struct unit_system *snapshot_units,
+                            hid_t grp, const void *temp,
+                            const struct io_chunk *chunks) {
 
   /* Create data space */
   const hid_t h_space = H5Screate(H5S_SIMPLE);
@@ -316,7 +508,7 @@ void write_los_hdf5_dataset(const struct io_props props, const size_t N,
     error("Error while creating data space for field '%s'.", props.name);
 
   /* Decide what chunk size to use based on compression */
-  int log2_chunk_size = e->snapshot_compression > 0 ? 12 : 18;
+  int log2_chunk_size = gzip_level > 0 ? 12 : 18;
 
   int rank = 0;
   hsize_t shape[2];
@@ -353,35 +545,25 @@ void write_los_hdf5_dataset(const struct io_props props, const size_t N,
           (unsigned long long)chunk_shape[0],
           (unsigned long long)chunk_shape[1], props.name);
 
-  /* Impose check-sum to verify data corruption */
-  h_err = H5Pset_fletcher32(h_prop);
-  if (h_err < 0)
-    error("Error while setting checksum options for field '%s'.", props.name);
-
   /* Impose data compression */
   char comp_buffer[32] = "None";
-  if (e->snapshot_compression > 0) {
+  if (gzip_level > 0) {
     h_err = H5Pset_shuffle(h_prop);
     if (h_err < 0)
       error("Error while setting shuffling options for field '%s'.",
             props.name);
 
-    h_err = H5Pset_deflate(h_prop, e->snapshot_compression);
+    h_err = H5Pset_deflate(h_prop, gzip_level);
     if (h_err < 0)
       error("Error while setting compression options for field '%s'.",
             props.name);
   }
 
-  /* Allocate temporary buffer */
-  const size_t num_elements = N * props.dimension;
-  const size_t typeSize = io_sizeof_type(props.type);
-  void *temp = NULL;
-  if (swift_memalign("writebuff", (void **)&temp, IO_BUFFER_ALIGNMENT,
-                     num_elements * typeSize) != 0)
-    error("Unable to allocate temporary i/o buffer");
-
-  /* Copy particle data to temp buffer */
-  io_copy_temp_buffer(temp, e, props, N, e->internal_units, e->snapshot_units);
+  /* Impose check-sum to verify data corruption (after the compression, as
+   * in the snapshots and io_compress_slices()) */
+  h_err = H5Pset_fletcher32(h_prop);
+  if (h_err < 0)
+    error("Error while setting checksum options for field '%s'.", props.name);
 
   /* Create dataset */
   char att_name[200];
@@ -391,13 +573,19 @@ void write_los_hdf5_dataset(const struct io_props props, const size_t N,
   if (h_data < 0) error("Error while creating dataspace '%s'.", props.name);
 
   /* Write dataset */
-  herr_t status = H5Dwrite(h_data, io_hdf5_type(props.type), H5S_ALL, H5S_ALL,
-                           H5P_DEFAULT, temp);
-  if (status < 0) error("Error while writing data array '%s'.", props.name);
+  if (chunks != NULL) {
+#if defined(IO_THREADED_COMPRESSION)
+    io_write_compressed_chunks(h_data, chunks, N, chunk_shape[0]);
+#endif
+  } else {
+    herr_t status = H5Dwrite(h_data, io_hdf5_type(props.type), H5S_ALL,
+                             H5S_ALL, H5P_DEFAULT, temp);
+    if (status < 0) error("Error while writing data array '%s'.", props.name);
+  }
 
   /* Write unit conversion factors for this data set */
   char buffer[FIELD_BUFFER_SIZE] = {0};
-  units_cgs_conversion_string(buffer, e->snapshot_units, props.units,
+  units_cgs_conversion_string(buffer, snapshot_units, props.units,
                               props.scale_factor_exponent);
   float baseUnitsExp[5];
   units_get_base_unit_exponents_array(baseUnitsExp, props.units);
@@ -413,7 +601,7 @@ void write_los_hdf5_dataset(const struct io_props props, const size_t N,
 
   /* Write the actual number this conversion factor corresponds to */
   const double factor =
-      units_cgs_conversion_factor(e->snapshot_units, props.units);
+      units_cgs_conversion_factor(snapshot_units, props.units);
   io_write_attribute_d(
       h_data,
       "Conversion factor to CGS (not including cosmological corrections)",
@@ -421,7 +609,7 @@ void write_los_hdf5_dataset(const struct io_props props, const size_t N,
   io_write_attribute_d(
       h_data,
       "Conversion factor to physical CGS (including cosmological corrections)",
-      factor * pow(e->cosmology->a, props.scale_factor_exponent));
+      factor * pow(a, props.scale_factor_exponent));
 
 #ifdef SWIFT_DEBUG_CHECKS
   if (strlen(props.description) == 0)
@@ -432,23 +620,176 @@ void write_los_hdf5_dataset(const struct io_props props, const size_t N,
   io_write_attribute_s(h_data, "Description", props.description);
 
   /* Free and close everything */
-  swift_free("writebuff", temp);
   H5Pclose(h_prop);
   H5Dclose(h_data);
   H5Sclose(h_space);
 }
 
 /**
- * @brief Write parts in LOS to HDF5 file.
+ * @brief A field of all the LOS waiting to be written by the asynchronous
+ * i/o thread.
+ */
+struct write_los_field_job {
+
+  /*! The file to write to */
+  hid_t h_file;
+
+  /*! The field and its converted data for all the LOS */
+  struct io_props props;
+  char *temp;
+
+  /*! The number of LOS and where each of them starts in temp */
+  int num_los;
+  size_t *offsets;
+
+  /*! The compressed chunks and the first chunk of each LOS (NULL to let
+   * HDF5 compress the data) */
+  struct io_chunk *chunks;
+  size_t *first_chunk;
+
+  /*! Compression level, scale-factor and units of the outputs */
+  int gzip_level;
+  double a;
+  const struct unit_system *snapshot_units;
+};
+
+/**
+ * @brief Write a field of all the LOS from the asynchronous i/o thread.
  *
- * @param grp HDF5 group of this LOS.
- * @param j LOS ID.
- * @param N number of parts in this line of sight.
- * @param parts the list of parts in this LOS.
+ * @param data The #write_los_field_job.
+ */
+static void write_los_field_async(void *data) {
+
+  struct write_los_field_job *job = (struct write_los_field_job *)data;
+  const size_t row_size =
+      job->props.dimension * io_sizeof_type(job->props.type);
+
+  for (int j = 0; j < job->num_los; j++) {
+    const size_t N = job->offsets[j + 1] - job->offsets[j];
+    if (N == 0) continue;
+    const struct io_chunk *los_chunks = NULL;
+    const char *los_temp = NULL;
+#if defined(IO_THREADED_COMPRESSION)
+    if (job->chunks != NULL) los_chunks = &job->chunks[job->first_chunk[j]];
+#endif
+    if (job->temp != NULL) los_temp = job->temp + job->offsets[j] * row_size;
+    write_los_hdf5_dataset(job->props, N, j, job->gzip_level, job->a,
+                           job->snapshot_units, job->h_file, los_temp,
+                           los_chunks);
+  }
+
+#if defined(IO_THREADED_COMPRESSION)
+  if (job->chunks != NULL) {
+    for (size_t k = 0; k < job->first_chunk[job->num_los]; k++)
+      free(job->chunks[k].data);
+    free(job->chunks);
+  }
+#endif
+  if (job->temp != NULL) swift_free("writebuff", job->temp);
+  free(job->first_chunk);
+  free(job->offsets);
+  free(job);
+}
+
+/**
+ * @brief Close a LOS file from the asynchronous i/o thread once all its
+ * fields have been written.
+ *
+ * @param data The HDF5 file reference.
+ */
+static void close_los_file_async(void *data) {
+
+  hid_t *h_file = (hid_t *)data;
+  H5Fclose(*h_file);
+  free(h_file);
+}
+
+/**
+ * @brief Convert and compress a field of all the LOS and hand it over to the
+ * asynchronous i/o thread.
+ *
+ * No HDF5 call is made here, such that the i/o thread can write the previous
+ * fields in the meantime.
+ *
+ * @param h_file HDF5 file reference.
+ * @param props The field to write.
+ * @param num_los The number of LOS.
+ * @param offsets Where each LOS starts in the list of parts.
+ * @param N_total The total number of parts in all the LOS.
  * @param e The engine.
- * @param xparts the list of xparts in this LOS.
  */
-void write_los_hdf5_datasets(hid_t grp, const int j, const size_t N,
+static void write_los_field_staged(hid_t h_file, const struct io_props props,
+                                   const int num_los, const size_t *offsets,
+                                   const size_t N_total,
+                                   const struct engine *e) {
+
+  const size_t row_size = props.dimension * io_sizeof_type(props.type);
+
+  struct write_los_field_job *job =
+      (struct write_los_field_job *)malloc(sizeof(struct write_los_field_job));
+  if (job == NULL) error("Unable to allocate asynchronous i/o job");
+  job->offsets = (size_t *)malloc((num_los + 1) * sizeof(size_t));
+  job->first_chunk = (size_t *)malloc((num_los + 1) * sizeof(size_t));
+  if (job->offsets == NULL || job->first_chunk == NULL)
+    error("Failed to allocate LOS offsets.");
+  memcpy(job->offsets, offsets, (num_los + 1) * sizeof(size_t));
+
+  job->temp = (char *)io_async_alloc(e->snapshot_async, "writebuff",
+                                     N_total * row_size);
+  io_copy_temp_buffer(job->temp, e, props, N_total, e->internal_units,
+                      e->snapshot_units);
+
+  /* Compress all the LOS in one go while we still have the threadpool */
+  size_t staged_size = N_total * row_size;
+  job->chunks = NULL;
+#if defined(IO_THREADED_COMPRESSION)
+  if (e->snapshot_threaded_compression && e->snapshot_compression > 0) {
+    job->chunks = io_compress_slices(
+        job->temp, num_los, offsets, props.dimension, props.type,
+        /*max_chunk_length=*/1 << 12, e->snapshot_compression,
+        (struct threadpool *)&e->threadpool, job->first_chunk);
+
+    /* Only the compressed chunks are held from now on */
+    swift_free("writebuff", job->temp);
+    job->temp = NULL;
+    const size_t num_chunks = job->first_chunk[num_los];
+    size_t compressed_size = num_chunks * sizeof(struct io_chunk);
+    for (size_t k = 0; k < num_chunks; k++)
+      compressed_size += job->chunks[k].size;
+    io_async_restage(e->snapshot_async, staged_size, compressed_size);
+    staged_size = compressed_size;
+  }
+#endif
+
+  job->h_file = h_file;
+  job->props = props;
+  job->num_los = num_los;
+  job->gzip_level = e->snapshot_compression;
+  job->a = e->cosmology->a;
+  job->snapshot_units = e->snapshot_units;
+
+  io_async_submit(e->snapshot_async, write_los_field_async, job, staged_size);
+}
+
+/**
+ * @brief Write the parts in all the LOS to HDF5 file.
+ *
+ * Each field is converted for all the LOS at once and, if threaded
+ * compression is enabled, the chunks of all the LOS are compressed at once
+ * before being written one dataset at a time. With asynchronous snapshots,
+ * the fields are only converted and compressed here and the HDF5 calls are
+ * left to the i/o thread. The caller must then not hold the HDF5 lock.
+ *
+ * @param h_file HDF5 file reference.
+ * @param LOS_list The list of LOS.
+ * @param num_los The number of LOS.
+ * @param N_total The total number of parts in all the LOS.
+ * @param parts the list of parts in all the LOS (LOS by LOS).
+ * @param e The engine.
+ * @param xparts the list of xparts in all the LOS (LOS by LOS).
+ */
+void write_los_hdf5_datasets(hid_t h_file, const struct line_of_sight *LOS_list,
+                             const int num_los, const size_t N_total,
                              const struct part *parts, const struct engine *e,
                              const struct xpart *xparts) {
 
@@ -466,6 +807,23 @@ void write_los_hdf5_datasets(hid_t grp, const int j, const size_t N,
 #endif
   const int with_rt = e->policy & engine_policy_rt;
 
+  if (N_total == 0) return;
+
+  /* Where does each LOS start? */
+  size_t *offsets = (size_t *)malloc((num_los + 1) * sizeof(size_t));
+  if (offsets == NULL) error("Failed to allocate LOS offsets.");
+  offsets[0] = 0;
+  for (int j = 0; j < num_los; j++)
+    offsets[j + 1] = offsets[j] + LOS_list[j].particles_in_los_total;
+
+#if defined(IO_THREADED_COMPRESSION)
+  /* Do we compress the data ourselves? */
+  const int threaded_compression =
+      e->snapshot_threaded_compression && e->snapshot_compression > 0;
+  size_t *first_chunk = (size_t *)malloc((num_los + 1) * sizeof(size_t));
+  if (first_chunk == NULL) error("Failed to allocate LOS chunk offsets.");
+#endif
+
   int num_fields = 0;
   struct io_props list[100];
 
@@ -481,10 +839,61 @@ void write_los_hdf5_datasets(hid_t grp, const int j, const size_t N,
     char field[PARSER_MAX_LINE_SIZE];
     sprintf(field, "SelectOutputLOS:%.*s", FIELD_BUFFER_SIZE, list[i].name);
     int should_write = parser_get_opt_param_int(params, field, 1);
+    if (!should_write) continue;
+
+    const size_t row_size = list[i].dimension * io_sizeof_type(list[i].type);
+
+    if (e->snapshot_async != NULL) {
+      write_los_field_staged(h_file, list[i], num_los, offsets, N_total, e);
+      continue;
+    }
+
+    /* Allocate temporary buffer */
+    char *temp = NULL;
+    if (swift_memalign("writebuff", (void **)&temp, IO_BUFFER_ALIGNMENT,
+                       N_total * row_size) != 0)
+      error("Unable to allocate temporary i/o buffer");
+
+    /* Copy particle data of all the LOS to temp buffer */
+    io_copy_temp_buffer(temp, e, list[i], N_total, e->internal_units,
+                        e->snapshot_units);
+
+    /* Compress all the LOS in one go */
+    struct io_chunk *chunks = NULL;
+#if defined(IO_THREADED_COMPRESSION)
+    if (threaded_compression)
+      chunks = io_compress_slices(
+          temp, num_los, offsets, list[i].dimension, list[i].type,
+          /*max_chunk_length=*/1 << 12, e->snapshot_compression,
+          (struct threadpool *)&e->threadpool, first_chunk);
+#endif
 
     /* Write (if selected) */
-    if (should_write) write_los_hdf5_dataset(list[i], N, j, e, grp);
+    for (int j = 0; j < num_los; j++) {
+      const size_t N = LOS_list[j].particles_in_los_total;
+      if (N == 0) continue;
+      const struct io_chunk *los_chunks = NULL;
+#if defined(IO_THREADED_COMPRESSION)
+      if (chunks != NULL) los_chunks = &chunks[first_chunk[j]];
+#endif
+      write_los_hdf5_dataset(list[i], N, j, e->snapshot_compression,
+                             e->cosmology->a, e->snapshot_units, h_file,
+                             temp + offsets[j] * row_size, los_chunks);
+    }
+
+#if defined(IO_THREADED_COMPRESSION)
+    if (chunks != NULL) {
+      for (size_t k = 0; k < first_chunk[num_los]; k++) free(chunks[k].data);
+      free(chunks);
+    }
+#endif
+    swift_free("writebuff", temp);
   }
+
+#if defined(IO_THREADED_COMPRESSION)
+  free(first_chunk);
+#endif
+  free(offsets);
 }
 
 /**
@@ -612,6 +1021,8 @@ void write_hdf5_header(hid_t h_file, const struct engine *e,
 /**
  * @brief Loop over each part to see which ones intersect the LOS.
  *
+ * Only used to check the index of the sightlines by brute force.
+ *
  * @param map_data The parts.
  * @param count The number of parts.
  * @param extra_data The line_of_sight structure for this LOS.
@@ -629,113 +1040,137 @@ void los_first_loop_mapper(void *restrict map_data, int count,
 
     /* Don't consider inhibited parts. */
     if (parts[i].time_bin == time_bin_inhibited) continue;
+    if (parts[i].time_bin == time_bin_not_created) continue;
 
-    /* Don't consider part if outwith allowed z-range. */
-    if (parts[i].x[LOS_list->zaxis] <
-            LOS_list->range_when_shooting_down_axis[0] ||
-        parts[i].x[LOS_list->zaxis] >
-            LOS_list->range_when_shooting_down_axis[1])
-      continue;
+    if (los_part_in_sightline(&parts[i], LOS_list)) los_particle_count++;
 
-    /* Distance from this part to LOS along x dim. */
-    double dx = parts[i].x[LOS_list->xaxis] - LOS_list->Xpos;
+  } /* End of loop over all parts */
 
-    /* Periodic wrap. */
-    if (LOS_list->periodic) dx = nearest(dx, LOS_list->dim[LOS_list->xaxis]);
+  atomic_add(&LOS_list->particles_in_los_local, los_particle_count);
+}
 
-    /* Square. */
-    const double dx2 = dx * dx;
+/**
+ * @brief Find all the sightlines each part contributes to.
+ *
+ * When the offsets of the sightlines are not known yet, we only count the
+ * parts in each sightline. Otherwise, we also record their index.
+ *
+ * @param map_data The parts.
+ * @param count The number of parts.
+ * @param extra_data The #los_mapper_data.
+ */
+void los_assign_mapper(void *restrict map_data, int count,
+                       void *restrict extra_data) {
 
-    /* Smoothing length of this part. */
-    const double hsml = parts[i].h * kernel_gamma;
-    const double hsml2 = hsml * hsml;
+  struct los_mapper_data *data = (struct los_mapper_data *)extra_data;
+  const struct part *parts = (struct part *)map_data;
 
-    /* Does this particle fall into our LOS? */
-    if (dx2 < hsml2) {
+  for (int i = 0; i < count; i++) {
 
-      /* Distance from this part to LOS along y dim. */
-      double dy = parts[i].x[LOS_list->yaxis] - LOS_list->Ypos;
+    const struct part *p = &parts[i];
 
-      /* Periodic wrap. */
-      if (LOS_list->periodic) dy = nearest(dy, LOS_list->dim[LOS_list->yaxis]);
+    /* Don't consider inhibited parts. */
+    if (p->time_bin == time_bin_inhibited) continue;
+    if (p->time_bin == time_bin_not_created) continue;
 
-      /* Square. */
-      const double dy2 = dy * dy;
+    const double hsml = p->h * kernel_gamma;
 
-      /* Does this part still fall into our LOS? */
-      if (dy2 < hsml2) {
+    /* Look for sightlines in the three projection planes */
+    for (int axis = 0; axis < 3; axis++) {
 
-        /* 2D distance to LOS. */
-        if (dx2 + dy2 <= hsml2) {
+      const struct los_plane_index *index = &data->index[axis];
+      const int nbins = index->nbins;
+      if (nbins == 0) continue;
 
-          /* We've found one. */
-          los_particle_count++;
+      /* Bins the kernel of this part overlaps with */
+      int ix_first, ix_last, iy_first, iy_last;
+      los_bin_range(p->x[index->xaxis], hsml, index, 0, &ix_first, &ix_last);
+      los_bin_range(p->x[index->yaxis], hsml, index, 1, &iy_first, &iy_last);
+
+      for (int ix = ix_first; ix <= ix_last; ix++) {
+        const int bx = ((ix % nbins) + nbins) % nbins;
+
+        for (int iy = iy_first; iy <= iy_last; iy++) {
+          const int by = ((iy % nbins) + nbins) % nbins;
+          const int bin = bx * nbins + by;
+
+          for (int k = index->bin_offsets[bin]; k < index->bin_offsets[bin + 1];
+               k++) {
+
+            const int j = index->los_ids[k];
+            if (!los_part_in_sightline(p, &data->LOS_list[j])) continue;
+
+            /* We've found one. */
+            const int n = atomic_inc(&data->counts[j]);
+            if (data->part_ids != NULL)
+              data->part_ids[data->offsets[j] + n] = p - data->parts;
+          }
         }
       }
     }
   } /* End of loop over all parts */
+}
 
-  atomic_add(&LOS_list->particles_in_los_local, los_particle_count);
+/**
+ * @brief Compare two part indices (for qsort).
+ */
+static int los_compare_ids(const void *a, const void *b) {
+  const size_t ia = *(const size_t *)a;
+  const size_t ib = *(const size_t *)b;
+  return (ia > ib) - (ia < ib);
 }
 
 /**
- * @brief Find all top level cells that a LOS will intersect.
+ * @brief Copy the parts found in each sightline to the sightline arrays.
  *
- * This includes the top level cells the LOS directly passes through
- * and the neighbouring top level cells whose parts could smooth into the LOS.
- *
- * @param e The engine.
- * @param los The line_of_sight structure.
- * @param los_cells_top (return) Array indicating whether this cell is
- * intersected.
- * @param cells The array of top-level cells.
- * @param local_cells_with_particles The list of local non-empty top-level
- * cells.
- * @param nr_local_cells_with_particles The number of local non-empty top-level
- * cells.
+ * @param map_data The sightlines.
+ * @param count The number of sightlines.
+ * @param extra_data The #los_mapper_data.
  */
-void find_intersecting_top_level_cells(
-    const struct engine *e, struct line_of_sight *los,
-    int *restrict los_cells_top, const struct cell *cells,
-    const int *restrict local_cells_with_particles,
-    const int nr_local_cells_with_particles) {
+void los_copy_mapper(void *restrict map_data, int count,
+                     void *restrict extra_data) {
 
-  /* Keep track of how many top level cells we intersect. */
-  int num_intersecting_top_level_cells = 0;
+  struct los_mapper_data *data = (struct los_mapper_data *)extra_data;
+  const struct line_of_sight *LOS = (struct line_of_sight *)map_data;
 
-  /* Loop over each top level cell */
-  for (int n = 0; n < nr_local_cells_with_particles; n++) {
+  for (int i = 0; i < count; i++) {
 
-    /* This top level cell. */
-    const struct cell *c = &cells[local_cells_with_particles[n]];
+    const size_t j = &LOS[i] - data->LOS_list;
+    const size_t offset = data->offsets[j];
+    const size_t N = LOS[i].particles_in_los_local;
+    size_t *ids = &data->part_ids[offset];
 
-    if (does_los_intersect(c, los)) {
-      num_intersecting_top_level_cells++;
-      los_cells_top[n] = 1;
-    }
-  }
+    /* Keep the parts in the order they are found in memory */
+    qsort(ids, N, sizeof(size_t), los_compare_ids);
 
-#ifdef WITH_MPI
-  if (MPI_Allreduce(MPI_IN_PLACE, &num_intersecting_top_level_cells, 1, MPI_INT,
-                    MPI_SUM, MPI_COMM_WORLD) != MPI_SUCCESS)
-    error("Failed to allreduce num_intersecting_top_level_cells.");
-#endif
+    for (size_t k = 0; k < N; k++) {
+
+      const struct part *p = &data->parts[ids[k]];
 
-  /* Store how many top level cells this LOS intersects. */
-  los->num_intersecting_top_level_cells = num_intersecting_top_level_cells;
+      /* Store part and xpart properties. */
+      memcpy(&data->LOS_parts[offset + k], p, sizeof(struct part));
+      memcpy(&data->LOS_xparts[offset + k], &data->xparts[ids[k]],
+             sizeof(struct xpart));
+      if (p->gpart != NULL)
+        memcpy(&data->LOS_gparts[offset + k], p->gpart, sizeof(struct gpart));
+      else
+        bzero(&data->LOS_gparts[offset + k], sizeof(struct gpart));
+    }
+  }
 }
 
 /**
  * @brief Main work function for computing line of sights.
  *
  * 1) Construct N random line of sight positions.
- * 2) Loop over each line of sight.
- *  - 2.1) Find which top level cells sightline intersects.
- *  - 2.2) Loop over each part in these top level cells to see which intersect
- * sightline.
- *  - 2.3) Use this count to construct a LOS parts/xparts array.
- *  - 2.4) Loop over each part and extract those in sightline to new array.
- *  - 2.5) Save sightline parts to HDF5 file.
+ * 2) Sort them in a grid of bins in each of the three projection planes.
+ * 3) Loop over all the local parts in parallel and use the bins to find the
+ * sightlines each of them contributes to. This is done twice, first to count
+ * the parts in each sightline and then to record them.
+ * 4) Copy the parts of all the sightlines to one array (sightline by
+ * sightline).
+ * 5) Collect all the sightlines on rank 0 in one go.
+ * 6) Save each sightline to the HDF5 file.
  *
  * @param e The engine.
  */
@@ -748,293 +1183,267 @@ void do_line_of_sight(struct engine *e) {
   const int periodic = s->periodic;
   const double dim[3] = {s->dim[0], s->dim[1], s->dim[2]};
   const struct los_props *LOS_params = e->los_properties;
+  const int num_los = LOS_params->num_tot;
   const int verbose = e->verbose;
 
   /* Start by generating the random sightline positions. */
-  struct line_of_sight *LOS_list = (struct line_of_sight *)malloc(
-      LOS_params->num_tot * sizeof(struct line_of_sight));
+  struct line_of_sight *LOS_list =
+      (struct line_of_sight *)malloc(num_los * sizeof(struct line_of_sight));
 
   if (e->nodeID == 0) {
     generate_sightlines(LOS_list, LOS_params, periodic, dim);
-    if (verbose)
-      message("Generated %i random sightlines.", LOS_params->num_tot);
+    if (verbose) message("Generated %i random sightlines.", num_los);
   }
 
 #ifdef WITH_MPI
   /* Share the list of LoS with all the MPI ranks */
-  MPI_Bcast(LOS_list, LOS_params->num_tot * sizeof(struct line_of_sight),
-            MPI_BYTE, 0, MPI_COMM_WORLD);
+  MPI_Bcast(LOS_list, num_los * sizeof(struct line_of_sight), MPI_BYTE, 0,
+            MPI_COMM_WORLD);
 #endif
 
-  /* Node 0 creates the HDF5 file. */
-  hid_t h_file = -1, h_grp = -1;
-  char fileName[256], groupName[200];
-
-  if (e->nodeID == 0) {
-    sprintf(fileName, "%s_%04i.hdf5", LOS_params->basename,
-            e->los_output_count);
-    if (verbose) message("Creating LOS file: %s", fileName);
-    h_file = H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-    if (h_file < 0) error("Error while opening file '%s'.", fileName);
+  ticks tic2 = getticks();
+
+  /* Sort the sightlines in each projection plane. */
+  struct los_plane_index index[3];
+  los_index_init(index, LOS_list, num_los, periodic, dim);
+
+  struct los_mapper_data data;
+  bzero(&data, sizeof(struct los_mapper_data));
+  data.index = index;
+  data.LOS_list = LOS_list;
+  data.parts = s->parts;
+  data.xparts = s->xparts;
+  data.counts = (int *)calloc(num_los, sizeof(int));
+  if (data.counts == NULL) error("Failed to allocate LOS counts.");
+
+  /* Count the local parts in each sightline. */
+  threadpool_map(&e->threadpool, los_assign_mapper, s->parts, s->nr_parts,
+                 sizeof(struct part), threadpool_auto_chunk_size, &data);
+
+  /* Where does each sightline start in the list of local parts? */
+  size_t *offsets = (size_t *)malloc((num_los + 1) * sizeof(size_t));
+  if (offsets == NULL) error("Failed to allocate LOS offsets.");
+  offsets[0] = 0;
+  for (int j = 0; j < num_los; j++) {
+    LOS_list[j].particles_in_los_local = data.counts[j];
+    offsets[j + 1] = offsets[j] + data.counts[j];
   }
+  const size_t nr_parts_local = offsets[num_los];
 
-#ifdef WITH_MPI
-  MPI_Barrier(MPI_COMM_WORLD);
+#ifdef SWIFT_DEBUG_CHECKS
+  /* Confirm we are capturing all the parts that intersect each LOS by redoing
+   * the count looping over all parts and all sightlines. */
+  for (int j = 0; j < num_los; j++) {
+    struct line_of_sight los = LOS_list[j];
+    los.particles_in_los_local = 0;
+    threadpool_map(&e->threadpool, los_first_loop_mapper, s->parts,
+                   s->nr_parts, sizeof(struct part),
+                   threadpool_auto_chunk_size, &los);
+    if (los.particles_in_los_local != LOS_list[j].particles_in_los_local)
+      error("LOS %d: brute force vs index don't match s:%d != i:%d", j,
+            los.particles_in_los_local, LOS_list[j].particles_in_los_local);
+  }
 #endif
 
-  /* Keep track of the total number of parts in all sightlines. */
-  size_t total_num_parts_in_los = 0;
-
-  /* ------------------------------- */
-  /* Main loop over each random LOS. */
-  /* ------------------------------- */
-
-  /* Get list of local non-empty top level cells. */
-  const struct cell *cells = e->s->cells_top;
-  const int *local_cells_with_particles = e->s->local_cells_with_particles_top;
-  const int nr_local_cells_with_particles = s->nr_local_cells_with_particles;
-
-  /* Loop over each random LOS. */
-  for (int j = 0; j < LOS_params->num_tot; j++) {
-
-    /* Create empty top level cell list for this LOS */
-    int *los_cells_top = (int *)swift_malloc(
-        "tl_cells_los", nr_local_cells_with_particles * sizeof(int));
-    bzero(los_cells_top, nr_local_cells_with_particles * sizeof(int));
-
-    /* Find all top level cells this LOS will intersect. */
-    find_intersecting_top_level_cells(e, &LOS_list[j], los_cells_top, cells,
-                                      local_cells_with_particles,
-                                      nr_local_cells_with_particles);
-
-    /* Next count all the parts that intersect with this line of sight */
-    for (int n = 0; n < nr_local_cells_with_particles; n++) {
-      if (los_cells_top[n] == 1) {
-        const struct cell *c = &cells[local_cells_with_particles[n]];
-        threadpool_map(&s->e->threadpool, los_first_loop_mapper, c->hydro.parts,
-                       c->hydro.count, sizeof(struct part),
-                       threadpool_auto_chunk_size, &LOS_list[j]);
-      }
-    }
+  /* Record which parts are in each sightline. */
+  size_t *part_ids = NULL;
+  if ((part_ids = (size_t *)swift_malloc(
+           "los_part_ids", nr_parts_local * sizeof(size_t))) == NULL)
+    error("Failed to allocate LOS part indices.");
+  bzero(data.counts, num_los * sizeof(int));
+  data.offsets = offsets;
+  data.part_ids = part_ids;
+  threadpool_map(&e->threadpool, los_assign_mapper, s->parts, s->nr_parts,
+                 sizeof(struct part), threadpool_auto_chunk_size, &data);
+
+  /* Setup LOS part and xpart structures. */
+  struct part *LOS_parts = NULL;
+  struct xpart *LOS_xparts = NULL;
+  struct gpart *LOS_gparts = NULL;
+  if ((LOS_parts = (struct part *)swift_malloc(
+           "los_parts_array", sizeof(struct part) * nr_parts_local)) ==
+      NULL)
+    error("Failed to allocate LOS part memory.");
+  if ((LOS_xparts = (struct xpart *)swift_malloc(
+           "los_xparts_array", sizeof(struct xpart) * nr_parts_local)) ==
+      NULL)
+    error("Failed to allocate LOS xpart memory.");
+  if ((LOS_gparts = (struct gpart *)swift_malloc(
+           "los_gparts_array", sizeof(struct gpart) * nr_parts_local)) ==
+      NULL)
+    error("Failed to allocate LOS gpart memory.");
+
+  /* Copy the parts, one sightline at a time. */
+  data.LOS_parts = LOS_parts;
+  data.LOS_xparts = LOS_xparts;
+  data.LOS_gparts = LOS_gparts;
+  threadpool_map(&e->threadpool, los_copy_mapper, LOS_list, num_los,
+                 sizeof(struct line_of_sight), threadpool_auto_chunk_size,
+                 &data);
+
+  swift_free("los_part_ids", part_ids);
+  los_index_clean(index);
 
-#ifdef SWIFT_DEBUG_CHECKS
-    /* Confirm we are capturing all the parts that intersect the LOS by redoing
-     * the count looping over all parts in the space (not just those in the
-     * subset of top level cells). */
-
-    struct part *parts = s->parts;
-    const size_t nr_parts = s->nr_parts;
-    const int old_particles_in_los_local = LOS_list[j].particles_in_los_local;
-    LOS_list[j].particles_in_los_local = 0;
-
-    /* Count all parts that intersect with this line of sight. */
-    threadpool_map(&s->e->threadpool, los_first_loop_mapper, parts, nr_parts,
-                   sizeof(struct part), threadpool_auto_chunk_size,
-                   &LOS_list[j]);
-
-    /* Make sure we get the same answer as above. */
-    if (old_particles_in_los_local != LOS_list[j].particles_in_los_local)
-      error("Space vs cells don't match s:%d != c:%d",
-            LOS_list[j].particles_in_los_local, old_particles_in_los_local);
-#endif
+  if (verbose)
+    message("Finding the %zd local parts in the sightlines took %.3f %s.",
+            nr_parts_local, clocks_from_ticks(getticks() - tic2),
+            clocks_getunit());
 
 #ifdef WITH_MPI
-    /* Make sure all nodes know how many parts are in this LOS */
-    int *counts = (int *)malloc(sizeof(int) * e->nr_nodes);
-    int *offsets = (int *)malloc(sizeof(int) * e->nr_nodes);
+  tic2 = getticks();
 
-    /* How many parts does each rank have for this LOS? */
-    MPI_Allgather(&LOS_list[j].particles_in_los_local, 1, MPI_INT, counts, 1,
-                  MPI_INT, MPI_COMM_WORLD);
-
-    int offset_count = 0;
-    for (int k = 0; k < e->nr_nodes; k++) {
+  /* How many parts does each rank have in each LOS? */
+  int *all_counts = NULL;
+  if (e->nodeID == 0) {
+    all_counts = (int *)malloc(e->nr_nodes * num_los * sizeof(int));
+    if (all_counts == NULL) error("Failed to allocate LOS counts.");
+  }
+  MPI_Gather(data.counts, num_los, MPI_INT, all_counts, num_los, MPI_INT, 0,
+             MPI_COMM_WORLD);
 
-      /* Total parts in this LOS. */
-      LOS_list[j].particles_in_los_total += counts[k];
+  if (nr_parts_local > INT_MAX)
+    error("Too many parts in the sightlines on this rank (%zd).",
+          nr_parts_local);
 
-      /* Counts and offsets for Gatherv. */
-      offsets[k] = offset_count;
-      offset_count += counts[k];
+  /* Counts and offsets for Gatherv. */
+  int *counts = NULL, *displs = NULL;
+  size_t nr_parts_total = 0;
+  if (e->nodeID == 0) {
+    counts = (int *)malloc(sizeof(int) * e->nr_nodes);
+    displs = (int *)malloc(sizeof(int) * e->nr_nodes);
+    for (int k = 0; k < e->nr_nodes; k++) {
+      counts[k] = 0;
+      for (int j = 0; j < num_los; j++)
+        counts[k] += all_counts[k * num_los + j];
+      displs[k] = nr_parts_total;
+      nr_parts_total += counts[k];
     }
-#else
-    LOS_list[j].particles_in_los_total = LOS_list[j].particles_in_los_local;
-#endif
-    total_num_parts_in_los += LOS_list[j].particles_in_los_total;
-
-    /* Print information about this LOS */
-    if (e->nodeID == 0) print_los_info(LOS_list, j);
+    if (nr_parts_total > INT_MAX)
+      error("Too many parts in the sightlines (%zd).", nr_parts_total);
+  }
 
-    /* Don't work with empty LOS */
-    if (LOS_list[j].particles_in_los_total == 0) {
-      if (e->nodeID == 0) {
-        message("*WARNING* LOS %i is empty", j);
-        print_los_info(LOS_list, j);
+  /* Collect all parts in the sightlines on rank 0. */
+  struct part *recv_parts = NULL;
+  struct xpart *recv_xparts = NULL;
+  struct gpart *recv_gparts = NULL;
+  if (e->nodeID == 0) {
+    if ((recv_parts = (struct part *)swift_malloc(
+             "los_parts_recv", sizeof(struct part) * nr_parts_total)) ==
+        NULL)
+      error("Failed to allocate LOS part memory.");
+    if ((recv_xparts = (struct xpart *)swift_malloc(
+             "los_xparts_recv", sizeof(struct xpart) * nr_parts_total)) ==
+        NULL)
+      error("Failed to allocate LOS xpart memory.");
+    if ((recv_gparts = (struct gpart *)swift_malloc(
+             "los_gparts_recv", sizeof(struct gpart) * nr_parts_total)) ==
+        NULL)
+      error("Failed to allocate LOS gpart memory.");
+  }
+  MPI_Gatherv(LOS_parts, nr_parts_local, part_mpi_type, recv_parts, counts,
+              displs, part_mpi_type, 0, MPI_COMM_WORLD);
+  MPI_Gatherv(LOS_xparts, nr_parts_local, xpart_mpi_type, recv_xparts, counts,
+              displs, xpart_mpi_type, 0, MPI_COMM_WORLD);
+  MPI_Gatherv(LOS_gparts, nr_parts_local, gpart_mpi_type, recv_gparts, counts,
+              displs, gpart_mpi_type, 0, MPI_COMM_WORLD);
+
+  swift_free("los_parts_array", LOS_parts);
+  swift_free("los_xparts_array", LOS_xparts);
+  swift_free("los_gparts_array", LOS_gparts);
+  LOS_parts = NULL;
+  LOS_xparts = NULL;
+  LOS_gparts = NULL;
+
+  /* Rank 0 puts them back in sightline order (and rank order within each
+   * sightline). */
+  if (e->nodeID == 0) {
+    if ((LOS_parts = (struct part *)swift_malloc(
+             "los_parts_array", sizeof(struct part) * nr_parts_total)) ==
+        NULL)
+      error("Failed to allocate LOS part memory.");
+    if ((LOS_xparts = (struct xpart *)swift_malloc(
+             "los_xparts_array", sizeof(struct xpart) * nr_parts_total)) ==
+        NULL)
+      error("Failed to allocate LOS xpart memory.");
+    if ((LOS_gparts = (struct gpart *)swift_malloc(
+             "los_gparts_array", sizeof(struct gpart) * nr_parts_total)) ==
+        NULL)
+      error("Failed to allocate LOS gpart memory.");
+
+    size_t count = 0;
+    for (int j = 0; j < num_los; j++) {
+      LOS_list[j].particles_in_los_total = 0;
+      for (int k = 0; k < e->nr_nodes; k++) {
+        const int N = all_counts[k * num_los + j];
+        memcpy(&LOS_parts[count], &recv_parts[displs[k]],
+               N * sizeof(struct part));
+        memcpy(&LOS_xparts[count], &recv_xparts[displs[k]],
+               N * sizeof(struct xpart));
+        memcpy(&LOS_gparts[count], &recv_gparts[displs[k]],
+               N * sizeof(struct gpart));
+        displs[k] += N;
+        count += N;
+        LOS_list[j].particles_in_los_total += N;
       }
-#ifdef WITH_MPI
-      free(counts);
-      counts = NULL;
-      free(offsets);
-      offsets = NULL;
-#endif
-      swift_free("tl_cells_los", los_cells_top);
-      continue;
     }
 
-    /* Setup LOS part and xpart structures. */
-    struct part *LOS_parts = NULL;
-    struct xpart *LOS_xparts = NULL;
-    struct gpart *LOS_gparts = NULL;
-
-    /* Rank 0 allocates more space as it will gather all the data for writing */
-    if (e->nodeID == 0) {
-      if ((LOS_parts = (struct part *)swift_malloc(
-               "los_parts_array",
-               sizeof(struct part) * LOS_list[j].particles_in_los_total)) ==
-          NULL)
-        error("Failed to allocate LOS part memory.");
-      if ((LOS_xparts = (struct xpart *)swift_malloc(
-               "los_xparts_array",
-               sizeof(struct xpart) * LOS_list[j].particles_in_los_total)) ==
-          NULL)
-        error("Failed to allocate LOS xpart memory.");
-      if ((LOS_gparts = (struct gpart *)swift_malloc(
-               "los_gparts_array",
-               sizeof(struct gpart) * LOS_list[j].particles_in_los_total)) ==
-          NULL)
-        error("Failed to allocate LOS gpart memory.");
-    } else {
-      if ((LOS_parts = (struct part *)swift_malloc(
-               "los_parts_array",
-               sizeof(struct part) * LOS_list[j].particles_in_los_local)) ==
-          NULL)
-        error("Failed to allocate LOS part memory.");
-      if ((LOS_xparts = (struct xpart *)swift_malloc(
-               "los_xparts_array",
-               sizeof(struct xpart) * LOS_list[j].particles_in_los_local)) ==
-          NULL)
-        error("Failed to allocate LOS xpart memory.");
-      if ((LOS_gparts = (struct gpart *)swift_malloc(
-               "los_gparts_array",
-               sizeof(struct gpart) * LOS_list[j].particles_in_los_local)) ==
-          NULL)
-        error("Failed to allocate LOS gpart memory.");
-    }
-
-    /* Loop over each part again, pulling out those in LOS. */
-    int count = 0;
-
-    for (int n = 0; n < e->s->nr_local_cells_with_particles; ++n) {
-
-      if (los_cells_top[n] == 0) continue;
-
-      const struct cell *c = &cells[local_cells_with_particles[n]];
-      const struct part *cell_parts = c->hydro.parts;
-      const struct xpart *cell_xparts = c->hydro.xparts;
-      const size_t num_parts_in_cell = c->hydro.count;
-
-      for (size_t i = 0; i < num_parts_in_cell; i++) {
-
-        /* Don't consider inhibited parts. */
-        if (cell_parts[i].time_bin == time_bin_inhibited) continue;
-        if (cell_parts[i].time_bin == time_bin_not_created) continue;
-
-        /* Don't consider part if outwith allowed z-range. */
-        if (cell_parts[i].x[LOS_list[j].zaxis] <
-                LOS_list[j].range_when_shooting_down_axis[0] ||
-            cell_parts[i].x[LOS_list[j].zaxis] >
-                LOS_list[j].range_when_shooting_down_axis[1])
-          continue;
-
-        /* Distance from this part to LOS along x dim. */
-        double dx = cell_parts[i].x[LOS_list[j].xaxis] - LOS_list[j].Xpos;
-
-        /* Periodic wrap. */
-        if (LOS_list[j].periodic)
-          dx = nearest(dx, LOS_list[j].dim[LOS_list[j].xaxis]);
-
-        /* Square */
-        const double dx2 = dx * dx;
-
-        /* Smoothing length of this part. */
-        const double hsml = cell_parts[i].h * kernel_gamma;
-        const double hsml2 = hsml * hsml;
-
-        /* Does this part fall into our LOS? */
-        if (dx2 < hsml2) {
+    swift_free("los_parts_recv", recv_parts);
+    swift_free("los_xparts_recv", recv_xparts);
+    swift_free("los_gparts_recv", recv_gparts);
+    free(counts);
+    free(displs);
+    free(all_counts);
+  }
 
-          /* Distance from this part to LOS along y dim. */
-          double dy = cell_parts[i].x[LOS_list[j].yaxis] - LOS_list[j].Ypos;
+  if (verbose)
+    message("Collecting the parts on rank 0 took %.3f %s.",
+            clocks_from_ticks(getticks() - tic2), clocks_getunit());
+#else
+  for (int j = 0; j < num_los; j++)
+    LOS_list[j].particles_in_los_total = LOS_list[j].particles_in_los_local;
+#endif
 
-          /* Periodic wrap. */
-          if (LOS_list[j].periodic)
-            dy = nearest(dy, LOS_list[j].dim[LOS_list[j].yaxis]);
+  free(data.counts);
+  free(offsets);
 
-          /* Square */
-          const double dy2 = dy * dy;
+  /* Rank 0 writes particles to file. */
+  if (e->nodeID == 0) {
 
-          /* Does this part still fall into our LOS? */
-          if (dy2 < hsml2) {
-            /* 2D distance to LOS. */
+    tic2 = getticks();
 
-            if (dx2 + dy2 <= hsml2) {
+    char fileName[256], groupName[200];
+    sprintf(fileName, "%s_%04i.hdf5", LOS_params->basename,
+            e->los_output_count);
+    if (verbose) message("Creating LOS file: %s", fileName);
 
-              /* Store part and xpart properties. */
-              memcpy(&LOS_parts[count], &cell_parts[i], sizeof(struct part));
-              memcpy(&LOS_xparts[count], &cell_xparts[i], sizeof(struct xpart));
-              memcpy(&LOS_gparts[count], cell_parts[i].gpart,
-                     sizeof(struct gpart));
+    /* When writing asynchronously, the fields are converted now and written
+     * by the i/o thread. We can only use the HDF5 library while holding its
+     * lock, which we release before staging the fields. */
+    if (e->snapshot_async != NULL) io_hdf5_lock();
 
-              count++;
-            }
-          }
-        }
-      }
-    }
+    const hid_t h_file =
+        H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (h_file < 0) error("Error while opening file '%s'.", fileName);
 
-#ifdef SWIFT_DEBUG_CHECKS
-    if (count != LOS_list[j].particles_in_los_local)
-      error("LOS counts don't add up");
-#endif
+    /* Keep track of the total number of parts in all sightlines. */
+    size_t total_num_parts_in_los = 0;
 
-#ifdef WITH_MPI
-    /* Collect all parts in this LOS to rank 0. */
-    if (e->nodeID == 0) {
-      MPI_Gatherv(MPI_IN_PLACE, 0, part_mpi_type, LOS_parts, counts, offsets,
-                  part_mpi_type, 0, MPI_COMM_WORLD);
-      MPI_Gatherv(MPI_IN_PLACE, 0, xpart_mpi_type, LOS_xparts, counts, offsets,
-                  xpart_mpi_type, 0, MPI_COMM_WORLD);
-      MPI_Gatherv(MPI_IN_PLACE, 0, gpart_mpi_type, LOS_gparts, counts, offsets,
-                  gpart_mpi_type, 0, MPI_COMM_WORLD);
+    /* Create the HDF5 group of each LOS */
+    for (int j = 0; j < num_los; j++) {
 
-    } else {
-      MPI_Gatherv(LOS_parts, LOS_list[j].particles_in_los_local, part_mpi_type,
-                  LOS_parts, counts, offsets, part_mpi_type, 0, MPI_COMM_WORLD);
-      MPI_Gatherv(LOS_xparts, LOS_list[j].particles_in_los_local,
-                  xpart_mpi_type, LOS_xparts, counts, offsets, xpart_mpi_type,
-                  0, MPI_COMM_WORLD);
-      MPI_Gatherv(LOS_gparts, LOS_list[j].particles_in_los_local,
-                  gpart_mpi_type, LOS_gparts, counts, offsets, gpart_mpi_type,
-                  0, MPI_COMM_WORLD);
-    }
-#endif
+      /* Print information about this LOS */
+      if (verbose) print_los_info(LOS_list, j);
 
-    /* Re-instate part->gpart pointer on teh receiving side */
-    if (e->nodeID == 0) {
-#ifdef WITH_MPI
-      for (int i = 0; i < LOS_list[j].particles_in_los_total; ++i) {
-        LOS_parts[i].gpart = &LOS_gparts[i];
-        LOS_gparts[i].id_or_neg_offset = -i;
+      /* Don't work with empty LOS */
+      if (LOS_list[j].particles_in_los_total == 0) {
+        message("*WARNING* LOS %i is empty", j);
+        continue;
       }
-#endif
-    }
-
-    /* Rank 0 writes particles to file. */
-    if (e->nodeID == 0) {
+      total_num_parts_in_los += LOS_list[j].particles_in_los_total;
 
       /* Create HDF5 group for this LOS */
       sprintf(groupName, "/LOS_%04i", j);
-      h_grp =
+      const hid_t h_grp =
           H5Gcreate(h_file, groupName, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
       if (h_grp < 0) error("Error while creating LOS HDF5 group\n");
 
@@ -1047,40 +1456,52 @@ void do_line_of_sight(struct engine *e) {
       io_write_attribute(h_grp, "Xpos", DOUBLE, &LOS_list[j].Xpos, 1);
       io_write_attribute(h_grp, "Ypos", DOUBLE, &LOS_list[j].Ypos, 1);
 
-#ifdef SWIFT_DEBUG_CHECKS
-      for (int i = 0; i < LOS_list[j].particles_in_los_total; ++i) {
-        if (LOS_parts[i].gpart != &LOS_gparts[i]) error("Incorrect pointers!");
-      }
-#endif
-
-      /* Write the data for this LOS */
-      write_los_hdf5_datasets(h_grp, j, LOS_list[j].particles_in_los_total,
-                              LOS_parts, e, LOS_xparts);
-
       /* Close HDF5 group */
       H5Gclose(h_grp);
     }
 
+    /* Write header */
+    write_hdf5_header(h_file, e, LOS_params, total_num_parts_in_los);
+
+    if (e->snapshot_async != NULL) io_hdf5_unlock();
+
+    /* Re-instate part->gpart pointer on the copies */
+    for (size_t i = 0; i < total_num_parts_in_los; ++i) {
+      if (LOS_parts[i].gpart == NULL) continue;
+      LOS_parts[i].gpart = &LOS_gparts[i];
+      LOS_gparts[i].id_or_neg_offset = -(long long)i;
+    }
+
+    /* Write the data of all the LOS */
+    write_los_hdf5_datasets(h_file, LOS_list, num_los, total_num_parts_in_los,
+                            LOS_parts, e, LOS_xparts);
+
+    /* Close HDF5 file (once all the fields are written) */
+    if (e->snapshot_async != NULL) {
+      hid_t *h_file_async = (hid_t *)malloc(sizeof(hid_t));
+      if (h_file_async == NULL)
+        error("Unable to allocate asynchronous i/o job");
+      *h_file_async = h_file;
+      io_async_submit(e->snapshot_async, close_los_file_async, h_file_async,
+                      /*size=*/0);
+    } else {
+      H5Fclose(h_file);
+    }
+
+    if (verbose)
+      message("%s the %zd parts in the sightlines took %.3f %s.",
+              e->snapshot_async != NULL ? "Staging" : "Writing",
+              total_num_parts_in_los, clocks_from_ticks(getticks() - tic2),
+              clocks_getunit());
+
     /* Free up some memory */
-#ifdef WITH_MPI
-    free(counts);
-    free(offsets);
-#endif
-    swift_free("tl_cells_los", los_cells_top);
     swift_free("los_parts_array", LOS_parts);
     swift_free("los_xparts_array", LOS_xparts);
     swift_free("los_gparts_array", LOS_gparts);
-
-  } /* End of loop over each LOS */
-
-  if (e->nodeID == 0) {
-    /* Write header */
-    write_hdf5_header(h_file, e, LOS_params, total_num_parts_in_los);
-
-    /* Close HDF5 file */
-    H5Fclose(h_file);
   }
 
+  free(LOS_list);
+
   /* Up the LOS counter. */
   e->los_output_count++;
 
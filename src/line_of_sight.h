@@ -71,9 +71,6 @@ struct line_of_sight {
   /*! Dimensions of the space. */
   double dim[3];
 
-  /*! How many top level cells does ths LOS intersect? */
-  int num_intersecting_top_level_cells;
-
   /*! The min--max range to consider for parts in LOS. */
   double range_when_shooting_down_axis[2];
 };
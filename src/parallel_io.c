@@ -25,6 +25,7 @@
 
 /* Some standard headers. */
 #include <hdf5.h>
+#include <limits.h>
 #include <math.h>
 #include <mpi.h>
 #include <stddef.h>
@@ -53,9 +54,11 @@
 #include "mhd_io.h"
 #include "output_list.h"
 #include "output_options.h"
+#include "parser.h"
 #include "part.h"
 #include "part_type.h"
 #include "particle_splitting.h"
+#include "partition.h"
 #include "rt_io.h"
 #include "sink_io.h"
 #include "star_formation_io.h"
@@ -392,12 +395,14 @@ void read_array_parallel(hid_t grp, struct io_props props, size_t N,
  * @param partTypeGroupName The name of the group we are writing to.
  * @param props The #io_props of the field to write.
  * @param N_total The total number of particles to write in this array.
+ * @param N_chunk The smallest non-zero number of particles written by a rank.
+ * @param lossy_compression Level of lossy compression to use for this field.
  * @param snapshot_units The units used for the data in this snapshot.
  */
 void prepare_array_parallel(
     struct engine* e, hid_t grp, const char* fileName, FILE* xmfFile,
     const char* partTypeGroupName, const struct io_props props,
-    const long long N_total,
+    const long long N_total, const long long N_chunk,
     const enum lossy_compression_schemes lossy_compression,
     const struct unit_system* snapshot_units) {
 
@@ -406,6 +411,12 @@ void prepare_array_parallel(
   if (h_space < 0)
     error("Error while creating data space for field '%s'.", props.name);
 
+  /* Chunks no larger than the smallest contribution of a rank span at most
+   * two ranks, which limits the exchanges needed by the parallel filters. */
+  long long chunk_size = N_chunk;
+  if (chunk_size > (1LL << 20)) chunk_size = 1LL << 20;
+  if (chunk_size < (1LL << 12)) chunk_size = 1LL << 12;
+
   int rank = 0;
   hsize_t shape[2];
   hsize_t chunk_shape[2];
@@ -413,13 +424,13 @@ void prepare_array_parallel(
     rank = 2;
     shape[0] = N_total;
     shape[1] = props.dimension;
-    chunk_shape[0] = 1 << 20; /* Just a guess...*/
+    chunk_shape[0] = chunk_size;
     chunk_shape[1] = props.dimension;
   } else {
     rank = 1;
     shape[0] = N_total;
     shape[1] = 0;
-    chunk_shape[0] = 1 << 20; /* Just a guess...*/
+    chunk_shape[0] = chunk_size;
     chunk_shape[1] = 0;
   }
 
@@ -441,23 +452,48 @@ void prepare_array_parallel(
   const hid_t h_plist_id = H5Pcreate(H5P_DATASET_XFER);
   H5Pset_dxpl_mpio(h_plist_id, H5FD_MPIO_COLLECTIVE);
 
-  /* Set chunk size */
-  // h_err = H5Pset_chunk(h_prop, rank, chunk_shape);
-  // if (h_err < 0) {
-  //  error("Error while setting chunk size (%llu, %llu) for field '%s'.",
-  //        chunk_shape[0], chunk_shape[1], props.name);
-  //}
-
-  /* Are we imposing some form of lossy compression filter? */
+  /* Filters can only be used in collective writes from HDF5 1.10.3
+   * onwards. Older versions write contiguous, uncompressed, datasets. */
   char comp_buffer[32] = "None";
-  // if (lossy_compression != compression_write_lossless)
-  //  set_hdf5_lossy_compression(&h_prop, &h_type, lossy_compression,
-  //  props.name);
+#if H5_VERSION_GE(1, 10, 3)
+  if (N_total > 0) {
+
+    /* Set chunk size */
+    h_err = H5Pset_chunk(h_prop, rank, chunk_shape);
+    if (h_err < 0)
+      error("Error while setting chunk size (%llu, %llu) for field '%s'.",
+            (unsigned long long)chunk_shape[0],
+            (unsigned long long)chunk_shape[1], props.name);
+
+    /* The ranks overwrite every element, no need for fill values */
+    h_err = H5Pset_fill_time(h_prop, H5D_FILL_TIME_NEVER);
+    if (h_err < 0)
+      error("Error while setting fill time for field '%s'.", props.name);
+
+    /* Are we imposing some form of lossy compression filter? */
+    if (lossy_compression != compression_write_lossless)
+      set_hdf5_lossy_compression(&h_prop, &h_type, lossy_compression,
+                                 props.name, comp_buffer);
+
+    /* Impose GZIP and shuffle data compression */
+    if (e->snapshot_compression > 0) {
+      h_err = H5Pset_shuffle(h_prop);
+      if (h_err < 0)
+        error("Error while setting shuffling options for field '%s'.",
+              props.name);
+
+      h_err = H5Pset_deflate(h_prop, e->snapshot_compression);
+      if (h_err < 0)
+        error("Error while setting compression options for field '%s'.",
+              props.name);
+    }
 
-  /* Impose check-sum to verify data corruption */
-  // h_err = H5Pset_fletcher32(h_prop);
-  // if (h_err < 0)
-  //  error("Error while setting checksum options for field '%s'.", props.name);
+    /* Impose check-sum to verify data corruption */
+    h_err = H5Pset_fletcher32(h_prop);
+    if (h_err < 0)
+      error("Error while setting checksum options for field '%s'.", props.name);
+  }
+#endif
 
   /* Create dataset */
   const hid_t h_data = H5Dcreate(grp, props.name, h_type, h_space, H5P_DEFAULT,
@@ -719,6 +755,335 @@ void write_array_parallel(const struct engine* e, hid_t grp,
 #endif
 }
 
+/**
+ * @brief Fills the list of fields to read for a given particle type.
+ *
+ * @param ptype The type of particles.
+ * @param base The first particle the fields are read into.
+ * @param list (output) The list of #io_props of the fields.
+ *
+ * @return The number of fields.
+ */
+static int read_ic_parallel_fields(const int ptype, char* base,
+                                   struct io_props* list) {
+
+  int num_fields = 0;
+  switch (ptype) {
+
+    case swift_type_gas:
+      hydro_read_particles((struct part*)base, list, &num_fields);
+      num_fields += mhd_read_particles((struct part*)base, list + num_fields);
+      num_fields +=
+          chemistry_read_particles((struct part*)base, list + num_fields);
+      num_fields += rt_read_particles((struct part*)base, list + num_fields);
+      break;
+
+    case swift_type_dark_matter:
+    case swift_type_dark_matter_background:
+    case swift_type_neutrino:
+      darkmatter_read_particles((struct gpart*)base, list, &num_fields);
+      break;
+
+    case swift_type_sink:
+      sink_read_particles((struct sink*)base, list, &num_fields);
+      break;
+
+    case swift_type_stars:
+      stars_read_particles((struct spart*)base, list, &num_fields);
+      num_fields +=
+          star_formation_read_particles((struct spart*)base, list + num_fields);
+      num_fields += rt_read_stars((struct spart*)base, list + num_fields);
+      break;
+
+    case swift_type_black_hole:
+      black_holes_read_particles((struct bpart*)base, list, &num_fields);
+      break;
+
+    default:
+      error("Invalid particle type %d.", ptype);
+  }
+  return num_fields;
+}
+
+/**
+ * @brief Returns the position of a particle of a given type.
+ *
+ * @param ptype The type of particles.
+ * @param p The particle.
+ */
+static const double* read_ic_parallel_position(const int ptype,
+                                               const char* p) {
+
+  switch (ptype) {
+    case swift_type_gas:
+      return ((const struct part*)p)->x;
+    case swift_type_dark_matter:
+    case swift_type_dark_matter_background:
+    case swift_type_neutrino:
+      return ((const struct gpart*)p)->x;
+    case swift_type_sink:
+      return ((const struct sink*)p)->x;
+    case swift_type_stars:
+      return ((const struct spart*)p)->x;
+    case swift_type_black_hole:
+      return ((const struct bpart*)p)->x;
+    default:
+      error("Invalid particle type %d.", ptype);
+      return NULL;
+  }
+}
+
+/**
+ * @brief Gets the properties of the array the particles of a given type are
+ * read into.
+ *
+ * @param ptype The type of particles.
+ * @param with_hydro Are we running with hydro ?
+ * @param with_gravity Are we running with gravity ?
+ * @param with_sink Are we running with sink ?
+ * @param with_stars Are we running with stars ?
+ * @param with_black_holes Are we running with black holes ?
+ * @param label (output) The label of the array allocations.
+ * @param sizeofpart (output) The size of one particle.
+ * @param alignpart (output) The alignment of the array.
+ *
+ * @return 1 if the particles of this type are read, 0 otherwise.
+ */
+static int read_ic_parallel_array_props(
+    const int ptype, const int with_hydro, const int with_gravity,
+    const int with_sink, const int with_stars, const int with_black_holes,
+    const char** label, size_t* sizeofpart, size_t* alignpart) {
+
+  switch (ptype) {
+    case swift_type_gas:
+      *label = "parts", *sizeofpart = sizeof(struct part);
+      *alignpart = part_align;
+      return with_hydro;
+    case swift_type_dark_matter:
+    case swift_type_dark_matter_background:
+    case swift_type_neutrino:
+      *label = "gparts", *sizeofpart = sizeof(struct gpart);
+      *alignpart = gpart_align;
+      return with_gravity;
+    case swift_type_sink:
+      *label = "sinks", *sizeofpart = sizeof(struct sink);
+      *alignpart = sink_align;
+      return with_sink;
+    case swift_type_stars:
+      *label = "sparts", *sizeofpart = sizeof(struct spart);
+      *alignpart = spart_align;
+      return with_stars;
+    case swift_type_black_hole:
+      *label = "bparts", *sizeofpart = sizeof(struct bpart);
+      *alignpart = bpart_align;
+      return with_black_holes;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Reads the particles of one type in batches and sends each of them
+ * to the rank of the provisional domain that contains it.
+ *
+ * The provisional domains are a regular grid over the box, assigned to the
+ * ranks in the same way as the "grid" initial partition. Every rank reads
+ * its slice of the file one batch at a time, so the slice is never held in
+ * full, and appends the particles it is sent to its array.
+ *
+ * With count_only set, only the coordinates are read and nothing is sent.
+ * The number of particles this rank would receive is added to count, so that
+ * the arrays can then be allocated at their final size.
+ *
+ * @param h_grp The HDF5 group of this particle type.
+ * @param ptype The type of particles.
+ * @param label The label of the particle array allocations.
+ * @param array The particle array (unused with count_only).
+ * @param count (in/out) The number of particles in the array.
+ * @param size The number of particles the array can hold.
+ * @param count_only Only count the particles this rank receives?
+ * @param sizeofpart The size of one particle.
+ * @param alignpart The alignment of the particle array.
+ * @param N The number of particles this rank reads.
+ * @param N_total The total number of particles of this type.
+ * @param offset The offset in the file of the first particle this rank reads.
+ * @param dim The size of the box.
+ * @param grid The number of provisional domains along each axis.
+ * @param batch_bytes The maximal number of bytes a rank reads per batch.
+ * @param internal_units The #unit_system used internally.
+ * @param ic_units The #unit_system used in the ICs.
+ * @param cleanup_h Are we removing h-factors from the ICs?
+ * @param cleanup_sqrt_a Are we cleaning-up the sqrt(a) factors in the Gadget
+ * IC velocities?
+ * @param h The value of the reduced Hubble constant to use for cleaning.
+ * @param a The current value of the scale-factor.
+ * @param mpi_rank The MPI rank of this node.
+ * @param mpi_size The number of MPI ranks.
+ * @param comm The MPI communicator.
+ * @param remap_ids Are we ignoring the ICs' IDs?
+ */
+static void read_ic_parallel_routed(
+    hid_t h_grp, const int ptype, const char* label, char* array,
+    size_t* count, const size_t size, const int count_only,
+    const size_t sizeofpart,
+    const size_t alignpart, const size_t N, const long long N_total,
+    const long long offset, const double dim[3], const int grid[3],
+    const size_t batch_bytes, const struct unit_system* internal_units,
+    const struct unit_system* ic_units, const int cleanup_h,
+    const int cleanup_sqrt_a, const double h, const double a,
+    const int mpi_rank, const int mpi_size, MPI_Comm comm,
+    const int remap_ids) {
+
+  /* Number of particles per batch, keeping the messages below 2GB. */
+  size_t batch = batch_bytes / sizeofpart;
+  batch = max(batch, (size_t)1);
+  batch = min(batch, (size_t)(INT_MAX / sizeofpart));
+
+  /* All the ranks take part in every batch, so go by the largest slice. */
+  const size_t N_max = (N_total + mpi_size - 1) / mpi_size;
+  const size_t nr_batches = (N_max + batch - 1) / batch;
+
+  char* parts_read = NULL;
+  char* parts_sorted = NULL;
+  if (swift_memalign(label, (void**)&parts_read, alignpart,
+                     batch * sizeofpart) != 0 ||
+      swift_memalign(label, (void**)&parts_sorted, alignpart,
+                     batch * sizeofpart) != 0)
+    error("Unable to allocate memory for the IC batches.");
+
+  int* dest = NULL;
+  int* send_counts = NULL;
+  int* recv_counts = NULL;
+  size_t* send_offsets = NULL;
+  MPI_Request* reqs = NULL;
+  if ((dest = (int*)malloc(sizeof(int) * batch)) == NULL ||
+      (send_counts = (int*)malloc(sizeof(int) * mpi_size)) == NULL ||
+      (recv_counts = (int*)malloc(sizeof(int) * mpi_size)) == NULL ||
+      (send_offsets = (size_t*)malloc(sizeof(size_t) * mpi_size)) == NULL ||
+      (reqs = (MPI_Request*)malloc(sizeof(MPI_Request) * 2 * mpi_size)) ==
+          NULL)
+    error("Unable to allocate memory for the IC routing.");
+
+  for (size_t b = 0; b < nr_batches; b++) {
+
+    const size_t first = min(b * batch, N);
+    const size_t nr_read = min(batch, N - first);
+
+    /* Read all the fields of the particles of this batch, or only their
+     * position if we are just counting. */
+    bzero(parts_read, nr_read * sizeofpart);
+    struct io_props list[io_max_size_output_list];
+    bzero(list, io_max_size_output_list * sizeof(struct io_props));
+    const int num_fields = read_ic_parallel_fields(ptype, parts_read, list);
+    for (int i = 0; i < num_fields; ++i) {
+      if (count_only && strcmp(list[i].name, "Coordinates") != 0) continue;
+      if (remap_ids && strcmp(list[i].name, "ParticleIDs") == 0) continue;
+      read_array_parallel(h_grp, list[i], nr_read, N_total, mpi_rank,
+                          offset + first, internal_units, ic_units, cleanup_h,
+                          cleanup_sqrt_a, h, a);
+    }
+
+    /* Find the domain of each particle and sort them by destination. */
+    for (int r = 0; r < mpi_size; r++) send_counts[r] = 0;
+    for (size_t k = 0; k < nr_read; k++) {
+      const double* x =
+          read_ic_parallel_position(ptype, &parts_read[k * sizeofpart]);
+      int ind[3];
+      for (int j = 0; j < 3; j++) {
+        ind[j] = x[j] / dim[j] * grid[j];
+        if (ind[j] < 0) ind[j] = 0;
+        if (ind[j] >= grid[j]) ind[j] = grid[j] - 1;
+      }
+      dest[k] = ind[0] + grid[0] * (ind[1] + grid[1] * ind[2]);
+      send_counts[dest[k]]++;
+    }
+    send_offsets[0] = 0;
+    for (int r = 1; r < mpi_size; r++)
+      send_offsets[r] = send_offsets[r - 1] + send_counts[r - 1];
+    for (size_t k = 0; k < nr_read; k++)
+      memcpy(&parts_sorted[send_offsets[dest[k]]++ * sizeofpart],
+             &parts_read[k * sizeofpart], sizeofpart);
+
+    /* Tell every rank how many particles it gets. */
+    int res = MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT,
+                           comm);
+    if (res != MPI_SUCCESS) mpi_error(res, "Failed to exchange IC counts.");
+    size_t nr_in = 0;
+    for (int r = 0; r < mpi_size; r++) nr_in += recv_counts[r];
+    if (count_only) {
+      *count += nr_in;
+      continue;
+    }
+    if (*count + nr_in > size)
+      error("Received more %s than were counted (%zu > %zu).", label,
+            *count + nr_in, size);
+
+    /* And send the particles on their way, in order of rank. */
+    size_t recv_offset = *count;
+    for (int r = 0; r < mpi_size; r++) {
+      reqs[2 * r + 0] = MPI_REQUEST_NULL;
+      reqs[2 * r + 1] = MPI_REQUEST_NULL;
+      const size_t send_offset = send_offsets[r] - send_counts[r];
+
+      if (r == mpi_rank) {
+        memcpy(&array[recv_offset * sizeofpart],
+               &parts_sorted[send_offset * sizeofpart],
+               send_counts[r] * sizeofpart);
+      } else {
+        if (send_counts[r] > 0) {
+          res = MPI_Isend(&parts_sorted[send_offset * sizeofpart],
+                          send_counts[r] * sizeofpart, MPI_BYTE, r, ptype,
+                          comm, &reqs[2 * r + 0]);
+          if (res != MPI_SUCCESS)
+            mpi_error(res, "Failed to isend IC particles to node %i.", r);
+        }
+        if (recv_counts[r] > 0) {
+          res = MPI_Irecv(&array[recv_offset * sizeofpart],
+                          recv_counts[r] * sizeofpart, MPI_BYTE, r, ptype,
+                          comm, &reqs[2 * r + 1]);
+          if (res != MPI_SUCCESS)
+            mpi_error(res, "Failed to irecv IC particles from node %i.", r);
+        }
+      }
+      recv_offset += recv_counts[r];
+    }
+    res = MPI_Waitall(2 * mpi_size, reqs, MPI_STATUSES_IGNORE);
+    if (res != MPI_SUCCESS) mpi_error(res, "Failed to route the IC particles.");
+    *count += nr_in;
+  }
+
+  free(reqs);
+  free(send_offsets);
+  free(recv_counts);
+  free(send_counts);
+  free(dest);
+  swift_free(label, parts_sorted);
+  swift_free(label, parts_read);
+}
+
+/**
+ * @brief Returns the size of the batches in which read_ic_parallel() sends
+ * the particles to their provisional domain.
+ *
+ * The particles are only routed while reading when the redistribution is
+ * streamed (DomainDecomposition:stream_MB > 0) and the initial partition is
+ * a grid. Other partitions are only known once all the cells are built.
+ *
+ * @param params The parsed parameter file.
+ * @param initial_partition The initial partition of the domain.
+ *
+ * @return The maximal number of bytes a rank reads per batch, 0 for a
+ * plain read.
+ */
+size_t read_ic_parallel_route_bytes(struct swift_params* params,
+                                    const struct partition* initial_partition) {
+
+  if (initial_partition->type != INITPART_GRID) return 0;
+  const float stream_MB =
+      parser_get_opt_param_float(params, "DomainDecomposition:stream_MB", 0.f);
+  return stream_MB > 0.f ? (size_t)(stream_MB * 1024. * 1024.) : 0;
+}
+
 /**
  * @brief Reads an HDF5 initial condition file (GADGET-3 type) in parallel
  *
@@ -758,6 +1123,10 @@ void write_array_parallel(const struct engine* e, hid_t grp,
  * @param n_threads The number of threads to use for local operations.
  * @param dry_run If 1, don't read the particle. Only allocates the arrays.
  * @param remap_ids Are we ignoring the ICs' IDs and remapping them to [1, N[ ?
+ * @param route_grid The number of provisional domains along each axis.
+ * @param route_batch_bytes If > 0, read the particles in batches of at most
+ * that many bytes per rank and send each of them to the rank of its
+ * provisional domain.
  * @param ics_metadata Will store metadata group copied from the ICs file
  *
  */
@@ -774,7 +1143,9 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
                       const int cleanup_sqrt_a, const double h, const double a,
                       const int mpi_rank, const int mpi_size, MPI_Comm comm,
                       MPI_Info info, const int n_threads, const int dry_run,
-                      const int remap_ids, struct ic_info* ics_metadata) {
+                      const int remap_ids, const int route_grid[3],
+                      const size_t route_batch_bytes,
+                      struct ic_info* ics_metadata) {
 
   hid_t h_file = 0, h_grp = 0;
   /* GADGET has only cubic boxes (in cosmological mode) */
@@ -924,9 +1295,58 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
     dim[j] *=
         units_conversion_factor(ic_units, internal_units, UNIT_CONV_LENGTH);
 
+  /* Number of particles of each type this rank ends up with. Without
+   * routing, this is the slice it reads. */
+  size_t N_local[swift_type_count];
+  for (int ptype = 0; ptype < swift_type_count; ++ptype)
+    N_local[ptype] = N[ptype];
+
+  /* Are the particles sent to their provisional domain as they are read?
+   * If so, a first pass over the coordinates counts how many particles of
+   * each type this rank receives so that the arrays can be allocated at
+   * their final size. */
+  const int routed = (route_batch_bytes > 0 && mpi_size > 1 && !dry_run);
+  if (routed) {
+    if (route_grid[0] * route_grid[1] * route_grid[2] != mpi_size)
+      error("Grid size does not match number of nodes.");
+    if (mpi_rank == 0)
+      message("Sending the particles to a provisional [ %i %i %i ] grid of "
+              "domains while reading.",
+              route_grid[0], route_grid[1], route_grid[2]);
+
+    for (int ptype = 0; ptype < swift_type_count; ptype++) {
+
+      const char* label;
+      size_t sizeofpart, alignpart;
+      if (N_total[ptype] == 0 ||
+          !read_ic_parallel_array_props(ptype, with_hydro, with_gravity,
+                                        with_sink, with_stars,
+                                        with_black_holes, &label, &sizeofpart,
+                                        &alignpart))
+        continue;
+
+      char partTypeGroupName[PARTICLE_GROUP_BUFFER_SIZE];
+      snprintf(partTypeGroupName, PARTICLE_GROUP_BUFFER_SIZE, "/PartType%d",
+               ptype);
+      h_grp = H5Gopen(h_file, partTypeGroupName, H5P_DEFAULT);
+      if (h_grp < 0)
+        error("Error while opening particle group %s.", partTypeGroupName);
+
+      N_local[ptype] = 0;
+      read_ic_parallel_routed(
+          h_grp, ptype, label, /*array=*/NULL, &N_local[ptype], /*size=*/0,
+          /*count_only=*/1, sizeofpart, alignpart, N[ptype], N_total[ptype],
+          offset[ptype], dim, route_grid, route_batch_bytes, internal_units,
+          ic_units, cleanup_h, cleanup_sqrt_a, h, a, mpi_rank, mpi_size, comm,
+          remap_ids);
+
+      H5Gclose(h_grp);
+    }
+  }
+
   /* Allocate memory to store SPH particles */
   if (with_hydro) {
-    *Ngas = N[0];
+    *Ngas = N_local[0];
     if (swift_memalign("parts", (void**)parts, part_align,
                        (*Ngas) * sizeof(struct part)) != 0)
       error("Error while allocating memory for particles");
@@ -935,7 +1355,7 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
 
   /* Allocate memory to store black hole particles */
   if (with_sink) {
-    *Nsinks = N[swift_type_sink];
+    *Nsinks = N_local[swift_type_sink];
     if (swift_memalign("sinks", (void**)sinks, sink_align,
                        *Nsinks * sizeof(struct sink)) != 0)
       error("Error while allocating memory for sink particles");
@@ -944,7 +1364,7 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
 
   /* Allocate memory to store stars particles */
   if (with_stars) {
-    *Nstars = N[swift_type_stars];
+    *Nstars = N_local[swift_type_stars];
     if (swift_memalign("sparts", (void**)sparts, spart_align,
                        *Nstars * sizeof(struct spart)) != 0)
       error("Error while allocating memory for stars particles");
@@ -953,7 +1373,7 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
 
   /* Allocate memory to store black hole particles */
   if (with_black_holes) {
-    *Nblackholes = N[swift_type_black_hole];
+    *Nblackholes = N_local[swift_type_black_hole];
     if (swift_memalign("bparts", (void**)bparts, bpart_align,
                        *Nblackholes * sizeof(struct bpart)) != 0)
       error("Error while allocating memory for black_holes particles");
@@ -962,15 +1382,16 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
 
   /* Allocate memory to store gravity particles */
   if (with_gravity) {
-    Ndm = N[swift_type_dark_matter];
-    Ndm_background = N[swift_type_dark_matter_background];
-    Ndm_neutrino = N[swift_type_neutrino];
-    *Ngparts = (with_hydro ? N[swift_type_gas] : 0) +
-               N[swift_type_dark_matter] +
-               N[swift_type_dark_matter_background] + N[swift_type_neutrino] +
-               (with_stars ? N[swift_type_stars] : 0) +
-               (with_sink ? N[swift_type_sink] : 0) +
-               (with_black_holes ? N[swift_type_black_hole] : 0);
+    Ndm = N_local[swift_type_dark_matter];
+    Ndm_background = N_local[swift_type_dark_matter_background];
+    Ndm_neutrino = N_local[swift_type_neutrino];
+    *Ngparts = (with_hydro ? N_local[swift_type_gas] : 0) +
+               N_local[swift_type_dark_matter] +
+               N_local[swift_type_dark_matter_background] +
+               N_local[swift_type_neutrino] +
+               (with_stars ? N_local[swift_type_stars] : 0) +
+               (with_sink ? N_local[swift_type_sink] : 0) +
+               (with_black_holes ? N_local[swift_type_black_hole] : 0);
     *Ngparts_background = Ndm_background;
     *Nnuparts = Ndm_neutrino;
     if (swift_memalign("gparts", (void**)gparts, gpart_align,
@@ -982,6 +1403,10 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
   /* message("Allocated %8.2f MB for particles.", *N * sizeof(struct part) /
    * (1024.*1024.)); */
 
+  /* The routed particles are appended to the arrays allocated above */
+  size_t Ngparts_read = 0;
+  if (routed) *Ngas = 0, *Nsinks = 0, *Nstars = 0, *Nblackholes = 0;
+
   /* message("BoxSize = %lf", dim[0]); */
   /* message("NumPart = [%zd, %zd] Total = %zd", *Ngas, Ndm, *Ngparts); */
 
@@ -999,6 +1424,51 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
     if (h_grp < 0)
       error("Error while opening particle group %s.", partTypeGroupName);
 
+    /* Stream the particles to their provisional domain, appending the
+     * three types of dark matter to the same array. */
+    if (routed) {
+      const char* label;
+      size_t sizeofpart, alignpart;
+      if (read_ic_parallel_array_props(ptype, with_hydro, with_gravity,
+                                       with_sink, with_stars, with_black_holes,
+                                       &label, &sizeofpart, &alignpart)) {
+
+        char* array = NULL;
+        size_t* count = NULL;
+        switch (ptype) {
+          case swift_type_gas:
+            array = (char*)*parts, count = Ngas;
+            break;
+          case swift_type_sink:
+            array = (char*)*sinks, count = Nsinks;
+            break;
+          case swift_type_stars:
+            array = (char*)*sparts, count = Nstars;
+            break;
+          case swift_type_black_hole:
+            array = (char*)*bparts, count = Nblackholes;
+            break;
+          default:
+            array = (char*)*gparts, count = &Ngparts_read;
+        }
+
+        const size_t count_before = *count;
+        read_ic_parallel_routed(
+            h_grp, ptype, label, array, count, count_before + N_local[ptype],
+            /*count_only=*/0, sizeofpart, alignpart, N[ptype], N_total[ptype],
+            offset[ptype], dim, route_grid, route_batch_bytes, internal_units,
+            ic_units, cleanup_h, cleanup_sqrt_a, h, a, mpi_rank, mpi_size,
+            comm, remap_ids);
+        if (*count != count_before + N_local[ptype])
+          error("Received %zu %s instead of the %zu counted.",
+                *count - count_before, label, N_local[ptype]);
+      }
+
+      /* Close particle group */
+      H5Gclose(h_grp);
+      continue;
+    }
+
     int num_fields = 0;
     struct io_props list[io_max_size_output_list];
     bzero(list, io_max_size_output_list * sizeof(struct io_props));
@@ -1010,56 +1480,51 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
       case swift_type_gas:
         if (with_hydro) {
           Nparticles = *Ngas;
-          hydro_read_particles(*parts, list, &num_fields);
-          num_fields += mhd_read_particles(*parts, list + num_fields);
-          num_fields += chemistry_read_particles(*parts, list + num_fields);
-          num_fields += rt_read_particles(*parts, list + num_fields);
+          num_fields = read_ic_parallel_fields(ptype, (char*)*parts, list);
         }
         break;
 
       case swift_type_dark_matter:
         if (with_gravity) {
           Nparticles = Ndm;
-          darkmatter_read_particles(*gparts, list, &num_fields);
+          num_fields = read_ic_parallel_fields(ptype, (char*)*gparts, list);
         }
         break;
 
       case swift_type_dark_matter_background:
         if (with_gravity) {
           Nparticles = Ndm_background;
-          darkmatter_read_particles(*gparts + Ndm, list, &num_fields);
+          num_fields =
+              read_ic_parallel_fields(ptype, (char*)(*gparts + Ndm), list);
         }
         break;
 
       case swift_type_neutrino:
         if (with_gravity) {
           Nparticles = Ndm_neutrino;
-          darkmatter_read_particles(*gparts + Ndm + Ndm_background, list,
-                                    &num_fields);
+          num_fields = read_ic_parallel_fields(
+              ptype, (char*)(*gparts + Ndm + Ndm_background), list);
         }
         break;
 
       case swift_type_sink:
         if (with_sink) {
           Nparticles = *Nsinks;
-          sink_read_particles(*sinks, list, &num_fields);
+          num_fields = read_ic_parallel_fields(ptype, (char*)*sinks, list);
         }
         break;
 
       case swift_type_stars:
         if (with_stars) {
           Nparticles = *Nstars;
-          stars_read_particles(*sparts, list, &num_fields);
-          num_fields +=
-              star_formation_read_particles(*sparts, list + num_fields);
-          num_fields += rt_read_stars(*sparts, list + num_fields);
+          num_fields = read_ic_parallel_fields(ptype, (char*)*sparts, list);
         }
         break;
 
       case swift_type_black_hole:
         if (with_black_holes) {
           Nparticles = *Nblackholes;
-          black_holes_read_particles(*bparts, list, &num_fields);
+          num_fields = read_ic_parallel_fields(ptype, (char*)*bparts, list);
         }
         break;
 
@@ -1147,6 +1612,8 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
  * @param e The #engine.
  * @param fileName The file name to write to.
  * @param N_total The total number of particles of each type to write.
+ * @param N_chunk The smallest non-zero number of particles of each type
+ * written by a rank.
  * @param to_write Whether or not specific particle types must be written.
  * @param numFields The number of fields to write for each particle type.
  * @param internal_units The #unit_system used internally.
@@ -1158,6 +1625,7 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
 void prepare_file(struct engine* e, const char* fileName,
                   const char* xmfFileName,
                   const long long N_total[swift_type_count],
+                  const long long N_chunk[swift_type_count],
                   const int to_write[swift_type_count],
                   const int numFields[swift_type_count],
                   const char current_selection_name[FIELD_BUFFER_SIZE],
@@ -1406,8 +1874,8 @@ void prepare_file(struct engine* e, const char* fileName,
 
       if (compression_level != compression_do_not_write) {
         prepare_array_parallel(e, h_grp, fileName, xmfFile, partTypeGroupName,
-                               list[i], N_total[ptype], compression_level,
-                               snapshot_units);
+                               list[i], N_total[ptype], N_chunk[ptype],
+                               compression_level, snapshot_units);
         num_fields_written++;
       }
     }
@@ -1626,6 +2094,13 @@ void write_output_parallel(struct engine* e,
   /* Now everybody konws its offset and the total number of
    * particles of each type */
 
+  /* Smallest non-empty contribution of a rank, used to size the chunks */
+  long long N_chunk[swift_type_count];
+  for (int ptype = 0; ptype < swift_type_count; ++ptype)
+    N_chunk[ptype] = N[ptype] > 0 ? N[ptype] : LLONG_MAX;
+  MPI_Allreduce(MPI_IN_PLACE, N_chunk, swift_type_count, MPI_LONG_LONG_INT,
+                MPI_MIN, comm);
+
   /* List what fields to write.
    * Note that we want to want to write a 0-size dataset for some species
    * in case future snapshots will contain them (e.g. star formation) */
@@ -1637,9 +2112,9 @@ void write_output_parallel(struct engine* e,
 
   /* Rank 0 prepares the file */
   if (mpi_rank == 0)
-    prepare_file(e, fileName, xmfFileName, N_total, to_write, numFields,
-                 current_selection_name, internal_units, snapshot_units, fof,
-                 subsample_any, subsample_fraction);
+    prepare_file(e, fileName, xmfFileName, N_total, N_chunk, to_write,
+                 numFields, current_selection_name, internal_units,
+                 snapshot_units, fof, subsample_any, subsample_fraction);
 
   MPI_Barrier(MPI_COMM_WORLD);
 
@@ -1671,7 +2146,8 @@ void write_output_parallel(struct engine* e,
                         e->s->nr_cells, e->s->width, mpi_rank,
                         /*distributed=*/0, subsample, subsample_fraction,
                         e->snapshot_output_count, N_total, offset, to_write,
-                        numFields, internal_units, snapshot_units);
+                        numFields, e->snapshot_cell_index_depth,
+                        internal_units, snapshot_units);
 
   /* Close everything */
   if (mpi_rank == 0) {
@@ -32,8 +32,13 @@
 #include "part.h"
 
 struct engine;
+struct partition;
+struct swift_params;
 struct unit_system;
 
+size_t read_ic_parallel_route_bytes(struct swift_params* params,
+                                    const struct partition* initial_partition);
+
 void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
                       double dim[3], struct part** parts, struct gpart** gparts,
                       struct sink** sinks, struct spart** sparts,
@@ -47,7 +52,9 @@ void read_ic_parallel(char* fileName, const struct unit_system* internal_units,
                       const int cleanup_sqrt_a, const double h, const double a,
                       const int mpi_rank, const int mpi_size, MPI_Comm comm,
                       MPI_Info info, const int nr_threads, const int dry_run,
-                      const int remap_ids, struct ic_info* ics_metadata);
+                      const int remap_ids, const int route_grid[3],
+                      const size_t route_batch_bytes,
+                      struct ic_info* ics_metadata);
 
 void write_output_parallel(struct engine* e,
                            const struct unit_system* internal_units,
@@ -22,12 +22,68 @@
 #include "align.h"
 #include "error.h"
 #include "memuse.h"
+#include "minmax.h"
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/*! Source of the generation numbers of the buffers */
+static long long particle_buffer_generation = 0;
+
+/*! The block cache of a thread for one #particle_buffer */
+struct particle_buffer_cache_entry {
+
+  /*! The buffer (NULL if this entry is unused) */
+  const struct particle_buffer *buffer;
+
+  /*! Generation of the buffer when the block was taken */
+  long long generation;
+
+  /*! The block this thread is currently filling */
+  struct particle_buffer_block *block;
+
+  /*! Number of elements of the next block this thread allocates */
+  size_t next_capacity;
+};
+
+/*! The block caches of a thread for all the buffers it appended to */
+struct particle_buffer_thread_cache {
+
+  /*! Open-addressing table of caches (size is a power of two) */
+  struct particle_buffer_cache_entry *entries;
+  size_t size;
+  size_t count;
+};
+
+/*! Key giving each thread its #particle_buffer_thread_cache */
+static pthread_key_t particle_buffer_cache_key;
+static pthread_once_t particle_buffer_cache_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Free the block caches of a thread when it exits.
+ *
+ * @param data The #particle_buffer_thread_cache
+ */
+static void particle_buffer_cache_destroy(void *data) {
+
+  struct particle_buffer_thread_cache *cache =
+      (struct particle_buffer_thread_cache *)data;
+  free(cache->entries);
+  free(cache);
+}
+
+/**
+ * @brief Create the key of the per-thread block caches.
+ */
+static void particle_buffer_cache_create_key(void) {
+  if (pthread_key_create(&particle_buffer_cache_key,
+                         particle_buffer_cache_destroy) != 0)
+    error("Failed to create the particle buffer cache key.");
+}
+
 /**
  * @brief Initialize a particle buffer.
  *
@@ -51,8 +107,11 @@ void particle_buffer_init(struct particle_buffer *buffer, size_t element_size,
   buffer->element_size = element_size;
   buffer->elements_per_block = elements_per_block;
   buffer->first_block = NULL;
-  buffer->last_block = NULL;
-  lock_init(&buffer->lock);
+
+  /* Invalidate the blocks cached by the threads for a previous buffer
+   * stored at the same address */
+  buffer->generation =
+      __atomic_add_fetch(&particle_buffer_generation, 1, __ATOMIC_SEQ_CST);
 
   int len = snprintf(buffer->name, PARTICLE_BUFFER_NAME_LENGTH, "%s", name);
   if (len >= PARTICLE_BUFFER_NAME_LENGTH || len < 0)
@@ -77,9 +136,8 @@ void particle_buffer_free(struct particle_buffer *buffer) {
     block = next;
   }
   buffer->first_block = NULL;
-  buffer->last_block = NULL;
-  if (lock_destroy(&buffer->lock) != 0)
-    error("Failed to destroy lock on particle buffer");
+  buffer->generation =
+      __atomic_add_fetch(&particle_buffer_generation, 1, __ATOMIC_SEQ_CST);
 }
 
 /**
@@ -104,14 +162,12 @@ void particle_buffer_empty(struct particle_buffer *buffer) {
  * @brief Allocate a new particle buffer block
  *
  * @param buffer The #particle_buffer
- * @param previous_block The previous final block in the linked list
+ * @param capacity The number of elements the block can hold
  */
 static struct particle_buffer_block *allocate_block(
-    struct particle_buffer *buffer,
-    struct particle_buffer_block *previous_block) {
+    struct particle_buffer *buffer, const size_t capacity) {
 
   const size_t element_size = buffer->element_size;
-  const size_t elements_per_block = buffer->elements_per_block;
 
   /* Allocate the struct */
   struct particle_buffer_block *block = (struct particle_buffer_block *)malloc(
@@ -122,20 +178,90 @@ static struct particle_buffer_block *allocate_block(
   /* Allocate data buffer */
   char *data;
   if (swift_memalign(buffer->name, (void **)&data, SWIFT_STRUCT_ALIGNMENT,
-                     element_size * elements_per_block) != 0) {
+                     element_size * capacity) != 0) {
     error("Failed to allocate particle buffer data block: %s", buffer->name);
   }
 
   /* Initalise the struct */
   block->data = data;
   block->num_elements = 0;
+  block->capacity = capacity;
   block->next = NULL;
 
-  if (previous_block) previous_block->next = block;
-
   return block;
 }
 
+/**
+ * @brief Return the block cache of the calling thread for a particle buffer.
+ *
+ * The cache is created on first use. A cache left over from a buffer which
+ * was emptied or freed since is reset.
+ *
+ * @param buffer The #particle_buffer
+ */
+static struct particle_buffer_cache_entry *get_cache_entry(
+    const struct particle_buffer *buffer) {
+
+  pthread_once(&particle_buffer_cache_once, particle_buffer_cache_create_key);
+
+  struct particle_buffer_thread_cache *cache =
+      (struct particle_buffer_thread_cache *)pthread_getspecific(
+          particle_buffer_cache_key);
+
+  /* First time this thread appends to a buffer? */
+  if (cache == NULL) {
+    cache = (struct particle_buffer_thread_cache *)malloc(
+        sizeof(struct particle_buffer_thread_cache));
+    if (cache == NULL) error("Failed to allocate particle buffer cache.");
+    cache->size = 16;
+    cache->count = 0;
+    cache->entries = (struct particle_buffer_cache_entry *)calloc(
+        cache->size, sizeof(struct particle_buffer_cache_entry));
+    if (cache->entries == NULL)
+      error("Failed to allocate particle buffer cache.");
+    pthread_setspecific(particle_buffer_cache_key, cache);
+  }
+
+  /* Keep the table at most half full, re-inserting the existing entries */
+  if (2 * (cache->count + 1) > cache->size) {
+    struct particle_buffer_cache_entry *old_entries = cache->entries;
+    const size_t old_size = cache->size;
+    cache->size *= 2;
+    cache->entries = (struct particle_buffer_cache_entry *)calloc(
+        cache->size, sizeof(struct particle_buffer_cache_entry));
+    if (cache->entries == NULL)
+      error("Failed to allocate particle buffer cache.");
+    for (size_t i = 0; i < old_size; i++) {
+      if (old_entries[i].buffer == NULL) continue;
+      size_t k = (((uintptr_t)old_entries[i].buffer) >> 4) & (cache->size - 1);
+      while (cache->entries[k].buffer != NULL) k = (k + 1) & (cache->size - 1);
+      cache->entries[k] = old_entries[i];
+    }
+    free(old_entries);
+  }
+
+  /* Look for this buffer */
+  size_t k = (((uintptr_t)buffer) >> 4) & (cache->size - 1);
+  while (cache->entries[k].buffer != NULL && cache->entries[k].buffer != buffer)
+    k = (k + 1) & (cache->size - 1);
+  struct particle_buffer_cache_entry *entry = &cache->entries[k];
+
+  if (entry->buffer == NULL) {
+    entry->buffer = buffer;
+    entry->generation = -1;
+    cache->count++;
+  }
+
+  /* Start again if the buffer was emptied since we last used it */
+  if (entry->generation != buffer->generation) {
+    entry->generation = buffer->generation;
+    entry->block = NULL;
+    entry->next_capacity = max(buffer->elements_per_block / 16, (size_t)1);
+  }
+
+  return entry;
+}
+
 /**
  * @brief Append an element to a particle buffer.
  *
@@ -146,59 +272,69 @@ static struct particle_buffer_block *allocate_block(
  *
  */
 void particle_buffer_append(struct particle_buffer *buffer, void *data) {
+  particle_buffer_append_n(buffer, data, 1);
+}
+
+/**
+ * @brief Append several elements to a particle buffer.
+ *
+ * May be called from multiple threads simultaneously. Each thread fills its
+ * own block, found through a per-thread cache, such that no atomic
+ * operation is needed until the block is full. The blocks are allocated
+ * (and first touched) by the thread filling them, so they are local to
+ * its NUMA domain. A new block is handed over to the buffer by pushing it at
+ * the start of the linked list with a compare-and-swap.
+ *
+ * The first block a thread takes is 1/16th of the block size of the buffer
+ * and the following ones double in size up to the full block size. This
+ * limits the memory wasted in the partially filled blocks of threads which
+ * only append a few elements. Elements from the same batch are contiguous
+ * within each block. The order of the blocks is not specified.
+ *
+ * @param buffer The #particle_buffer
+ * @param data The elements to append
+ * @param n The number of elements to append
+ *
+ */
+void particle_buffer_append_n(struct particle_buffer *buffer, void *data,
+                              size_t n) {
 
   const size_t element_size = buffer->element_size;
-  const size_t elements_per_block = buffer->elements_per_block;
+  struct particle_buffer_cache_entry *entry = get_cache_entry(buffer);
+  const char *src = (const char *)data;
 
-  while (1) {
-
-    /* Find the current block (atomic because last_block may be modified by
-     * other threads) */
-    struct particle_buffer_block *block =
-        __atomic_load_n(&buffer->last_block, __ATOMIC_SEQ_CST);
-
-    /* It may be that no blocks exist yet */
-    if (!block) {
-      lock_lock(&buffer->lock);
-      /* Check no-one else allocated the first block before we got the lock */
-      if (!buffer->last_block) {
-        block = allocate_block(buffer, NULL);
-        buffer->first_block = block;
-        __atomic_thread_fence(__ATOMIC_SEQ_CST);
-        /* After this store other threads will write to the new block,
-           so all initialization must complete before this. */
-        __atomic_store_n(&buffer->last_block, block, __ATOMIC_SEQ_CST);
-      }
-      if (lock_unlock(&buffer->lock) != 0)
-        error("Failed to unlock particle buffer");
-      /* Now try again */
-      continue;
-    }
+  while (n > 0) {
 
-    /* Find next available index in current block */
-    size_t index =
-        __atomic_fetch_add(&block->num_elements, 1, __ATOMIC_SEQ_CST);
-
-    if (index < elements_per_block) {
-      /* We reserved a valid index, so copy the data */
-      memcpy(block->data + index * element_size, data, element_size);
-      return;
-    } else {
-      /* No space left, so we need to allocate a new block */
-      lock_lock(&buffer->lock);
-      /* Check no-one else already did it before we got the lock */
-      if (!block->next) {
-        /* Allocate and initialize the new block */
-        struct particle_buffer_block *new_block = allocate_block(buffer, block);
-        __atomic_thread_fence(__ATOMIC_SEQ_CST);
-        /* After this store other threads will write to the new block,
-           so all initialization must complete before this. */
-        __atomic_store_n(&buffer->last_block, new_block, __ATOMIC_SEQ_CST);
-      }
-      if (lock_unlock(&buffer->lock) != 0)
-        error("Failed to unlock particle buffer");
-      /* Now we have space, will try again */
+    struct particle_buffer_block *block = entry->block;
+
+    /* Take a new block if we have none or it is full */
+    if (block == NULL || block->num_elements == block->capacity) {
+
+      block = allocate_block(buffer, entry->next_capacity);
+      entry->block = block;
+      entry->next_capacity =
+          min(2 * entry->next_capacity, buffer->elements_per_block);
+
+      /* Hand it over to the buffer. The block must be fully initialised
+       * before other threads can see it, which the compare-and-swap
+       * guarantees. */
+      struct particle_buffer_block *first =
+          __atomic_load_n(&buffer->first_block, __ATOMIC_SEQ_CST);
+      do {
+        block->next = first;
+      } while (!__atomic_compare_exchange_n(&buffer->first_block, &first,
+                                            block, /*weak=*/0,
+                                            __ATOMIC_SEQ_CST,
+                                            __ATOMIC_SEQ_CST));
     }
+
+    /* Nobody else writes to this block, so just copy the data */
+    const size_t count = min(n, block->capacity - block->num_elements);
+    memcpy(block->data + block->num_elements * element_size, src,
+           count * element_size);
+    block->num_elements += count;
+    src += count * element_size;
+    n -= count;
   }
 }
 
@@ -224,14 +360,106 @@ void particle_buffer_iterate(struct particle_buffer *buffer,
   if (*block) {
     *data = (*block)->data;
     *num_elements = (*block)->num_elements;
-    if (*num_elements > buffer->elements_per_block)
-      *num_elements = buffer->elements_per_block;
   } else {
     *data = NULL;
     *num_elements = 0;
   }
 }
 
+/*! Information passed to particle_buffer_mapper() for each block */
+struct particle_buffer_block_info {
+
+  /*! The block to process */
+  struct particle_buffer_block *block;
+
+  /*! Index of the first element of the block in the buffer */
+  size_t offset;
+};
+
+/*! Information passed to particle_buffer_mapper() for all the blocks */
+struct particle_buffer_mapper_data {
+
+  /*! The function to call on each block */
+  particle_buffer_map_function map_function;
+
+  /*! The user data to pass on to map_function */
+  void *extra_data;
+};
+
+/**
+ * @brief Threadpool mapper calling the user function on buffer blocks.
+ *
+ * @param map_data Pointer to an array of #particle_buffer_block_info
+ * @param num_elements Number of blocks in the array
+ * @param extra_data Pointer to a #particle_buffer_mapper_data
+ */
+static void particle_buffer_mapper(void *map_data, int num_elements,
+                                   void *extra_data) {
+
+  const struct particle_buffer_block_info *info =
+      (const struct particle_buffer_block_info *)map_data;
+  const struct particle_buffer_mapper_data *data =
+      (const struct particle_buffer_mapper_data *)extra_data;
+
+  for (int i = 0; i < num_elements; i++) {
+    struct particle_buffer_block *block = info[i].block;
+    if (block->num_elements > 0)
+      data->map_function(block->data, block->num_elements, info[i].offset,
+                         data->extra_data);
+  }
+}
+
+/**
+ * @brief Process the blocks of a particle buffer in parallel.
+ *
+ * The function is called once for each non-empty block, with the index of
+ * the first element of the block in the order used by
+ * particle_buffer_iterate(). This can be used e.g. to copy the elements to
+ * a contiguous array. Must not be called while elements are being appended.
+ *
+ * @param buffer The #particle_buffer
+ * @param tp The #threadpool to use
+ * @param map_function The function to call on each block
+ * @param extra_data Pointer passed on to map_function
+ */
+void particle_buffer_threadpool_map(struct particle_buffer *buffer,
+                                    struct threadpool *tp,
+                                    particle_buffer_map_function map_function,
+                                    void *extra_data) {
+
+  /* Count the blocks */
+  int nr_blocks = 0;
+  for (struct particle_buffer_block *block = buffer->first_block; block;
+       block = block->next)
+    nr_blocks++;
+  if (nr_blocks == 0) return;
+
+  /* Find the offset of each block */
+  struct particle_buffer_block_info *info =
+      (struct particle_buffer_block_info *)malloc(
+          nr_blocks * sizeof(struct particle_buffer_block_info));
+  if (!info) error("Failed to allocate block list for: %s", buffer->name);
+  size_t offset = 0;
+  int i = 0;
+  for (struct particle_buffer_block *block = buffer->first_block; block;
+       block = block->next) {
+    info[i].block = block;
+    info[i].offset = offset;
+    offset += block->num_elements;
+    i++;
+  }
+
+  /* Process the blocks */
+  struct particle_buffer_mapper_data data;
+  data.map_function = map_function;
+  data.extra_data = extra_data;
+  threadpool_map(tp, particle_buffer_mapper, info, nr_blocks,
+                 sizeof(struct particle_buffer_block_info), /*chunk=*/1,
+                 &data);
+
+  free(info);
+}
+
 /**
  * @brief Return number of elements in particle buffer.
  *
@@ -243,13 +471,7 @@ size_t particle_buffer_num_elements(struct particle_buffer *buffer) {
   size_t num_elements = 0;
   struct particle_buffer_block *block = buffer->first_block;
   while (block) {
-    if (block->num_elements < buffer->elements_per_block) {
-      /* Non-full block, so block->num_elements is correct */
-      num_elements += block->num_elements;
-    } else {
-      /* Full block, so block->num_elements may be out of range */
-      num_elements += buffer->elements_per_block;
-    }
+    num_elements += block->num_elements;
     block = block->next;
   }
   return num_elements;
@@ -266,7 +488,7 @@ size_t particle_buffer_memory_use(struct particle_buffer *buffer) {
   size_t num_bytes = 0;
   struct particle_buffer_block *block = buffer->first_block;
   while (block) {
-    num_bytes += (buffer->elements_per_block * buffer->element_size);
+    num_bytes += (block->capacity * buffer->element_size);
     block = block->next;
   }
   return num_bytes;
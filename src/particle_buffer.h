@@ -17,7 +17,6 @@
  *
  ******************************************************************************/
 
-#include "lock.h"
 #include "threadpool.h"
 
 #ifndef SWIFT_PARTICLE_BUFFER_H
@@ -27,6 +26,7 @@
 
 struct particle_buffer_block {
   size_t num_elements;
+  size_t capacity;
   char *data;
   struct particle_buffer_block *next;
 };
@@ -35,11 +35,22 @@ struct particle_buffer {
   size_t element_size;
   size_t elements_per_block;
   struct particle_buffer_block *first_block;
-  struct particle_buffer_block *last_block;
-  swift_lock_type lock;
+  long long generation;
   char name[PARTICLE_BUFFER_NAME_LENGTH];
 };
 
+/**
+ * @brief Function called on each block of a #particle_buffer by
+ * particle_buffer_threadpool_map().
+ *
+ * @param data Pointer to the first element of the block
+ * @param num_elements Number of elements in the block
+ * @param offset Index of the first element of the block in the buffer
+ * @param extra_data Pointer to user data
+ */
+typedef void (*particle_buffer_map_function)(void *data, size_t num_elements,
+                                             size_t offset, void *extra_data);
+
 void particle_buffer_init(struct particle_buffer *buffer, size_t element_size,
                           size_t elements_per_block, char *name);
 
@@ -49,10 +60,18 @@ void particle_buffer_empty(struct particle_buffer *buffer);
 
 void particle_buffer_append(struct particle_buffer *buffer, void *data);
 
+void particle_buffer_append_n(struct particle_buffer *buffer, void *data,
+                              size_t n);
+
 void particle_buffer_iterate(struct particle_buffer *buffer,
                              struct particle_buffer_block **block,
                              size_t *num_elements, void **data);
 
+void particle_buffer_threadpool_map(struct particle_buffer *buffer,
+                                    struct threadpool *tp,
+                                    particle_buffer_map_function map_function,
+                                    void *extra_data);
+
 size_t particle_buffer_num_elements(struct particle_buffer *buffer);
 
 size_t particle_buffer_memory_use(struct particle_buffer *buffer);
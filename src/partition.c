@@ -1363,6 +1363,7 @@ struct weights_mapper_data {
   int nr_cells;
   int use_ticks;
   struct cell *cells;
+  const struct scheduler *sched;
 };
 
 #ifdef SWIFT_DEBUG_CHECKS
@@ -1394,6 +1395,7 @@ void partition_gather_weights(void *map_data, int num_elements,
   int timebins = mydata->timebins;
   int vweights = mydata->vweights;
   int use_ticks = mydata->use_ticks;
+  const struct scheduler *sched = mydata->sched;
 
   struct cell *cells = mydata->cells;
 
@@ -1406,10 +1408,12 @@ void partition_gather_weights(void *map_data, int num_elements,
         t->type == task_type_csds || t->implicit || t->ci == NULL)
       continue;
 
-    /* Get weight for this task. Either based on fixed costs or task timings. */
+    /* Get weight for this task: task timings, cost model or fixed costs. */
     double w = 0.0;
     if (use_ticks) {
       w = (double)t->toc - (double)t->tic;
+    } else if (sched != NULL) {
+      w = scheduler_task_cost(sched, t);
     } else {
       w = repartition_costs[t->type][t->subtype];
     }
@@ -1532,6 +1536,153 @@ void partition_gather_weights(void *map_data, int num_elements,
   }
 }
 
+/* qsort support. */
+struct migrationval {
+  int index;
+  double ratio;
+};
+static int migrationvalcmp(const void *p1, const void *p2) {
+  const struct migrationval *mv1 = (const struct migrationval *)p1;
+  const struct migrationval *mv2 = (const struct migrationval *)p2;
+  if (mv1->ratio < mv2->ratio) return 1;
+  if (mv1->ratio > mv2->ratio) return -1;
+  return mv1->index - mv2->index;
+}
+
+/**
+ * @brief Trade the load imbalance of a new partition against the volume of
+ *        particle data it will move between the ranks.
+ *
+ * All the particles of cells that change rank need to be exchanged by the
+ * following engine_redistribute(), so a partition that only marginally
+ * improves the balance can cost a lot more than it gains. We estimate the
+ * migration volume from the particle memory per cell (see accumulate_sizes())
+ * and greedily return moved cells to their current rank, starting with the
+ * cells that save most data per unit of added work, as long as the load of
+ * any rank stays within (1 + migration_tolerance) of the most loaded rank of
+ * the new partition. Ranks always keep at least one cell.
+ *
+ * The decision is made on rank 0 and broadcast, so all ranks end up with
+ * the same cell list.
+ *
+ * @param repartition the partition struct of the local engine, the
+ *        celllist is updated.
+ * @param nodeID our nodeID.
+ * @param nr_nodes the number of nodes.
+ * @param s the space of cells holding our local particles.
+ * @param weights_v the work per cell used for the partition, NULL to use the
+ *        particle memory as the work.
+ * @param sizes the particle memory per cell, if already known, otherwise
+ *        NULL and this will be calculated.
+ */
+static void repart_limit_migration(struct repartition *repartition,
+                                   int nodeID, int nr_nodes, struct space *s,
+                                   double *weights_v, double *sizes) {
+
+  const ticks tic = getticks();
+  const int nr_cells = s->nr_cells;
+  int *celllist = repartition->celllist;
+
+  /* Particle memory per cell, this is the migration cost. */
+  double *bytes = sizes;
+  if (bytes == NULL) {
+    if ((bytes = (double *)malloc(sizeof(double) * nr_cells)) == NULL)
+      error("Failed to allocate cell sizes buffer.");
+    accumulate_sizes(s, s->e->verbose, bytes);
+  }
+  const double *work = (weights_v != NULL) ? weights_v : bytes;
+
+  if (nodeID == 0) {
+
+    double *load = NULL;
+    double *oldload = NULL;
+    int *ncells = NULL;
+    if ((load = (double *)calloc(nr_nodes, sizeof(double))) == NULL ||
+        (oldload = (double *)calloc(nr_nodes, sizeof(double))) == NULL ||
+        (ncells = (int *)calloc(nr_nodes, sizeof(int))) == NULL)
+      error("Failed to allocate per-node load buffers.");
+
+    /* Loads of the old and new partitions and the cells that will move. */
+    struct migrationval *moved = NULL;
+    if ((moved = (struct migrationval *)malloc(sizeof(struct migrationval) *
+                                               nr_cells)) == NULL)
+      error("Failed to allocate moved cells buffer.");
+    int nmoved = 0;
+    double total_bytes = 0.0;
+    double total_work = 0.0;
+    double moved_bytes = 0.0;
+    for (int k = 0; k < nr_cells; k++) {
+      const int oldnode = s->cells_top[k].nodeID;
+      load[celllist[k]] += work[k];
+      oldload[oldnode] += work[k];
+      ncells[celllist[k]]++;
+      total_bytes += bytes[k];
+      total_work += work[k];
+      if (celllist[k] != oldnode) {
+        moved_bytes += bytes[k];
+        moved[nmoved].index = k;
+        moved[nmoved].ratio = bytes[k] / max(work[k], 1.0);
+        nmoved++;
+      }
+    }
+
+    double maxload = 0.0;
+    double oldmaxload = 0.0;
+    for (int i = 0; i < nr_nodes; i++) {
+      maxload = max(maxload, load[i]);
+      oldmaxload = max(oldmaxload, oldload[i]);
+    }
+    const double meanload = total_work / nr_nodes;
+    const double newmaxload = maxload;
+    const double limit = (1.0 + repartition->migration_tolerance) * maxload;
+
+    /* Return cells to their old ranks, most data per unit work first. */
+    qsort(moved, nmoved, sizeof(struct migrationval), migrationvalcmp);
+    double kept_bytes = 0.0;
+    int nkept = 0;
+    for (int k = 0; k < nmoved; k++) {
+      const int cid = moved[k].index;
+      const int oldnode = s->cells_top[cid].nodeID;
+      const int newnode = celllist[cid];
+      if (ncells[newnode] > 1 && load[oldnode] + work[cid] <= limit) {
+        load[oldnode] += work[cid];
+        load[newnode] -= work[cid];
+        ncells[oldnode]++;
+        ncells[newnode]--;
+        celllist[cid] = oldnode;
+        maxload = max(maxload, load[oldnode]);
+        kept_bytes += bytes[cid];
+        nkept++;
+      }
+    }
+
+    /* Report the trade-off we made. */
+    if (meanload > 0.0 && total_bytes > 0.0)
+      message(
+          "migration limit: kept %d of %d moved cells, moving %.2f%% of "
+          "particle data instead of %.2f%%, imbalance %.3f (old %.3f, "
+          "unlimited %.3f)",
+          nkept, nmoved, 100.0 * (moved_bytes - kept_bytes) / total_bytes,
+          100.0 * moved_bytes / total_bytes, maxload / meanload,
+          oldmaxload / meanload, newmaxload / meanload);
+
+    free(moved);
+    free(ncells);
+    free(oldload);
+    free(load);
+  }
+
+  /* And everyone gets a copy. */
+  int res = MPI_Bcast(celllist, nr_cells, MPI_INT, 0, MPI_COMM_WORLD);
+  if (res != MPI_SUCCESS) mpi_error(res, "Failed to broadcast new celllist");
+
+  if (sizes == NULL) free(bytes);
+
+  if (s->e->verbose)
+    message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
+            clocks_getunit());
+}
+
 /**
  * @brief Repartition the cells amongst the nodes using weights of
  *        various kinds.
@@ -1594,6 +1745,14 @@ static void repart_edge_metis(int vweights, int eweights, int timebins,
   weights_data.weights_v = weights_v;
   weights_data.use_ticks = repartition->use_ticks;
 
+  /* Without timings prefer the measured cost model, if it has any fits, to
+   * the fixed costs. */
+  const struct scheduler *sched = &s->e->sched;
+  if (sched->cost_model != NULL && sched->cost_model->fitted)
+    weights_data.sched = sched;
+  else
+    weights_data.sched = NULL;
+
   ticks tic = getticks();
 
   threadpool_map(&s->e->threadpool, partition_gather_weights, tasks, nr_tasks,
@@ -1744,6 +1903,11 @@ static void repart_edge_metis(int vweights, int eweights, int timebins,
           " partition, load balance will not be optimal");
     for (int k = 0; k < nr_cells; k++)
       repartition->celllist[k] = cells[k].nodeID;
+
+  } else if (repartition->migration_tolerance > 0.f) {
+
+    /* Avoid moving particles when it only buys a small improvement. */
+    repart_limit_migration(repartition, nodeID, nr_nodes, s, weights_v, NULL);
   }
 
   /* And apply to our cells */
@@ -1841,6 +2005,11 @@ static void repart_memory_metis(struct repartition *repartition, int nodeID,
           " partition, load balance will not be optimal");
     for (int k = 0; k < s->nr_cells; k++)
       repartition->celllist[k] = s->cells_top[k].nodeID;
+
+  } else if (repartition->migration_tolerance > 0.f) {
+
+    /* Avoid moving particles when it only buys a small improvement. */
+    repart_limit_migration(repartition, nodeID, nr_nodes, s, weights, weights);
   }
 
   /* And apply to our cells */
@@ -2191,6 +2360,14 @@ void partition_init(struct partition *partition,
   repartition->itr =
       parser_get_opt_param_float(params, "DomainDecomposition:itr", 100.0f);
 
+  /* Imbalance we are prepared to accept to reduce the particle migration. */
+  repartition->migration_tolerance = parser_get_opt_param_float(
+      params, "DomainDecomposition:migration_tolerance", 0.0f);
+  if (repartition->migration_tolerance < 0.f)
+    error(
+        "Invalid DomainDecomposition:migration_tolerance, must be greater "
+        "than or equal to zero");
+
   /* Do we have fixed costs available? These can be used to force
    * repartitioning at any time. Not required if not repartitioning.*/
   repartition->use_fixed_costs = parser_get_opt_param_int(
@@ -2325,6 +2502,7 @@ static void check_weights(struct task *tasks, int nr_tasks,
   int timebins = mydata->timebins;
   int vweights = mydata->vweights;
   int use_ticks = mydata->use_ticks;
+  const struct scheduler *sched = mydata->sched;
 
   struct cell *cells = mydata->cells;
 
@@ -2353,10 +2531,12 @@ static void check_weights(struct task *tasks, int nr_tasks,
         t->type == task_type_csds || t->implicit || t->ci == NULL)
       continue;
 
-    /* Get weight for this task. Either based on fixed costs or task timings. */
+    /* Get weight for this task: task timings, cost model or fixed costs. */
     double w = 0.0;
     if (use_ticks) {
       w = (double)t->toc - (double)t->tic;
+    } else if (sched != NULL) {
+      w = scheduler_task_cost(sched, t);
     } else {
       w = repartition_costs[t->type][t->subtype];
     }
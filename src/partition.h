@@ -60,6 +60,10 @@ struct repartition {
   int usemetis;
   int adaptive;
 
+  /* Fractional increase of the most loaded rank accepted to reduce the
+   * particle migration, 0 to not limit the migration. */
+  float migration_tolerance;
+
   int use_fixed_costs;
   int use_ticks;
 
@@ -26,6 +26,9 @@
 
 #ifdef HAVE_FFTW
 #include <fftw3.h>
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+#include <fftw3-mpi.h>
+#endif
 #endif
 
 /* Standard headers */
@@ -38,6 +41,7 @@
 /* Local includes. */
 #include "cooling.h"
 #include "engine.h"
+#include "exchange_structs.h"
 #include "minmax.h"
 #include "neutrino.h"
 #include "random.h"
@@ -50,6 +54,7 @@
 #define power_data_default_grid_side_length 256
 #define power_data_default_fold_factor 4
 #define power_data_default_window_order 3
+#define power_data_default_distributed_grid 0
 
 #ifdef HAVE_FFTW
 
@@ -143,9 +148,9 @@ INLINE static const char* get_powtype_filename(const enum power_type type) {
  */
 struct shot_mapper_data {
   const struct cell* cells;
-  double tot12;
-  enum power_type type1;
-  enum power_type type2;
+  double* tot12;
+  const int* has_shot;
+  const struct power_spectrum_data* pow_data;
   const struct engine* e;
   struct neutrino_model* nu_model;
 };
@@ -183,6 +188,7 @@ struct pow_mapper_data {
   fftw_complex* powgridft;
   fftw_complex* powgridft2;
   int Ngrid;
+  int slice_offset;
   int windoworder;
   int* kbin;
   int* modecounts;
@@ -232,114 +238,132 @@ int should_collect_mass(const enum power_type type, const struct gpart* gp,
 }
 
 /**
- * @brief Calculates the necessary mass terms for shot noise.
+ * @brief Does a #gpart contribute to the grid of a given #power_type?
  *
- * @param c The #cell.
- * @param tot12 The shot noise contribution returned.
- * @param type1 The component type of field 1.
- * @param type2 The component type of field 2.
- * @param e The #engine.
+ * @param type The #power_type we want to assign to the grid.
+ * @param gp The #gpart.
+ * @param ti_current The current integer time.
  */
-void shotnoiseterms(const struct cell* c, double* tot12,
-                    const enum power_type type1, const enum power_type type2,
-                    const struct engine* e, struct neutrino_model* nu_model) {
+INLINE static int power_should_assign(const enum power_type type,
+                                      const struct gpart* gp,
+                                      const integertime_t ti_current) {
 
-  const int gcount = c->grav.count;
-  const struct gpart* gparts = c->grav.parts;
-
-  /* Handle on the other particle types */
-  const struct part* parts = e->s->parts;
-  const struct xpart* xparts = e->s->xparts;
+  /* Skip invalid particles */
+  if (gp->time_bin == time_bin_inhibited) return 0;
 
-  /* Handle on the physics modules */
-  const struct cosmology* cosmo = e->cosmology;
-  const struct hydro_props* hydro_props = e->hydro_properties;
-  const struct unit_system* us = e->internal_units;
-  const struct phys_const* phys_const = e->physical_constants;
-  const struct cooling_function_data* cool_func = e->cooling_func;
+  /* Only the gas carries an electron pressure */
+  if (type == pow_type_pressure) return gp->type == swift_type_gas;
 
-  /* Local accumulator for this cell */
-  double local_tot12 = 0.;
+  /* We are collecting a mass of some kind */
+  return should_collect_mass(type, gp, ti_current);
+}
 
-  /* Calculate the value each particle adds to the grids */
-  for (int i = 0; i < gcount; ++i) {
+/**
+ * @brief Quantity a #gpart assigns to the grid of a given #power_type.
+ *
+ * Only valid for the particles for which power_should_assign() is true.
+ *
+ * @param type The #power_type we want to assign to the grid.
+ * @param gp The #gpart.
+ * @param e The #engine.
+ * @param nu_model The neutrino constants (for the delta-f weighting).
+ */
+INLINE static double power_get_quantity(
+    const enum power_type type, const struct gpart* gp, const struct engine* e,
+    const struct neutrino_model* nu_model) {
+
+  /* Special case first for the electron pressure */
+  if (type == pow_type_pressure) {
+
+    const struct part* p = &e->s->parts[-gp->id_or_neg_offset];
+    const struct xpart* xp = &e->s->xparts[-gp->id_or_neg_offset];
+    return cooling_get_electron_pressure(
+        e->physical_constants, e->hydro_properties, e->internal_units,
+        e->cosmology, e->cooling_func, p, xp);
+  }
 
-    /* Skip invalid particles */
-    if (gparts[i].time_bin == time_bin_inhibited) continue;
+  /* Compute weight (for neutrino delta-f weighting) */
+  double weight = 1.0;
+  if (gp->type == swift_type_neutrino)
+    gpart_neutrino_weight_mesh_only(gp, nu_model, &weight);
 
-    double quantity1;
+  return gp->mass * weight;
+}
 
-    /* Special case first for the electron pressure */
-    if (type1 == pow_type_pressure) {
+/**
+ * @brief Does the spectrum of two component types have a shot noise?
+ *
+ * Note that for cross-power, there is only shot noise for particles
+ * that occur in both fields.
+ *
+ * @param type1 The component type of field 1.
+ * @param type2 The component type of field 2.
+ */
+INLINE static int power_has_shot_noise(const enum power_type type1,
+                                       const enum power_type type2) {
 
-      /* Skip non-gas particles */
-      if (gparts[i].type != swift_type_gas) continue;
+  return type1 == pow_type_matter || type2 == pow_type_matter ||
+         type1 == type2 ||
+         (type1 == pow_type_gas && type2 == pow_type_pressure) ||
+         (type2 == pow_type_gas && type1 == pow_type_pressure);
+}
 
-      const struct part* p = &parts[-gparts[i].id_or_neg_offset];
-      const struct xpart* xp = &xparts[-gparts[i].id_or_neg_offset];
-      quantity1 = cooling_get_electron_pressure(phys_const, hydro_props, us,
-                                                cosmo, cool_func, p, xp);
-    } else {
+/**
+ * @brief Calculates the necessary mass terms for the shot noise of all the
+ * requested spectra.
+ *
+ * The quantity each particle assigns to each of the fields is computed once
+ * and then combined for all the spectra.
+ *
+ * @param c The #cell.
+ * @param tot12 The shot noise contributions returned (one per spectrum).
+ * @param cell_tot12 Scratch space for the contributions of this cell.
+ * @param data The #shot_mapper_data.
+ */
+void shotnoiseterms(const struct cell* c, double* tot12, double* cell_tot12,
+                    const struct shot_mapper_data* data) {
 
-      /* We are collecting a mass of some kind.
-       * We skip any particle not matching the PS type we want */
-      if (!should_collect_mass(type1, &gparts[i], e->ti_current)) continue;
+  const int gcount = c->grav.count;
+  const struct gpart* gparts = c->grav.parts;
+  const struct power_spectrum_data* pow_data = data->pow_data;
+  const int nr_fields = pow_data->nr_fields;
+  const int nr_spectra = pow_data->spectrumcount;
+  const struct engine* e = data->e;
 
-      /* Compute weight (for neutrino delta-f weighting) */
-      double weight1 = 1.0;
-      if (gparts[i].type == swift_type_neutrino)
-        gpart_neutrino_weight_mesh_only(&gparts[i], nu_model, &weight1);
+  /* Local accumulators for this cell */
+  for (int j = 0; j < nr_spectra; ++j) cell_tot12[j] = 0.;
 
-      /* And eventually... collect */
-      quantity1 = gparts[i].mass * weight1;
-    }
+  /* Calculate the value each particle adds to the grids */
+  for (int i = 0; i < gcount; ++i) {
 
-    /* Can we assign already? (i.e. this is an auto-spectrum) */
-    if (type1 == type2) {
+    /* Skip invalid particles */
+    if (gparts[i].time_bin == time_bin_inhibited) continue;
 
-      /* Now assign to the shot noise collection */
-      local_tot12 += quantity1 * quantity1;
+    /* Collect what this particle assigns to each field */
+    int in_field[pow_type_count];
+    double quantity[pow_type_count];
+    for (int f = 0; f < nr_fields; ++f) {
+      const enum power_type type = pow_data->field_types[f];
+      in_field[f] = power_should_assign(type, &gparts[i], e->ti_current);
+      if (in_field[f])
+        quantity[f] = power_get_quantity(type, &gparts[i], e, data->nu_model);
     }
 
-    /* This is a cross-spectrum */
-    else {
-
-      double quantity2;
-
-      /* Special case first for the electron pressure */
-      if (type2 == pow_type_pressure) {
-
-        /* Skip non-gas particles */
-        if (gparts[i].type != swift_type_gas) continue;
-
-        const struct part* p = &parts[-gparts[i].id_or_neg_offset];
-        const struct xpart* xp = &xparts[-gparts[i].id_or_neg_offset];
-        quantity2 = cooling_get_electron_pressure(phys_const, hydro_props, us,
-                                                  cosmo, cool_func, p, xp);
-      } else {
-
-        /* We are collecting a mass of some kind.
-         * We skip any particle not matching the PS type we want */
-        if (!should_collect_mass(type2, &gparts[i], e->ti_current)) continue;
-
-        /* Compute weight (for neutrino delta-f weighting) */
-        double weight2 = 1.0;
-        if (gparts[i].type == swift_type_neutrino)
-          gpart_neutrino_weight_mesh_only(&gparts[i], nu_model, &weight2);
-
-        /* And eventually... collect */
-        quantity2 = gparts[i].mass * weight2;
-      }
-
-      /* Now assign to the shot noise collection */
-      local_tot12 += quantity1 * quantity2;
+    /* Now assign to the shot noise collection of each spectrum */
+    for (int j = 0; j < nr_spectra; ++j) {
+      if (!data->has_shot[j]) continue;
+      const int f1 = pow_data->field_index[pow_data->types1[j]];
+      const int f2 = pow_data->field_index[pow_data->types2[j]];
+      if (in_field[f1] && in_field[f2])
+        cell_tot12[j] += quantity[f1] * quantity[f2];
     }
 
   } /* Loop over particles */
 
-  /* Now that we are done with this cell, write back to the global accumulator
-   */
-  atomic_add_d(tot12, local_tot12);
+  /* Now that we are done with this cell, write back to the global
+   * accumulators */
+  for (int j = 0; j < nr_spectra; ++j)
+    if (data->has_shot[j]) atomic_add_d(&tot12[j], cell_tot12[j]);
 }
 
 /**
@@ -354,20 +378,25 @@ void shotnoise_mapper(void* map_data, int num, void* extra) {
   /* Unpack the shared information */
   struct shot_mapper_data* data = (struct shot_mapper_data*)extra;
   const struct cell* cells = data->cells;
-  const struct engine* e = data->e;
-  struct neutrino_model* nu_model = data->nu_model;
 
   /* Pointer to the chunk to be processed */
   int* local_cells = (int*)map_data;
 
+  /* Scratch space for the contributions of each cell */
+  double* cell_tot12 =
+      (double*)malloc(data->pow_data->spectrumcount * sizeof(double));
+  if (cell_tot12 == NULL) error("Failed to allocate the shot noise terms.");
+
   /* Loop over the elements assigned to this thread */
   for (int i = 0; i < num; ++i) {
     /* Pointer to local cell */
     const struct cell* c = &cells[local_cells[i]];
 
     /* Calculate the necessary mass terms */
-    shotnoiseterms(c, &data->tot12, data->type1, data->type2, e, nu_model);
+    shotnoiseterms(c, data->tot12, cell_tot12, data);
   }
+
+  free(cell_tot12);
 }
 
 __attribute__((always_inline)) INLINE static void TSC_set(
@@ -596,50 +625,14 @@ void cell_to_powgrid(const struct cell* c, double* rho, const int N,
   const int gcount = c->grav.count;
   const struct gpart* gparts = c->grav.parts;
 
-  /* Handle on the other particle types */
-  const struct part* parts = e->s->parts;
-  const struct xpart* xparts = e->s->xparts;
-
-  /* Handle on the physics modules */
-  const struct cosmology* cosmo = e->cosmology;
-  const struct hydro_props* hydro_props = e->hydro_properties;
-  const struct unit_system* us = e->internal_units;
-  const struct phys_const* phys_const = e->physical_constants;
-  const struct cooling_function_data* cool_func = e->cooling_func;
-
   /* Assign all the gpart of that cell to the mesh */
   for (int i = 0; i < gcount; ++i) {
 
-    /* Skip invalid particles */
-    if (gparts[i].time_bin == time_bin_inhibited) continue;
+    /* Skip the particles not matching the PS type we want */
+    if (!power_should_assign(type, &gparts[i], e->ti_current)) continue;
 
     /* Collect the quantity to assign to the mesh */
-    double quantity;
-
-    /* Special case first for the electron pressure */
-    if (type == pow_type_pressure) {
-
-      /* Skip non-gas particles */
-      if (gparts[i].type != swift_type_gas) continue;
-
-      const struct part* p = &parts[-gparts[i].id_or_neg_offset];
-      const struct xpart* xp = &xparts[-gparts[i].id_or_neg_offset];
-      quantity = cooling_get_electron_pressure(phys_const, hydro_props, us,
-                                               cosmo, cool_func, p, xp);
-    } else {
-
-      /* We are collecting a mass of some kind.
-       * We skip any particle not matching the PS type we want */
-      if (!should_collect_mass(type, &gparts[i], e->ti_current)) continue;
-
-      /* Compute weight (for neutrino delta-f weighting) */
-      double weight = 1.0;
-      if (gparts[i].type == swift_type_neutrino)
-        gpart_neutrino_weight_mesh_only(&gparts[i], nu_model, &weight);
-
-      /* And eventually... collect */
-      quantity = gparts[i].mass * weight;
-    }
+    const double quantity = power_get_quantity(type, &gparts[i], e, nu_model);
 
     /* Assign the quantity to the grid */
     switch (windoworder) {
@@ -727,11 +720,369 @@ void mass_to_contrast_mapper(void* map_data, int num, void* extra) {
   }
 }
 
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+
+/**
+ * @brief The contribution of a particle to a distributed power grid.
+ *
+ * These are sent to the ranks holding the slabs of the grid covered by the
+ * assignment window of the particle.
+ */
+struct power_grid_contribution {
+
+  /*! Folded position of the particle in units of the grid cells */
+  double x[3];
+
+  /*! Quantity to assign to the grid */
+  double value;
+};
+
+/**
+ * @brief Shared information about a slab-distributed grid to be used by all
+ * the threads in the pool.
+ */
+struct slab_mapper_data {
+  const struct cell* cells;
+  int N;
+  enum power_type type;
+  int windoworder;
+  double dim[3];
+  double fac;
+  const struct engine* e;
+  struct neutrino_model* nu_model;
+
+  /*! Rank holding each plane of the grid along the x-axis */
+  const int* slab_owner;
+
+  /*! Number of contributions to send to each rank */
+  size_t* nr_send;
+
+  /*! Next free element of #sendbuf for each rank (NULL when counting) */
+  size_t* send_offset;
+
+  /*! The contributions to send */
+  struct power_grid_contribution* sendbuf;
+
+  /*! Thickness of the local slab */
+  int local_n0;
+
+  /*! Position of the local slab along the x-axis */
+  int local_0_start;
+
+  /*! The local slab of the grid */
+  double* slab;
+};
+
+/**
+ * @brief Planes and weights of the mass assignment window along one axis.
+ *
+ * @param pos The position in units of the grid cells.
+ * @param windoworder The window to use for grid assignment.
+ * @param N The size of the grid along one axis.
+ * @param ind (return) The (wrapped) index of the planes.
+ * @param w (return) The weight of each plane.
+ * @return The number of planes.
+ */
+INLINE static int power_window_planes(const double pos, const int windoworder,
+                                      const int N, int ind[3], double w[3]) {
+
+  switch (windoworder) {
+    case 1: {
+      ind[0] = (int)(pos + 0.5) % N;
+      w[0] = 1.;
+      return 1;
+    }
+    case 2: {
+      const int i = (int)pos;
+      const double d = pos - i;
+      ind[0] = (i + N) % N;
+      ind[1] = (i + 1 + N) % N;
+      w[0] = 1. - d;
+      w[1] = d;
+      return 2;
+    }
+    case 3: {
+      const int i = (int)(pos + 0.5);
+      const double d = pos - i;
+      ind[0] = (i - 1 + N) % N;
+      ind[1] = (i + N) % N;
+      ind[2] = (i + 1 + N) % N;
+      w[0] = 0.5 * (0.5 - d) * (0.5 - d);
+      w[1] = 0.75 - d * d;
+      w[2] = 0.5 * (0.5 + d) * (0.5 + d);
+      return 3;
+    }
+    default:
+      error("Not implemented!");
+      return 0;
+  }
+}
+
+/**
+ * @brief Ranks holding the slabs covered by the assignment window of a
+ * particle.
+ *
+ * @param pos_x The x-coordinate of the particle in units of the grid cells.
+ * @param data The #slab_mapper_data.
+ * @param dest (return) The (distinct) ranks.
+ * @return The number of ranks.
+ */
+INLINE static int power_slab_destinations(const double pos_x,
+                                          const struct slab_mapper_data* data,
+                                          int dest[3]) {
+
+  int ind[3];
+  double w[3];
+  const int n = power_window_planes(pos_x, data->windoworder, data->N, ind, w);
+
+  int nr_dest = 0;
+  for (int a = 0; a < n; ++a) {
+    const int rank = data->slab_owner[ind[a]];
+    int found = 0;
+    for (int b = 0; b < nr_dest; ++b)
+      if (dest[b] == rank) found = 1;
+    if (!found) dest[nr_dest++] = rank;
+  }
+  return nr_dest;
+}
+
+/**
+ * @brief Threadpool mapper function counting or collecting the contributions
+ * of the particles of a list of cells to each rank's slab.
+ *
+ * When the send offsets are NULL, only adds up the number of contributions
+ * to send to each rank. Otherwise, reserves room in the send buffer for the
+ * contributions of these cells and fills it.
+ *
+ * @param map_data A chunk of the list of local cells.
+ * @param num The number of cells in the chunk.
+ * @param extra The #slab_mapper_data.
+ */
+void cell_to_slab_contributions_mapper(void* map_data, int num, void* extra) {
+
+  /* Unpack the shared information */
+  struct slab_mapper_data* data = (struct slab_mapper_data*)extra;
+  const struct cell* cells = data->cells;
+  const struct engine* e = data->e;
+  const enum power_type type = data->type;
+  const double dim[3] = {data->dim[0], data->dim[1], data->dim[2]};
+  const double fac = data->fac;
+  const int nr_nodes = e->nr_nodes;
+
+  /* Pointer to the chunk to be processed */
+  const int* local_cells = (int*)map_data;
+
+  /* Count the contributions of these cells to each rank */
+  size_t* counts = (size_t*)calloc(nr_nodes, sizeof(size_t));
+  if (counts == NULL) error("Failed to allocate the contribution counts.");
+
+  for (int i = 0; i < num; ++i) {
+    const struct cell* c = &cells[local_cells[i]];
+    for (int k = 0; k < c->grav.count; ++k) {
+      const struct gpart* gp = &c->grav.parts[k];
+      if (!power_should_assign(type, gp, e->ti_current)) continue;
+
+      const double pos_x = box_wrap_multiple(gp->x[0], 0., dim[0]) * fac;
+      int dest[3];
+      const int nr_dest = power_slab_destinations(pos_x, data, dest);
+      for (int d = 0; d < nr_dest; ++d) counts[dest[d]]++;
+    }
+  }
+
+  /* Only counting? */
+  if (data->send_offset == NULL) {
+    for (int r = 0; r < nr_nodes; ++r)
+      if (counts[r] > 0) atomic_add(&data->nr_send[r], counts[r]);
+    free(counts);
+    return;
+  }
+
+  /* Reserve some room in the send buffer */
+  for (int r = 0; r < nr_nodes; ++r)
+    if (counts[r] > 0) counts[r] = atomic_add(&data->send_offset[r], counts[r]);
+
+  /* And fill it */
+  for (int i = 0; i < num; ++i) {
+    const struct cell* c = &cells[local_cells[i]];
+    for (int k = 0; k < c->grav.count; ++k) {
+      const struct gpart* gp = &c->grav.parts[k];
+      if (!power_should_assign(type, gp, e->ti_current)) continue;
+
+      struct power_grid_contribution contrib;
+      contrib.x[0] = box_wrap_multiple(gp->x[0], 0., dim[0]) * fac;
+      contrib.x[1] = box_wrap_multiple(gp->x[1], 0., dim[1]) * fac;
+      contrib.x[2] = box_wrap_multiple(gp->x[2], 0., dim[2]) * fac;
+      contrib.value = power_get_quantity(type, gp, e, data->nu_model);
+
+      int dest[3];
+      const int nr_dest = power_slab_destinations(contrib.x[0], data, dest);
+      for (int d = 0; d < nr_dest; ++d)
+        data->sendbuf[counts[dest[d]]++] = contrib;
+    }
+  }
+
+  free(counts);
+}
+
+/**
+ * @brief Threadpool mapper function assigning the contributions received
+ * from all the ranks to the local slab.
+ *
+ * Only the planes of the assignment windows that are part of the local slab
+ * are filled; the other ones are filled by the other ranks.
+ *
+ * @param map_data A chunk of the array of #power_grid_contribution.
+ * @param num The number of contributions in the chunk.
+ * @param extra The #slab_mapper_data.
+ */
+void slab_contributions_to_grid_mapper(void* map_data, int num, void* extra) {
+
+  /* Unpack the shared information */
+  const struct slab_mapper_data* data = (struct slab_mapper_data*)extra;
+  const int N = data->N;
+  const int windoworder = data->windoworder;
+  const int local_n0 = data->local_n0;
+  const int local_0_start = data->local_0_start;
+  double* slab = data->slab;
+
+  const struct power_grid_contribution* contribs =
+      (struct power_grid_contribution*)map_data;
+
+  for (int i = 0; i < num; ++i) {
+
+    int ix[3], iy[3], iz[3];
+    double wx[3], wy[3], wz[3];
+    const int nx =
+        power_window_planes(contribs[i].x[0], windoworder, N, ix, wx);
+    const int ny =
+        power_window_planes(contribs[i].x[1], windoworder, N, iy, wy);
+    const int nz =
+        power_window_planes(contribs[i].x[2], windoworder, N, iz, wz);
+    const double value = contribs[i].value;
+
+    for (int a = 0; a < nx; ++a) {
+
+      /* Is this plane in our slab? */
+      const int xl = ix[a] - local_0_start;
+      if (xl < 0 || xl >= local_n0) continue;
+
+      for (int b = 0; b < ny; ++b) {
+        for (int c = 0; c < nz; ++c) {
+          const size_t index = ((size_t)xl * N + iy[b]) * (N + 2) + iz[c];
+          atomic_add_d(&slab[index], value * wx[a] * wy[b] * wz[c]);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Assign the local particles to a slab-distributed grid.
+ *
+ * Every rank sends the contributions of its particles to the ranks holding
+ * the planes covered by their assignment window, then assigns the
+ * contributions it received to its own slab. The slab must have been zeroed.
+ *
+ * @param data The #slab_mapper_data describing the grid and the slab.
+ * @param local_cells The list of local top-level cells.
+ * @param nr_local_cells The number of local top-level cells.
+ * @param tp The #threadpool object used for parallelisation.
+ * @param verbose Are we talkative?
+ */
+static void power_assign_to_slab(struct slab_mapper_data* data,
+                                 const int* local_cells,
+                                 const int nr_local_cells,
+                                 struct threadpool* tp, const int verbose) {
+
+  const int nr_nodes = data->e->nr_nodes;
+  const ticks tic = getticks();
+
+  /* Count the contributions to send to each rank */
+  size_t* nr_send = (size_t*)calloc(nr_nodes, sizeof(size_t));
+  size_t* send_offset = (size_t*)malloc(nr_nodes * sizeof(size_t));
+  size_t* nr_recv = (size_t*)malloc(nr_nodes * sizeof(size_t));
+  if (nr_send == NULL || send_offset == NULL || nr_recv == NULL)
+    error("Failed to allocate the slab exchange counts.");
+
+  data->nr_send = nr_send;
+  data->send_offset = NULL;
+  data->sendbuf = NULL;
+  threadpool_map(tp, cell_to_slab_contributions_mapper, (void*)local_cells,
+                 nr_local_cells, sizeof(int), threadpool_auto_chunk_size, data);
+
+  size_t nr_send_tot = 0;
+  for (int r = 0; r < nr_nodes; ++r) {
+    send_offset[r] = nr_send_tot;
+    nr_send_tot += nr_send[r];
+  }
+
+  /* Collect them, sorted by destination */
+  struct power_grid_contribution* sendbuf = NULL;
+  if (swift_memalign("power_sendbuf", (void**)&sendbuf, SWIFT_CACHE_ALIGNMENT,
+                     nr_send_tot * sizeof(struct power_grid_contribution)) !=
+      0)
+    error("Failed to allocate the power grid send buffer.");
+
+  data->send_offset = send_offset;
+  data->sendbuf = sendbuf;
+  threadpool_map(tp, cell_to_slab_contributions_mapper, (void*)local_cells,
+                 nr_local_cells, sizeof(int), threadpool_auto_chunk_size, data);
+
+#ifdef SWIFT_DEBUG_CHECKS
+  size_t check = 0;
+  for (int r = 0; r < nr_nodes; ++r) {
+    check += nr_send[r];
+    if (send_offset[r] != check)
+      error("Inconsistent number of contributions sent to rank %d!", r);
+  }
+#endif
+
+  /* Exchange them */
+  MPI_Alltoall(nr_send, sizeof(size_t), MPI_BYTE, nr_recv, sizeof(size_t),
+               MPI_BYTE, MPI_COMM_WORLD);
+  size_t nr_recv_tot = 0;
+  for (int r = 0; r < nr_nodes; ++r) nr_recv_tot += nr_recv[r];
+
+  struct power_grid_contribution* recvbuf = NULL;
+  if (swift_memalign("power_recvbuf", (void**)&recvbuf, SWIFT_CACHE_ALIGNMENT,
+                     nr_recv_tot * sizeof(struct power_grid_contribution)) !=
+      0)
+    error("Failed to allocate the power grid receive buffer.");
+
+  exchange_structs(nr_send, sendbuf, nr_recv, recvbuf,
+                   sizeof(struct power_grid_contribution));
+  swift_free("power_sendbuf", sendbuf);
+  data->send_offset = NULL;
+  data->sendbuf = NULL;
+
+  /* Assign what we received to the local slab */
+  threadpool_map(tp, slab_contributions_to_grid_mapper, recvbuf, nr_recv_tot,
+                 sizeof(struct power_grid_contribution),
+                 threadpool_auto_chunk_size, data);
+  swift_free("power_recvbuf", recvbuf);
+
+  if (verbose)
+    message("Assigning %zd contributions to the local slab took %.3f %s.",
+            nr_recv_tot, clocks_from_ticks(getticks() - tic),
+            clocks_getunit());
+
+  free(nr_recv);
+  free(send_offset);
+  free(nr_send);
+}
+
+#endif /* WITH_MPI && HAVE_MPI_FFTW */
+
 /**
  * @brief Mapper function for calculating the power from a Fourier grid.
  *
+ * The grid may only be the local slab of a distributed grid, in which case
+ * the first axis is the y-axis (FFTW transposed output). The power being
+ * symmetric in kx and ky, the loops are the same. The modes are binned in
+ * local arrays first to avoid hammering the shared bins with atomics.
+ *
  * @param map_data The array of the density field Fourier transform.
- * @param num The number of elements to iterate on (along the x-axis).
+ * @param num The number of elements to iterate on (along the first axis).
  * @param extra Arrays to store the results/helper variables.
  */
 void pow_from_grid_mapper(void* map_data, const int num, void* extra) {
@@ -747,13 +1098,20 @@ void pow_from_grid_mapper(void* map_data, const int num, void* extra) {
   const int windoworder = data->windoworder;
   const int* restrict kbin = data->kbin;
   const double jfac = data->jfac;
+  const int slice_offset = data->slice_offset;
 
   /* Output data */
   int* restrict modecounts = data->modecounts;
   double* restrict powersum = data->powersum;
 
-  /* Range handled by this call */
-  const int xi_start = (fftw_complex*)map_data - powgridft;
+  /* Local accumulators for this call */
+  int* restrict local_modecounts = (int*)calloc(Nhalf + 1, sizeof(int));
+  double* restrict local_powersum = (double*)calloc(Nhalf + 1, sizeof(double));
+  if (local_modecounts == NULL || local_powersum == NULL)
+    error("Failed to allocate the local power bins.");
+
+  /* Range handled by this call (in the full grid) */
+  const int xi_start = ((fftw_complex*)map_data - powgridft) + slice_offset;
   const int xi_end = xi_start + num;
 
   /* Loop over the assigned FT'd cells, get deconvolved power from them */
@@ -796,16 +1154,27 @@ void pow_from_grid_mapper(void* map_data, const int num, void* extra) {
         const int bin = kbin[kk];
 
         const int mult = (zi == 0) ? 1 : 2;
-        atomic_add(&modecounts[bin], mult);
-
-        const int index = (xi * Ngrid + yi) * (Nhalf + 1) + zi;
-        atomic_add_d(&powersum[bin],
-                     mult * W * W *
-                         (powgridft[index][0] * powgridft2[index][0] +
-                          powgridft[index][1] * powgridft2[index][1]));
+        local_modecounts[bin] += mult;
+
+        const int index =
+            ((xi - slice_offset) * Ngrid + yi) * (Nhalf + 1) + zi;
+        local_powersum[bin] +=
+            mult * W * W *
+            (powgridft[index][0] * powgridft2[index][0] +
+             powgridft[index][1] * powgridft2[index][1]);
       } /* Loop over z */
     }   /* Loop over y */
   }     /* Loop over z */
+
+  /* Add this call's contribution to the shared bins */
+  for (int bin = 0; bin <= Nhalf; ++bin) {
+    if (local_modecounts[bin] == 0) continue;
+    atomic_add(&modecounts[bin], local_modecounts[bin]);
+    atomic_add_d(&powersum[bin], local_powersum[bin]);
+  }
+
+  free(local_modecounts);
+  free(local_powersum);
 }
 
 /**
@@ -871,24 +1240,113 @@ INLINE static void power_init_output_file(FILE* fp, const enum power_type type1,
 }
 
 /**
- * @brief Compute the power spectrum between type1 and type2, including
- * foldings and dealiasing. Only the real part of the power is returned.
+ * @brief Base name of the output files of a spectrum.
+ *
+ * @param base (return) The base name (at least 200 characters long).
+ * @param type1 The component type of field 1.
+ * @param type2 The component type of field 2.
+ */
+INLINE static void power_get_output_file_base(char* base,
+                                              const enum power_type type1,
+                                              const enum power_type type2) {
+
+  sprintf(base, "power_%s", get_powtype_filename(type1));
+  if (type1 != type2) {
+    const int length = strlen(base);
+    sprintf(base + length, "-%s", get_powtype_filename(type2));
+  }
+}
+
+/**
+ * @brief Size of the part of the grids held by this rank.
+ *
+ * This is everything or, for a distributed grid, a slab along x in real
+ * space and along y in Fourier space (FFTW's transposed output).
  *
- * Distributes the cells into slabs, performs the FFT, calculates the dealiased
- * power and writes this to file. Then repeats this procedure for a given
- * number of foldings.
+ * @param p The #power_spectrum_data.
+ * @param local_n0 (return) Thickness of the local slab in real space.
+ * @param local_0_start (return) Position of the local slab in real space.
+ * @param local_n1 (return) Thickness of the local slab in Fourier space.
+ * @param local_1_start (return) Position of the local slab in Fourier space.
+ * @return The number of doubles to allocate for each grid.
+ */
+static size_t power_local_grid_size(const struct power_spectrum_data* p,
+                                    int* local_n0, int* local_0_start,
+                                    int* local_n1, int* local_1_start) {
+
+  const int Ngrid = p->Ngrid;
+
+  *local_n0 = Ngrid;
+  *local_0_start = 0;
+  *local_n1 = Ngrid;
+  *local_1_start = 0;
+
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  if (p->distributed_grid) {
+
+    /* Ask FFTW what slab of the grid we need to store on this rank. This is
+     * in terms of complex numbers, the real grid is padded along z. */
+    ptrdiff_t n0, start0, n1, start1;
+    const ptrdiff_t nalloc = fftw_mpi_local_size_3d_transposed(
+        Ngrid, Ngrid, Ngrid / 2 + 1, MPI_COMM_WORLD, &n0, &start0, &n1,
+        &start1);
+    *local_n0 = (int)n0;
+    *local_0_start = (int)start0;
+    *local_n1 = (int)n1;
+    *local_1_start = (int)start1;
+    return 2 * (size_t)nalloc;
+  }
+#endif
+
+  return (size_t)Ngrid * Ngrid * (Ngrid + 2);
+}
+
+/**
+ * @brief Inverse of the cosmic mean quantity per grid cell for a component.
  *
- * @param type1 The #enum power_type indicating the first quantity to correlate.
- * @param type2 The #enum power_type indicating the second quantity to
- * correlate.
- * @param powdata The #power_spectrum_data containing power spectrum
- * parameters, FFT plans and pointers to the grids.
+ * This converts the mass assigned to the grid to a density contrast or the
+ * electron pressure to eV/cm^3.
+ *
+ * @param type The #power_type.
+ * @param Ngrid3 The number of cells in the grid.
+ * @param volume The volume of the (folded) box.
+ * @param meanrho The cosmic mean matter density.
+ * @param conv_EV The conversion factor from internal pressure to eV/cm^3.
+ */
+INLINE static double power_inv_cell_mean(const enum power_type type,
+                                         const int Ngrid3, const double volume,
+                                         const double meanrho,
+                                         const double conv_EV) {
+
+  double invcellmean;
+  if (type != pow_type_pressure)
+    invcellmean = Ngrid3 / (meanrho * volume);
+  else
+    invcellmean = Ngrid3 / volume * conv_EV;
+
+  /* When splitting the neutrino ensemble in half, double the inverse mean */
+  if (type == pow_type_neutrino_0 || type == pow_type_neutrino_1)
+    invcellmean *= 2.0;
+
+  return invcellmean;
+}
+
+/**
+ * @brief Compute all the requested power spectra, including foldings and
+ * dealiasing. Only the real part of the power is returned.
+ *
+ * For each folding, every distinct field entering the spectra is assigned to
+ * its own grid and transformed once. All the auto- and cross-spectra are
+ * then binned from these transforms and written to file. The shot noise of
+ * all the spectra is obtained in a single pass over the particles.
+ *
+ * @param pow_data The #power_spectrum_data containing power spectrum
+ * parameters, the list of fields and the FFT plans.
  * @param s The #space containing the particles.
  * @param tp The #threadpool object used for parallelisation.
  * @param verbose Are we talkative?
  */
-void power_spectrum(const enum power_type type1, const enum power_type type2,
-                    struct power_spectrum_data* pow_data, const struct space* s,
+void power_spectrum(struct power_spectrum_data* pow_data, const struct space* s,
                     struct threadpool* tp, const int verbose) {
 
   const int* local_cells = s->local_cells_top;
@@ -906,6 +1364,10 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
   const int Nfold = pow_data->Nfold;
   const int foldfac = pow_data->foldfac;
   const double jfac = M_PI / Ngrid;
+  const int nr_fields = pow_data->nr_fields;
+  const int nr_spectra = pow_data->spectrumcount;
+  const enum power_type* types1 = pow_data->types1;
+  const enum power_type* types2 = pow_data->types2;
 
   /* Gather some neutrino constants if using delta-f weighting on the mesh */
   struct neutrino_model nu_model;
@@ -913,29 +1375,76 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
   if (s->e->neutrino_properties->use_delta_f_mesh_only)
     gather_neutrino_consts(s, &nu_model);
 
-  if (verbose)
-    message("Preparing to calculate the %s-%s power spectrum.",
-            get_powtype_name(type1), get_powtype_name(type2));
-
   /* could loop over particles but for now just abort */
   if (nr_local_cells == 0)
     error("Cell infrastructure is not in place for power spectra.");
 
-  /* Allocate the grids based on whether this is an auto- or cross-spectrum*/
-  pow_data->powgrid = fftw_alloc_real(Ngrid2 * (Ngrid + 2));
-  memuse_log_allocation("fftw_grid.grid", pow_data->powgrid, 1,
-                        sizeof(double) * Ngrid2 * (Ngrid + 2));
-  pow_data->powgridft = (fftw_complex*)pow_data->powgrid;
-  if (type1 != type2) {
-    pow_data->powgrid2 = fftw_alloc_real(Ngrid2 * (Ngrid + 2));
-    memuse_log_allocation("fftw_grid.grid2", pow_data->powgrid2, 1,
-                          sizeof(double) * Ngrid2 * (Ngrid + 2));
-    pow_data->powgridft2 = (fftw_complex*)pow_data->powgrid2;
-  } else {
-    pow_data->powgrid2 = pow_data->powgrid;
-    pow_data->powgridft2 = pow_data->powgridft;
+  /* Part of the grids held by this rank */
+  int local_n0, local_0_start, local_n1, local_1_start;
+  const size_t grid_size = power_local_grid_size(
+      pow_data, &local_n0, &local_0_start, &local_n1, &local_1_start);
+
+  if (verbose)
+    message(
+        "Preparing to calculate %d power spectra from %d fields (grids use "
+        "%.3f MB).",
+        nr_spectra, nr_fields,
+        nr_fields * grid_size * sizeof(double) / (1024. * 1024.));
+
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  int* slab_owner = NULL;
+
+  if (pow_data->distributed_grid) {
+
+    /* Which rank holds each plane of the grid? */
+    const int nr_nodes = e->nr_nodes;
+    int* slab_width = (int*)malloc(nr_nodes * sizeof(int));
+    int* slab_offset = (int*)malloc(nr_nodes * sizeof(int));
+    slab_owner = (int*)malloc(Ngrid * sizeof(int));
+    if (slab_width == NULL || slab_offset == NULL || slab_owner == NULL)
+      error("Failed to allocate the slab decomposition.");
+    MPI_Allgather(&local_n0, 1, MPI_INT, slab_width, 1, MPI_INT,
+                  MPI_COMM_WORLD);
+    MPI_Allgather(&local_0_start, 1, MPI_INT, slab_offset, 1, MPI_INT,
+                  MPI_COMM_WORLD);
+    for (int r = 0; r < nr_nodes; ++r)
+      for (int i = slab_offset[r]; i < slab_offset[r] + slab_width[r]; ++i)
+        slab_owner[i] = r;
+    free(slab_offset);
+    free(slab_width);
+
+    if (verbose)
+      message("Local slab of the grid has thickness %d.", local_n0);
+  }
+#else
+  if (pow_data->distributed_grid)
+    error("FFTW MPI not found - unable to use a distributed grid.");
+#endif
+
+  /* Allocate one grid per field. The transforms are done in place and kept
+   * until all the spectra of a folding have been binned. */
+  double** grids = (double**)malloc(nr_fields * sizeof(double*));
+  if (grids == NULL) error("Failed to allocate the list of power grids.");
+  for (int f = 0; f < nr_fields; ++f) {
+    grids[f] = fftw_alloc_real(grid_size);
+    if (grids[f] == NULL) error("Failed to allocate a power grid.");
+    memuse_log_allocation("fftw_grid.grid", grids[f], 1,
+                          sizeof(double) * grid_size);
   }
 
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  /* The distributed plans depend on the slabs, so we make them here */
+  fftw_plan* slab_plans = NULL;
+  if (pow_data->distributed_grid) {
+    slab_plans = (fftw_plan*)malloc(nr_fields * sizeof(fftw_plan));
+    if (slab_plans == NULL) error("Failed to allocate the FFT plans.");
+    for (int f = 0; f < nr_fields; ++f)
+      slab_plans[f] = fftw_mpi_plan_dft_r2c_3d(
+          Ngrid, Ngrid, Ngrid, grids[f], (fftw_complex*)grids[f],
+          MPI_COMM_WORLD, FFTW_ESTIMATE | FFTW_MPI_TRANSPOSED_OUT);
+  }
+#endif
+
   /* Constants used for the normalization */
   double dim[3] = {s->dim[0], s->dim[1], s->dim[2]};
   const double volume = dim[0] * dim[1] * dim[2]; /* units Mpc^3 */
@@ -946,82 +1455,71 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
   const double conv_EV = units_cgs_conversion_factor(us, UNIT_CONV_INV_VOLUME) /
                          phys_const->const_electron_volt;
 
-  /* Inverse of the cosmic mean mass per grid cell in code units */
-  double invcellmean, invcellmean2;
-
-  if (type1 != pow_type_pressure)
-    invcellmean = Ngrid3 / (meanrho * volume);
-  else
-    invcellmean = Ngrid3 / volume * conv_EV;
-
-  if (type2 != pow_type_pressure)
-    invcellmean2 = Ngrid3 / (meanrho * volume);
-  else
-    invcellmean2 = Ngrid3 / volume * conv_EV;
-
-  /* When splitting the neutrino ensemble in half, double the inverse mean */
-  if (type1 == pow_type_neutrino_0 || type1 == pow_type_neutrino_1)
-    invcellmean *= 2.0;
-  if (type2 == pow_type_neutrino_0 || type2 == pow_type_neutrino_1)
-    invcellmean2 *= 2.0;
-
   /* Gather the shared information to be used by the threads
      for density computation */
   struct grid_mapper_data densdata;
-  struct grid_mapper_data densdata2;
-
   densdata.cells = s->cells_top;
-  densdata.dens = pow_data->powgrid;
   densdata.N = Ngrid;
-  densdata.type = type1;
   densdata.windoworder = pow_data->windoworder;
   densdata.e = s->e;
   densdata.nu_model = &nu_model;
-  if (type1 != type2) {
-    densdata2.cells = s->cells_top;
-    densdata2.dens = pow_data->powgrid2;
-    densdata2.N = Ngrid;
-    densdata2.type = type2;
-    densdata2.windoworder = pow_data->windoworder;
-    densdata2.e = s->e;
-    densdata2.nu_model = &nu_model;
-  }
+
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  /* Same for the assignment to the distributed grids */
+  struct slab_mapper_data slabdata;
+  bzero(&slabdata, sizeof(struct slab_mapper_data));
+  slabdata.cells = s->cells_top;
+  slabdata.N = Ngrid;
+  slabdata.windoworder = pow_data->windoworder;
+  slabdata.e = s->e;
+  slabdata.nu_model = &nu_model;
+  slabdata.slab_owner = slab_owner;
+  slabdata.local_n0 = local_n0;
+  slabdata.local_0_start = local_0_start;
+#endif
 
   if (verbose) message("Calculating the shot noise.");
 
-  /* Calculate mass terms for shot noise */
-  double shot = 0.;
-  if (type1 == pow_type_matter || type2 == pow_type_matter || type1 == type2 ||
-      (type1 == pow_type_gas && type2 == pow_type_pressure) ||
-      (type2 == pow_type_gas && type1 == pow_type_pressure)) {
+  /* Calculate mass terms for the shot noise of all the spectra at once */
+  double* shot = (double*)calloc(nr_spectra, sizeof(double));
+  int* has_shot = (int*)malloc(nr_spectra * sizeof(int));
+  if (shot == NULL || has_shot == NULL)
+    error("Failed to allocate the shot noise terms.");
+  int any_shot = 0;
+  for (int j = 0; j < nr_spectra; ++j) {
+    has_shot[j] = power_has_shot_noise(types1[j], types2[j]);
+    any_shot |= has_shot[j];
+  }
+
+  if (any_shot) {
 
-    /* Note that for cross-power, there is only shot noise for particles
-       that occur in both fields */
     struct shot_mapper_data shotdata;
     shotdata.cells = s->cells_top;
-    shotdata.tot12 = 0;
-    shotdata.type1 = type1;
-    shotdata.type2 = type2;
+    shotdata.tot12 = shot;
+    shotdata.has_shot = has_shot;
+    shotdata.pow_data = pow_data;
     shotdata.e = s->e;
     shotdata.nu_model = &nu_model;
     threadpool_map(tp, shotnoise_mapper, (void*)local_cells, nr_local_cells,
                    sizeof(int), threadpool_auto_chunk_size, (void*)&shotdata);
 #ifdef WITH_MPI
-    /* Add up everybody's shot noise term */
-    MPI_Allreduce(MPI_IN_PLACE, &shotdata.tot12, 1, MPI_DOUBLE, MPI_SUM,
+    /* Add up everybody's shot noise terms */
+    MPI_Allreduce(MPI_IN_PLACE, shot, nr_spectra, MPI_DOUBLE, MPI_SUM,
                   MPI_COMM_WORLD);
 #endif
 
     /* Store shot noise */
-    shot = shotdata.tot12 / volume;
-    if (type1 != pow_type_pressure)
-      shot /= meanrho;
-    else
-      shot *= conv_EV;
-    if (type2 != pow_type_pressure)
-      shot /= meanrho;
-    else
-      shot *= conv_EV;
+    for (int j = 0; j < nr_spectra; ++j) {
+      shot[j] /= volume;
+      if (types1[j] != pow_type_pressure)
+        shot[j] /= meanrho;
+      else
+        shot[j] *= conv_EV;
+      if (types2[j] != pow_type_pressure)
+        shot[j] /= meanrho;
+      else
+        shot[j] *= conv_EV;
+    }
   }
 
   /* Gather the shared information to be used by the threads
@@ -1042,16 +1540,15 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
   double* powersum = (double*)malloc((Nhalf + 1) * sizeof(double));
 
   struct pow_mapper_data powmapdata;
-  powmapdata.powgridft = pow_data->powgridft;
-  powmapdata.powgridft2 = pow_data->powgridft2;
   powmapdata.Ngrid = Ngrid;
+  powmapdata.slice_offset = local_1_start;
   powmapdata.windoworder = pow_data->windoworder;
   powmapdata.modecounts = modecounts;
   powmapdata.powersum = powersum;
   powmapdata.kbin = kbin;
   powmapdata.jfac = jfac;
 
-  /* Allocate arrays for combined power spectrum */
+  /* Allocate arrays for combined power spectra */
   const int kcutn = (pow_data->windoworder >= 3) ? 90 : 70;
   const int kcutleft = (int)(Ngrid / 256.0 * kcutn);
   const int kcutright = (int)(Ngrid / 256.0 * (double)kcutn / foldfac);
@@ -1061,18 +1558,12 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
   int numstart = 0;
 
   double* kcomb = (double*)malloc(numtot * sizeof(double));
-  double* pcomb = (double*)malloc(numtot * sizeof(double));
+  double* pcomb = (double*)malloc(nr_spectra * numtot * sizeof(double));
 
-  /* Determine output file name */
+  /* Determine output file names */
   char outputfileBase[200] = "";
   char outputfileName[256] = "";
 
-  sprintf(outputfileBase, "power_%s", get_powtype_filename(type1));
-  if (type1 != type2) {
-    const int length = strlen(outputfileBase);
-    sprintf(outputfileBase + length, "-%s", get_powtype_filename(type2));
-  }
-
   /* Loop over foldings */
   for (int i = 0; i < Nfold; ++i) {
 
@@ -1080,95 +1571,127 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
 
     /* Note:  implicitly assuming a cubic box here */
     densdata.fac = Ngrid / dim[0];
-    densdata2.fac = Ngrid / dim[0];
     densdata.dim[0] = dim[0];
     densdata.dim[1] = dim[1];
     densdata.dim[2] = dim[2];
-    densdata2.dim[0] = dim[0];
-    densdata2.dim[1] = dim[1];
-    densdata2.dim[2] = dim[2];
     const double kfac = 2 * M_PI / dim[0];
 
-    /* Empty the grid(s) */
-    bzero(pow_data->powgrid, Ngrid2 * (Ngrid + 2) * sizeof(double));
-    if (type1 != type2)
-      bzero(pow_data->powgrid2, Ngrid2 * (Ngrid + 2) * sizeof(double));
-
-    /* Fill out the folded grid(s) */
-    threadpool_map(tp, cell_to_powgrid_mapper, (void*)local_cells,
-                   nr_local_cells, sizeof(int), threadpool_auto_chunk_size,
-                   (void*)&densdata);
-    if (type1 != type2)
-      threadpool_map(tp, cell_to_powgrid_mapper, (void*)local_cells,
-                     nr_local_cells, sizeof(int), threadpool_auto_chunk_size,
-                     (void*)&densdata2);
+    /* Assign and transform each field once */
+    for (int f = 0; f < nr_fields; ++f) {
+
+      const enum power_type type = pow_data->field_types[f];
+
+      /* Empty the grid */
+      bzero(grids[f], grid_size * sizeof(double));
+
+      if (pow_data->distributed_grid) {
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+
+        /* Send the particles to the ranks holding the slabs they overlap */
+        slabdata.fac = Ngrid / dim[0];
+        slabdata.dim[0] = dim[0];
+        slabdata.dim[1] = dim[1];
+        slabdata.dim[2] = dim[2];
+        slabdata.type = type;
+        slabdata.slab = grids[f];
+        power_assign_to_slab(&slabdata, local_cells, nr_local_cells, tp,
+                             verbose);
+#endif
+      } else {
+
+        /* Fill out the folded grid */
+        densdata.type = type;
+        densdata.dens = grids[f];
+        threadpool_map(tp, cell_to_powgrid_mapper, (void*)local_cells,
+                       nr_local_cells, sizeof(int), threadpool_auto_chunk_size,
+                       (void*)&densdata);
 #ifdef WITH_MPI
-    /* Merge everybody's share of the grid onto rank 0 */
-    if (e->nodeID == 0)
-      MPI_Reduce(MPI_IN_PLACE, pow_data->powgrid, Ngrid2 * (Ngrid + 2),
-                 MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-    else
-      MPI_Reduce(pow_data->powgrid, NULL, Ngrid2 * (Ngrid + 2), MPI_DOUBLE,
-                 MPI_SUM, 0, MPI_COMM_WORLD);
-
-    /* Same for the secondary grid */
-    if (type1 != type2) {
-
-      if (e->nodeID == 0)
-        MPI_Reduce(MPI_IN_PLACE, pow_data->powgrid2, Ngrid2 * (Ngrid + 2),
-                   MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-      else
-        MPI_Reduce(pow_data->powgrid2, NULL, Ngrid2 * (Ngrid + 2), MPI_DOUBLE,
-                   MPI_SUM, 0, MPI_COMM_WORLD);
-    }
+        /* Merge everybody's share of the grid onto rank 0 */
+        if (e->nodeID == 0)
+          MPI_Reduce(MPI_IN_PLACE, grids[f], Ngrid2 * (Ngrid + 2), MPI_DOUBLE,
+                     MPI_SUM, 0, MPI_COMM_WORLD);
+        else
+          MPI_Reduce(grids[f], NULL, Ngrid2 * (Ngrid + 2), MPI_DOUBLE,
+                     MPI_SUM, 0, MPI_COMM_WORLD);
 #endif
+      }
 
-    /* Only rank 0 needs to perform all the remaining work */
-    if (e->nodeID == 0) {
+      /* With a distributed grid, every rank transforms its slab.
+       * Otherwise, only rank 0 needs to perform all the remaining work */
+      if (!pow_data->distributed_grid && e->nodeID != 0) continue;
 
       /* Convert mass to density contrast or pressure to eV/cm^3 */
-      convdata.grid = pow_data->powgrid;
-      convdata.invcellmean = invcellmean;
+      convdata.grid = grids[f];
+      convdata.invcellmean =
+          power_inv_cell_mean(type, Ngrid3, volume, meanrho, conv_EV);
       if (Ngrid < 32) {
-        mass_to_contrast_mapper(pow_data->powgrid, Ngrid, &convdata);
+        mass_to_contrast_mapper(grids[f], local_n0, &convdata);
       } else {
-        threadpool_map(tp, mass_to_contrast_mapper, pow_data->powgrid, Ngrid,
+        threadpool_map(tp, mass_to_contrast_mapper, grids[f], local_n0,
                        sizeof(double), threadpool_auto_chunk_size, &convdata);
       }
 
-      if (type1 != type2) {
-        convdata.grid = pow_data->powgrid2;
-        convdata.invcellmean = invcellmean2;
-        if (Ngrid < 32) {
-          mass_to_contrast_mapper(pow_data->powgrid2, Ngrid, &convdata);
-        } else {
-          threadpool_map(tp, mass_to_contrast_mapper, pow_data->powgrid2, Ngrid,
-                         sizeof(double), threadpool_auto_chunk_size, &convdata);
-        }
+      /* Perform FFT */
+      if (pow_data->distributed_grid) {
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+        fftw_execute(slab_plans[f]);
+#endif
+      } else {
+        fftw_execute_dft_r2c(pow_data->fftplanpow, grids[f],
+                             (fftw_complex*)grids[f]);
       }
+    }
 
-      /* Perform FFT(s) */
-      fftw_execute_dft_r2c(pow_data->fftplanpow, pow_data->powgrid,
-                           pow_data->powgridft);
-      if (type1 != type2)
-        fftw_execute_dft_r2c(pow_data->fftplanpow2, pow_data->powgrid2,
-                             pow_data->powgridft2);
+    /* Now get all the spectra from the transforms */
+    for (int j = 0; j < nr_spectra; ++j) {
 
-      powmapdata.powgridft = pow_data->powgridft;
-      powmapdata.powgridft2 = pow_data->powgridft2;
+      const enum power_type type1 = types1[j];
+      const enum power_type type2 = types2[j];
+      fftw_complex* powgridft =
+          (fftw_complex*)grids[pow_data->field_index[type1]];
+      fftw_complex* powgridft2 =
+          (fftw_complex*)grids[pow_data->field_index[type2]];
 
       /* Zero the mode arrays */
       bzero(modecounts, (Nhalf + 1) * sizeof(int));
       bzero(powersum, (Nhalf + 1) * sizeof(double));
 
-      /* Calculate compensated mode contributions */
-      if (Ngrid < 32) {
-        pow_from_grid_mapper(pow_data->powgridft, Ngrid, &powmapdata);
-      } else {
-        threadpool_map(tp, pow_from_grid_mapper, pow_data->powgridft, Ngrid,
-                       sizeof(fftw_complex), threadpool_auto_chunk_size,
-                       &powmapdata);
+      if (pow_data->distributed_grid || e->nodeID == 0) {
+
+        powmapdata.powgridft = powgridft;
+        powmapdata.powgridft2 = powgridft2;
+
+        /* Calculate compensated mode contributions */
+        if (Ngrid < 32) {
+          pow_from_grid_mapper(powgridft, local_n1, &powmapdata);
+        } else {
+          threadpool_map(tp, pow_from_grid_mapper, powgridft, local_n1,
+                         sizeof(fftw_complex), threadpool_auto_chunk_size,
+                         &powmapdata);
+        }
+      }
+
+#ifdef WITH_MPI
+      /* Add up everybody's modes */
+      if (pow_data->distributed_grid) {
+        if (e->nodeID == 0) {
+          MPI_Reduce(MPI_IN_PLACE, modecounts, Nhalf + 1, MPI_INT, MPI_SUM, 0,
+                     MPI_COMM_WORLD);
+          MPI_Reduce(MPI_IN_PLACE, powersum, Nhalf + 1, MPI_DOUBLE, MPI_SUM,
+                     0, MPI_COMM_WORLD);
+        } else {
+          MPI_Reduce(modecounts, NULL, Nhalf + 1, MPI_INT, MPI_SUM, 0,
+                     MPI_COMM_WORLD);
+          MPI_Reduce(powersum, NULL, Nhalf + 1, MPI_DOUBLE, MPI_SUM, 0,
+                     MPI_COMM_WORLD);
+        }
       }
+#endif
+
+      /* Only rank 0 writes the results */
+      if (e->nodeID != 0) continue;
+
+      power_get_output_file_base(outputfileBase, type1, type2);
 
       /* Write this folding to the detail file */
       const double volfac = (volume / Ngrid3) / Ngrid3;
@@ -1190,68 +1713,72 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
               "are not corrected for the weights of the modes.\n",
               i);
       fprintf(outputfile, "# Shotnoise [%s]\n", powunits);
-      fprintf(outputfile, "%g\n", shot);
+      fprintf(outputfile, "%g\n", shot[j]);
       fprintf(outputfile, "# Redshift [dimensionless]\n");
       fprintf(outputfile, "%g\n", s->e->cosmology->z);
       fprintf(outputfile, "# k [Mpc^(-1)]   p [%s]\n", powunits);
 
-      for (int j = 1; j <= Nhalf; ++j) {
-        fprintf(outputfile, "%g %g\n", j * kfac,
-                powersum[j] / modecounts[j] * volfac);
+      for (int k = 1; k <= Nhalf; ++k) {
+        fprintf(outputfile, "%g %g\n", k * kfac,
+                powersum[k] / modecounts[k] * volfac);
       }
       fclose(outputfile);
 
       /* Combine most accurate measurements from foldings */
+      double* pcomb_j = pcomb + (size_t)j * numtot;
       if (i == 0) {
 
-        for (int j = 0; j < kcutleft; ++j) {
-          kcomb[j] = (j + 1) * kfac;
-          pcomb[j] = powersum[j + 1] / modecounts[j + 1] * volfac;
+        for (int k = 0; k < kcutleft; ++k) {
+          kcomb[k] = (k + 1) * kfac;
+          pcomb_j[k] = powersum[k + 1] / modecounts[k + 1] * volfac;
         }
 
-        numstart += kcutleft;
-
       } else {
 
         const int off = kcutright + 1;
-        for (int j = 0; j < (kcutleft - kcutright + 1); ++j) {
-          kcomb[j + numstart] = (j + off) * kfac;
-          pcomb[j + numstart] =
-              powersum[j + off] / modecounts[j + off] * volfac;
+        for (int k = 0; k < (kcutleft - kcutright + 1); ++k) {
+          kcomb[k + numstart] = (k + off) * kfac;
+          pcomb_j[k + numstart] =
+              powersum[k + off] / modecounts[k + off] * volfac;
         }
-        numstart += (kcutleft - kcutright + 1);
       }
 
-    } /* Work of rank 0 */
+    } /* Loop over the spectra */
+
+    /* Move along the combined spectra */
+    numstart += (i == 0) ? kcutleft : (kcutleft - kcutright + 1);
 
     /* Fold the box */
     for (int j = 0; j < 3; ++j) dim[j] /= foldfac;
 
   } /* Loop over the foldings */
 
-  if (e->nodeID == 0) {
+  /* Output attempt at combined measurements */
+  for (int j = 0; j < nr_spectra && e->nodeID == 0; ++j) {
 
-    /* Output attempt at combined measurement */
+    const double* pcomb_j = pcomb + (size_t)j * numtot;
+
+    power_get_output_file_base(outputfileBase, types1[j], types2[j]);
     sprintf(outputfileName, "%s/%s_%04d.txt", "power_spectra", outputfileBase,
             snapnum);
 
     FILE* outputfile = fopen(outputfileName, "w");
 
     /* Header and units */
-    power_init_output_file(outputfile, type1, type2, us, phys_const);
+    power_init_output_file(outputfile, types1[j], types2[j], us, phys_const);
 
-    for (int j = 0; j < numtot; ++j) {
+    for (int k = 0; k < numtot; ++k) {
 
-      float k = kcomb[j];
+      float kk = kcomb[k];
 
       /* Shall we correct the position of the k-space bin
        * to account for the different weights of the modes entering the bin? */
-      if (pow_data->shift_centre_small_k_bins && j < number_of_corrected_bins) {
-        k *= correction_shift_k_values[j];
+      if (pow_data->shift_centre_small_k_bins && k < number_of_corrected_bins) {
+        kk *= correction_shift_k_values[k];
       }
 
       fprintf(outputfile, "%15.8f %15.8e %15.8e %15.8e\n", s->e->cosmology->z,
-              k, (pcomb[j] - shot), shot);
+              kk, (pcomb_j[k] - shot[j]), shot[j]);
     }
     fclose(outputfile);
   }
@@ -1264,16 +1791,74 @@ void power_spectrum(const enum power_type type1, const enum power_type type2,
   free(powersum);
   free(modecounts);
   free(kbin);
-  if (type1 != type2) {
-    memuse_log_allocation("fftw_grid.grid2", pow_data->powgrid2, 0, 0);
-    fftw_free(pow_data->powgrid2);
+  free(has_shot);
+  free(shot);
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  if (pow_data->distributed_grid) {
+    for (int f = 0; f < nr_fields; ++f) fftw_destroy_plan(slab_plans[f]);
+    free(slab_plans);
+    free(slab_owner);
+  }
+#endif
+  for (int f = 0; f < nr_fields; ++f) {
+    memuse_log_allocation("fftw_grid.grid", grids[f], 0, 0);
+    fftw_free(grids[f]);
+  }
+  free(grids);
+}
+
+/**
+ * @brief Make the FFT plan for the full (non-distributed) grids.
+ *
+ * The plan is made only once -- much faster for FFTs run often!
+ * Does require us to allocate a grid, but we delete it right away.
+ * The plan is then used for the grids of all the fields via the new-array
+ * execute interface of FFTW.
+ *
+ * @param p The #power_spectrum_data.
+ */
+static void power_make_plans(struct power_spectrum_data* p) {
+
+  p->fftplanpow = NULL;
+
+  /* Nothing to do for distributed grids */
+  if (p->distributed_grid) return;
+
+  const int Ngrid = p->Ngrid;
+
+  /* Grid is padded to allow for in-place FFT */
+  double* powgrid = fftw_alloc_real(Ngrid * Ngrid * (Ngrid + 2));
+  /* Pointer to grid to interpret it as complex data */
+  fftw_complex* powgridft = (fftw_complex*)powgrid;
+
+  p->fftplanpow = fftw_plan_dft_r2c_3d(Ngrid, Ngrid, Ngrid, powgrid,
+                                       powgridft, FFTW_MEASURE);
+
+  fftw_free(powgrid);
+}
+
+/**
+ * @brief Plan the calculation of all the requested spectra.
+ *
+ * Lists the distinct fields entering the spectra such that each of them is
+ * assigned to a grid and transformed only once per folding.
+ *
+ * @param p The #power_spectrum_data.
+ */
+static void power_plan_fields(struct power_spectrum_data* p) {
+
+  p->nr_fields = 0;
+  for (int t = 0; t < pow_type_count; ++t) p->field_index[t] = -1;
+
+  for (int i = 0; i < p->spectrumcount; ++i) {
+    const enum power_type types[2] = {p->types1[i], p->types2[i]};
+    for (int k = 0; k < 2; ++k) {
+      if (p->field_index[types[k]] >= 0) continue;
+      p->field_index[types[k]] = p->nr_fields;
+      p->field_types[p->nr_fields] = types[k];
+      p->nr_fields++;
+    }
   }
-  pow_data->powgrid2 = NULL;
-  pow_data->powgridft2 = NULL;
-  memuse_log_allocation("fftw_grid.grid", pow_data->powgrid, 0, 0);
-  fftw_free(pow_data->powgrid);
-  pow_data->powgrid = NULL;
-  pow_data->powgridft = NULL;
 }
 
 #endif /* HAVE_FFTW */
@@ -1318,6 +1903,20 @@ void power_init(struct power_spectrum_data* p, struct swift_params* params,
   p->shift_centre_small_k_bins = parser_get_opt_param_int(
       params, "PowerSpectrum:shift_centre_small_k_bins", 1);
 
+  p->distributed_grid =
+      parser_get_opt_param_int(params, "PowerSpectrum:distributed_grid",
+                               power_data_default_distributed_grid);
+
+#if !defined(WITH_MPI) || !defined(HAVE_MPI_FFTW)
+  if (p->distributed_grid)
+    error(
+        "Need to use MPI and FFTW MPI library (i.e. compile with "
+        "--enable-mpi-mesh-gravity) to run with a distributed power grid.");
+#endif
+
+  if (p->distributed_grid && p->Ngrid % 2 != 0)
+    error("The distributed power grid side-length must be an even number.");
+
   /* Make sensible choices for the k-cuts */
   const int kcutn = (p->windoworder >= 3) ? 90 : 70;
   const int kcutleft = (int)(p->Ngrid / 256.0 * kcutn);
@@ -1339,6 +1938,10 @@ void power_init(struct power_spectrum_data* p, struct swift_params* params,
 #else
   message("Note that FFTW is not threaded!");
 #endif
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  /* Initialize FFTW MPI support - must be called after fftw_init_threads() */
+  if (p->distributed_grid) fftw_mpi_init();
+#endif
 
   char** requested_spectra = NULL;
   parser_get_param_string_array(params, "PowerSpectrum:requested_spectra",
@@ -1368,36 +1971,22 @@ void power_init(struct power_spectrum_data* p, struct swift_params* params,
     p->types2[i] = power_spectrum_get_type(type2);
   }
 
-  /* Initialize the plan only once -- much faster for FFTs run often!
-   * Does require us to allocate the grids, but we delete them right away.
-   * Plan can only be used for the same FFTW call */
-  const int Ngrid = p->Ngrid;
+  /* List the distinct fields to assign and transform */
+  power_plan_fields(p);
 
-  /* Grid is padded to allow for in-place FFT */
-  p->powgrid = fftw_alloc_real(Ngrid * Ngrid * (Ngrid + 2));
-  /* Pointer to grid to interpret it as complex data */
-  p->powgridft = (fftw_complex*)p->powgrid;
-
-  p->fftplanpow = fftw_plan_dft_r2c_3d(Ngrid, Ngrid, Ngrid, p->powgrid,
-                                       p->powgridft, FFTW_MEASURE);
+  /* The distributed grids get their plans when computing the spectra */
+  power_make_plans(p);
 
-  fftw_free(p->powgrid);
-  p->powgrid = NULL;
-  p->powgridft = NULL;
-
-  /* Do the same for a second grid/plan to allow for cross power */
-
-  /* Grid is padded to allow for in-place FFT */
-  p->powgrid2 = fftw_alloc_real(Ngrid * Ngrid * (Ngrid + 2));
-  /* Pointer to grid to interpret it as complex data */
-  p->powgridft2 = (fftw_complex*)p->powgrid2;
-
-  p->fftplanpow2 = fftw_plan_dft_r2c_3d(Ngrid, Ngrid, Ngrid, p->powgrid2,
-                                        p->powgridft2, FFTW_MEASURE);
-
-  fftw_free(p->powgrid2);
-  p->powgrid2 = NULL;
-  p->powgridft2 = NULL;
+  /* Report the memory needed by the grids of all the fields */
+  int local_n0, local_0_start, local_n1, local_1_start;
+  const size_t grid_size = power_local_grid_size(
+      p, &local_n0, &local_0_start, &local_n1, &local_1_start);
+  if (engine_rank == 0)
+    message(
+        "Computing %d power spectra from %d distinct fields. The grids will "
+        "use %.3f MB per rank.",
+        p->spectrumcount, p->nr_fields,
+        p->nr_fields * grid_size * sizeof(double) / (1024. * 1024.));
 
   /* Create directories for power spectra and foldings */
   if (engine_rank == 0) {
@@ -1417,10 +2006,8 @@ void calc_all_power_spectra(struct power_spectrum_data* pow_data,
 
   const ticks tic = getticks();
 
-  /* Loop over all type combinations the user requested */
-  for (int i = 0; i < pow_data->spectrumcount; ++i)
-    power_spectrum(pow_data->types1[i], pow_data->types2[i], pow_data, s, tp,
-                   verbose);
+  /* Compute all the type combinations the user requested */
+  power_spectrum(pow_data, s, tp, verbose);
 
   /* Increment the PS output counter */
   s->e->ps_output_count++;
@@ -1438,8 +2025,7 @@ void calc_all_power_spectra(struct power_spectrum_data* pow_data,
 
 void power_clean(struct power_spectrum_data* pow_data) {
 #ifdef HAVE_FFTW
-  fftw_destroy_plan(pow_data->fftplanpow);
-  fftw_destroy_plan(pow_data->fftplanpow2);
+  if (!pow_data->distributed_grid) fftw_destroy_plan(pow_data->fftplanpow);
   free(pow_data->types2);
   free(pow_data->types1);
 #ifdef HAVE_THREADED_FFTW
@@ -1501,35 +2087,10 @@ void power_spectrum_struct_restore(struct power_spectrum_data* p,
 #else
   message("Note that FFTW is not threaded!");
 #endif
+#if defined(WITH_MPI) && defined(HAVE_MPI_FFTW)
+  if (p->distributed_grid) fftw_mpi_init();
+#endif
 
-  /* Initialize the plan only once -- much faster for FFTs run often!
-     Does require us to allocate the grids, but we delete them right away */
-  int Ngrid = p->Ngrid;
-
-  /* Grid is padded to allow for in-place FFT */
-  p->powgrid = fftw_alloc_real(Ngrid * Ngrid * (Ngrid + 2));
-  /* Pointer to grid to interpret it as complex data */
-  p->powgridft = (fftw_complex*)p->powgrid;
-
-  p->fftplanpow = fftw_plan_dft_r2c_3d(Ngrid, Ngrid, Ngrid, p->powgrid,
-                                       p->powgridft, FFTW_MEASURE);
-
-  fftw_free(p->powgrid);
-  p->powgrid = NULL;
-  p->powgridft = NULL;
-
-  /* Do the same for a second grid/plan to allow for cross power */
-
-  /* Grid is padded to allow for in-place FFT */
-  p->powgrid2 = fftw_alloc_real(Ngrid * Ngrid * (Ngrid + 2));
-  /* Pointer to grid to interpret it as complex data */
-  p->powgridft2 = (fftw_complex*)p->powgrid2;
-
-  p->fftplanpow2 = fftw_plan_dft_r2c_3d(Ngrid, Ngrid, Ngrid, p->powgrid2,
-                                        p->powgridft2, FFTW_MEASURE);
-
-  fftw_free(p->powgrid2);
-  p->powgrid2 = NULL;
-  p->powgridft2 = NULL;
+  power_make_plans(p);
 #endif /* HAVE_FFTW */
 }
@@ -74,30 +74,27 @@ struct power_spectrum_data {
   /* Shall we correct the position of the k-space bin? */
   int shift_centre_small_k_bins;
 
+  /*! Are the grids distributed in slabs over the MPI ranks? */
+  int distributed_grid;
+
   /*! Array of component types to correlate on the "left" side */
   enum power_type* types1;
 
   /*! Array of component types to correlate on the "right" side */
   enum power_type* types2;
 
-  /*! Pointer to the grid to be reused */
-  double* powgrid;
-
-  /*! Pointer to a second grid for cross-power spectra */
-  double* powgrid2;
+  /*! Number of distinct fields entering the requested spectra */
+  int nr_fields;
 
-#ifdef HAVE_FFTW
-  /*! Pointer to the grid in Fourier space */
-  fftw_complex* powgridft;
+  /*! Component type of each of the distinct fields */
+  enum power_type field_types[pow_type_count];
 
-  /*! Pointer to the second grid in Fourier space */
-  fftw_complex* powgridft2;
+  /*! Index in #field_types of each component type (-1 if not needed) */
+  int field_index[pow_type_count];
 
-  /*! The FFT plan to be reused */
+#ifdef HAVE_FFTW
+  /*! The FFT plan to be reused for the grids of all the fields */
   fftw_plan fftplanpow;
-
-  /*! The FFT plan to be reused for the second grid */
-  fftw_plan fftplanpow2;
 #endif
 };
 
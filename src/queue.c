@@ -181,6 +181,9 @@ void queue_insert(struct queue *q, struct task *t) {
 
   /* Increase the incoming count. */
   atomic_inc(&q->count_incoming);
+
+  /* Keep track of the heaviest task waiting. */
+  atomic_max_f(&q->max_weight, t->weight);
 }
 
 /**
@@ -216,17 +219,23 @@ void queue_init(struct queue *q, struct task *tasks) {
   q->first_incoming = 0;
   q->last_incoming = 0;
   q->count_incoming = 0;
+  q->max_weight = 0.f;
 }
 
 /**
  * @brief Get a task free of dependencies and conflicts.
  *
+ * Only the tasks with a weight of at least @c min_weight or a cost of at
+ * most @c max_cost are considered.
+ *
  * @param q The task #queue.
  * @param prev The previous #task extracted from this #queue.
  * @param blocking Block until access to the queue is granted.
+ * @param min_weight The weight above which any task can be returned.
+ * @param max_cost The cost below which any task can be returned.
  */
 struct task *queue_gettask(struct queue *q, const struct task *prev,
-                           int blocking) {
+                           int blocking, float min_weight, float max_cost) {
 
   swift_lock_type *qlock = &q->lock;
   struct task *res = NULL;
@@ -243,6 +252,7 @@ struct task *queue_gettask(struct queue *q, const struct task *prev,
 
   /* If there are no tasks, leave immediately. */
   if (q->count == 0) {
+    q->max_weight = 0.f;
     lock_unlock_blind(qlock);
     return NULL;
   }
@@ -256,6 +266,10 @@ struct task *queue_gettask(struct queue *q, const struct task *prev,
   int ind;
   for (ind = 0; ind < old_qcount; ind++) {
 
+    /* Leave the tasks we are not allowed to run for somebody else. */
+    const struct task *t = &qtasks[entries[ind].tid];
+    if (t->weight < min_weight && t->cost > max_cost) continue;
+
     /* Try to lock the next task. */
     if (task_lock(&qtasks[entries[ind].tid])) break;
 
@@ -294,6 +308,9 @@ struct task *queue_gettask(struct queue *q, const struct task *prev,
   } else
     res = NULL;
 
+  /* Update the estimate of the heaviest task left. */
+  q->max_weight = (q->count > 0) ? qtasks[entries[0].tid].weight : 0.f;
+
 #ifdef SWIFT_DEBUG_CHECKS
   /* Check the queue's consistency. */
   for (int k = 1; k < q->count; k++)
@@ -75,11 +75,14 @@ struct queue {
   int *tid_incoming;
   volatile unsigned int first_incoming, last_incoming, count_incoming;
 
+  /* Estimate of the largest task weight in the queue and its DEQ. */
+  volatile float max_weight;
+
 } __attribute__((aligned(queue_struct_align)));
 
 /* Function prototypes. */
 struct task *queue_gettask(struct queue *q, const struct task *prev,
-                           int blocking);
+                           int blocking, float min_weight, float max_cost);
 void queue_init(struct queue *q, struct task *tasks);
 void queue_insert(struct queue *q, struct task *t);
 void queue_clean(struct queue *q);
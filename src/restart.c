@@ -29,29 +29,544 @@
 #include "engine.h"
 #include "error.h"
 #include "restart.h"
+#include "threadpool.h"
 #include "version.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <glob.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 /* The signature for restart files. */
 #define SWIFT_RESTART_SIGNATURE "SWIFT-restart-file"
 #define SWIFT_RESTART_END_SIGNATURE "SWIFT-restart-file:end"
+#define SWIFT_RESTART_TABLE_SIGNATURE "SWRSTTBL"
 
 #define FNAMELEN 200
 #define LABLEN 20
 
+/* Sections larger than this start on a page boundary so that they can be
+ * mapped into memory directly. */
+#define RESTART_ALIGNMENT 4096
+#define RESTART_ALIGN_THRESHOLD (64 * 1024)
+
+/* Size of the chunks the checksums are computed over and that are read by
+ * each thread. */
+#define RESTART_CHUNK_SIZE (1024 * 1024)
+
 /* Structure for a dumped header. */
 struct header {
   size_t len;             /* Total length of data in bytes. */
+  uint32_t checksum;      /* CRC-32 of the CRC-32s of the data chunks. */
+  uint32_t pad;           /* Padding bytes between header and data. */
+  uint32_t flags;         /* See restart_section_flags. */
+  char label[LABLEN + 1]; /* A label for data */
+};
+
+/* The types of section. */
+enum restart_section_flags {
+
+  /* Some chunks are stored in the last full dump. The data is preceded by
+   * a struct restart_delta and one char per chunk, 1 if the chunk is to be
+   * found in the full dump. Only the other chunks follow. */
+  restart_section_delta = (1 << 0)
+};
+
+/* Header of the data of a delta section. */
+struct restart_delta {
+  size_t base_offset; /* Position of the section in the full dump. */
+  uint64_t base_id;   /* Identifier of the full dump. */
+};
+
+/* Entry of the table of sections written at the end of the file. */
+struct restart_section {
+  size_t offset;          /* Position of the data in the file. */
+  size_t size;            /* Number of bytes of data in the file. */
+  size_t len;             /* Total length of data in bytes. */
+  uint32_t checksum;      /* Same as in the header. */
+  uint32_t flags;         /* Same as in the header. */
   char label[LABLEN + 1]; /* A label for data */
 };
 
+/* Last bytes of the file, locating the table of sections. */
+struct restart_trailer {
+  size_t nr_sections;
+  size_t table_offset;
+  uint64_t dump_id; /* Identifier of a full dump used by deltas, or 0. */
+  char signature[8];
+};
+
+/* Checksums of a large section of the last full dump. */
+struct restart_base_section {
+  char label[LABLEN + 1];
+  size_t offset;
+  size_t len;
+  uint32_t *crcs;
+  uint64_t *hashes;
+};
+
+/* Threads used to checksum and read the large sections (can be NULL). */
+static struct threadpool *restart_threadpool = NULL;
+
+/* Table of the sections written so far to the current file. */
+static struct restart_section *restart_sections = NULL;
+static size_t restart_nr_sections = 0;
+static size_t restart_size_sections = 0;
+
+/* The large sections of the last full dump, with the checksums of all their
+ * chunks, which the delta dumps refer to. */
+static struct restart_base_section *restart_base = NULL;
+static size_t restart_base_nr_sections = 0;
+static size_t restart_base_size_sections = 0;
+static uint64_t restart_base_id = 0;
+
+/* Are we writing a delta dump or a full dump that deltas will refer to? */
+static int restart_write_delta = 0;
+static int restart_write_base = 0;
+
+/* Number of deltas written since the last full dump. */
+static int restart_nr_deltas = 0;
+
+/* When reading, the name of the file and the full dump it refers to. */
+static const char *restart_read_name = NULL;
+static int restart_read_base_fd = -1;
+static uint64_t restart_read_base_id = 0;
+
+#ifndef HAVE_ZLIB
+/* Look-up table for the CRC-32 computation. */
+static uint32_t restart_crc_table[256];
+static int restart_crc_table_done = 0;
+
+/**
+ * @brief Compute the look-up table for the CRC-32 (zlib polynomial).
+ *
+ * Must be called from a single thread before any use of restart_crc32().
+ */
+static void restart_crc_init(void) {
+  if (restart_crc_table_done) return;
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320U ^ (c >> 1) : c >> 1;
+    restart_crc_table[n] = c;
+  }
+  restart_crc_table_done = 1;
+}
+
+/**
+ * @brief Update a CRC-32 with some data, as zlib's crc32() does.
+ */
+static uint32_t restart_crc32(uint32_t crc, const unsigned char *buf,
+                              size_t len) {
+  crc = crc ^ 0xffffffffU;
+  for (size_t i = 0; i < len; i++)
+    crc = restart_crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xffffffffU;
+}
+#else
+#define restart_crc_init()
+
+/**
+ * @brief Update a CRC-32 with some data using zlib.
+ */
+static uint32_t restart_crc32(uint32_t crc, const unsigned char *buf,
+                              size_t len) {
+  while (len > 0) {
+    const uInt n = len > (1U << 30) ? (1U << 30) : (uInt)len;
+    crc = crc32(crc, buf, n);
+    buf += n;
+    len -= n;
+  }
+  return crc;
+}
+#endif
+
+/**
+ * @brief 64-bits FNV-1a hash of some data, used together with the CRC-32 to
+ *        decide whether a chunk changed since the last full dump.
+ */
+static uint64_t restart_hash(const unsigned char *buf, size_t len) {
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, buf + i, 8);
+    hash = (hash ^ word) * 1099511628211ULL;
+  }
+  for (; i < len; i++) hash = (hash ^ buf[i]) * 1099511628211ULL;
+  return hash;
+}
+
+/* Data for the threaded checksums and reads of a section. */
+struct restart_chunk_data {
+  char *ptr;                 /* The data of the section. */
+  size_t len;                /* Its length. */
+  uint32_t *crcs;            /* The CRC-32 of each chunk. */
+  uint64_t *hashes;          /* The hash of each chunk, NULL if not needed. */
+  int fd;                    /* File to read the data from, -1 if none. */
+  off_t offset;              /* Position of the section in the file. */
+  const int *chunk_fds;      /* Or file to read each chunk from. */
+  const off_t *chunk_offset; /* And position of each chunk in that file. */
+  const char *label;         /* For error messages. */
+};
+
+/**
+ * @brief Mapper function reading (if needed) and checksumming chunks of a
+ *        section.
+ */
+static void restart_chunk_mapper(void *map_data, int num_elements,
+                                 void *extra_data) {
+
+  const struct restart_chunk_data *data =
+      (const struct restart_chunk_data *)extra_data;
+  uint32_t *crcs = (uint32_t *)map_data;
+
+  for (int k = 0; k < num_elements; k++) {
+    const size_t chunk = &crcs[k] - data->crcs;
+    const size_t start = chunk * RESTART_CHUNK_SIZE;
+    const size_t len = data->len - start < RESTART_CHUNK_SIZE
+                           ? data->len - start
+                           : RESTART_CHUNK_SIZE;
+    char *ptr = data->ptr + start;
+
+    /* Read the chunk straight from a file? */
+    int fd = data->fd;
+    off_t offset = data->offset + start;
+    if (data->chunk_fds != NULL) {
+      fd = data->chunk_fds[chunk];
+      offset = data->chunk_offset[chunk];
+    }
+    if (fd >= 0) {
+      size_t done = 0;
+      while (done < len) {
+        const ssize_t n = pread(fd, ptr + done, len - done, offset + done);
+        if (n <= 0)
+          error("Failed to restore %s from restart file (%s)", data->label,
+                n < 0 ? strerror(errno) : "unexpected end of file");
+        done += n;
+      }
+    }
+
+    crcs[k] = restart_crc32(0, (const unsigned char *)ptr, len);
+    if (data->hashes != NULL)
+      data->hashes[chunk] = restart_hash((const unsigned char *)ptr, len);
+  }
+}
+
+/**
+ * @brief Checksum the chunks of a section, possibly reading them first.
+ *
+ * The chunks are RESTART_CHUNK_SIZE bytes long and are processed in parallel
+ * when a threadpool is available.
+ *
+ * @param data the section, its reading instructions and the output arrays.
+ */
+static void restart_process_chunks(struct restart_chunk_data *data) {
+
+  restart_crc_init();
+
+  const size_t nr_chunks =
+      (data->len + RESTART_CHUNK_SIZE - 1) / RESTART_CHUNK_SIZE;
+
+  if (restart_threadpool != NULL && nr_chunks > 1)
+    threadpool_map(restart_threadpool, restart_chunk_mapper, data->crcs,
+                   nr_chunks, sizeof(uint32_t), /*chunk=*/1, data);
+  else
+    restart_chunk_mapper(data->crcs, nr_chunks, data);
+}
+
+/**
+ * @brief Checksum of a section from the CRC-32s of its chunks, i.e. the
+ *        CRC-32 of the chunk CRC-32s stored as little-endian integers.
+ */
+static uint32_t restart_combine_crcs(const uint32_t *crcs, size_t nr_chunks) {
+  uint32_t checksum = 0;
+  for (size_t k = 0; k < nr_chunks; k++) {
+    const unsigned char bytes[4] = {crcs[k] & 0xff, (crcs[k] >> 8) & 0xff,
+                                    (crcs[k] >> 16) & 0xff, crcs[k] >> 24};
+    checksum = restart_crc32(checksum, bytes, 4);
+  }
+  return checksum;
+}
+
+/**
+ * @brief Checksum of a section, possibly reading it first from a file.
+ *
+ * @param ptr the data of the section.
+ * @param len its length.
+ * @param fd the file to read the data from, -1 if already in memory.
+ * @param offset the position of the data in the file.
+ * @param label a string to qualify any errors.
+ */
+static uint32_t restart_checksum(void *ptr, size_t len, int fd, off_t offset,
+                                 const char *label) {
+
+  const size_t nr_chunks = (len + RESTART_CHUNK_SIZE - 1) / RESTART_CHUNK_SIZE;
+  uint32_t *crcs = (uint32_t *)malloc(nr_chunks * sizeof(uint32_t));
+  if (crcs == NULL) error("Failed to allocate checksums for %s", label);
+
+  struct restart_chunk_data data = {(char *)ptr, len, crcs, NULL, fd,
+                                    offset,      NULL, NULL, label};
+  restart_process_chunks(&data);
+  const uint32_t checksum = restart_combine_crcs(crcs, nr_chunks);
+
+  free(crcs);
+  return checksum;
+}
+
+/**
+ * @brief Append an entry to the table of sections of the file being written.
+ */
+static void restart_add_section(size_t offset, size_t size, size_t len,
+                                uint32_t checksum, uint32_t flags,
+                                const char *label) {
+
+  if (restart_nr_sections == restart_size_sections) {
+    restart_size_sections =
+        restart_size_sections == 0 ? 256 : 2 * restart_size_sections;
+    restart_sections = (struct restart_section *)realloc(
+        restart_sections,
+        restart_size_sections * sizeof(struct restart_section));
+    if (restart_sections == NULL)
+      error("Failed to allocate restart section table.");
+  }
+
+  struct restart_section *section = &restart_sections[restart_nr_sections++];
+  bzero(section, sizeof(struct restart_section));
+  section->offset = offset;
+  section->size = size;
+  section->len = len;
+  section->checksum = checksum;
+  section->flags = flags;
+  strncpy(section->label, label, LABLEN);
+}
+
+/**
+ * @brief Forget about the last full dump.
+ */
+static void restart_base_clean(void) {
+  for (size_t k = 0; k < restart_base_nr_sections; k++) {
+    free(restart_base[k].crcs);
+    free(restart_base[k].hashes);
+  }
+  free(restart_base);
+  restart_base = NULL;
+  restart_base_nr_sections = 0;
+  restart_base_size_sections = 0;
+}
+
+/**
+ * @brief Remember a large section of the full dump being written.
+ *
+ * Takes ownership of the crcs and hashes arrays.
+ */
+static void restart_base_add(const char *label, size_t offset, size_t len,
+                             uint32_t *crcs, uint64_t *hashes) {
+
+  if (restart_base_nr_sections == restart_base_size_sections) {
+    restart_base_size_sections =
+        restart_base_size_sections == 0 ? 64 : 2 * restart_base_size_sections;
+    restart_base = (struct restart_base_section *)realloc(
+        restart_base,
+        restart_base_size_sections * sizeof(struct restart_base_section));
+    if (restart_base == NULL) error("Failed to allocate restart base table.");
+  }
+
+  struct restart_base_section *base = &restart_base[restart_base_nr_sections++];
+  bzero(base->label, LABLEN + 1);
+  strncpy(base->label, label, LABLEN);
+  base->offset = offset;
+  base->len = len;
+  base->crcs = crcs;
+  base->hashes = hashes;
+}
+
+/**
+ * @brief Find the section of the last full dump matching the next section
+ *        to write, i.e. the one with the same label appearing the same
+ *        number of times before it, if it also has the same length.
+ */
+static const struct restart_base_section *restart_base_find(const char *label,
+                                                            size_t len) {
+
+  /* How many large sections with this label did we write already? */
+  size_t count = 0;
+  for (size_t k = 0; k < restart_nr_sections; k++)
+    if (restart_sections[k].len >= RESTART_ALIGN_THRESHOLD &&
+        strncmp(restart_sections[k].label, label, LABLEN) == 0)
+      count++;
+
+  for (size_t k = 0; k < restart_base_nr_sections; k++) {
+    if (strncmp(restart_base[k].label, label, LABLEN) != 0) continue;
+    if (count-- > 0) continue;
+    return restart_base[k].len == len ? &restart_base[k] : NULL;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Read the trailer of a restart file.
+ *
+ * @result 0 on success.
+ */
+static int restart_read_trailer(int fd, struct restart_trailer *trailer) {
+  struct stat buf;
+  if (fstat(fd, &buf) != 0 ||
+      buf.st_size < (off_t)sizeof(struct restart_trailer))
+    return 1;
+  if (pread(fd, trailer, sizeof(struct restart_trailer),
+            buf.st_size - sizeof(struct restart_trailer)) !=
+      sizeof(struct restart_trailer))
+    return 1;
+  return strncmp(trailer->signature, SWIFT_RESTART_TABLE_SIGNATURE,
+                 sizeof(trailer->signature)) != 0;
+}
+
+/**
+ * @brief Open the full dump a delta restart file refers to.
+ *
+ * This is <file>.full, or <file>.full.prev when restarting from the previous
+ * set of files.
+ *
+ * @param id the identifier of the full dump.
+ * @result the file descriptor.
+ */
+static int restart_open_base(uint64_t id) {
+
+  if (restart_read_base_fd >= 0 && restart_read_base_id == id)
+    return restart_read_base_fd;
+  if (restart_read_base_fd >= 0) close(restart_read_base_fd);
+  restart_read_base_fd = -1;
+
+  const char *suffixes[2] = {".full", ".full.prev"};
+  for (int k = 0; k < 2; k++) {
+    char name[FNAMELEN + 16];
+    snprintf(name, sizeof(name), "%s%s", restart_read_name, suffixes[k]);
+    const int fd = open(name, O_RDONLY);
+    if (fd < 0) continue;
+    struct restart_trailer trailer;
+    if (restart_read_trailer(fd, &trailer) == 0 && trailer.dump_id == id) {
+      restart_read_base_fd = fd;
+      restart_read_base_id = id;
+      return fd;
+    }
+    close(fd);
+  }
+
+  error("Could not find the full dump (%s.full) the restart file refers to.",
+        restart_read_name);
+  return -1;
+}
+
+/**
+ * @brief Make a freshly written full dump the base of the next deltas by
+ *        linking it to <file>.full.
+ *
+ * The previous full dump is kept as <file>.full.prev if the previous restart
+ * files are saved, as these may be deltas referring to it.
+ *
+ * @param filename the name of the full dump.
+ * @param save whether the previous restart files are kept.
+ * @result 0 on success.
+ */
+static int restart_link_base(const char *filename, int save) {
+
+  char full[FNAMELEN + 16];
+  snprintf(full, sizeof(full), "%s.full", filename);
+
+  if (save) {
+    char prev[FNAMELEN + 16];
+    snprintf(prev, sizeof(prev), "%s.full.prev", filename);
+    if (rename(full, prev) != 0 && errno != ENOENT)
+      message("Failed to rename file '%s' to '%s' (%s)", full, prev,
+              strerror(errno));
+  } else if (unlink(full) != 0 && errno != ENOENT) {
+    message("Failed to unlink file '%s' (%s)", full, strerror(errno));
+  }
+
+  if (link(filename, full) != 0) {
+    message("WARNING: Failed to link '%s' to '%s' (%s), the next restart "
+            "dump will be a full one",
+            filename, full, strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Rebuild a section written as a delta against the last full dump.
+ *
+ * The unchanged chunks are read from the full dump and the others from the
+ * restart file, in parallel when a threadpool is available.
+ *
+ * @param ptr the memory to fill.
+ * @param len the length of the section.
+ * @param stream the restart file, positioned after the header.
+ * @param label a string to qualify any errors.
+ * @result the checksum of the section.
+ */
+static uint32_t restart_read_delta(void *ptr, size_t len, FILE *stream,
+                                   const char *label) {
+
+  const size_t nr_chunks = (len + RESTART_CHUNK_SIZE - 1) / RESTART_CHUNK_SIZE;
+
+  struct restart_delta delta;
+  char *from_base = (char *)malloc(nr_chunks);
+  if (from_base == NULL) error("Failed to allocate delta for %s", label);
+  if (fread(&delta, sizeof(struct restart_delta), 1, stream) != 1 ||
+      fread(from_base, 1, nr_chunks, stream) != nr_chunks)
+    error("Failed to read the %s delta from restart file (%s)", label,
+          ferror(stream) ? strerror(errno) : "unexpected end of file");
+
+  const int base_fd = restart_open_base(delta.base_id);
+
+  /* Where does each chunk come from? */
+  uint32_t *crcs = (uint32_t *)malloc(nr_chunks * sizeof(uint32_t));
+  int *fds = (int *)malloc(nr_chunks * sizeof(int));
+  off_t *offsets = (off_t *)malloc(nr_chunks * sizeof(off_t));
+  if (crcs == NULL || fds == NULL || offsets == NULL)
+    error("Failed to allocate delta for %s", label);
+
+  const off_t data_offset = ftello(stream);
+  size_t changed = 0;
+  for (size_t k = 0; k < nr_chunks; k++) {
+    const size_t start = k * RESTART_CHUNK_SIZE;
+    if (from_base[k]) {
+      fds[k] = base_fd;
+      offsets[k] = delta.base_offset + start;
+    } else {
+      fds[k] = fileno(stream);
+      offsets[k] = data_offset + changed;
+      changed += len - start < RESTART_CHUNK_SIZE ? len - start
+                                                  : RESTART_CHUNK_SIZE;
+    }
+  }
+
+  struct restart_chunk_data data = {(char *)ptr, len, crcs, NULL,   -1,
+                                    0,           fds, offsets, label};
+  restart_process_chunks(&data);
+  const uint32_t checksum = restart_combine_crcs(crcs, nr_chunks);
+
+  if (fseeko(stream, data_offset + changed, SEEK_SET) != 0)
+    error("Failed to seek past %s in restart file (%s)", label,
+          strerror(errno));
+
+  free(offsets);
+  free(fds);
+  free(crcs);
+  free(from_base);
+  return checksum;
+}
+
 /**
  * @brief generate a name for a restart file.
  *
@@ -133,6 +648,23 @@ void restart_write(struct engine *e, const char *filename) {
   /* Save a backup the existing restart file, if requested. */
   if (e->restart_save) restart_save_previous(filename);
 
+  /* Full dump or delta against the last full one? */
+  const int use_deltas = e->restart_full_every > 1;
+  restart_write_delta = use_deltas && restart_base_id != 0 &&
+                        restart_nr_deltas < e->restart_full_every - 1;
+  restart_write_base = use_deltas && !restart_write_delta;
+  if (restart_write_base) {
+    restart_base_clean();
+    restart_base_id = ((uint64_t)time(NULL) << 32) ^ (uint64_t)getticks() ^
+                      (uint64_t)e->nodeID;
+    if (restart_base_id == 0) restart_base_id = 1;
+  }
+
+  /* The old file may be a hard link to the last full dump, which must not be
+   * overwritten in place. */
+  if (use_deltas && unlink(filename) != 0 && errno != ENOENT)
+    message("Failed to unlink file '%s' (%s)", filename, strerror(errno));
+
   /* Use a single Lustre stripe with a rank-based OST offset? */
   if (e->restart_lustre_OST_count != 0) {
 
@@ -156,6 +688,11 @@ void restart_write(struct engine *e, const char *filename) {
   if (stream == NULL)
     error("Failed to open restart file: %s (%s)", filename, strerror(errno));
 
+  /* Checksum the large sections using all the threads and keep track of
+   * where each section goes. */
+  restart_threadpool = &e->threadpool;
+  restart_nr_sections = 0;
+
   /* Dump our signature and version. */
   restart_write_blocks((void *)SWIFT_RESTART_SIGNATURE,
                        strlen(SWIFT_RESTART_SIGNATURE), 1, stream, "signature",
@@ -170,20 +707,58 @@ void restart_write(struct engine *e, const char *filename) {
                        strlen(SWIFT_RESTART_END_SIGNATURE), 1, stream,
                        "endsignature", "SWIFT end signature");
 
-  fclose(stream);
+  /* Finish with the table of sections and the trailer locating it. */
+  struct restart_trailer trailer;
+  bzero(&trailer, sizeof(struct restart_trailer));
+  trailer.nr_sections = restart_nr_sections;
+  trailer.table_offset = ftello(stream);
+  if (restart_write_base) trailer.dump_id = restart_base_id;
+  memcpy(trailer.signature, SWIFT_RESTART_TABLE_SIGNATURE,
+         sizeof(trailer.signature));
+  if (fwrite(restart_sections, sizeof(struct restart_section),
+             restart_nr_sections, stream) != restart_nr_sections ||
+      fwrite(&trailer, sizeof(struct restart_trailer), 1, stream) != 1)
+    error("Failed to save the section table to restart file (%s)",
+          strerror(errno));
+
+  free(restart_sections);
+  restart_sections = NULL;
+  restart_nr_sections = 0;
+  restart_size_sections = 0;
+  restart_threadpool = NULL;
+
+  if (fclose(stream) != 0)
+    error("Failed to close restart file: %s (%s)", filename, strerror(errno));
+
+  /* Make this the full dump the next deltas refer to. */
+  if (restart_write_base) {
+    restart_nr_deltas = 0;
+    if (restart_link_base(filename, e->restart_save) != 0) {
+      restart_base_clean();
+      restart_base_id = 0;
+    }
+  } else if (restart_write_delta) {
+    restart_nr_deltas++;
+  }
 
   if (e->verbose)
-    message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
-            clocks_getunit());
+    message("took %.3f %s (%s dump).", clocks_from_ticks(getticks() - tic),
+            clocks_getunit(), restart_write_delta ? "delta" : "full");
+  restart_write_delta = 0;
+  restart_write_base = 0;
 }
 
 /**
  * @brief Read a restart file to construct a saved engine struct state.
  *
+ * The large sections are read and their checksums verified by several
+ * threads.
+ *
  * @param e the engine to recover from the saved state.
  * @param filename name of the file containing the staved state.
+ * @param nr_threads the number of threads to read with.
  */
-void restart_read(struct engine *e, const char *filename) {
+void restart_read(struct engine *e, const char *filename, int nr_threads) {
 
   const ticks tic = getticks();
 
@@ -191,6 +766,11 @@ void restart_read(struct engine *e, const char *filename) {
   if (stream == NULL)
     error("Failed to open restart file: %s (%s)", filename, strerror(errno));
 
+  struct threadpool tp;
+  threadpool_init(&tp, nr_threads);
+  restart_threadpool = &tp;
+  restart_read_name = filename;
+
   /* Get our version and signature back. These should match. */
   char signature[strlen(SWIFT_RESTART_SIGNATURE) + 1];
   int len = strlen(SWIFT_RESTART_SIGNATURE);
@@ -216,7 +796,23 @@ void restart_read(struct engine *e, const char *filename) {
         package_version(), version);
 
   engine_struct_restore(e, stream);
+
+  /* Check that we got to the end of what was written. */
+  char end_signature[strlen(SWIFT_RESTART_END_SIGNATURE) + 1];
+  len = strlen(SWIFT_RESTART_END_SIGNATURE);
+  restart_read_blocks(end_signature, len, 1, stream, NULL,
+                      "SWIFT end signature");
+  end_signature[len] = '\0';
+  if (strncmp(end_signature, SWIFT_RESTART_END_SIGNATURE, len) != 0)
+    error("Restart file %s is corrupted, found '%s' expected '%s'", filename,
+          end_signature, SWIFT_RESTART_END_SIGNATURE);
+
+  restart_threadpool = NULL;
+  threadpool_clean(&tp);
   fclose(stream);
+  if (restart_read_base_fd >= 0) close(restart_read_base_fd);
+  restart_read_base_fd = -1;
+  restart_read_name = NULL;
 
   if (e->verbose)
     message("took %.3f %s.", clocks_from_ticks(getticks() - tic),
@@ -225,8 +821,8 @@ void restart_read(struct engine *e, const char *filename) {
 
 /**
  * @brief Read blocks of memory from a file stream into a memory location.
- *        Exits the application if the read fails and does nothing if the
- *        size is zero.
+ *        Exits the application if the read fails or the data does not match
+ *        its checksum and does nothing if the size is zero.
  *
  * @param ptr pointer to the memory
  * @param size size of a block
@@ -256,10 +852,40 @@ void restart_read_blocks(void *ptr, size_t size, size_t nblocks, FILE *stream,
       strncpy(label, head.label, LABLEN + 1);
     }
 
-    nread = fread(ptr, size, nblocks, stream);
-    if (nread != nblocks)
-      error("Failed to restore %s from restart file (%s)", errstr,
-            ferror(stream) ? strerror(errno) : "unexpected end of file");
+    /* Skip the alignment padding. */
+    if (head.pad > 0 && fseeko(stream, head.pad, SEEK_CUR) != 0)
+      error("Failed to seek to %s in restart file (%s)", errstr,
+            strerror(errno));
+
+    uint32_t checksum;
+    if (head.flags & restart_section_delta) {
+
+      /* Rebuild the section from this file and the last full dump. */
+      checksum = restart_read_delta(ptr, head.len, stream, errstr);
+
+    } else if (restart_threadpool != NULL &&
+               head.len >= RESTART_ALIGN_THRESHOLD) {
+
+      /* Large section: read it in parallel, straight from the file. */
+      const off_t offset = ftello(stream);
+      checksum =
+          restart_checksum(ptr, head.len, fileno(stream), offset, errstr);
+      if (fseeko(stream, offset + head.len, SEEK_SET) != 0)
+        error("Failed to seek past %s in restart file (%s)", errstr,
+              strerror(errno));
+
+    } else {
+
+      nread = fread(ptr, size, nblocks, stream);
+      if (nread != nblocks)
+        error("Failed to restore %s from restart file (%s)", errstr,
+              ferror(stream) ? strerror(errno) : "unexpected end of file");
+      checksum = restart_checksum(ptr, head.len, -1, 0, errstr);
+    }
+
+    if (checksum != head.checksum)
+      error("Checksum mismatch for %s in restart file (%x != %x)", errstr,
+            checksum, head.checksum);
   }
 }
 
@@ -281,19 +907,115 @@ void restart_write_blocks(void *ptr, size_t size, size_t nblocks, FILE *stream,
 
     /* Add a preamble header. */
     struct header head;
+    bzero(&head, sizeof(struct header));
     head.len = nblocks * size;
     strncpy(head.label, label, LABLEN);
     head.label[LABLEN] = '\0';
 
-    /* Now dump it and the data. */
-    size_t nwrite = fwrite(&head, sizeof(struct header), 1, stream);
-    if (nwrite != 1)
-      error("Failed to save %s header to restart file (%s)", errstr,
-            strerror(errno));
+    /* Checksum the chunks. Large sections of the dumps that are involved in
+     * deltas also get a hash of each chunk to recognise the unchanged ones. */
+    const int large = head.len >= RESTART_ALIGN_THRESHOLD;
+    const size_t nr_chunks =
+        (head.len + RESTART_CHUNK_SIZE - 1) / RESTART_CHUNK_SIZE;
+    uint32_t *crcs = (uint32_t *)malloc(nr_chunks * sizeof(uint32_t));
+    uint64_t *hashes = NULL;
+    if (large && (restart_write_delta || restart_write_base))
+      hashes = (uint64_t *)malloc(nr_chunks * sizeof(uint64_t));
+    if (crcs == NULL || (large && (restart_write_delta || restart_write_base) &&
+                         hashes == NULL))
+      error("Failed to allocate checksums for %s", errstr);
+
+    struct restart_chunk_data data = {(char *)ptr, head.len, crcs, hashes, -1,
+                                      0,           NULL,     NULL, errstr};
+    restart_process_chunks(&data);
+    head.checksum = restart_combine_crcs(crcs, nr_chunks);
+
+    /* Which chunks are unchanged since the last full dump? */
+    const struct restart_base_section *base =
+        (large && restart_write_delta) ? restart_base_find(label, head.len)
+                                       : NULL;
+    char *from_base = NULL;
+    size_t nr_from_base = 0;
+    if (base != NULL) {
+      from_base = (char *)malloc(nr_chunks);
+      if (from_base == NULL) error("Failed to allocate delta for %s", errstr);
+      for (size_t k = 0; k < nr_chunks; k++) {
+        from_base[k] = crcs[k] == base->crcs[k] && hashes[k] == base->hashes[k];
+        nr_from_base += from_base[k];
+      }
+    }
+    const off_t offset = ftello(stream) + sizeof(struct header);
+
+    if (nr_from_base > 0) {
+
+      /* Only write the chunks that changed since the full dump. */
+      head.flags = restart_section_delta;
+      struct restart_delta delta;
+      bzero(&delta, sizeof(struct restart_delta));
+      delta.base_offset = base->offset;
+      delta.base_id = restart_base_id;
+
+      if (fwrite(&head, sizeof(struct header), 1, stream) != 1 ||
+          fwrite(&delta, sizeof(struct restart_delta), 1, stream) != 1 ||
+          fwrite(from_base, 1, nr_chunks, stream) != nr_chunks)
+        error("Failed to save %s header to restart file (%s)", errstr,
+              strerror(errno));
+
+      size_t written = sizeof(struct restart_delta) + nr_chunks;
+      for (size_t k = 0; k < nr_chunks; k++) {
+        if (from_base[k]) continue;
+        const size_t start = k * RESTART_CHUNK_SIZE;
+        const size_t len = head.len - start < RESTART_CHUNK_SIZE
+                               ? head.len - start
+                               : RESTART_CHUNK_SIZE;
+        if (fwrite((char *)ptr + start, 1, len, stream) != len)
+          error("Failed to save %s to restart file (%s)", errstr,
+                strerror(errno));
+        written += len;
+      }
+
+      restart_add_section(offset, written, head.len, head.checksum, head.flags,
+                          label);
+      free(crcs);
+      free(hashes);
 
-    nwrite = fwrite(ptr, size, nblocks, stream);
-    if (nwrite != nblocks)
-      error("Failed to save %s to restart file (%s)", errstr, strerror(errno));
+    } else {
+
+      /* Large sections start on a page boundary. */
+      if (large)
+        head.pad = (RESTART_ALIGNMENT - offset % RESTART_ALIGNMENT) %
+                   RESTART_ALIGNMENT;
+
+      /* Now dump it and the data. */
+      size_t nwrite = fwrite(&head, sizeof(struct header), 1, stream);
+      if (nwrite != 1)
+        error("Failed to save %s header to restart file (%s)", errstr,
+              strerror(errno));
+
+      if (head.pad > 0) {
+        const char zeros[RESTART_ALIGNMENT] = {0};
+        if (fwrite(zeros, 1, head.pad, stream) != head.pad)
+          error("Failed to save %s padding to restart file (%s)", errstr,
+                strerror(errno));
+      }
+
+      nwrite = fwrite(ptr, size, nblocks, stream);
+      if (nwrite != nblocks)
+        error("Failed to save %s to restart file (%s)", errstr,
+              strerror(errno));
+
+      restart_add_section(offset + head.pad, head.len, head.len, head.checksum,
+                          head.flags, label);
+
+      /* Keep the checksums of the full dump for the next deltas. */
+      if (large && restart_write_base) {
+        restart_base_add(label, offset + head.pad, head.len, crcs, hashes);
+      } else {
+        free(crcs);
+        free(hashes);
+      }
+    }
+    free(from_base);
   }
 }
 
@@ -355,13 +1077,15 @@ void restart_save_previous(const char *filename) {
  */
 void restart_remove_previous(const char *filename) {
   struct stat buf;
-  char newname[FNAMELEN];
-  strcpy(newname, filename);
-  strcat(newname, ".prev");
-  if (stat(newname, &buf) == 0) {
-    if (unlink(newname) != 0) {
-      /* Worth a complaint, this should not happen. */
-      message("Failed to unlink file '%s' (%s)", newname, strerror(errno));
+  const char *suffixes[2] = {".prev", ".full.prev"};
+  for (int k = 0; k < 2; k++) {
+    char newname[FNAMELEN + 16];
+    snprintf(newname, sizeof(newname), "%s%s", filename, suffixes[k]);
+    if (stat(newname, &buf) == 0) {
+      if (unlink(newname) != 0) {
+        /* Worth a complaint, this should not happen. */
+        message("Failed to unlink file '%s' (%s)", newname, strerror(errno));
+      }
     }
   }
 }
@@ -75,6 +75,9 @@ struct runner {
   /*! Time this runner was active during the last engine_launch. */
   ticks active_time;
 
+  /*! Time at which this runner finished its last task. */
+  ticks last_task_end;
+
 #ifdef WITH_VECTORIZATION
 
   /*! The particle cache of cell ci. */
@@ -163,6 +166,7 @@ void runner_do_collect_rt_times(struct runner *r, struct cell *c,
 void *runner_main(void *data);
 
 ticks runner_get_active_time(const struct runner *restrict r);
+ticks runner_get_last_task_end(const struct runner *restrict r);
 void runner_reset_active_time(struct runner *restrict r);
 
 #endif /* SWIFT_RUNNER_H */
@@ -597,7 +597,9 @@ void *runner_main(void *data) {
         default:
           error("Unknown/invalid task type (%d).", t->type);
       }
-      r->active_time += (getticks() - task_beg);
+      const ticks task_end = getticks();
+      r->active_time += task_end - task_beg;
+      r->last_task_end = task_end;
 
 /* Mark that we have run this task on these cells */
 #ifdef SWIFT_DEBUG_CHECKS
@@ -629,4 +631,11 @@ ticks runner_get_active_time(const struct runner *restrict r) {
   return r->active_time;
 }
 
-void runner_reset_active_time(struct runner *restrict r) { r->active_time = 0; }
+ticks runner_get_last_task_end(const struct runner *restrict r) {
+  return r->last_task_end;
+}
+
+void runner_reset_active_time(struct runner *restrict r) {
+  r->active_time = 0;
+  r->last_task_end = 0;
+}
@@ -152,12 +152,20 @@ void runner_do_cooling(struct runner *r, struct cell *c, int timer) {
       if (c->progeny[k] != NULL) runner_do_cooling(r, c->progeny[k], 0);
   } else {
 
+#ifdef cooling_batch_size
+    /* The cooling modules defining a batch size cool the active particles
+     * in batches */
+    int batch_ind[cooling_batch_size];
+    float batch_dt_cool[cooling_batch_size];
+    float batch_dt_therm[cooling_batch_size];
+    int batch_count = 0;
+#endif
+
     /* Loop over the parts in this cell. */
     for (int i = 0; i < count; i++) {
 
       /* Get a direct pointer on the part. */
       struct part *restrict p = &parts[i];
-      struct xpart *restrict xp = &xparts[i];
 
       /* Anything to do here? (i.e. does this particle need updating?) */
       if (part_is_active(p, e)) {
@@ -178,12 +186,40 @@ void runner_do_cooling(struct runner *r, struct cell *c, int timer) {
           dt_therm = get_timestep(p->time_bin, time_base);
         }
 
+#ifdef cooling_batch_size
+        /* Add the particle to the batch and cool it once the batch is full */
+        batch_ind[batch_count] = i;
+        batch_dt_cool[batch_count] = dt_cool;
+        batch_dt_therm[batch_count] = dt_therm;
+        batch_count++;
+
+        if (batch_count == cooling_batch_size) {
+          cooling_cool_part_batch(constants, us, cosmo, hydro_props,
+                                  entropy_floor_props, pressure_floor,
+                                  cooling_func, parts, xparts, batch_ind,
+                                  batch_dt_cool, batch_dt_therm, batch_count,
+                                  time);
+          batch_count = 0;
+        }
+#else
+        struct xpart *restrict xp = &xparts[i];
+
         /* Let's cool ! */
         cooling_cool_part(constants, us, cosmo, hydro_props,
                           entropy_floor_props, pressure_floor, cooling_func, p,
                           xp, dt_cool, dt_therm, time);
+#endif
       }
     }
+
+#ifdef cooling_batch_size
+    /* Cool what is left in the last batch */
+    if (batch_count > 0)
+      cooling_cool_part_batch(constants, us, cosmo, hydro_props,
+                              entropy_floor_props, pressure_floor, cooling_func,
+                              parts, xparts, batch_ind, batch_dt_cool,
+                              batch_dt_therm, batch_count, time);
+#endif
   }
 
   if (timer) TIMER_TOC(timer_do_cooling);
@@ -23,6 +23,7 @@
 #include <config.h>
 
 /* Some standard headers. */
+#include <float.h>
 #include <limits.h>
 #include <math.h>
 #include <pthread.h>
@@ -1730,6 +1731,7 @@ struct task *scheduler_addtask(struct scheduler *s, enum task_types type,
   t->skip = 1; /* Mark tasks as skip by default. */
   t->implicit = implicit;
   t->weight = 0;
+  t->cost = 0;
   t->rank = 0;
   t->nr_unlock_tasks = 0;
 #ifdef SWIFT_DEBUG_TASKS
@@ -1950,396 +1952,597 @@ void scheduler_reset(struct scheduler *s, int size) {
 }
 
 /**
- * @brief Compute the task weights
+ * @brief Estimate the cost of a task from the particle counts of its cells.
  *
- * @param s The #scheduler.
- * @param verbose Are we talkative?
+ * These are the hard-coded cost formulas used to weight the tasks when no
+ * measured costs are available. The measured cost model is fitted against
+ * these estimates.
+ *
+ * @param t The #task.
+ * @param nodeID The ID of the node we are running on.
  */
-void scheduler_reweight(struct scheduler *s, int verbose) {
-  const int nr_tasks = s->nr_tasks;
-  int *tid = s->tasks_ind;
-  struct task *tasks = s->tasks;
-  const int nodeID = s->nodeID;
+static float scheduler_task_cost_estimate(const struct task *t,
+                                          const int nodeID) {
   const float wscale = 0.001f;
-  const ticks tic = getticks();
-
-  /* Run through the tasks backwards and set their weights. */
-  for (int k = nr_tasks - 1; k >= 0; k--) {
-    struct task *t = &tasks[tid[k]];
-    float cost = 0.f;
-    t->weight = 0.f;
-
-    for (int j = 0; j < t->nr_unlock_tasks; j++)
-      t->weight += t->unlock_tasks[j]->weight;
+  float cost = 0.f;
+
+  const float count_i = (t->ci != NULL) ? t->ci->hydro.count : 0.f;
+  const float count_j = (t->cj != NULL) ? t->cj->hydro.count : 0.f;
+  const float gcount_i = (t->ci != NULL) ? t->ci->grav.count : 0.f;
+  const float gcount_j = (t->cj != NULL) ? t->cj->grav.count : 0.f;
+  const float scount_i = (t->ci != NULL) ? t->ci->stars.count : 0.f;
+  const float scount_j = (t->cj != NULL) ? t->cj->stars.count : 0.f;
+  const float sink_count_i = (t->ci != NULL) ? t->ci->sinks.count : 0.f;
+  const float sink_count_j = (t->cj != NULL) ? t->cj->sinks.count : 0.f;
+  const float bcount_i = (t->ci != NULL) ? t->ci->black_holes.count : 0.f;
+  const float bcount_j = (t->cj != NULL) ? t->cj->black_holes.count : 0.f;
+
+  switch (t->type) {
+    case task_type_sort:
+    case task_type_rt_sort:
+      cost = wscale * intrinsics_popcount(t->flags) * count_i *
+             (sizeof(int) * 8 - (count_i ? intrinsics_clz(count_i) : 0));
+      break;
 
-    const float count_i = (t->ci != NULL) ? t->ci->hydro.count : 0.f;
-    const float count_j = (t->cj != NULL) ? t->cj->hydro.count : 0.f;
-    const float gcount_i = (t->ci != NULL) ? t->ci->grav.count : 0.f;
-    const float gcount_j = (t->cj != NULL) ? t->cj->grav.count : 0.f;
-    const float scount_i = (t->ci != NULL) ? t->ci->stars.count : 0.f;
-    const float scount_j = (t->cj != NULL) ? t->cj->stars.count : 0.f;
-    const float sink_count_i = (t->ci != NULL) ? t->ci->sinks.count : 0.f;
-    const float sink_count_j = (t->cj != NULL) ? t->cj->sinks.count : 0.f;
-    const float bcount_i = (t->ci != NULL) ? t->ci->black_holes.count : 0.f;
-    const float bcount_j = (t->cj != NULL) ? t->cj->black_holes.count : 0.f;
+    case task_type_stars_sort:
+      cost = wscale * intrinsics_popcount(t->flags) * scount_i *
+             (sizeof(int) * 8 - (scount_i ? intrinsics_clz(scount_i) : 0));
+      break;
 
-    switch (t->type) {
-      case task_type_sort:
-      case task_type_rt_sort:
-        cost = wscale * intrinsics_popcount(t->flags) * count_i *
-               (sizeof(int) * 8 - (count_i ? intrinsics_clz(count_i) : 0));
-        break;
+    case task_type_stars_resort:
+      cost = wscale * intrinsics_popcount(t->flags) * scount_i *
+             (sizeof(int) * 8 - (scount_i ? intrinsics_clz(scount_i) : 0));
+      break;
 
-      case task_type_stars_sort:
-        cost = wscale * intrinsics_popcount(t->flags) * scount_i *
-               (sizeof(int) * 8 - (scount_i ? intrinsics_clz(scount_i) : 0));
-        break;
+    case task_type_self:
+      if (t->subtype == task_subtype_grav) {
+        cost = 1.f * (wscale * gcount_i) * gcount_i;
+      } else if (t->subtype == task_subtype_external_grav)
+        cost = 1.f * wscale * gcount_i;
+      else if (t->subtype == task_subtype_stars_density ||
+               t->subtype == task_subtype_stars_prep1 ||
+               t->subtype == task_subtype_stars_prep2 ||
+               t->subtype == task_subtype_stars_feedback)
+        cost = 1.f * wscale * scount_i * count_i;
+      else if (t->subtype == task_subtype_sink_swallow ||
+               t->subtype == task_subtype_sink_do_gas_swallow)
+        cost = 1.f * wscale * count_i * sink_count_i;
+      else if (t->subtype == task_subtype_sink_do_sink_swallow)
+        cost = 1.f * wscale * sink_count_i * sink_count_i;
+      else if (t->subtype == task_subtype_bh_density ||
+               t->subtype == task_subtype_bh_swallow ||
+               t->subtype == task_subtype_bh_feedback)
+        cost = 1.f * wscale * bcount_i * count_i;
+      else if (t->subtype == task_subtype_do_gas_swallow)
+        cost = 1.f * wscale * count_i;
+      else if (t->subtype == task_subtype_do_bh_swallow)
+        cost = 1.f * wscale * bcount_i;
+      else if (t->subtype == task_subtype_density ||
+               t->subtype == task_subtype_gradient ||
+               t->subtype == task_subtype_force ||
+               t->subtype == task_subtype_limiter)
+        cost = 1.f * (wscale * count_i) * count_i;
+      else if (t->subtype == task_subtype_rt_gradient)
+        cost = 1.f * wscale * count_i * count_i;
+      else if (t->subtype == task_subtype_rt_transport)
+        cost = 1.f * wscale * count_i * count_i;
+      else
+        error("Untreated sub-type for selfs: %s",
+              subtaskID_names[t->subtype]);
+      break;
 
-      case task_type_stars_resort:
-        cost = wscale * intrinsics_popcount(t->flags) * scount_i *
-               (sizeof(int) * 8 - (scount_i ? intrinsics_clz(scount_i) : 0));
-        break;
+    case task_type_pair:
+      if (t->subtype == task_subtype_grav) {
+        if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID)
+          cost = 3.f * (wscale * gcount_i) * gcount_j;
+        else
+          cost = 2.f * (wscale * gcount_i) * gcount_j;
 
-      case task_type_self:
-        if (t->subtype == task_subtype_grav) {
-          cost = 1.f * (wscale * gcount_i) * gcount_i;
-        } else if (t->subtype == task_subtype_external_grav)
-          cost = 1.f * wscale * gcount_i;
-        else if (t->subtype == task_subtype_stars_density ||
+      } else if (t->subtype == task_subtype_stars_density ||
                  t->subtype == task_subtype_stars_prep1 ||
                  t->subtype == task_subtype_stars_prep2 ||
-                 t->subtype == task_subtype_stars_feedback)
-          cost = 1.f * wscale * scount_i * count_i;
-        else if (t->subtype == task_subtype_sink_swallow ||
-                 t->subtype == task_subtype_sink_do_gas_swallow)
-          cost = 1.f * wscale * count_i * sink_count_i;
-        else if (t->subtype == task_subtype_sink_do_sink_swallow)
-          cost = 1.f * wscale * sink_count_i * sink_count_i;
-        else if (t->subtype == task_subtype_bh_density ||
+                 t->subtype == task_subtype_stars_feedback) {
+        if (t->ci->nodeID != nodeID)
+          cost = 3.f * wscale * count_i * scount_j * sid_scale[t->flags];
+        else if (t->cj->nodeID != nodeID)
+          cost = 3.f * wscale * scount_i * count_j * sid_scale[t->flags];
+        else
+          cost = 2.f * wscale * (scount_i * count_j + scount_j * count_i) *
+                 sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_sink_swallow ||
+                 t->subtype == task_subtype_sink_do_gas_swallow) {
+        if (t->ci->nodeID != nodeID)
+          cost = 3.f * wscale * count_i * sink_count_j * sid_scale[t->flags];
+        else if (t->cj->nodeID != nodeID)
+          cost = 3.f * wscale * sink_count_i * count_j * sid_scale[t->flags];
+        else
+          cost = 2.f * wscale *
+                 (sink_count_i * count_j + sink_count_j * count_i) *
+                 sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
+        if (t->ci->nodeID != nodeID)
+          cost = 3.f * wscale * sink_count_i * sink_count_j *
+                 sid_scale[t->flags];
+        else if (t->cj->nodeID != nodeID)
+          cost = 3.f * wscale * sink_count_i * sink_count_j *
+                 sid_scale[t->flags];
+        else
+          cost = 2.f * wscale *
+                 (sink_count_i * sink_count_j + sink_count_j * sink_count_i) *
+                 sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_bh_density ||
                  t->subtype == task_subtype_bh_swallow ||
-                 t->subtype == task_subtype_bh_feedback)
-          cost = 1.f * wscale * bcount_i * count_i;
-        else if (t->subtype == task_subtype_do_gas_swallow)
-          cost = 1.f * wscale * count_i;
-        else if (t->subtype == task_subtype_do_bh_swallow)
-          cost = 1.f * wscale * bcount_i;
-        else if (t->subtype == task_subtype_density ||
+                 t->subtype == task_subtype_bh_feedback) {
+        if (t->ci->nodeID != nodeID)
+          cost = 3.f * wscale * count_i * bcount_j * sid_scale[t->flags];
+        else if (t->cj->nodeID != nodeID)
+          cost = 3.f * wscale * bcount_i * count_j * sid_scale[t->flags];
+        else
+          cost = 2.f * wscale * (bcount_i * count_j + bcount_j * count_i) *
+                 sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_do_gas_swallow) {
+        cost = 1.f * wscale * (count_i + count_j);
+
+      } else if (t->subtype == task_subtype_do_bh_swallow) {
+        cost = 1.f * wscale * (bcount_i + bcount_j);
+
+      } else if (t->subtype == task_subtype_density ||
                  t->subtype == task_subtype_gradient ||
                  t->subtype == task_subtype_force ||
-                 t->subtype == task_subtype_limiter)
-          cost = 1.f * (wscale * count_i) * count_i;
-        else if (t->subtype == task_subtype_rt_gradient)
-          cost = 1.f * wscale * count_i * count_i;
-        else if (t->subtype == task_subtype_rt_transport)
-          cost = 1.f * wscale * count_i * count_i;
+                 t->subtype == task_subtype_limiter) {
+        if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID)
+          cost = 3.f * (wscale * count_i) * count_j * sid_scale[t->flags];
         else
-          error("Untreated sub-type for selfs: %s",
-                subtaskID_names[t->subtype]);
-        break;
-
-      case task_type_pair:
-        if (t->subtype == task_subtype_grav) {
-          if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID)
-            cost = 3.f * (wscale * gcount_i) * gcount_j;
-          else
-            cost = 2.f * (wscale * gcount_i) * gcount_j;
-
-        } else if (t->subtype == task_subtype_stars_density ||
-                   t->subtype == task_subtype_stars_prep1 ||
-                   t->subtype == task_subtype_stars_prep2 ||
-                   t->subtype == task_subtype_stars_feedback) {
-          if (t->ci->nodeID != nodeID)
-            cost = 3.f * wscale * count_i * scount_j * sid_scale[t->flags];
-          else if (t->cj->nodeID != nodeID)
-            cost = 3.f * wscale * scount_i * count_j * sid_scale[t->flags];
-          else
-            cost = 2.f * wscale * (scount_i * count_j + scount_j * count_i) *
-                   sid_scale[t->flags];
-
-        } else if (t->subtype == task_subtype_sink_swallow ||
-                   t->subtype == task_subtype_sink_do_gas_swallow) {
-          if (t->ci->nodeID != nodeID)
-            cost = 3.f * wscale * count_i * sink_count_j * sid_scale[t->flags];
-          else if (t->cj->nodeID != nodeID)
-            cost = 3.f * wscale * sink_count_i * count_j * sid_scale[t->flags];
-          else
-            cost = 2.f * wscale *
-                   (sink_count_i * count_j + sink_count_j * count_i) *
-                   sid_scale[t->flags];
-
-        } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
-          if (t->ci->nodeID != nodeID)
-            cost = 3.f * wscale * sink_count_i * sink_count_j *
-                   sid_scale[t->flags];
-          else if (t->cj->nodeID != nodeID)
-            cost = 3.f * wscale * sink_count_i * sink_count_j *
-                   sid_scale[t->flags];
-          else
-            cost = 2.f * wscale *
-                   (sink_count_i * sink_count_j + sink_count_j * sink_count_i) *
-                   sid_scale[t->flags];
-
-        } else if (t->subtype == task_subtype_bh_density ||
-                   t->subtype == task_subtype_bh_swallow ||
-                   t->subtype == task_subtype_bh_feedback) {
-          if (t->ci->nodeID != nodeID)
-            cost = 3.f * wscale * count_i * bcount_j * sid_scale[t->flags];
-          else if (t->cj->nodeID != nodeID)
-            cost = 3.f * wscale * bcount_i * count_j * sid_scale[t->flags];
-          else
-            cost = 2.f * wscale * (bcount_i * count_j + bcount_j * count_i) *
-                   sid_scale[t->flags];
-
-        } else if (t->subtype == task_subtype_do_gas_swallow) {
-          cost = 1.f * wscale * (count_i + count_j);
-
-        } else if (t->subtype == task_subtype_do_bh_swallow) {
-          cost = 1.f * wscale * (bcount_i + bcount_j);
-
-        } else if (t->subtype == task_subtype_density ||
-                   t->subtype == task_subtype_gradient ||
-                   t->subtype == task_subtype_force ||
-                   t->subtype == task_subtype_limiter) {
-          if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID)
-            cost = 3.f * (wscale * count_i) * count_j * sid_scale[t->flags];
-          else
-            cost = 2.f * (wscale * count_i) * count_j * sid_scale[t->flags];
-
-        } else if (t->subtype == task_subtype_rt_gradient) {
-          cost = 1.f * wscale * count_i * count_j;
-        } else if (t->subtype == task_subtype_rt_transport) {
-          cost = 1.f * wscale * count_i * count_j;
-        } else {
-          error("Untreated sub-type for pairs: %s",
-                subtaskID_names[t->subtype]);
-        }
-        break;
+          cost = 2.f * (wscale * count_i) * count_j * sid_scale[t->flags];
+
+      } else if (t->subtype == task_subtype_rt_gradient) {
+        cost = 1.f * wscale * count_i * count_j;
+      } else if (t->subtype == task_subtype_rt_transport) {
+        cost = 1.f * wscale * count_i * count_j;
+      } else {
+        error("Untreated sub-type for pairs: %s",
+              subtaskID_names[t->subtype]);
+      }
+      break;
 
-      case task_type_sub_pair:
+    case task_type_sub_pair:
 #ifdef SWIFT_DEBUG_CHECKS
-        if (t->flags < 0) error("Negative flag value!");
+      if (t->flags < 0) error("Negative flag value!");
 #endif
-        if (t->subtype == task_subtype_stars_density ||
-            t->subtype == task_subtype_stars_prep1 ||
-            t->subtype == task_subtype_stars_prep2 ||
-            t->subtype == task_subtype_stars_feedback) {
-          if (t->ci->nodeID != nodeID) {
-            cost = 3.f * (wscale * count_i) * scount_j * sid_scale[t->flags];
-          } else if (t->cj->nodeID != nodeID) {
-            cost = 3.f * (wscale * scount_i) * count_j * sid_scale[t->flags];
-          } else {
-            cost = 2.f * wscale * (scount_i * count_j + scount_j * count_i) *
-                   sid_scale[t->flags];
-          }
+      if (t->subtype == task_subtype_stars_density ||
+          t->subtype == task_subtype_stars_prep1 ||
+          t->subtype == task_subtype_stars_prep2 ||
+          t->subtype == task_subtype_stars_feedback) {
+        if (t->ci->nodeID != nodeID) {
+          cost = 3.f * (wscale * count_i) * scount_j * sid_scale[t->flags];
+        } else if (t->cj->nodeID != nodeID) {
+          cost = 3.f * (wscale * scount_i) * count_j * sid_scale[t->flags];
+        } else {
+          cost = 2.f * wscale * (scount_i * count_j + scount_j * count_i) *
+                 sid_scale[t->flags];
+        }
 
-        } else if (t->subtype == task_subtype_sink_swallow ||
-                   t->subtype == task_subtype_sink_do_gas_swallow) {
-          if (t->ci->nodeID != nodeID) {
-            cost =
-                3.f * (wscale * count_i) * sink_count_j * sid_scale[t->flags];
-          } else if (t->cj->nodeID != nodeID) {
-            cost =
-                3.f * (wscale * sink_count_i) * count_j * sid_scale[t->flags];
-          } else {
-            cost = 2.f * wscale *
-                   (sink_count_i * count_j + sink_count_j * count_i) *
-                   sid_scale[t->flags];
-          }
+      } else if (t->subtype == task_subtype_sink_swallow ||
+                 t->subtype == task_subtype_sink_do_gas_swallow) {
+        if (t->ci->nodeID != nodeID) {
+          cost =
+              3.f * (wscale * count_i) * sink_count_j * sid_scale[t->flags];
+        } else if (t->cj->nodeID != nodeID) {
+          cost =
+              3.f * (wscale * sink_count_i) * count_j * sid_scale[t->flags];
+        } else {
+          cost = 2.f * wscale *
+                 (sink_count_i * count_j + sink_count_j * count_i) *
+                 sid_scale[t->flags];
+        }
 
-        } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
-          if (t->ci->nodeID != nodeID) {
-            cost = 3.f * (wscale * sink_count_i) * sink_count_j *
-                   sid_scale[t->flags];
-          } else if (t->cj->nodeID != nodeID) {
-            cost = 3.f * (wscale * sink_count_i) * sink_count_j *
-                   sid_scale[t->flags];
-          } else {
-            cost = 2.f * wscale *
-                   (sink_count_i * sink_count_j + sink_count_j * sink_count_i) *
-                   sid_scale[t->flags];
-          }
-        } else if (t->subtype == task_subtype_bh_density ||
-                   t->subtype == task_subtype_bh_swallow ||
-                   t->subtype == task_subtype_bh_feedback) {
-          if (t->ci->nodeID != nodeID) {
-            cost = 3.f * (wscale * count_i) * bcount_j * sid_scale[t->flags];
-          } else if (t->cj->nodeID != nodeID) {
-            cost = 3.f * (wscale * bcount_i) * count_j * sid_scale[t->flags];
-          } else {
-            cost = 2.f * wscale * (bcount_i * count_j + bcount_j * count_i) *
-                   sid_scale[t->flags];
-          }
+      } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
+        if (t->ci->nodeID != nodeID) {
+          cost = 3.f * (wscale * sink_count_i) * sink_count_j *
+                 sid_scale[t->flags];
+        } else if (t->cj->nodeID != nodeID) {
+          cost = 3.f * (wscale * sink_count_i) * sink_count_j *
+                 sid_scale[t->flags];
+        } else {
+          cost = 2.f * wscale *
+                 (sink_count_i * sink_count_j + sink_count_j * sink_count_i) *
+                 sid_scale[t->flags];
+        }
+      } else if (t->subtype == task_subtype_bh_density ||
+                 t->subtype == task_subtype_bh_swallow ||
+                 t->subtype == task_subtype_bh_feedback) {
+        if (t->ci->nodeID != nodeID) {
+          cost = 3.f * (wscale * count_i) * bcount_j * sid_scale[t->flags];
+        } else if (t->cj->nodeID != nodeID) {
+          cost = 3.f * (wscale * bcount_i) * count_j * sid_scale[t->flags];
+        } else {
+          cost = 2.f * wscale * (bcount_i * count_j + bcount_j * count_i) *
+                 sid_scale[t->flags];
+        }
 
-        } else if (t->subtype == task_subtype_do_gas_swallow) {
-          cost = 1.f * wscale * (count_i + count_j);
+      } else if (t->subtype == task_subtype_do_gas_swallow) {
+        cost = 1.f * wscale * (count_i + count_j);
 
-        } else if (t->subtype == task_subtype_do_bh_swallow) {
-          cost = 1.f * wscale * (bcount_i + bcount_j);
+      } else if (t->subtype == task_subtype_do_bh_swallow) {
+        cost = 1.f * wscale * (bcount_i + bcount_j);
 
-        } else if (t->subtype == task_subtype_density ||
-                   t->subtype == task_subtype_gradient ||
-                   t->subtype == task_subtype_force ||
-                   t->subtype == task_subtype_limiter) {
-          if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID) {
-            cost = 3.f * (wscale * count_i) * count_j * sid_scale[t->flags];
-          } else {
-            cost = 2.f * (wscale * count_i) * count_j * sid_scale[t->flags];
-          }
-        } else if (t->subtype == task_subtype_rt_gradient) {
-          cost = 1.f * wscale * count_i * count_j;
-        } else if (t->subtype == task_subtype_rt_transport) {
-          cost = 1.f * wscale * count_i * count_j;
+      } else if (t->subtype == task_subtype_density ||
+                 t->subtype == task_subtype_gradient ||
+                 t->subtype == task_subtype_force ||
+                 t->subtype == task_subtype_limiter) {
+        if (t->ci->nodeID != nodeID || t->cj->nodeID != nodeID) {
+          cost = 3.f * (wscale * count_i) * count_j * sid_scale[t->flags];
         } else {
-          error("Untreated sub-type for sub-pairs: %s",
-                subtaskID_names[t->subtype]);
+          cost = 2.f * (wscale * count_i) * count_j * sid_scale[t->flags];
         }
-        break;
+      } else if (t->subtype == task_subtype_rt_gradient) {
+        cost = 1.f * wscale * count_i * count_j;
+      } else if (t->subtype == task_subtype_rt_transport) {
+        cost = 1.f * wscale * count_i * count_j;
+      } else {
+        error("Untreated sub-type for sub-pairs: %s",
+              subtaskID_names[t->subtype]);
+      }
+      break;
 
-      case task_type_sub_self:
-        if (t->subtype == task_subtype_stars_density ||
-            t->subtype == task_subtype_stars_prep1 ||
-            t->subtype == task_subtype_stars_prep2 ||
-            t->subtype == task_subtype_stars_feedback) {
-          cost = 1.f * (wscale * scount_i) * count_i;
-        } else if (t->subtype == task_subtype_sink_swallow ||
-                   t->subtype == task_subtype_sink_do_gas_swallow) {
-          cost = 1.f * (wscale * sink_count_i) * count_i;
-        } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
-          cost = 1.f * (wscale * sink_count_i) * sink_count_i;
-        } else if (t->subtype == task_subtype_bh_density ||
-                   t->subtype == task_subtype_bh_swallow ||
-                   t->subtype == task_subtype_bh_feedback) {
-          cost = 1.f * (wscale * bcount_i) * count_i;
-        } else if (t->subtype == task_subtype_do_gas_swallow) {
-          cost = 1.f * wscale * count_i;
-        } else if (t->subtype == task_subtype_do_bh_swallow) {
-          cost = 1.f * wscale * bcount_i;
-        } else if (t->subtype == task_subtype_density ||
-                   t->subtype == task_subtype_gradient ||
-                   t->subtype == task_subtype_force ||
-                   t->subtype == task_subtype_limiter) {
-          cost = 1.f * (wscale * count_i) * count_i;
-        } else if (t->subtype == task_subtype_rt_gradient) {
-          cost = 1.f * wscale * scount_i * count_i;
-        } else if (t->subtype == task_subtype_rt_transport) {
-          cost = 1.f * wscale * scount_i * count_i;
-        } else {
-          error("Untreated sub-type for sub-selfs: %s",
-                subtaskID_names[t->subtype]);
-        }
-        break;
-      case task_type_ghost:
-        if (t->ci == t->ci->hydro.super) cost = wscale * count_i;
-        break;
-      case task_type_extra_ghost:
-        if (t->ci == t->ci->hydro.super) cost = wscale * count_i;
-        break;
-      case task_type_stars_ghost:
-        if (t->ci == t->ci->hydro.super) cost = wscale * scount_i;
-        break;
-      case task_type_bh_density_ghost:
-        if (t->ci == t->ci->hydro.super) cost = wscale * bcount_i;
-        break;
-      case task_type_bh_swallow_ghost2:
-        if (t->ci == t->ci->hydro.super) cost = wscale * bcount_i;
-        break;
-      case task_type_drift_part:
-        cost = wscale * count_i;
-        break;
-      case task_type_drift_gpart:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_drift_spart:
-        cost = wscale * scount_i;
-        break;
-      case task_type_drift_sink:
-        cost = wscale * sink_count_i;
-        break;
-      case task_type_drift_bpart:
-        cost = wscale * bcount_i;
-        break;
-      case task_type_init_grav:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_grav_down:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_grav_long_range:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_grav_mm:
-        cost = wscale * (gcount_i + gcount_j);
-        break;
-      case task_type_end_hydro_force:
-        cost = wscale * count_i;
-        break;
-      case task_type_end_grav_force:
-        cost = wscale * gcount_i;
-        break;
-      case task_type_cooling:
-        cost = wscale * count_i;
-        break;
-      case task_type_star_formation:
-        cost = wscale * (count_i + scount_i);
-        break;
-      case task_type_star_formation_sink:
-        cost = wscale * (sink_count_i + scount_i);
-        break;
-      case task_type_sink_formation:
-        cost = wscale * (count_i + sink_count_i);
-        break;
-      case task_type_rt_ghost1:
-        cost = wscale * count_i;
-        break;
-      case task_type_rt_ghost2:
-        cost = wscale * count_i;
-        break;
-      case task_type_rt_tchem:
-        cost = wscale * count_i;
-        break;
-      case task_type_rt_advance_cell_time:
-      case task_type_rt_collect_times:
-        cost = wscale;
-        break;
-      case task_type_csds:
-        cost =
-            wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
-        break;
-      case task_type_kick1:
-        cost =
-            wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
-        break;
-      case task_type_kick2:
-        cost =
-            wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
-        break;
-      case task_type_timestep:
-        cost =
-            wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
-        break;
-      case task_type_timestep_limiter:
-        cost = wscale * count_i;
-        break;
-      case task_type_timestep_sync:
-        cost = wscale * count_i;
-        break;
-      case task_type_send:
-        if (count_i < 1e5)
-          cost = 10.f * (wscale * count_i) * count_i;
-        else
-          cost = 2e9;
-        break;
-      case task_type_recv:
-        if (count_i < 1e5)
-          cost = 5.f * (wscale * count_i) * count_i;
-        else
-          cost = 1e9;
-        break;
-      default:
-        cost = 0;
-        break;
+    case task_type_sub_self:
+      if (t->subtype == task_subtype_stars_density ||
+          t->subtype == task_subtype_stars_prep1 ||
+          t->subtype == task_subtype_stars_prep2 ||
+          t->subtype == task_subtype_stars_feedback) {
+        cost = 1.f * (wscale * scount_i) * count_i;
+      } else if (t->subtype == task_subtype_sink_swallow ||
+                 t->subtype == task_subtype_sink_do_gas_swallow) {
+        cost = 1.f * (wscale * sink_count_i) * count_i;
+      } else if (t->subtype == task_subtype_sink_do_sink_swallow) {
+        cost = 1.f * (wscale * sink_count_i) * sink_count_i;
+      } else if (t->subtype == task_subtype_bh_density ||
+                 t->subtype == task_subtype_bh_swallow ||
+                 t->subtype == task_subtype_bh_feedback) {
+        cost = 1.f * (wscale * bcount_i) * count_i;
+      } else if (t->subtype == task_subtype_do_gas_swallow) {
+        cost = 1.f * wscale * count_i;
+      } else if (t->subtype == task_subtype_do_bh_swallow) {
+        cost = 1.f * wscale * bcount_i;
+      } else if (t->subtype == task_subtype_density ||
+                 t->subtype == task_subtype_gradient ||
+                 t->subtype == task_subtype_force ||
+                 t->subtype == task_subtype_limiter) {
+        cost = 1.f * (wscale * count_i) * count_i;
+      } else if (t->subtype == task_subtype_rt_gradient) {
+        cost = 1.f * wscale * scount_i * count_i;
+      } else if (t->subtype == task_subtype_rt_transport) {
+        cost = 1.f * wscale * scount_i * count_i;
+      } else {
+        error("Untreated sub-type for sub-selfs: %s",
+              subtaskID_names[t->subtype]);
+      }
+      break;
+    case task_type_ghost:
+      if (t->ci == t->ci->hydro.super) cost = wscale * count_i;
+      break;
+    case task_type_extra_ghost:
+      if (t->ci == t->ci->hydro.super) cost = wscale * count_i;
+      break;
+    case task_type_stars_ghost:
+      if (t->ci == t->ci->hydro.super) cost = wscale * scount_i;
+      break;
+    case task_type_bh_density_ghost:
+      if (t->ci == t->ci->hydro.super) cost = wscale * bcount_i;
+      break;
+    case task_type_bh_swallow_ghost2:
+      if (t->ci == t->ci->hydro.super) cost = wscale * bcount_i;
+      break;
+    case task_type_drift_part:
+      cost = wscale * count_i;
+      break;
+    case task_type_drift_gpart:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_drift_spart:
+      cost = wscale * scount_i;
+      break;
+    case task_type_drift_sink:
+      cost = wscale * sink_count_i;
+      break;
+    case task_type_drift_bpart:
+      cost = wscale * bcount_i;
+      break;
+    case task_type_init_grav:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_grav_down:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_grav_long_range:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_grav_mm:
+      cost = wscale * (gcount_i + gcount_j);
+      break;
+    case task_type_end_hydro_force:
+      cost = wscale * count_i;
+      break;
+    case task_type_end_grav_force:
+      cost = wscale * gcount_i;
+      break;
+    case task_type_cooling:
+      cost = wscale * count_i;
+      break;
+    case task_type_star_formation:
+      cost = wscale * (count_i + scount_i);
+      break;
+    case task_type_star_formation_sink:
+      cost = wscale * (sink_count_i + scount_i);
+      break;
+    case task_type_sink_formation:
+      cost = wscale * (count_i + sink_count_i);
+      break;
+    case task_type_rt_ghost1:
+      cost = wscale * count_i;
+      break;
+    case task_type_rt_ghost2:
+      cost = wscale * count_i;
+      break;
+    case task_type_rt_tchem:
+      cost = wscale * count_i;
+      break;
+    case task_type_rt_advance_cell_time:
+    case task_type_rt_collect_times:
+      cost = wscale;
+      break;
+    case task_type_csds:
+      cost =
+          wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
+      break;
+    case task_type_kick1:
+      cost =
+          wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
+      break;
+    case task_type_kick2:
+      cost =
+          wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
+      break;
+    case task_type_timestep:
+      cost =
+          wscale * (count_i + gcount_i + scount_i + sink_count_i + bcount_i);
+      break;
+    case task_type_timestep_limiter:
+      cost = wscale * count_i;
+      break;
+    case task_type_timestep_sync:
+      cost = wscale * count_i;
+      break;
+    case task_type_send:
+      if (count_i < 1e5)
+        cost = 10.f * (wscale * count_i) * count_i;
+      else
+        cost = 2e9;
+      break;
+    case task_type_recv:
+      if (count_i < 1e5)
+        cost = 5.f * (wscale * count_i) * count_i;
+      else
+        cost = 1e9;
+      break;
+    default:
+      cost = 0;
+      break;
+  }
+
+  return cost;
+}
+
+/**
+ * @brief Return the cost of a task, as used to weight it.
+ *
+ * Once the measured cost model has seen some tasks this is the predicted
+ * run time of the task in ticks. Otherwise it is the estimate from the
+ * particle counts.
+ *
+ * @param s The #scheduler.
+ * @param t The #task.
+ */
+float scheduler_task_cost(const struct scheduler *s, const struct task *t) {
+
+  const float estimate = scheduler_task_cost_estimate(t, s->nodeID);
+
+  const struct scheduler_cost_model *model = s->cost_model;
+  if (model == NULL || !model->fitted || estimate <= 0.f) return estimate;
+
+  /* Use the fit for this kind of task if we have measured enough of them,
+   * otherwise convert the estimate to ticks using the global fit. */
+  const struct scheduler_cost_fit *fit = &model->fits[t->type][t->subtype];
+  if (fit->n >= model->min_samples) {
+    const float cost = fit->intercept + fit->slope * estimate;
+    return (cost > 0.f) ? cost : 0.f;
+  } else {
+    return model->slope_all * estimate;
+  }
+}
+
+/**
+ * @brief Allocate and zero the measured task cost model.
+ *
+ * The parameters of the model are set by the caller.
+ *
+ * @param s The #scheduler.
+ */
+void scheduler_cost_model_init(struct scheduler *s) {
+
+  s->cost_model = (struct scheduler_cost_model *)swift_malloc(
+      "cost_model", sizeof(struct scheduler_cost_model));
+  if (s->cost_model == NULL) error("Failed to allocate the task cost model.");
+  bzero(s->cost_model, sizeof(struct scheduler_cost_model));
+}
+
+/**
+ * @brief Update the measured task cost model with the tasks of this step.
+ *
+ * The previous samples are decayed and the tasks that ran since the start
+ * of the step are added. For each task type and subtype the ticks are then
+ * fitted as a linear function of the cost estimated from the particle
+ * counts.
+ *
+ * @param s The #scheduler.
+ * @param tic_step The start of the step.
+ * @param verbose Are we talkative?
+ */
+void scheduler_cost_model_update(struct scheduler *s, const ticks tic_step,
+                                 const int verbose) {
+
+  struct scheduler_cost_model *model = s->cost_model;
+  if (model == NULL) return;
+
+  const ticks tic = getticks();
+  const double decay = model->decay;
+
+  /* Age the samples of the previous steps. */
+  for (int j = 0; j < task_type_count; j++) {
+    for (int k = 0; k < task_subtype_count; k++) {
+      struct scheduler_cost_fit *fit = &model->fits[j][k];
+      fit->n *= decay;
+      fit->sum_x *= decay;
+      fit->sum_y *= decay;
+      fit->sum_xx *= decay;
+      fit->sum_xy *= decay;
+    }
+  }
+  model->sum_x_all *= decay;
+  model->sum_y_all *= decay;
+
+  /* Add the tasks that ran during this step. The communications are left
+   * out as their times are dominated by waiting for the other ranks. */
+  int nr_samples = 0;
+  for (int k = 0; k < s->nr_tasks; k++) {
+    const struct task *t = &s->tasks[k];
+    if (t->implicit || t->tic < tic_step || t->toc <= t->tic) continue;
+    if (t->type == task_type_send || t->type == task_type_recv) continue;
+
+    const double x = scheduler_task_cost_estimate(t, s->nodeID);
+    if (x <= 0.) continue;
+    const double y = (double)(t->toc - t->tic);
+
+    struct scheduler_cost_fit *fit = &model->fits[t->type][t->subtype];
+    fit->n += 1.;
+    fit->sum_x += x;
+    fit->sum_y += y;
+    fit->sum_xx += x * x;
+    fit->sum_xy += x * y;
+    model->sum_x_all += x;
+    model->sum_y_all += y;
+    nr_samples++;
+  }
+
+  /* Re-fit. Fall back to a proportional fit when the estimates do not
+   * spread enough to constrain a fixed overhead. */
+  int nr_fits = 0;
+  for (int j = 0; j < task_type_count; j++) {
+    for (int k = 0; k < task_subtype_count; k++) {
+      struct scheduler_cost_fit *fit = &model->fits[j][k];
+      if (fit->n < model->min_samples || fit->sum_xx <= 0.) continue;
+
+      const double det = fit->n * fit->sum_xx - fit->sum_x * fit->sum_x;
+      double slope = 0., intercept = 0.;
+      if (det > 1e-6 * fit->n * fit->sum_xx) {
+        slope = (fit->n * fit->sum_xy - fit->sum_x * fit->sum_y) / det;
+        intercept = (fit->sum_y - slope * fit->sum_x) / fit->n;
+      }
+      if (slope <= 0.) {
+        slope = fit->sum_xy / fit->sum_xx;
+        intercept = 0.;
+      }
+      fit->slope = slope;
+      fit->intercept = intercept;
+      nr_fits++;
     }
-    t->weight += cost;
+  }
+  if (model->sum_x_all > 0.) {
+    model->slope_all = model->sum_y_all / model->sum_x_all;
+    model->fitted = 1;
+  }
+
+  if (verbose)
+    message("added %d samples, %d task types fitted, took %.3f %s.",
+            nr_samples, nr_fits, clocks_from_ticks(getticks() - tic),
+            clocks_getunit());
+}
+
+/**
+ * @brief Write the current fits of the measured task cost model to a file.
+ *
+ * @param s The #scheduler.
+ * @param step The current step.
+ */
+void scheduler_cost_model_dump(const struct scheduler *s, int step) {
+
+  const struct scheduler_cost_model *model = s->cost_model;
+  if (model == NULL) return;
+
+  char filename[200];
+#ifdef WITH_MPI
+  sprintf(filename, "task_cost_model_%04d_%d.txt", s->nodeID, step);
+#else
+  sprintf(filename, "task_cost_model_%d.txt", step);
+#endif
+
+  FILE *f = fopen(filename, "w");
+  if (f == NULL) error("Error opening task cost model file.");
+
+  fprintf(f, "# Predicted cost [ticks] = intercept + slope * estimate\n");
+  fprintf(f, "# Tasks without a fit use: slope = %e\n", model->slope_all);
+  fprintf(f, "# task_type task_subtype samples intercept slope used\n");
+
+  for (int j = 0; j < task_type_count; j++) {
+    for (int k = 0; k < task_subtype_count; k++) {
+      const struct scheduler_cost_fit *fit = &model->fits[j][k];
+      if (fit->n <= 0.) continue;
+      fprintf(f, "%s %s %.2f %e %e %d\n", taskID_names[j], subtaskID_names[k],
+              fit->n, fit->intercept, fit->slope,
+              fit->n >= model->min_samples);
+    }
+  }
+
+  fclose(f);
+}
+
+/**
+ * @brief Compute the task weights
+ *
+ * The weight of a task is its own cost plus the sum of the weights of the
+ * tasks it unlocks. When scheduling along the critical path it is its own
+ * cost plus the largest weight of the tasks it unlocks, i.e. the length of
+ * the longest chain of tasks that still has to run after it starts.
+ *
+ * @param s The #scheduler.
+ * @param verbose Are we talkative?
+ */
+void scheduler_reweight(struct scheduler *s, int verbose) {
+  const int nr_tasks = s->nr_tasks;
+  int *tid = s->tasks_ind;
+  struct task *tasks = s->tasks;
+  const int critical_path = (s->critical_path_queues > 0);
+  const ticks tic = getticks();
+
+  /* Run through the tasks backwards and set their weights. */
+  for (int k = nr_tasks - 1; k >= 0; k--) {
+    struct task *t = &tasks[tid[k]];
+    t->weight = 0.f;
+
+    if (critical_path) {
+      for (int j = 0; j < t->nr_unlock_tasks; j++)
+        t->weight = max(t->weight, t->unlock_tasks[j]->weight);
+    } else {
+      for (int j = 0; j < t->nr_unlock_tasks; j++)
+        t->weight += t->unlock_tasks[j]->weight;
+    }
+
+    t->cost = scheduler_task_cost(s, t);
+    t->weight += t->cost;
   }
 
   if (verbose)
@@ -2894,6 +3097,14 @@ void scheduler_check_deadlock(struct scheduler *s) {
 /**
  * @brief Get a task, preferably from the given queue.
  *
+ * The runners of the last #scheduler.critical_path_queues queues are
+ * reserved for the critical path. They only pick up the tasks whose weight
+ * is close to the remaining critical path, i.e. the largest weight waiting
+ * in any queue, or tasks short enough to be finished well before the end of
+ * that path. This keeps them free to start the critical tasks as soon as
+ * these are unlocked. When no such task is waiting anywhere, they fall back
+ * to the tasks of their own queue so that these never starve.
+ *
  * @param s The #scheduler.
  * @param qid The ID of the preferred #queue.
  * @param prev the previous task that was run.
@@ -2904,6 +3115,7 @@ struct task *scheduler_gettask(struct scheduler *s, int qid,
                                const struct task *prev) {
   struct task *res = NULL;
   const int nr_queues = s->nr_queues;
+  const int reserved = (qid >= nr_queues - s->critical_path_queues);
   unsigned int seed = qid;
 
   /* Check qid. */
@@ -2911,13 +3123,25 @@ struct task *scheduler_gettask(struct scheduler *s, int qid,
 
   /* Loop as long as there are tasks... */
   while (s->waiting > 0 && res == NULL) {
+
+    /* Which tasks are we allowed to run? */
+    float min_weight = 0.f;
+    float max_cost = FLT_MAX;
+    if (reserved) {
+      float critical = 0.f;
+      for (int k = 0; k < nr_queues; k++)
+        critical = max(critical, s->queues[k].max_weight);
+      min_weight = s->critical_path_slack * critical;
+      max_cost = s->critical_path_lookahead * critical;
+    }
+
     /* Try more than once before sleeping. */
     for (int tries = 0; res == NULL && s->waiting && tries < scheduler_maxtries;
          tries++) {
       /* Try to get a task from the suggested queue. */
       if (s->queues[qid].count > 0 || s->queues[qid].count_incoming > 0) {
         TIMER_TIC
-        res = queue_gettask(&s->queues[qid], prev, 0);
+        res = queue_gettask(&s->queues[qid], prev, 0, min_weight, max_cost);
         TIMER_TOC(timer_qget);
         if (res != NULL) break;
       }
@@ -2932,7 +3156,8 @@ struct task *scheduler_gettask(struct scheduler *s, int qid,
         for (int k = 0; k < scheduler_maxsteal && count > 0; k++) {
           const int ind = rand_r(&seed) % count;
           TIMER_TIC
-          res = queue_gettask(&s->queues[qids[ind]], prev, 0);
+          res = queue_gettask(&s->queues[qids[ind]], prev, 0, min_weight,
+                              max_cost);
           TIMER_TOC(timer_qsteal);
           if (res != NULL) {
             break;
@@ -2944,6 +3169,15 @@ struct task *scheduler_gettask(struct scheduler *s, int qid,
       }
     }
 
+    /* No task on the critical path to run? Reserved runners then take any
+     * task of their own queue. */
+    if (res == NULL && reserved &&
+        (s->queues[qid].count > 0 || s->queues[qid].count_incoming > 0)) {
+      TIMER_TIC
+      res = queue_gettask(&s->queues[qid], prev, 0, 0.f, FLT_MAX);
+      TIMER_TOC(timer_qget);
+    }
+
 /* If we failed, take a short nap. */
 #ifdef WITH_MPI
     if (res == NULL && qid > 1)
@@ -2952,7 +3186,7 @@ struct task *scheduler_gettask(struct scheduler *s, int qid,
 #endif
     {
       pthread_mutex_lock(&s->sleep_mutex);
-      res = queue_gettask(&s->queues[qid], prev, 1);
+      res = queue_gettask(&s->queues[qid], prev, 1, 0.f, FLT_MAX);
       if (res == NULL && s->waiting > 0) {
         pthread_cond_wait(&s->sleep_cond, &s->sleep_mutex);
       }
@@ -3026,6 +3260,7 @@ void scheduler_init(struct scheduler *s, struct space *space, int nr_tasks,
   s->size = 0;
   s->tasks = NULL;
   s->tasks_ind = NULL;
+  s->cost_model = NULL;
   scheduler_reset(s, nr_tasks);
 
 #if defined(SWIFT_DEBUG_CHECKS)
@@ -3068,6 +3303,7 @@ void scheduler_clean(struct scheduler *s) {
   swift_free("unlock_ind", s->unlock_ind);
   for (int i = 0; i < s->nr_queues; ++i) queue_clean(&s->queues[i]);
   swift_free("queues", s->queues);
+  if (s->cost_model != NULL) swift_free("cost_model", s->cost_model);
 }
 
 /**
@@ -58,6 +58,44 @@
 extern int activate_by_unskip;
 #endif
 
+/* Fit of the measured cost of one task type/subtype. */
+struct scheduler_cost_fit {
+
+  /* Decayed sums of the samples: number, estimate, ticks, estimate^2 and
+   * estimate * ticks. */
+  double n, sum_x, sum_y, sum_xx, sum_xy;
+
+  /* Predicted ticks are intercept + slope * estimate. */
+  float intercept, slope;
+};
+
+/* Online model of the task costs fitted from the measured ticks. */
+struct scheduler_cost_model {
+
+  /* Fraction of the accumulated samples kept from one step to the next. */
+  float decay;
+
+  /* Number of (decayed) samples needed before a fit is used. */
+  float min_samples;
+
+  /* Frequency of the fits dumping. */
+  int dump_frequency;
+
+  /* Frequency of the re-weighting of the tasks between rebuilds. */
+  int reweight_frequency;
+
+  /* Has any task been measured yet? */
+  int fitted;
+
+  /* Decayed sums over all the tasks and the corresponding ticks per unit of
+   * estimated cost, used for the tasks without a fit of their own. */
+  double sum_x_all, sum_y_all;
+  float slope_all;
+
+  /* The fits per task type and subtype. */
+  struct scheduler_cost_fit fits[task_type_count][task_subtype_count];
+};
+
 /* Data of a scheduler. */
 struct scheduler {
   /* Scheduler flags. */
@@ -119,8 +157,24 @@ struct scheduler {
 
     /* Total ticks spent by runners running tasks. */
     ticks active_ticks;
+
+    /* Total ticks spent by runners between the end of their last task and
+     * the end of the step. */
+    ticks tail_ticks;
   } deadtime;
 
+  /* Number of queues whose runners are reserved for the critical path. 0 to
+   * schedule by weight only. */
+  int critical_path_queues;
+
+  /* Fraction of the remaining critical path above which a task is taken to
+   * be on it. */
+  float critical_path_slack;
+
+  /* Fraction of the remaining critical path below which the cost of a task
+   * has to be for reserved runners to pick it up when it is not critical. */
+  float critical_path_lookahead;
+
   /* Frequency of the dependency graph dumping. */
   int frequency_dependency;
 
@@ -130,6 +184,9 @@ struct scheduler {
   /* Frequency of the task levels dumping. */
   int frequency_task_levels;
 
+  /* Measured task cost model, NULL when not in use. */
+  struct scheduler_cost_model *cost_model;
+
 #if defined(SWIFT_DEBUG_CHECKS)
   /* Stuff for the deadlock detector */
 
@@ -295,6 +352,11 @@ void scheduler_start(struct scheduler *s);
 void scheduler_reset(struct scheduler *s, int nr_tasks);
 void scheduler_ranktasks(struct scheduler *s);
 void scheduler_reweight(struct scheduler *s, int verbose);
+float scheduler_task_cost(const struct scheduler *s, const struct task *t);
+void scheduler_cost_model_init(struct scheduler *s);
+void scheduler_cost_model_update(struct scheduler *s, const ticks tic_step,
+                                 const int verbose);
+void scheduler_cost_model_dump(const struct scheduler *s, int step);
 struct task *scheduler_addtask(struct scheduler *s, enum task_types type,
                                enum task_subtypes subtype, long long flags,
                                int implicit, struct cell *ci, struct cell *cj);
@@ -1325,7 +1325,8 @@ void write_output_serial(struct engine* e,
                         e->s->nr_cells, e->s->width, mpi_rank,
                         /*distributed=*/0, subsample, subsample_fraction,
                         e->snapshot_output_count, N_total, offset, to_write,
-                        numFields, internal_units, snapshot_units);
+                        numFields, e->snapshot_cell_index_depth,
+                        internal_units, snapshot_units);
 
   /* Close everything */
   if (mpi_rank == 0) {
@@ -0,0 +1,181 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers */
+#include <stdint.h>
+
+/* This object's header. */
+#include "shared_table.h"
+
+/* Local includes. */
+#include "align.h"
+#include "error.h"
+#include "memuse.h"
+
+/**
+ * @brief Allocate a table shared by all the ranks of the node.
+ *
+ * This is collective over all the ranks of MPI_COMM_WORLD when MPI is
+ * running. The writer rank has to fill the table and all the ranks must
+ * then call shared_table_ready() before reading it. The memory is aligned
+ * on SWIFT_STRUCT_ALIGNMENT.
+ *
+ * @param t The #shared_table.
+ * @param label Label used for the memory reports.
+ * @param size The size of the table in bytes.
+ * @return Pointer to the start of the table.
+ */
+void *shared_table_alloc(struct shared_table *t, const char *label,
+                         size_t size) {
+
+  t->data = NULL;
+  t->size = size;
+  t->writer = 1;
+
+#ifdef WITH_MPI
+  t->win = MPI_WIN_NULL;
+  t->comm = MPI_COMM_NULL;
+
+  int initialized = 0;
+  MPI_Initialized(&initialized);
+  if (initialized) {
+
+    /* Gather the ranks that can share memory with us */
+    MPI_Comm comm;
+    int res = MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0,
+                                  MPI_INFO_NULL, &comm);
+    if (res != MPI_SUCCESS)
+      mpi_error(res, "Failed to create the node communicator for %s.", label);
+
+    int node_size, node_rank;
+    MPI_Comm_size(comm, &node_size);
+    MPI_Comm_rank(comm, &node_rank);
+
+    if (node_size > 1) {
+
+      /* The first rank of the node owns the whole segment, with some room
+       * to align the start of the table */
+      const size_t seg_size = size + SWIFT_STRUCT_ALIGNMENT;
+      char *base = NULL;
+      t->comm = comm;
+      t->writer = (node_rank == 0);
+      res = MPI_Win_allocate_shared(t->writer ? seg_size : 0, /*disp_unit=*/1,
+                                    MPI_INFO_NULL, comm, &base, &t->win);
+      if (res != MPI_SUCCESS)
+        mpi_error(res, "Failed to allocate the shared segment for %s.",
+                  label);
+
+      /* The other ranks look at the writer's memory */
+      if (!t->writer) {
+        MPI_Aint query_size;
+        int disp_unit;
+        res = MPI_Win_shared_query(t->win, 0, &query_size, &disp_unit, &base);
+        if (res != MPI_SUCCESS)
+          mpi_error(res, "Failed to query the shared segment for %s.", label);
+        if ((size_t)query_size != seg_size)
+          error("Shared segment for %s has size %zu instead of %zu.", label,
+                (size_t)query_size, seg_size);
+      }
+
+      /* Everyone uses the offset found by the writer */
+      int offset = 0;
+      if (t->writer)
+        offset = (SWIFT_STRUCT_ALIGNMENT -
+                  ((uintptr_t)base) % SWIFT_STRUCT_ALIGNMENT) %
+                 SWIFT_STRUCT_ALIGNMENT;
+      res = MPI_Bcast(&offset, 1, MPI_INT, 0, comm);
+      if (res != MPI_SUCCESS)
+        mpi_error(res, "Failed to broadcast the offset of %s.", label);
+      t->data = base + offset;
+
+      if (((uintptr_t)t->data) % SWIFT_STRUCT_ALIGNMENT != 0)
+        error("Shared segment for %s is not aligned.", label);
+
+      /* Keep a passive epoch open for as long as the table lives */
+      res = MPI_Win_lock_all(MPI_MODE_NOCHECK, t->win);
+      if (res != MPI_SUCCESS)
+        mpi_error(res, "Failed to lock the shared segment for %s.", label);
+
+      /* Only count the memory once per node */
+      if (t->writer) {
+        memuse_log_allocation(label, t->data, 1, size);
+      }
+
+      return t->data;
+    }
+
+    MPI_Comm_free(&comm);
+  }
+#endif
+
+  if (swift_memalign(label, &t->data, SWIFT_STRUCT_ALIGNMENT, size) != 0)
+    error("Failed to allocate the table %s.", label);
+
+  return t->data;
+}
+
+/**
+ * @brief Make the content written by the writer visible to all the ranks
+ * of the node.
+ *
+ * This is collective over all the ranks sharing the table.
+ *
+ * @param t The #shared_table.
+ */
+void shared_table_ready(struct shared_table *t) {
+
+#ifdef WITH_MPI
+  if (t->win == MPI_WIN_NULL) return;
+
+  MPI_Win_sync(t->win);
+  int res = MPI_Barrier(t->comm);
+  if (res != MPI_SUCCESS)
+    mpi_error(res, "Failed to synchronize the ranks sharing a table.");
+  MPI_Win_sync(t->win);
+#endif
+}
+
+/**
+ * @brief Release a table.
+ *
+ * This is collective over all the ranks sharing the table.
+ *
+ * @param t The #shared_table.
+ * @param label Label used for the memory reports.
+ */
+void shared_table_free(struct shared_table *t, const char *label) {
+
+#ifdef WITH_MPI
+  if (t->win != MPI_WIN_NULL) {
+    if (t->writer) {
+      memuse_log_allocation(label, t->data, 0, 0);
+    }
+    MPI_Win_unlock_all(t->win);
+    MPI_Win_free(&t->win);
+    MPI_Comm_free(&t->comm);
+    t->data = NULL;
+    return;
+  }
+#endif
+
+  swift_free(label, t->data);
+  t->data = NULL;
+}
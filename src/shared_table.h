@@ -0,0 +1,78 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_SHARED_TABLE_H
+#define SWIFT_SHARED_TABLE_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers */
+#include <stddef.h>
+
+/* Local includes. */
+#include "inline.h"
+
+/* MPI headers. */
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+/**
+ * @brief A read-only table shared by all the ranks running on a node.
+ *
+ * With MPI, the memory is a single shared segment per node. Only one rank
+ * of the node (the writer) fills it, the others get a view of the same
+ * memory. Without MPI, or with a single rank on the node, the table is a
+ * plain allocation and the only rank is the writer.
+ */
+struct shared_table {
+
+  /*! Start of the table */
+  void *data;
+
+  /*! Size of the table in bytes */
+  size_t size;
+
+  /*! Does this rank fill the table? */
+  int writer;
+
+#ifdef WITH_MPI
+  /*! The window of the shared segment (MPI_WIN_NULL if not shared) */
+  MPI_Win win;
+
+  /*! The ranks sharing the segment (MPI_COMM_NULL if not shared) */
+  MPI_Comm comm;
+#endif
+};
+
+void *shared_table_alloc(struct shared_table *t, const char *label,
+                         size_t size);
+void shared_table_ready(struct shared_table *t);
+void shared_table_free(struct shared_table *t, const char *label);
+
+/**
+ * @brief Does this rank have to fill the table?
+ *
+ * @param t The #shared_table.
+ */
+__attribute__((always_inline)) INLINE static int shared_table_is_writer(
+    const struct shared_table *t) {
+  return t->writer;
+}
+
+#endif /* SWIFT_SHARED_TABLE_H */
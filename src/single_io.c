@@ -46,6 +46,7 @@
 #include "gravity_properties.h"
 #include "hydro_io.h"
 #include "hydro_properties.h"
+#include "io_async.h"
 #include "io_compression.h"
 #include "io_properties.h"
 #include "memuse.h"
@@ -223,42 +224,25 @@ void read_array_single(hid_t h_grp, const struct io_props props, size_t N,
 }
 
 /**
- * @brief Writes a data array in given HDF5 group.
+ * @brief Writes an already converted data array in given HDF5 group.
  *
- * @param e The #engine we are writing from.
  * @param grp The group in which to write.
- * @param fileName The name of the file in which the data is written
- * @param xmfFile The FILE used to write the XMF description
- * @param partTypeGroupName The name of the group containing the particles in
- * the HDF5 file.
- * @param props The #io_props of the field to read
+ * @param temp The buffer containing the data in snapshot units.
+ * @param props The #io_props of the field to write
  * @param N The number of particles to write.
- * @param internal_units The #unit_system used internally
+ * @param lossy_compression Level of lossy compression to use for this field.
+ * @param gzip_level Level of lossless (GZIP) compression to use.
+ * @param a The scale-factor at which the snapshot is written.
  * @param snapshot_units The #unit_system used in the snapshots
- *
- * @todo A better version using HDF5 hyper-slabs to write the file directly from
- * the part array will be written once the structures have been stabilized.
+ * @param chunks The data already compressed on the threadpool (or NULL).
+ * @param chunk_length The number of rows per compressed chunk.
  */
-void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
-                        FILE* xmfFile, const char* partTypeGroupName,
-                        const struct io_props props, const size_t N,
-                        const enum lossy_compression_schemes lossy_compression,
-                        const struct unit_system* internal_units,
-                        const struct unit_system* snapshot_units) {
-
-  const size_t typeSize = io_sizeof_type(props.type);
-  const size_t num_elements = N * props.dimension;
-
-  /* message("Writing '%s' array...", props.name); */
-
-  /* Allocate temporary buffer */
-  void* temp = NULL;
-  if (swift_memalign("writebuff", (void**)&temp, IO_BUFFER_ALIGNMENT,
-                     num_elements * typeSize) != 0)
-    error("Unable to allocate temporary i/o buffer");
-
-  /* Copy the particle data to the temporary buffer */
-  io_copy_temp_buffer(temp, e, props, N, internal_units, snapshot_units);
+static void write_array_single_hdf5(
+    hid_t grp, const void* temp, const struct io_props props, const size_t N,
+    const enum lossy_compression_schemes lossy_compression,
+    const int gzip_level, const double a,
+    const struct unit_system* snapshot_units, const struct io_chunk* chunks,
+    const size_t chunk_length) {
 
   /* Create data space */
   const hid_t h_space = H5Screate(H5S_SIMPLE);
@@ -289,6 +273,9 @@ void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
   /* Make sure the chunks are not larger than the dataset */
   if (chunk_shape[0] > N) chunk_shape[0] = N;
 
+  /* Pre-compressed data comes with its own chunking */
+  if (chunks != NULL) chunk_shape[0] = chunk_length;
+
   /* Change shape of data space */
   hid_t h_err = H5Sset_extent_simple(h_space, rank, shape, shape);
   if (h_err < 0)
@@ -317,13 +304,13 @@ void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
                                  props.name, comp_buffer);
 
     /* Impose GZIP and shuffle data compression */
-    if (e->snapshot_compression > 0) {
+    if (gzip_level > 0) {
       h_err = H5Pset_shuffle(h_prop);
       if (h_err < 0)
         error("Error while setting shuffling options for field '%s'.",
               props.name);
 
-      h_err = H5Pset_deflate(h_prop, e->snapshot_compression);
+      h_err = H5Pset_deflate(h_prop, gzip_level);
       if (h_err < 0)
         error("Error while setting compression options for field '%s'.",
               props.name);
@@ -340,15 +327,20 @@ void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
                                  h_prop, H5P_DEFAULT);
   if (h_data < 0) error("Error while creating dataspace '%s'.", props.name);
 
-  /* Write temporary buffer to HDF5 dataspace */
-  h_err = H5Dwrite(h_data, io_hdf5_type(props.type), h_space, H5S_ALL,
-                   H5P_DEFAULT, temp);
-  if (h_err < 0) error("Error while writing data array '%s'.", props.name);
+  if (chunks != NULL) {
 
-  /* Write XMF description for this data set */
-  if (xmfFile != NULL)
-    xmf_write_line(xmfFile, fileName, /*distributed=*/0, partTypeGroupName,
-                   props.name, N, props.dimension, props.type);
+#if defined(IO_THREADED_COMPRESSION)
+    /* Write the compressed chunks as they are */
+    io_write_compressed_chunks(h_data, chunks, N, chunk_length);
+#endif
+
+  } else {
+
+    /* Write temporary buffer to HDF5 dataspace */
+    h_err = H5Dwrite(h_data, io_hdf5_type(props.type), h_space, H5S_ALL,
+                     H5P_DEFAULT, temp);
+    if (h_err < 0) error("Error while writing data array '%s'.", props.name);
+  }
 
   /* Write unit conversion factors for this data set */
   char buffer[FIELD_BUFFER_SIZE] = {0};
@@ -376,7 +368,7 @@ void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
   io_write_attribute_d(
       h_data,
       "Conversion factor to physical CGS (including cosmological corrections)",
-      factor * pow(e->cosmology->a, props.scale_factor_exponent));
+      factor * pow(a, props.scale_factor_exponent));
 
 #ifdef SWIFT_DEBUG_CHECKS
   if (strlen(props.description) == 0)
@@ -386,14 +378,214 @@ void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
   /* Write the full description */
   io_write_attribute_s(h_data, "Description", props.description);
 
-  /* Free and close everything */
-  swift_free("writebuff", temp);
+  /* Close everything */
   H5Tclose(h_type);
   H5Pclose(h_prop);
   H5Dclose(h_data);
   H5Sclose(h_space);
 }
 
+/*! Data needed to write one array from the asynchronous i/o thread */
+struct write_array_single_job {
+  hid_t h_file;
+  char partTypeGroupName[PARTICLE_GROUP_BUFFER_SIZE];
+  struct io_props props;
+  size_t N;
+  enum lossy_compression_schemes lossy_compression;
+  int gzip_level;
+  double a;
+  const struct unit_system* snapshot_units;
+  void* temp;
+  struct io_chunk* chunks;
+  size_t chunk_length;
+};
+
+/**
+ * @brief Writes a staged array from the asynchronous i/o thread.
+ *
+ * @param data The #write_array_single_job.
+ */
+static void write_array_single_async(void* data) {
+
+  struct write_array_single_job* job = (struct write_array_single_job*)data;
+
+  const hid_t h_grp = H5Gopen(job->h_file, job->partTypeGroupName, H5P_DEFAULT);
+  if (h_grp < 0) error("Error while opening particle group.");
+
+  write_array_single_hdf5(h_grp, job->temp, job->props, job->N,
+                          job->lossy_compression, job->gzip_level, job->a,
+                          job->snapshot_units, job->chunks, job->chunk_length);
+
+  /* The file is really closed once the last job releases it */
+  H5Gclose(h_grp);
+  H5Fclose(job->h_file);
+#if defined(IO_THREADED_COMPRESSION)
+  if (job->chunks != NULL)
+    io_free_compressed_chunks(job->chunks, job->N, job->chunk_length);
+#endif
+  if (job->temp != NULL) swift_free("writebuff", job->temp);
+  free(job);
+}
+
+/**
+ * @brief Writes a data array in given HDF5 group.
+ *
+ * With asynchronous snapshots, the data is only converted into a staging
+ * buffer here and the HDF5 calls are left to the i/o thread. The caller must
+ * then hold the HDF5 lock.
+ *
+ * @param e The #engine we are writing from.
+ * @param grp The group in which to write.
+ * @param fileName The name of the file in which the data is written
+ * @param xmfFile The FILE used to write the XMF description
+ * @param partTypeGroupName The name of the group containing the particles in
+ * the HDF5 file.
+ * @param props The #io_props of the field to read
+ * @param N The number of particles to write.
+ * @param ptype The type of the particles.
+ * @param lossy_compression Level of lossy compression to use for this field.
+ * @param internal_units The #unit_system used internally
+ * @param snapshot_units The #unit_system used in the snapshots
+ *
+ * @todo A better version using HDF5 hyper-slabs to write the file directly from
+ * the part array will be written once the structures have been stabilized.
+ */
+void write_array_single(const struct engine* e, hid_t grp, const char* fileName,
+                        FILE* xmfFile, const char* partTypeGroupName,
+                        const struct io_props props, const size_t N,
+                        const int ptype,
+                        const enum lossy_compression_schemes lossy_compression,
+                        const struct unit_system* internal_units,
+                        const struct unit_system* snapshot_units) {
+
+  const size_t typeSize = io_sizeof_type(props.type);
+  const size_t num_elements = N * props.dimension;
+
+  /* Are we also writing a stratified subsample of this type? */
+  const int with_subsample = e->snapshot_stratified_fraction[ptype] > 0.f;
+  char subsampleGroupName[PARTICLE_GROUP_BUFFER_SIZE];
+  snprintf(subsampleGroupName, PARTICLE_GROUP_BUFFER_SIZE,
+           "/Subsample/PartType%d", ptype);
+  size_t N_sub = 0;
+  void* temp_sub = NULL;
+
+  /* message("Writing '%s' array...", props.name); */
+
+  /* Write XMF description for this data set */
+  if (xmfFile != NULL)
+    xmf_write_line(xmfFile, fileName, /*distributed=*/0, partTypeGroupName,
+                   props.name, N, props.dimension, props.type);
+
+  if (e->snapshot_async != NULL) {
+
+    /* Let the i/o thread use the library while we convert the data */
+    io_hdf5_unlock();
+    void* temp =
+        io_async_alloc(e->snapshot_async, "writebuff", num_elements * typeSize);
+    io_copy_temp_buffer(temp, e, props, N, internal_units, snapshot_units);
+    if (with_subsample)
+      temp_sub = io_stratified_subsample(e, temp, props, N, ptype, &N_sub);
+
+    /* Compress the data now while we still have the threadpool */
+    size_t chunk_length = 0;
+    struct io_chunk* chunks = io_compress_field(
+        e, temp, props, N, lossy_compression == compression_write_lossless,
+        &chunk_length);
+    size_t staged_size = num_elements * typeSize;
+    if (chunks != NULL) {
+      swift_free("writebuff", temp);
+      temp = NULL;
+
+      /* Only the compressed chunks are held from now on */
+#if defined(IO_THREADED_COMPRESSION)
+      const size_t compressed_size =
+          io_compressed_chunks_size(chunks, N, chunk_length);
+      io_async_restage(e->snapshot_async, staged_size, compressed_size);
+      staged_size = compressed_size;
+#endif
+    }
+    io_hdf5_lock();
+
+    struct write_array_single_job* job = (struct write_array_single_job*)malloc(
+        sizeof(struct write_array_single_job));
+    if (job == NULL) error("Unable to allocate asynchronous i/o job");
+    job->h_file = H5Iget_file_id(grp);
+    strcpy(job->partTypeGroupName, partTypeGroupName);
+    job->props = props;
+    job->N = N;
+    job->lossy_compression = lossy_compression;
+    job->gzip_level = e->snapshot_compression;
+    job->a = e->cosmology->a;
+    job->snapshot_units = snapshot_units;
+    job->temp = temp;
+    job->chunks = chunks;
+    job->chunk_length = chunk_length;
+
+    io_async_submit(e->snapshot_async, write_array_single_async, job,
+                    staged_size);
+
+    /* The subsample is small and not accounted for in the staging budget */
+    if (with_subsample) {
+      struct write_array_single_job* sub_job =
+          (struct write_array_single_job*)malloc(
+              sizeof(struct write_array_single_job));
+      if (sub_job == NULL) error("Unable to allocate asynchronous i/o job");
+      *sub_job = *job;
+      sub_job->h_file = H5Iget_file_id(grp);
+      strcpy(sub_job->partTypeGroupName, subsampleGroupName);
+      sub_job->N = N_sub;
+      sub_job->temp = temp_sub;
+      sub_job->chunks = NULL;
+      sub_job->chunk_length = 0;
+      io_async_submit(e->snapshot_async, write_array_single_async, sub_job,
+                      /*size=*/0);
+    }
+    return;
+  }
+
+  /* Allocate temporary buffer */
+  void* temp = NULL;
+  if (swift_memalign("writebuff", (void**)&temp, IO_BUFFER_ALIGNMENT,
+                     num_elements * typeSize) != 0)
+    error("Unable to allocate temporary i/o buffer");
+
+  /* Copy the particle data to the temporary buffer */
+  io_copy_temp_buffer(temp, e, props, N, internal_units, snapshot_units);
+  if (with_subsample)
+    temp_sub = io_stratified_subsample(e, temp, props, N, ptype, &N_sub);
+
+  /* Run the compression filters on the threadpool if we can */
+  size_t chunk_length = 0;
+  struct io_chunk* chunks = io_compress_field(
+      e, temp, props, N, lossy_compression == compression_write_lossless,
+      &chunk_length);
+  if (chunks != NULL) {
+    swift_free("writebuff", temp);
+    temp = NULL;
+  }
+
+  write_array_single_hdf5(grp, temp, props, N, lossy_compression,
+                          e->snapshot_compression, e->cosmology->a,
+                          snapshot_units, chunks, chunk_length);
+
+#if defined(IO_THREADED_COMPRESSION)
+  if (chunks != NULL) io_free_compressed_chunks(chunks, N, chunk_length);
+#endif
+  if (temp != NULL) swift_free("writebuff", temp);
+
+  /* And the subsample next to the other ones */
+  if (with_subsample) {
+    const hid_t h_grp_sub = H5Gopen(grp, subsampleGroupName, H5P_DEFAULT);
+    if (h_grp_sub < 0) error("Error while opening subsample group.");
+    write_array_single_hdf5(h_grp_sub, temp_sub, props, N_sub,
+                            lossy_compression, e->snapshot_compression,
+                            e->cosmology->a, snapshot_units, /*chunks=*/NULL,
+                            /*chunk_length=*/0);
+    H5Gclose(h_grp_sub);
+    swift_free("writebuff", temp_sub);
+  }
+}
+
 /**
  * @brief Reads an HDF5 initial condition file (GADGET-3 type)
  *
@@ -987,6 +1179,10 @@ void write_output_single(struct engine* e,
 
   };
 
+  /* Keep the library to ourselves while an asynchronous write of the
+   * fields may be going on in the background */
+  if (e->snapshot_async != NULL) io_hdf5_lock();
+
   /* Open file */
   /* message("Opening file '%s'.", fileName); */
   h_file = H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
@@ -1110,7 +1306,8 @@ void write_output_single(struct engine* e,
                         e->s->nr_cells, e->s->width, e->nodeID,
                         /*distributed=*/0, subsample, subsample_fraction,
                         e->snapshot_output_count, N_total, global_offsets,
-                        to_write, numFields, internal_units, snapshot_units);
+                        to_write, numFields, e->snapshot_cell_index_depth,
+                        internal_units, snapshot_units);
   H5Gclose(h_grp);
 
   /* Loop over all particle types */
@@ -1145,6 +1342,14 @@ void write_output_single(struct engine* e,
     io_write_attribute_ll(h_grp, "NumberOfParticles", N_total[ptype]);
     io_write_attribute_ll(h_grp, "TotalNumberOfParticles", N_total[ptype]);
 
+    /* Prepare the group of the stratified subsample */
+    if (e->snapshot_stratified_fraction[ptype] > 0.f)
+      io_create_stratified_subsample_group(
+          h_file, ptype, e->snapshot_stratified_fraction[ptype],
+          io_stratified_subsample_count(N_total[ptype],
+                                        e->snapshot_stratified_fraction[ptype],
+                                        ptype, e->snapshot_output_count));
+
     int num_fields = 0;
     struct io_props list[io_max_size_output_list];
     bzero(list, io_max_size_output_list * sizeof(struct io_props));
@@ -1445,8 +1650,8 @@ void write_output_single(struct engine* e,
 
       if (compression_level != compression_do_not_write) {
         write_array_single(e, h_grp, fileName, xmfFile, partTypeGroupName,
-                           list[i], N, compression_level, internal_units,
-                           snapshot_units);
+                           list[i], N, ptype, compression_level,
+                           internal_units, snapshot_units);
         num_fields_written++;
       }
     }
@@ -1476,8 +1681,9 @@ void write_output_single(struct engine* e,
 
   /* message("Done writing particles..."); */
 
-  /* Close file */
+  /* Close file (only done once all the fields have been written) */
   H5Fclose(h_file);
+  if (e->snapshot_async != NULL) io_hdf5_unlock();
 
   e->snapshot_output_count++;
   if (e->snapshot_invoke_stf) e->stf_output_count++;
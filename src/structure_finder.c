@@ -0,0 +1,143 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Config parameters. */
+#include <config.h>
+
+/* This object's header. */
+#include "structure_finder.h"
+
+/* Local includes. */
+#include "black_holes_io.h"
+#include "cooling.h"
+#include "engine.h"
+#include "gravity_io.h"
+#include "hydro.h"
+#include "hydro_io.h"
+#include "stars_io.h"
+
+/**
+ * @brief Set up a view of the #gpart of this rank for a structure finder.
+ *
+ * @param view The #structure_finder_view to initialise.
+ * @param e The #engine.
+ * @param fields The fields the structure finder will read
+ * (#structure_finder_field flags).
+ */
+void structure_finder_view_init(struct structure_finder_view *view,
+                                const struct engine *e, const int fields) {
+
+  const struct space *s = e->s;
+
+  view->e = e;
+  view->gparts = s->gparts;
+  view->count = s->nr_gparts;
+  view->fields = fields;
+}
+
+/**
+ * @brief Convert the selected fields of one particle of a view.
+ *
+ * Gas, star and black hole positions, velocities and IDs are taken from
+ * their hydro, star and black hole counterparts, as in the snapshots. The
+ * counterpart is only looked up once for all the fields.
+ *
+ * @param view The #structure_finder_view.
+ * @param index Index of the particle in the view.
+ * @param out (return) The fields of the particle.
+ */
+void structure_finder_view_get_particle(
+    const struct structure_finder_view *view, const size_t index,
+    struct structure_finder_particle *out) {
+
+#ifdef SWIFT_DEBUG_CHECKS
+  if (index >= view->count)
+    error("Requested a particle beyond the end of the view");
+#endif
+
+  /* Unpack what we need */
+  const struct engine *e = view->e;
+  const struct space *s = e->s;
+  const struct cosmology *cosmo = e->cosmology;
+  const struct gpart *gp = &view->gparts[index];
+  const int fields = view->fields;
+
+  /* Quantities the #gpart always holds */
+  if (fields & structure_finder_field_mass) out->mass = gravity_get_mass(gp);
+  if (fields & structure_finder_field_potential)
+    out->potential = gravity_get_comoving_potential(gp);
+  if (fields & structure_finder_field_type) out->type = gp->type;
+
+  /* Everything else comes from the counterpart, if any */
+  switch (gp->type) {
+
+    case swift_type_gas: {
+      const struct part *p = &s->parts[-gp->id_or_neg_offset];
+      const struct xpart *xp = &s->xparts[-gp->id_or_neg_offset];
+      if (fields & structure_finder_field_position)
+        convert_part_pos(e, p, xp, out->x);
+      if (fields & structure_finder_field_velocity)
+        convert_part_vel(e, p, xp, out->v);
+      if (fields & structure_finder_field_id) out->id = p->id;
+      if (fields & structure_finder_field_internal_energy)
+        out->u = hydro_get_drifted_physical_internal_energy(p, cosmo);
+      if (fields & structure_finder_field_temperature)
+        out->T = cooling_get_temperature(e->physical_constants,
+                                         e->hydro_properties,
+                                         e->internal_units, cosmo,
+                                         e->cooling_func, p, xp);
+    } break;
+
+    case swift_type_stars: {
+      const struct spart *sp = &s->sparts[-gp->id_or_neg_offset];
+      if (fields & structure_finder_field_position)
+        convert_spart_pos(e, sp, out->x);
+      if (fields & structure_finder_field_velocity)
+        convert_spart_vel(e, sp, out->v);
+      if (fields & structure_finder_field_id) out->id = sp->id;
+      out->u = 0.f;
+      out->T = 0.f;
+    } break;
+
+    case swift_type_black_hole: {
+      const struct bpart *bp = &s->bparts[-gp->id_or_neg_offset];
+      if (fields & structure_finder_field_position)
+        convert_bpart_pos(e, bp, out->x);
+      if (fields & structure_finder_field_velocity)
+        convert_bpart_vel(e, bp, out->v);
+      if (fields & structure_finder_field_id) out->id = bp->id;
+      out->u = 0.f;
+      out->T = 0.f;
+    } break;
+
+    case swift_type_dark_matter:
+    case swift_type_dark_matter_background:
+    case swift_type_neutrino:
+      if (fields & structure_finder_field_position)
+        convert_gpart_pos(e, gp, out->x);
+      if (fields & structure_finder_field_velocity)
+        convert_gpart_vel(e, gp, out->v);
+      if (fields & structure_finder_field_id) out->id = gp->id_or_neg_offset;
+      out->u = 0.f;
+      out->T = 0.f;
+      break;
+
+    default:
+      error("Particle type not handled by the structure finder.");
+  }
+}
@@ -0,0 +1,131 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef SWIFT_STRUCTURE_FINDER_H
+#define SWIFT_STRUCTURE_FINDER_H
+
+/* Config parameters. */
+#include <config.h>
+
+/* Standard headers */
+#include <stddef.h>
+
+/* Local headers */
+#include "part_type.h"
+
+/* Forward declarations */
+struct engine;
+struct gpart;
+
+/**
+ * @brief The particle properties a structure finder can ask for.
+ *
+ * The values can be combined with a bitwise or to select several fields.
+ */
+enum structure_finder_field {
+
+  /*! Co-moving positions wrapped into the box (double[3]) */
+  structure_finder_field_position = (1 << 0),
+
+  /*! Peculiar velocities at the current time (float[3]) */
+  structure_finder_field_velocity = (1 << 1),
+
+  /*! Masses (float) */
+  structure_finder_field_mass = (1 << 2),
+
+  /*! Co-moving gravitational potentials (float) */
+  structure_finder_field_potential = (1 << 3),
+
+  /*! Particle IDs (long long) */
+  structure_finder_field_id = (1 << 4),
+
+  /*! Particle types (enum part_type) */
+  structure_finder_field_type = (1 << 5),
+
+  /*! Physical internal energies, zero for non-gas particles (float) */
+  structure_finder_field_internal_energy = (1 << 6),
+
+  /*! Temperatures, zero for non-gas particles (float) */
+  structure_finder_field_temperature = (1 << 7),
+};
+
+/**
+ * @brief A view of the #gpart of this rank for an on-the-fly structure
+ * finder.
+ *
+ * The view does not copy any particle data. The selected fields of any
+ * particle can be obtained in the units and conventions used in the
+ * snapshots with structure_finder_view_get_particle(), which converts them
+ * in a single visit of the particle and its hydro, star or black hole
+ * counterpart. This lets a finder fill its own particle array in one pass
+ * instead of needing a full copy first.
+ */
+struct structure_finder_view {
+
+  /*! The #engine the particles belong to */
+  const struct engine *e;
+
+  /*! The particles */
+  const struct gpart *gparts;
+
+  /*! The number of particles */
+  size_t count;
+
+  /*! The fields the finder asked for (#structure_finder_field flags) */
+  int fields;
+};
+
+/**
+ * @brief The fields of one particle of a #structure_finder_view.
+ *
+ * Only the fields selected in the view are filled in.
+ */
+struct structure_finder_particle {
+
+  /*! Co-moving position wrapped into the box */
+  double x[3];
+
+  /*! Peculiar velocity at the current time */
+  float v[3];
+
+  /*! Mass */
+  float mass;
+
+  /*! Co-moving gravitational potential */
+  float potential;
+
+  /*! Particle ID */
+  long long id;
+
+  /*! Particle type */
+  enum part_type type;
+
+  /*! Physical internal energy (zero for non-gas particles) */
+  float u;
+
+  /*! Temperature (zero for non-gas particles) */
+  float T;
+};
+
+void structure_finder_view_init(struct structure_finder_view *view,
+                                const struct engine *e, const int fields);
+
+void structure_finder_view_get_particle(
+    const struct structure_finder_view *view, const size_t index,
+    struct structure_finder_particle *out);
+
+#endif /* SWIFT_STRUCTURE_FINDER_H */
@@ -708,6 +708,10 @@ void task_unlock(struct task *t) {
 /**
  * @brief Try to lock the cells associated with this task.
  *
+ * The hold words of the cells are non-zero when the cells or any of their
+ * progeny are locked, so checking them first rejects most conflicting tasks
+ * without any atomic operation.
+ *
  * @param t the #task.
  */
 int task_lock(struct task *t) {
@@ -257,6 +257,9 @@ struct task {
   /*! Weight of the task */
   float weight;
 
+  /*! Cost of the task itself, as included in its weight */
+  float cost;
+
   /*! Number of tasks unlocked by this one */
   int nr_unlock_tasks;
 
@@ -40,6 +40,7 @@
 #include "hydro.h"
 #include "hydro_io.h"
 #include "stars_io.h"
+#include "structure_finder.h"
 #include "swift_velociraptor_part.h"
 #include "threadpool.h"
 #include "velociraptor_struct.h"
@@ -236,15 +237,20 @@ struct vr_return_data InvokeVelociraptor(
  */
 struct velociraptor_copy_data {
   const struct engine *e;
+  const struct structure_finder_view *view;
   struct swift_vel_part *swift_parts;
 };
 
 /**
  * @brief Mapper function to conver the #gpart into VELOCIraptor Particles.
  *
+ * All the fields of a particle are converted in one go through the
+ * #structure_finder_view and written straight into the array of
+ * #swift_vel_part.
+ *
  * @param map_data The array of #gpart.
  * @param nr_gparts The number of #gpart.
- * @param extra_data Pointer to the #engine and to the array to fill.
+ * @param extra_data Pointer to the #engine, the view and the array to fill.
  */
 void velociraptor_convert_particles_mapper(void *map_data, int nr_gparts,
                                            void *extra_data) {
@@ -254,23 +260,9 @@ void velociraptor_convert_particles_mapper(void *map_data, int nr_gparts,
   struct velociraptor_copy_data *data =
       (struct velociraptor_copy_data *)extra_data;
   const struct engine *e = data->e;
-  const struct space *s = e->s;
-  struct swift_vel_part *swift_parts =
-      data->swift_parts + (ptrdiff_t)(gparts - s->gparts);
-  const ptrdiff_t index_offset = gparts - s->gparts;
-
-  /* Handle on the other particle types */
-  const struct part *parts = s->parts;
-  const struct xpart *xparts = s->xparts;
-  const struct spart *sparts = s->sparts;
-  const struct bpart *bparts = s->bparts;
-
-  /* Handle on the physics modules */
-  const struct cosmology *cosmo = e->cosmology;
-  const struct hydro_props *hydro_props = e->hydro_properties;
-  const struct unit_system *us = e->internal_units;
-  const struct phys_const *phys_const = e->physical_constants;
-  const struct cooling_function_data *cool_func = e->cooling_func;
+  const struct structure_finder_view *view = data->view;
+  const ptrdiff_t index_offset = gparts - e->s->gparts;
+  struct swift_vel_part *swift_parts = data->swift_parts + index_offset;
 
   /* Convert particle properties into VELOCIraptor units.
    * VELOCIraptor wants:
@@ -282,71 +274,32 @@ void velociraptor_convert_particles_mapper(void *map_data, int nr_gparts,
    */
   for (int i = 0; i < nr_gparts; i++) {
 
+    struct structure_finder_particle p;
+    structure_finder_view_get_particle(view, i + index_offset, &p);
+
+    struct swift_vel_part *vp = &swift_parts[i];
+    vp->id = p.id;
+    vp->x[0] = p.x[0];
+    vp->x[1] = p.x[1];
+    vp->x[2] = p.x[2];
+    vp->v[0] = p.v[0];
+    vp->v[1] = p.v[1];
+    vp->v[2] = p.v[2];
 #ifndef HAVE_VELOCIRAPTOR_WITH_NOMASS
-    swift_parts[i].mass = gravity_get_mass(&gparts[i]);
+    vp->mass = p.mass;
 #endif
+    vp->potential = p.potential;
+    vp->u = p.u;
+    vp->T = p.T;
+    vp->type = p.type;
 
-    swift_parts[i].potential = gravity_get_comoving_potential(&gparts[i]);
-
-    swift_parts[i].type = gparts[i].type;
-
-    swift_parts[i].index = i + index_offset;
+    /* Where the particle lives on the SWIFT side */
+    vp->index = i + index_offset;
 #ifdef WITH_MPI
-    swift_parts[i].task = e->nodeID;
+    vp->task = e->nodeID;
 #else
-    swift_parts[i].task = 0;
+    vp->task = 0;
 #endif
-
-    /* Set gas particle IDs from their hydro counterparts and set internal
-     * energies. */
-    switch (gparts[i].type) {
-
-      case swift_type_gas: {
-        const struct part *p = &parts[-gparts[i].id_or_neg_offset];
-        const struct xpart *xp = &xparts[-gparts[i].id_or_neg_offset];
-
-        convert_part_pos(e, p, xp, swift_parts[i].x);
-        convert_part_vel(e, p, xp, swift_parts[i].v);
-        swift_parts[i].id = parts[-gparts[i].id_or_neg_offset].id;
-        swift_parts[i].u = hydro_get_drifted_physical_internal_energy(p, cosmo);
-        swift_parts[i].T = cooling_get_temperature(phys_const, hydro_props, us,
-                                                   cosmo, cool_func, p, xp);
-      } break;
-
-      case swift_type_stars: {
-        const struct spart *sp = &sparts[-gparts[i].id_or_neg_offset];
-
-        convert_spart_pos(e, sp, swift_parts[i].x);
-        convert_spart_vel(e, sp, swift_parts[i].v);
-        swift_parts[i].id = sparts[-gparts[i].id_or_neg_offset].id;
-        swift_parts[i].u = 0.f;
-        swift_parts[i].T = 0.f;
-      } break;
-
-      case swift_type_black_hole: {
-        const struct bpart *bp = &bparts[-gparts[i].id_or_neg_offset];
-
-        convert_bpart_pos(e, bp, swift_parts[i].x);
-        convert_bpart_vel(e, bp, swift_parts[i].v);
-        swift_parts[i].id = bparts[-gparts[i].id_or_neg_offset].id;
-        swift_parts[i].u = 0.f;
-        swift_parts[i].T = 0.f;
-      } break;
-
-      case swift_type_dark_matter:
-      case swift_type_dark_matter_background:
-      case swift_type_neutrino:
-
-        convert_gpart_pos(e, &(gparts[i]), swift_parts[i].x);
-        convert_gpart_vel(e, &(gparts[i]), swift_parts[i].v);
-        swift_parts[i].id = gparts[i].id_or_neg_offset;
-        swift_parts[i].u = 0.f;
-        swift_parts[i].T = 0.f;
-        break;
-
-      default:
-        error("Particle type not handled by VELOCIraptor.");
-    }
   }
 }
 
@@ -738,17 +691,12 @@ void velociraptor_invoke(struct engine *e, const int linked_with_snap) {
   const int nr_cells = s->nr_cells;
   const struct cell *cells_top = s->cells_top;
 
-  /* Allow thread to run on any core for the duration of the call to
-   * VELOCIraptor so that  when OpenMP threads are spawned
-   * they can run on any core on the processor. */
-  const int nr_cores = sysconf(_SC_NPROCESSORS_ONLN);
+  /* Allow thread to run on any of the cores this rank was started on for the
+   * duration of the call to VELOCIraptor so that when OpenMP threads are
+   * spawned they can spread over them. We don't use all the cores of the
+   * node as they may be shared with other ranks. */
   pthread_t thread = pthread_self();
-
-  /* Set affinity mask to include all cores on the CPU for VELOCIraptor. */
-  cpu_set_t cpuset;
-  CPU_ZERO(&cpuset);
-  for (int j = 0; j < nr_cores; j++) CPU_SET(j, &cpuset);
-  pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
+  pthread_setaffinity_np(thread, sizeof(cpu_set_t), engine_entry_affinity());
 
   /* Set cosmology information for this point in time */
   struct cosmoinfo cosmo_info;
@@ -979,7 +927,20 @@ void velociraptor_invoke(struct engine *e, const int linked_with_snap) {
                      nr_gparts * sizeof(struct swift_vel_part)) != 0)
     error("Failed to allocate array of particles for VELOCIraptor.");
 
-  struct velociraptor_copy_data copy_data = {e, swift_parts};
+  /* Select the fields VELOCIraptor reads */
+  int fields = structure_finder_field_position |
+               structure_finder_field_velocity |
+               structure_finder_field_potential | structure_finder_field_id |
+               structure_finder_field_type |
+               structure_finder_field_internal_energy |
+               structure_finder_field_temperature;
+#ifndef HAVE_VELOCIRAPTOR_WITH_NOMASS
+  fields |= structure_finder_field_mass;
+#endif
+  struct structure_finder_view view;
+  structure_finder_view_init(&view, e, fields);
+
+  struct velociraptor_copy_data copy_data = {e, &view, swift_parts};
   threadpool_map(&e->threadpool, velociraptor_convert_particles_mapper,
                  s->gparts, nr_gparts, sizeof(struct gpart),
                  threadpool_auto_chunk_size, &copy_data);
@@ -989,6 +950,14 @@ void velociraptor_invoke(struct engine *e, const int linked_with_snap) {
     message("VR Collecting particle info took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
 
+  /* Report the memory handed over to VELOCIraptor */
+  if (e->verbose) {
+    const size_t bytes = nr_gparts * sizeof(struct swift_vel_part) +
+                         nr_cells * (sizeof(struct cell_loc) + sizeof(int));
+    message("VR Rank %d passes %.3f MB of particle and cell data (%s).",
+            engine_rank, bytes / (1024. * 1024.), memuse_process(1));
+  }
+
   tic = getticks();
 
 #ifdef SWIFT_MEMUSE_REPORTS
@@ -1038,10 +1007,13 @@ void velociraptor_invoke(struct engine *e, const int linked_with_snap) {
         "have.");
   }
 
-  /* Report timing */
-  if (e->verbose)
+  /* Report timing and memory use */
+  if (e->verbose) {
     message("VR Invocation of velociraptor took %.3f %s.",
             clocks_from_ticks(getticks() - tic), clocks_getunit());
+    message("VR Rank %d memory use after the invocation: %s.", engine_rank,
+            memuse_process(1));
+  }
 
   tic = getticks();
 
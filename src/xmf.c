@@ -25,6 +25,7 @@
 #include <libgen.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 /* This object's header. */
 #include "xmf.h"
@@ -71,45 +72,49 @@ static const char* xmf_basename(const char* hdfFileName,
 /**
  * @brief Prepare the XMF file corresponding to a snapshot.
  *
+ * The closing lines of the file (the last three) are removed in place such
+ * that the new entry can be appended. Only the end of the file is read, which
+ * keeps this step cheap for runs with many outputs.
+ *
  * @param fileName The name of the file.
  */
 FILE* xmf_prepare_file(const char* fileName) {
   char buffer[1024];
 
-  char tempFileName[FILENAME_BUFFER_SIZE];
-  snprintf(tempFileName, FILENAME_BUFFER_SIZE, "%s.temp", fileName);
-  FILE* xmfFile = fopen(fileName, "r");
-  FILE* tempFile = fopen(tempFileName, "w");
-
+  FILE* xmfFile = fopen(fileName, "r+");
   if (xmfFile == NULL) error("Unable to open current XMF file.");
 
-  if (tempFile == NULL) error("Unable to open temporary file.");
-
-  /* First we make a temporary copy of the XMF file and count the lines */
+  /* Start reading a bit before the end of the file. The closing lines are
+   * much shorter than this. */
+  if (fseek(xmfFile, 0, SEEK_END) != 0)
+    error("Unable to seek in current XMF file.");
+  const long size = ftell(xmfFile);
+  const long tail = 4096;
+  if (fseek(xmfFile, size > tail ? size - tail : 0, SEEK_SET) != 0)
+    error("Unable to seek in current XMF file.");
+
+  /* Skip the (partial) line we landed in */
+  if (size > tail && fgets(buffer, 1024, xmfFile) == NULL)
+    error("Unable to read current XMF file.");
+
+  /* Find where the last three lines start */
+  long line_start[3] = {0, 0, 0};
   int counter = 0;
+  long pos = ftell(xmfFile);
   while (fgets(buffer, 1024, xmfFile) != NULL) {
+    line_start[counter % 3] = pos;
     counter++;
-    fprintf(tempFile, "%s", buffer);
-  }
-  fclose(tempFile);
-  fclose(xmfFile);
-
-  /* We then copy the XMF file back up to the closing lines */
-  xmfFile = fopen(fileName, "w");
-  tempFile = fopen(tempFileName, "r");
-
-  if (xmfFile == NULL) error("Unable to open current XMF file.");
-
-  if (tempFile == NULL) error("Unable to open temporary file.");
-
-  int i = 0;
-  while (fgets(buffer, 1024, tempFile) != NULL && i < counter - 3) {
-    i++;
-    fprintf(xmfFile, "%s", buffer);
+    pos = ftell(xmfFile);
   }
+  if (counter < 3) error("Current XMF file is corrupted.");
+
+  /* Remove them and get ready to append */
+  const long end = line_start[counter % 3];
+  fflush(xmfFile);
+  if (ftruncate(fileno(xmfFile), end) != 0 ||
+      fseek(xmfFile, end, SEEK_SET) != 0)
+    error("Unable to truncate current XMF file.");
   fprintf(xmfFile, "\n");
-  fclose(tempFile);
-  remove(tempFileName);
 
   return xmfFile;
 }
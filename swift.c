@@ -75,6 +75,62 @@ static int handle_cmdparam(struct argparse *self,
   return 1;
 }
 
+/* The phases of a start-up from ICs that are timed. */
+enum startup_phase {
+  startup_read_ics,
+  startup_space_init,
+  startup_engine_init,
+  startup_split,
+  startup_init_particles,
+  startup_first_outputs,
+  startup_phase_count
+};
+
+static const char *startup_phase_names[startup_phase_count] = {
+    "reading ICs",    "space_init",     "engine set-up",
+    "domain decomp.", "particle init.", "initial outputs"};
+
+/**
+ * @brief Report the time spent in the different phases of the start-up.
+ *
+ * Under MPI, the minimal and maximal times over all the ranks are reported.
+ *
+ * @param times The time spent in each phase on this rank (in ms).
+ * @param myrank The rank of this node.
+ */
+static void print_startup_breakdown(const double times[startup_phase_count],
+                                    int myrank) {
+
+  double min_times[startup_phase_count];
+  double max_times[startup_phase_count];
+  for (int k = 0; k < startup_phase_count; k++)
+    min_times[k] = max_times[k] = times[k];
+
+#ifdef WITH_MPI
+  MPI_Reduce(times, min_times, startup_phase_count, MPI_DOUBLE, MPI_MIN, 0,
+             MPI_COMM_WORLD);
+  MPI_Reduce(times, max_times, startup_phase_count, MPI_DOUBLE, MPI_MAX, 0,
+             MPI_COMM_WORLD);
+#endif
+
+  if (myrank != 0) return;
+
+  double total = 0.;
+  for (int k = 0; k < startup_phase_count; k++) total += max_times[k];
+
+  message("Start-up phases took %.3f %s (min / max over ranks):", total,
+          clocks_getunit());
+  for (int k = 0; k < startup_phase_count; k++) {
+#ifndef WITH_MPI
+    if (k == startup_split) continue;
+#endif
+    message("  %-16s %12.3f / %12.3f %s (%5.1f%%)", startup_phase_names[k],
+            min_times[k], max_times[k], clocks_getunit(),
+            total > 0. ? 100. * max_times[k] / total : 0.);
+  }
+  fflush(stdout);
+}
+
 /**
  * @brief Main routine that loads a few particles and generates some output.
  *
@@ -84,6 +140,10 @@ int main(int argc, char *argv[]) {
   struct clocks_time tic, toc;
   struct engine e;
 
+  /* Time spent in the different phases of the start-up */
+  double startup_times[startup_phase_count] = {0.};
+  ticks startup_tic = 0;
+
   /* Structs used by the engine. Declare now to make sure these are always in
    * scope.  */
   struct chemistry_global_data chemistry;
@@ -977,7 +1037,7 @@ int main(int argc, char *argv[]) {
 #endif
 
     /* Now read it. */
-    restart_read(&e, restart_file);
+    restart_read(&e, restart_file, nr_threads);
 
 #ifdef WITH_MPI
     integertime_t min_ti_current = e.ti_current;
@@ -1235,6 +1295,7 @@ int main(int argc, char *argv[]) {
     ic_info_init(&ics_metadata, params);
 
     if (myrank == 0) clocks_gettime(&tic);
+    startup_tic = getticks();
 #if defined(HAVE_HDF5)
 #if defined(WITH_MPI)
 #if defined(HAVE_PARALLEL_HDF5)
@@ -1244,7 +1305,9 @@ int main(int argc, char *argv[]) {
                      with_gravity, with_sinks, with_stars, with_black_holes,
                      with_cosmology, cleanup_h, cleanup_sqrt_a, cosmo.h,
                      cosmo.a, myrank, nr_nodes, MPI_COMM_WORLD, MPI_INFO_NULL,
-                     nr_threads, dry_run, remap_ids, &ics_metadata);
+                     nr_threads, dry_run, remap_ids, initial_partition.grid,
+                     read_ic_parallel_route_bytes(params, &initial_partition),
+                     &ics_metadata);
 #else
     read_ic_serial(ICfileName, &us, dim, &parts, &gparts, &sinks, &sparts,
                    &bparts, &Ngas, &Ngpart, &Ngpart_background, &Nnupart,
@@ -1263,6 +1326,8 @@ int main(int argc, char *argv[]) {
                    nr_threads, dry_run, remap_ids, &ics_metadata);
 #endif
 #endif
+    startup_times[startup_read_ics] =
+        clocks_from_ticks(getticks() - startup_tic);
 
     if (myrank == 0) {
       clocks_gettime(&toc);
@@ -1368,12 +1433,15 @@ int main(int argc, char *argv[]) {
 
     /* Initialize the space with these data. */
     if (myrank == 0) clocks_gettime(&tic);
+    startup_tic = getticks();
     space_init(&s, params, &cosmo, dim, &hydro_properties, parts, gparts, sinks,
                sparts, bparts, Ngas, Ngpart, Nsink, Nspart, Nbpart, Nnupart,
                periodic, replicate, remap_ids, generate_gas_in_ics, with_hydro,
                with_self_gravity, with_star_formation, with_sinks,
                with_DM_particles, with_DM_background_particles, with_neutrinos,
                talking, dry_run, nr_nodes);
+    startup_times[startup_space_init] =
+        clocks_from_ticks(getticks() - startup_tic);
 
     /* Initialise the line of sight properties. */
     if (with_line_of_sight) los_init(s.dim, &los_properties, params);
@@ -1531,6 +1599,7 @@ int main(int argc, char *argv[]) {
     if (with_power) engine_policies |= engine_policy_power_spectra;
 
     /* Initialize the engine with the space and policies. */
+    startup_tic = getticks();
     engine_init(&e, &s, params, output_options, N_total[swift_type_gas],
                 N_total[swift_type_count], N_total[swift_type_sink],
                 N_total[swift_type_stars], N_total[swift_type_black_hole],
@@ -1546,6 +1615,8 @@ int main(int argc, char *argv[]) {
     engine_config(/*restart=*/0, /*fof=*/0, &e, params, nr_nodes, myrank,
                   nr_threads, nr_pool_threads, with_aff, talking, restart_dir,
                   restart_file, &reparttype);
+    startup_times[startup_engine_init] =
+        clocks_from_ticks(getticks() - startup_tic);
 
     /* Compute some stats for the star formation */
     if (with_star_formation) {
@@ -1594,11 +1665,16 @@ int main(int argc, char *argv[]) {
 
 #ifdef WITH_MPI
     /* Split the space. */
+    startup_tic = getticks();
     engine_split(&e, &initial_partition);
+    startup_times[startup_split] = clocks_from_ticks(getticks() - startup_tic);
 #endif
 
     /* Initialise the particles */
+    startup_tic = getticks();
     engine_init_particles(&e, flag_entropy_ICs, clean_smoothing_length_values);
+    startup_times[startup_init_particles] =
+        clocks_from_ticks(getticks() - startup_tic);
 
     /* Check that the matter content matches the cosmology given in the
      * parameter file. */
@@ -1613,6 +1689,7 @@ int main(int argc, char *argv[]) {
     }
 
     /* Write the state of the system before starting time integration. */
+    startup_tic = getticks();
 #ifdef WITH_CSDS
     if (e.policy & engine_policy_csds) {
       csds_log_all_particles(e.csds, &e, csds_flag_create);
@@ -1639,17 +1716,21 @@ int main(int argc, char *argv[]) {
 
     /* Is there a dump before the end of the first time-step? */
     engine_io(&e);
+    startup_times[startup_first_outputs] =
+        clocks_from_ticks(getticks() - startup_tic);
+
+    print_startup_breakdown(startup_times, myrank);
   }
 
   /* Legend */
   if (myrank == 0) {
     printf(
         "# %6s %14s %12s %12s %14s %9s %12s %12s %12s %12s %12s %16s [%s] "
-        "%6s %12s [%s] \n",
+        "%6s %12s [%s] %12s [%s] \n",
         "Step", "Time", "Scale-factor", "Redshift", "Time-step", "Time-bins",
         "Updates", "g-Updates", "s-Updates", "sink-Updates", "b-Updates",
         "Wall-clock time", clocks_getunit(), "Props", "Dead time",
-        clocks_getunit());
+        clocks_getunit(), "Tail idle", clocks_getunit());
     fflush(stdout);
   }
 
@@ -1795,24 +1876,26 @@ int main(int argc, char *argv[]) {
   if (myrank == 0) {
 
     const double dead_time = e.global_deadtime / (nr_nodes * e.nr_threads);
+    const double tail_time = e.global_tailtime / (nr_nodes * e.nr_threads);
 
     /* Print some information to the screen */
     printf(
         "  %6d %14e %12.7f %12.7f %14e %4d %4d %12lld %12lld %12lld %12lld "
         "%12lld"
-        " %21.3f %6d %17.3f\n",
+        " %21.3f %6d %17.3f %17.3f\n",
         e.step, e.time, e.cosmology->a, e.cosmology->z, e.time_step,
         e.min_active_bin, e.max_active_bin, e.updates, e.g_updates, e.s_updates,
-        e.sink_updates, e.b_updates, e.wallclock_time, e.step_props, dead_time);
+        e.sink_updates, e.b_updates, e.wallclock_time, e.step_props, dead_time,
+        tail_time);
     fflush(stdout);
 
     fprintf(e.file_timesteps,
             "  %6d %14e %12.7f %12.7f %14e %4d %4d %12lld %12lld %12lld %12lld"
-            " %12lld %21.3f %6d %17.3f\n",
+            " %12lld %21.3f %6d %17.3f %17.3f\n",
             e.step, e.time, e.cosmology->a, e.cosmology->z, e.time_step,
             e.min_active_bin, e.max_active_bin, e.updates, e.g_updates,
             e.s_updates, e.sink_updates, e.b_updates, e.wallclock_time,
-            e.step_props, dead_time);
+            e.step_props, dead_time, tail_time);
     fflush(e.file_timesteps);
 
     /* Print information to the SFH logger */
@@ -1871,8 +1954,12 @@ int main(int argc, char *argv[]) {
 
 #ifdef HAVE_VELOCIRAPTOR
       if (with_structure_finding && e.snapshot_invoke_stf &&
-          !e.stf_this_timestep)
+          !e.stf_this_timestep) {
+
+        /* Let the previous snapshot complete before the VR outputs */
+        io_async_wait(e.snapshot_async);
         velociraptor_invoke(&e, /*linked_with_snap=*/1);
+      }
 #endif
       engine_dump_snapshot(&e, /*fof=*/0);
 #ifdef HAVE_VELOCIRAPTOR
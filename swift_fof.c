@@ -479,7 +479,9 @@ int main(int argc, char *argv[]) {
                    /*with_grav=*/1, with_sinks, with_stars, with_black_holes,
                    with_cosmology, cleanup_h, cleanup_sqrt_a, cosmo.h, cosmo.a,
                    myrank, nr_nodes, MPI_COMM_WORLD, MPI_INFO_NULL, nr_threads,
-                   /*dry_run=*/0, /*remap_ids=*/0, &ics_metadata);
+                   /*dry_run=*/0, /*remap_ids=*/0, initial_partition.grid,
+                   read_ic_parallel_route_bytes(params, &initial_partition),
+                   &ics_metadata);
 #else
   read_ic_serial(ICfileName, &us, dim, &parts, &gparts, &sinks, &sparts,
                  &bparts, &Ngas, &Ngpart, &Ngpart_background, &Nnupart, &Nsink,
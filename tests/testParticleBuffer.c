@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * This file is part of SWIFT.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Config parameters. */
+#include <config.h>
+
+/* Local includes */
+#include "particle_buffer.h"
+#include "swift.h"
+
+const int num_values = 1000000;
+const int num_threads = 16;
+const int chunk_size = 37;
+const size_t elements_per_block = 100;
+
+/* Append the values one at a time or in batches of varying size */
+void map_function_append(void *data, int num_elements, void *extra_data) {
+
+  long long *values = (long long *)data;
+  struct particle_buffer *buffer = (struct particle_buffer *)extra_data;
+
+  int i = 0;
+  while (i < num_elements) {
+    int n = 1 + (values[i] % 7);
+    if (i + n > num_elements) n = num_elements - i;
+    if (n == 1)
+      particle_buffer_append(buffer, &values[i]);
+    else
+      particle_buffer_append_n(buffer, &values[i], n);
+    i += n;
+  }
+}
+
+/* Count how many times each value appears in the buffer */
+void map_function_count(void *data, size_t num_elements, size_t offset,
+                        void *extra_data) {
+
+  long long *values = (long long *)data;
+  int *count = (int *)extra_data;
+
+  if (offset + num_elements > (size_t)num_values)
+    error("Block offset out of range");
+
+  for (size_t i = 0; i < num_elements; ++i) {
+    if (values[i] < 0 || values[i] >= num_values) error("Value out of range");
+    atomic_inc(&count[values[i]]);
+  }
+}
+
+int main(int argc, char *argv[]) {
+
+  /* Initialize CPU frequency, this also starts time. */
+  unsigned long long cpufreq = 0;
+  clocks_set_cpufreq(cpufreq);
+
+  /* Start a bunch of threads */
+  printf("# Creating threadpool with %d threads\n", num_threads);
+  struct threadpool tp;
+  threadpool_init(&tp, num_threads);
+
+  /* Values to store */
+  long long *values = (long long *)malloc(num_values * sizeof(long long));
+  for (int i = 0; i < num_values; ++i) values[i] = i;
+  int *count = (int *)calloc(num_values, sizeof(int));
+
+  struct particle_buffer buffer;
+  particle_buffer_init(&buffer, sizeof(long long), elements_per_block,
+                       "test_buffer");
+
+  /* Do it twice to check that emptying the buffer works */
+  for (int iter = 0; iter < 2; ++iter) {
+
+    /* Fill the buffer from all threads at once */
+    threadpool_map(&tp, map_function_append, values, num_values,
+                   sizeof(long long), chunk_size, &buffer);
+
+    const size_t num_elements = particle_buffer_num_elements(&buffer);
+    if (num_elements != (size_t)num_values)
+      error("Wrong number of elements: %zu instead of %d", num_elements,
+            num_values);
+
+    /* Check that each thread left at most one block partially filled */
+    struct particle_buffer_block *block = NULL;
+    size_t block_elements = 0, total = 0;
+    void *block_data;
+    int num_partial = 0;
+    do {
+      particle_buffer_iterate(&buffer, &block, &block_elements, &block_data);
+      if (block == NULL) break;
+      if (block_elements > block->capacity ||
+          block->capacity > elements_per_block)
+        error("Too many elements in block");
+      if (block_elements < block->capacity) num_partial++;
+      total += block_elements;
+    } while (block);
+    if (total != num_elements) error("Blocks do not add up to the buffer");
+    if (num_partial > num_threads + 1)
+      error("Too many partially filled blocks: %d", num_partial);
+
+    /* Check that each value appears exactly once */
+    for (int i = 0; i < num_values; ++i) count[i] = 0;
+    particle_buffer_threadpool_map(&buffer, &tp, map_function_count, count);
+    for (int i = 0; i < num_values; ++i)
+      if (count[i] != 1) error("Value %d found %d times", i, count[i]);
+
+    message("Iteration %d: %zu elements in %zu bytes", iter, num_elements,
+            particle_buffer_memory_use(&buffer));
+
+    particle_buffer_empty(&buffer);
+  }
+
+  /* Be clean */
+  particle_buffer_free(&buffer);
+  threadpool_clean(&tp);
+  free(values);
+  free(count);
+  return 0;
+}
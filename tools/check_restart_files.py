@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+"""
+Usage:
+    check_restart_files.py [--quiet] <LIST OF RESTART FILES>
+
+Verifies a set of SWIFT restart files (e.g. restart/swift_*.rst) without
+running SWIFT. Each file is checked for:
+
+ - the start and end signatures,
+ - the table of sections at the end of the file agreeing with the headers
+   written in front of each section,
+ - the checksum of every section.
+
+Sections written as a delta against the last full dump (see the
+Restarts:full_dump_every parameter) are rebuilt using the <file>.full (or
+<file>.full.prev) file before being checked.
+
+For a set of files, we also check that the ranks are numbered contiguously
+and that all the files were written by the same version of SWIFT.
+
+The script returns a non-zero exit code if any of the checks failed.
+
+This file is part of SWIFT.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import zlib
+
+# Layout of the structures written by src/restart.c (64 bits machine, native
+# byte order and alignment).
+header_struct = struct.Struct("=QIII21s7x")  # len, checksum, pad, flags, label
+# offset, size, len, checksum, flags, label
+section_struct = struct.Struct("=QQQII21s3x")
+# nr_sections, table_offset, dump_id, signature
+trailer_struct = struct.Struct("=QQQ8s")
+delta_struct = struct.Struct("=QQ")  # base_offset, base_id
+
+# Flag of the sections written as a delta.
+section_delta = 1
+
+signature = b"SWIFT-restart-file"
+end_signature = b"SWIFT-restart-file:end"
+table_signature = b"SWRSTTBL"
+
+# Size of the chunks the checksums are computed over.
+chunk_size = 1024 * 1024
+
+
+def label_to_str(label):
+    return label.split(b"\0", 1)[0].decode("ascii", "replace")
+
+
+def read_trailer(stream):
+    """
+    Returns the trailer of a restart file or None if there is none.
+    """
+    size = os.fstat(stream.fileno()).st_size
+    if size < trailer_struct.size:
+        return None
+    stream.seek(size - trailer_struct.size)
+    trailer = trailer_struct.unpack(stream.read(trailer_struct.size))
+    if trailer[3] != table_signature:
+        return None
+    return trailer
+
+
+def open_base(filename, base_id, bases):
+    """
+    Open the full dump with the given identifier a delta file refers to.
+    """
+    if base_id not in bases:
+        if filename.endswith(".prev"):
+            filename = filename[: -len(".prev")]
+        for suffix in [".full", ".full.prev"]:
+            try:
+                stream = open(filename + suffix, "rb")
+            except IOError:
+                continue
+            trailer = read_trailer(stream)
+            if trailer is not None and trailer[2] == base_id:
+                bases[base_id] = stream
+                break
+            stream.close()
+        else:
+            raise IOError(f"full dump {filename}.full not found")
+    return bases[base_id]
+
+
+def read_chunks(stream, offset, length):
+    """
+    Generator over the 1 MB chunks of a section.
+    """
+    stream.seek(offset)
+    while length > 0:
+        data = stream.read(min(length, chunk_size))
+        if len(data) == 0:
+            raise IOError("unexpected end of file")
+        yield data
+        length -= len(data)
+
+
+def read_delta_chunks(stream, filename, offset, length, bases):
+    """
+    Generator over the 1 MB chunks of a section written as a delta, taking
+    the unchanged ones from the full dump.
+    """
+    nr_chunks = (length + chunk_size - 1) // chunk_size
+    stream.seek(offset)
+    base_offset, base_id = delta_struct.unpack(stream.read(delta_struct.size))
+    from_base = stream.read(nr_chunks)
+    base = open_base(filename, base_id, bases)
+    position = offset + delta_struct.size + nr_chunks
+    for k in range(nr_chunks):
+        size = min(chunk_size, length - k * chunk_size)
+        if from_base[k]:
+            source, start = base, base_offset + k * chunk_size
+        else:
+            source, start = stream, position
+            position += size
+        source.seek(start)
+        data = source.read(size)
+        if len(data) != size:
+            raise IOError("unexpected end of file")
+        yield data
+
+
+def checksum(chunks):
+    """
+    Checksum of a section, i.e. the CRC-32 of the little-endian CRC-32s of
+    its 1 MB chunks.
+    """
+    result = 0
+    for data in chunks:
+        result = zlib.crc32(struct.pack("<I", zlib.crc32(data)), result)
+    return result
+
+
+def check_file(filename, quiet):
+    """
+    Check one restart file. Returns the list of errors found and the version
+    string stored in the file.
+    """
+    errors = []
+    version = None
+
+    bases = {}
+    with open(filename, "rb") as stream:
+        size = os.fstat(stream.fileno()).st_size
+
+        # Locate the table of sections.
+        trailer = read_trailer(stream)
+        if trailer is None:
+            return ["no table of sections, file truncated?"], version
+        nr_sections, table_offset, dump_id, sig = trailer
+        if table_offset + nr_sections * section_struct.size + trailer_struct.size != size:
+            return ["inconsistent table of sections"], version
+
+        stream.seek(table_offset)
+        table = [
+            section_struct.unpack(stream.read(section_struct.size))
+            for _ in range(nr_sections)
+        ]
+
+        # Walk through the sections and compare with the table.
+        position = 0
+        total_len = 0
+        for k, (t_offset, t_size, t_len, t_checksum, t_flags, t_label) in enumerate(
+            table
+        ):
+            label = label_to_str(t_label)
+
+            stream.seek(position)
+            h_len, h_checksum, h_pad, h_flags, h_label = header_struct.unpack(
+                stream.read(header_struct.size)
+            )
+            data_offset = position + header_struct.size + h_pad
+            if (
+                data_offset != t_offset
+                or h_len != t_len
+                or h_checksum != t_checksum
+                or h_flags != t_flags
+                or label_to_str(h_label) != label
+                or (not (t_flags & section_delta) and t_size != t_len)
+            ):
+                errors.append(f"section {k} ('{label}') does not match its header")
+                break
+
+            try:
+                if t_flags & section_delta:
+                    chunks = read_delta_chunks(
+                        stream, filename, t_offset, t_len, bases
+                    )
+                else:
+                    chunks = read_chunks(stream, t_offset, t_len)
+                found = checksum(chunks)
+            except IOError as err:
+                errors.append(f"section {k} ('{label}'): {err}")
+                break
+            if found != t_checksum:
+                errors.append(
+                    f"section {k} ('{label}'): checksum {found:x} != {t_checksum:x}"
+                )
+
+            # Signatures and version
+            if k == 0 or k == 1 or k == nr_sections - 1:
+                stream.seek(t_offset)
+                content = stream.read(t_len)
+                if k == 0 and content != signature:
+                    errors.append("not a SWIFT restart file")
+                elif k == 1:
+                    version = content.decode("ascii", "replace")
+                elif k == nr_sections - 1 and content != end_signature:
+                    errors.append("missing end signature")
+
+            position = t_offset + t_size
+            total_len += t_len
+
+        if position != table_offset and not errors:
+            errors.append("data found between the last section and the table")
+
+        if not quiet:
+            kind = ""
+            if len(bases) > 0:
+                kind = f" (delta, {total_len / 1024**2:.1f} MB when rebuilt)"
+            elif dump_id != 0:
+                kind = " (full dump)"
+            print(
+                f"{filename}: {nr_sections} sections, {size / 1024**2:.1f} MB"
+                + kind
+                + ", "
+                + ("OK" if not errors else "FAILED")
+            )
+
+    for base in bases.values():
+        base.close()
+
+    return errors, version
+
+
+argparser = argparse.ArgumentParser("Verify a set of SWIFT restart files.")
+argparser.add_argument("files", nargs="+", help="Restart files to check.")
+argparser.add_argument(
+    "-q", "--quiet", action="store_true", help="Only report the problems."
+)
+args = argparser.parse_args()
+
+failed = False
+versions = {}
+ranks = []
+for filename in args.files:
+    try:
+        errors, version = check_file(filename, args.quiet)
+    except (IOError, struct.error) as err:
+        errors, version = [str(err)], None
+    for error in errors:
+        print(f"{filename}: {error}")
+    failed = failed or len(errors) > 0
+    if version is not None:
+        versions.setdefault(version, []).append(filename)
+    match = re.search(r"_(\d+)\.rst$", filename)
+    if match is not None:
+        ranks.append(int(match[1]))
+
+# Checks on the set of files.
+if len(versions) > 1:
+    failed = True
+    print("Files written by different versions of SWIFT:")
+    for version in versions:
+        print(f"  '{version}': {len(versions[version])} file(s)")
+if len(ranks) > 0 and sorted(ranks) != list(range(len(ranks))):
+    failed = True
+    print(f"Ranks are not numbered from 0 to {len(ranks) - 1}, files missing?")
+
+if not args.quiet and not failed:
+    print(f"All {len(args.files)} restart file(s) are valid.")
+
+sys.exit(1 if failed else 0)